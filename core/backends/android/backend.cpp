@@ -174,6 +174,10 @@ namespace backend {
     void getMouseScreenPos(double& x, double& y) { x = 0; y = 0; }
     void setMouseScreenPos(double x, double y) {}
 
+    // Frames are drawn continuously
+    void requestFrame() {}
+    void setMaxFPS(int fps) {}
+
     int renderLoop() {
         while (true) {
             int out_events;
@@ -12,6 +12,8 @@
 #include <stb_image.h>
 #include <stb_image_resize.h>
 #include <gui/gui.h>
+#include <atomic>
+#include <algorithm>
 
 namespace backend {
     const char* OPENGL_VERSIONS_GLSL[] = {
@@ -47,9 +49,20 @@ namespace backend {
     bool _maximized = maximized;
     int fsWidth, fsHeight, fsPosX, fsPosY;
     int _winWidth, _winHeight;
-    GLFWwindow* window;
+    GLFWwindow* window = NULL;
     GLFWmonitor* monitor;
 
+    // Frames drawn after an input so that hover effects and layout changes have settled
+    const int SETTLE_FRAMES = 3;
+
+    // Longest time without a frame, for what changes without any event (meters, clocks, tooltips...)
+    const double IDLE_FRAME_INTERVAL = 0.25;
+
+    int maxFPS = 60;
+    int pendingFrames = SETTLE_FRAMES;
+    std::atomic<bool> frameRequested = false;
+    bool iconified = false;
+
     static void glfw_error_callback(int error, const char* description) {
         flog::error("Glfw Error {0}: {1}", error, description);
     }
@@ -63,6 +76,23 @@ namespace backend {
         }
     }
 
+    static void iconify_callback(GLFWwindow* window, int n) {
+        iconified = (n == GLFW_TRUE);
+        gui::waterfall.setMinimized(iconified);
+        pendingFrames = SETTLE_FRAMES;
+    }
+
+    // Any of these means the next frames could look different
+    static void cursor_pos_callback(GLFWwindow* window, double x, double y) { pendingFrames = SETTLE_FRAMES; }
+    static void cursor_enter_callback(GLFWwindow* window, int entered) { pendingFrames = SETTLE_FRAMES; }
+    static void mouse_button_callback(GLFWwindow* window, int button, int action, int mods) { pendingFrames = SETTLE_FRAMES; }
+    static void scroll_callback(GLFWwindow* window, double x, double y) { pendingFrames = SETTLE_FRAMES; }
+    static void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods) { pendingFrames = SETTLE_FRAMES; }
+    static void char_callback(GLFWwindow* window, unsigned int c) { pendingFrames = SETTLE_FRAMES; }
+    static void focus_callback(GLFWwindow* window, int focused) { pendingFrames = SETTLE_FRAMES; }
+    static void size_callback(GLFWwindow* window, int width, int height) { pendingFrames = SETTLE_FRAMES; }
+    static void refresh_callback(GLFWwindow* window) { pendingFrames = SETTLE_FRAMES; }
+
     int init(std::string resDir) {
         // Load config
         core::configManager.acquire();
@@ -165,6 +195,18 @@ namespace backend {
         glfwSetWindowMaximizeCallback(window, maximized_callback);
     #endif
 
+        // Input callbacks, installed before ImGui's so that it chains them
+        glfwSetWindowIconifyCallback(window, iconify_callback);
+        glfwSetCursorPosCallback(window, cursor_pos_callback);
+        glfwSetCursorEnterCallback(window, cursor_enter_callback);
+        glfwSetMouseButtonCallback(window, mouse_button_callback);
+        glfwSetScrollCallback(window, scroll_callback);
+        glfwSetKeyCallback(window, key_callback);
+        glfwSetCharCallback(window, char_callback);
+        glfwSetWindowFocusCallback(window, focus_callback);
+        glfwSetFramebufferSizeCallback(window, size_callback);
+        glfwSetWindowRefreshCallback(window, refresh_callback);
+
         // Setup Dear ImGui context
         IMGUI_CHECKVERSION();
         ImGui::CreateContext();
@@ -231,10 +273,50 @@ namespace backend {
         ImGui_ImplGlfw_CursorPosCallback(window, x, y);
     }
 
+    void requestFrame() {
+        if (!window) { return; }
+        frameRequested = true;
+        glfwPostEmptyEvent();
+    }
+
+    void setMaxFPS(int fps) {
+        maxFPS = fps;
+    }
+
+    // Time at which the next frame is due
+    double nextFrameTime(double lastFrame) {
+        if (pendingFrames > 0 || frameRequested) {
+            return lastFrame + ((maxFPS > 0) ? (1.0 / (double)maxFPS) : 0.0);
+        }
+        return lastFrame + IDLE_FRAME_INTERVAL;
+    }
+
     int renderLoop() {
+        double lastFrame = 0.0;
+
         // Main loop
         while (!glfwWindowShouldClose(window)) {
-            glfwPollEvents();
+            // Nothing is drawn while minimized, only wait for the window to come back
+            if (iconified) {
+                glfwWaitEvents();
+                continue;
+            }
+
+            // Sleep until the next frame is due or an event comes in
+            double wait = nextFrameTime(lastFrame) - glfwGetTime();
+            if (wait > 0.0) {
+                glfwWaitEventsTimeout(wait);
+            }
+            else {
+                glfwPollEvents();
+            }
+
+            // Skip the frame if woken up too early, the events were still handed to ImGui
+            double now = glfwGetTime();
+            if (iconified || now < nextFrameTime(lastFrame)) { continue; }
+            lastFrame = now;
+            frameRequested = false;
+            if (pendingFrames > 0) { pendingFrames--; }
 
             beginFrame();
             
@@ -287,6 +369,9 @@ namespace backend {
                 gui::mainWindow.draw();
             }
 
+            // Widgets being used (text input, held buttons...) can change without events
+            if (ImGui::IsAnyItemActive()) { pendingFrames = std::max<int>(pendingFrames, 1); }
+
             render();
         }
 
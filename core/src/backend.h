@@ -8,5 +8,11 @@ namespace backend {
     void getMouseScreenPos(double& x, double& y);
     void setMouseScreenPos(double x, double y);
     int renderLoop();
+
+    // Asks for a new frame to be drawn, can be called from any thread
+    void requestFrame();
+
+    // Highest number of frames drawn per second, 0 for no limit other than vsync
+    void setMaxFPS(int fps);
     int end();
 }
\ No newline at end of file
@@ -15,9 +15,12 @@ void CommandArgsParser::defineAll() {
 
         define('a', "addr", "Server mode address", "0.0.0.0");
         define('h', "help", "Show help");
+        define('\0', "log-file", "Also write the log to a binary file", "");
         define('p', "port", "Server mode port", 5259);
+        define('\0', "read-log", "Print a binary log file written with --log-file and exit", "");
         define('r', "root", "Root directory, where all config files are stored", std::filesystem::absolute(root).string());
         define('s', "server", "Run in server mode");
+        define('\0', "startup-profile", "Print the time spent loading each module and creating each instance");
         define('\0', "autostart", "Automatically start the SDR after loading");
 }
 
@@ -45,11 +45,36 @@ void ConfigManager::load(json def, bool lock) {
 }
 
 void ConfigManager::save(bool lock) {
+    // Only copying the config needs the lock, serialising and writing it is done on the copy
     if (lock) { mtx.lock(); }
-    std::ofstream file(path.c_str());
-    file << conf.dump(4);
-    file.close();
+    json snapshot = conf;
     if (lock) { mtx.unlock(); }
+    write(snapshot);
+}
+
+void ConfigManager::write(const json& snapshot) {
+    std::string data = snapshot.dump(4);
+
+    std::lock_guard<std::mutex> lck(writeMtx);
+    if (data == lastWritten) { return; }
+
+    // Write to a temporary file then replace the config with it
+    std::string tmpPath = path + ".tmp";
+    std::ofstream file(tmpPath.c_str(), std::ios::binary | std::ios::trunc);
+    file << data;
+    file.close();
+    if (file.fail()) {
+        flog::error("Could not write config file '{0}'", tmpPath);
+        return;
+    }
+
+    std::error_code err;
+    std::filesystem::rename(tmpPath, path, err);
+    if (err) {
+        flog::error("Could not replace config file '{0}': {1}", path, err.message());
+        return;
+    }
+    lastWritten = std::move(data);
 }
 
 void ConfigManager::enableAutoSave() {
@@ -62,11 +87,11 @@ void ConfigManager::enableAutoSave() {
 void ConfigManager::disableAutoSave() {
     if (!autoSaveEnabled) { return; }
     {
-        std::lock_guard<std::mutex> lock(termMtx);
+        std::lock_guard<std::mutex> lock(saveMtx);
         autoSaveEnabled = false;
         termFlag = true;
     }
-    termCond.notify_one();
+    saveCond.notify_one();
     if (autoSaveThread.joinable()) { autoSaveThread.join(); }
 }
 
@@ -75,27 +100,39 @@ void ConfigManager::acquire() {
 }
 
 void ConfigManager::release(bool modified) {
-    changed |= modified;
     mtx.unlock();
+    if (!modified) { return; }
+
+    // Only record the change, the worker does the rest
+    {
+        std::lock_guard<std::mutex> lck(saveMtx);
+        auto now = std::chrono::steady_clock::now();
+        if (!changed) { firstChange = now; }
+        lastChange = now;
+        changed = true;
+    }
+    saveCond.notify_one();
 }
 
 void ConfigManager::autoSaveWorker() {
-    while (autoSaveEnabled) {
-        if (!mtx.try_lock()) {
-            flog::warn("ConfigManager locked, waiting...");
-            std::this_thread::sleep_for(std::chrono::milliseconds(1000));
-            continue;
+    std::unique_lock<std::mutex> lck(saveMtx);
+    while (true) {
+        // Sleep until something changes
+        saveCond.wait(lck, [this]() { return changed || termFlag; });
+
+        // Wait for the changes to settle, the pending ones are saved before exiting
+        while (changed && !termFlag) {
+            auto deadline = std::min<std::chrono::steady_clock::time_point>(lastChange + SAVE_DELAY, firstChange + MAX_SAVE_DELAY);
+            if (std::chrono::steady_clock::now() >= deadline) { break; }
+            saveCond.wait_until(lck, deadline);
         }
+
         if (changed) {
             changed = false;
-            save(false);
-        }
-        mtx.unlock();
-
-        // Sleep but listen for wakeup call
-        {
-            std::unique_lock<std::mutex> lock(termMtx);
-            termCond.wait_for(lock, std::chrono::milliseconds(1000), [this]() { return termFlag; });
+            lck.unlock();
+            save();
+            lck.lock();
         }
+        if (termFlag) { break; }
     }
-}
\ No newline at end of file
+}
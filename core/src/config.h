@@ -3,10 +3,14 @@
 #include <thread>
 #include <string>
 #include <mutex>
+#include <chrono>
 #include <condition_variable>
 
 using nlohmann::json;
 
+// Holds a JSON config and saves it to disk. Changes are saved in the background: once they have settled, a copy
+// of the config is taken under the lock, then serialised and written without holding it. Files are replaced
+// atomically so that a crash during a save never leaves a truncated config behind.
 class ConfigManager {
 public:
     ConfigManager();
@@ -21,16 +25,30 @@ public:
 
     json conf;
 
+    // Time without changes after which they are saved
+    static constexpr std::chrono::milliseconds SAVE_DELAY = std::chrono::milliseconds(1000);
+
+    // Longest time changes wait to be saved when they keep coming
+    static constexpr std::chrono::milliseconds MAX_SAVE_DELAY = std::chrono::milliseconds(5000);
+
 private:
+    void write(const json& snapshot);
     void autoSaveWorker();
 
     std::string path = "";
-    volatile bool changed = false;
     volatile bool autoSaveEnabled = false;
     std::thread autoSaveThread;
     std::mutex mtx;
 
-    std::mutex termMtx;
-    std::condition_variable termCond;
-    volatile bool termFlag = false;
-};
\ No newline at end of file
+    // Pending changes, protected by saveMtx so that the worker can sleep until there are some
+    std::mutex saveMtx;
+    std::condition_variable saveCond;
+    bool changed = false;
+    std::chrono::steady_clock::time_point firstChange;
+    std::chrono::steady_clock::time_point lastChange;
+    bool termFlag = false;
+
+    // Serialises writes to the file, and the last content written to skip saving identical configs
+    std::mutex writeMtx;
+    std::string lastWritten;
+};
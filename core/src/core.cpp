@@ -19,6 +19,7 @@
 #include <stb_image_resize.h>
 #include <gui/gui.h>
 #include <signal_path/signal_path.h>
+#include <dsp/fft/planner.h>
 
 #ifdef _WIN32
 #include <Windows.h>
@@ -77,6 +78,22 @@ int sdrpp_main(int argc, char* argv[]) {
         return 0;
     }
 
+    // Print a binary log and exit if requested
+    std::string readLog = (std::string)core::args["read-log"];
+    if (!readLog.empty()) {
+        if (!flog::readLogFile(readLog)) {
+            fprintf(stderr, "Could not read log file '%s'\n", readLog.c_str());
+            return -1;
+        }
+        return 0;
+    }
+
+    // Open the binary log file if requested
+    std::string logFile = (std::string)core::args["log-file"];
+    if (!logFile.empty() && !flog::setLogFile(logFile)) {
+        flog::error("Could not open log file {0}", logFile);
+    }
+
     bool serverMode = (bool)core::args["server"];
 
 #ifdef _WIN32
@@ -123,12 +140,15 @@ int sdrpp_main(int argc, char* argv[]) {
     defConfig["snrSmoothingSpeed"] = 20;
     defConfig["fastFFT"] = false;
     defConfig["fftHeight"] = 300;
+    defConfig["fftMeasuredPlanning"] = true;
+    defConfig["fftThreads"] = 2;
     defConfig["fftRate"] = 20;
     defConfig["fftSize"] = 65536;
     defConfig["fftWindow"] = 2;
     defConfig["frequency"] = 100000000.0;
     defConfig["fullWaterfallUpdate"] = false;
     defConfig["max"] = 0.0;
+    defConfig["maxFps"] = 60;
     defConfig["maximized"] = false;
     defConfig["fullscreen"] = false;
 
@@ -230,6 +250,7 @@ int sdrpp_main(int argc, char* argv[]) {
     defConfig["decimationPower"] = 0;
     defConfig["iqCorrection"] = false;
     defConfig["invertIQ"] = false;
+    defConfig["bufferLatency"] = 250.0;
 
     defConfig["streams"]["Radio"]["muted"] = false;
     defConfig["streams"]["Radio"]["sink"] = "Audio";
@@ -298,6 +319,12 @@ int sdrpp_main(int argc, char* argv[]) {
     core::configManager.conf["modules"][modCount++] = "scanner.so";
 #endif
 
+    // The multi-threaded FFT switch was replaced by a thread count
+    if (core::configManager.conf.contains("fftMultithreading") && !core::configManager.conf.contains("fftThreads")) {
+        bool multithreading = core::configManager.conf["fftMultithreading"];
+        core::configManager.conf["fftThreads"] = multithreading ? defConfig["fftThreads"] : json(1);
+    }
+
     // Fix missing elements in config
     for (auto const& item : defConfig.items()) {
         if (!core::configManager.conf.contains(item.key())) {
@@ -328,6 +355,12 @@ int sdrpp_main(int argc, char* argv[]) {
     // Load UI scaling
     style::uiScale = core::configManager.conf["uiScale"];
 
+    // Load the FFTW wisdom, plans measured in the background get saved back to it
+    dsp::fft::planner::setMeasuring(core::configManager.conf["fftMeasuredPlanning"]);
+    if (!dsp::fft::planner::loadWisdom(root + "/fftw_wisdom.dat")) {
+        flog::info("No FFTW wisdom found, FFT plans will be measured as they're needed");
+    }
+
     core::configManager.release(true);
 
     if (serverMode) { return server::main(); }
@@ -391,5 +424,6 @@ int sdrpp_main(int argc, char* argv[]) {
 #endif
 
     flog::info("Exiting successfully");
+    flog::flush();
     return 0;
 }
@@ -39,12 +39,20 @@ namespace dsp::audio {
             return count;
         }
 
+        int outputBufferSize(int inputSize) { return inputSize; }
+
         virtual int run() {
-            int count = base_type::_in->read();
+            int count = base_type::readInput();
             if (count < 0) { return -1; }
 
-            process(count, base_type::_in->readBuf, base_type::out.writeBuf);
+            if (base_type::_in->readIdle) {
+                base_type::outputSilence(count);
+            }
+            else {
+                process(count, base_type::_in->readBuf, base_type::out.writeBuf);
+            }
 
+            base_type::forwardMetadata(count);
             base_type::_in->flush();
             if (!base_type::out.swap(count)) { return -1; }
             return count;
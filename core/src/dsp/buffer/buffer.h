@@ -1,4 +1,6 @@
 #pragma once
+#include <string.h>
+#include <algorithm>
 #include <volk/volk.h>
 
 namespace dsp::buffer {
@@ -15,4 +17,19 @@ namespace dsp::buffer {
     inline void free(void* buffer) {
         volk_free(buffer);
     }
+
+    // Makes sure a work buffer can hold at least `count` items, keeping the first `keep` ones. The buffer is grown
+    // by at least half its size so that slowly growing block sizes don't cause a reallocation every time.
+    template<class T>
+    inline void reserve(T*& buffer, int& capacity, int count, int keep = 0) {
+        if (count <= capacity) { return; }
+        int newCapacity = std::max<int>(count, capacity + (capacity / 2));
+        T* newBuffer = alloc<T>(newCapacity);
+        if (buffer) {
+            if (keep) { memcpy(newBuffer, buffer, keep * sizeof(T)); }
+            free(buffer);
+        }
+        buffer = newBuffer;
+        capacity = newCapacity;
+    }
 }
\ No newline at end of file
@@ -0,0 +1,332 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <stdint.h>
+#include "../block.h"
+
+namespace dsp::buffer {
+    struct InputBufferStats {
+        uint64_t overflows = 0;         // Number of input buffers that didn't completely fit in the buffer
+        uint64_t droppedSamples = 0;    // Total number of samples lost to overflows
+        uint64_t inputGaps = 0;         // Number of times no input arrived for longer than the buffer latency
+        int64_t lastOverflow = 0;       // Unix time in milliseconds of the last overflow, zero if none
+        int64_t lastInputGap = 0;       // Unix time in milliseconds of the last input gap, zero if none
+        int fill = 0;                   // Number of samples currently buffered
+        int capacity = 0;               // Maximum number of samples buffered, derived from the latency
+    };
+
+    // Decouples a source from the rest of the DSP. Samples are queued in a ring sized for the requested latency.
+    // When nothing is queued and the output is ready, incoming samples are copied straight to the output.
+    // Once full, incoming samples are dropped and the overflow is recorded in the stats.
+    // Buffers coming from sources that don't provide metadata get stamped with the arrival time.
+    template <class T>
+    class InputBuffer : public block {
+        using base_type = block;
+    public:
+        InputBuffer() {}
+
+        InputBuffer(stream<T>* in, double samplerate, double latency) { init(in, samplerate, latency); }
+
+        ~InputBuffer() {
+            if (!base_type::_block_init) { return; }
+            base_type::stop();
+            buffer::free(ring);
+        }
+
+        void init(stream<T>* in, double samplerate, double latency) {
+            _in = in;
+            _samplerate = samplerate;
+            _latency = latency;
+            allocate();
+
+            base_type::registerInput(in);
+            base_type::registerOutput(&out);
+            base_type::_block_init = true;
+        }
+
+        void setInput(stream<T>* in) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            base_type::unregisterInput(_in);
+            _in = in;
+            base_type::registerInput(_in);
+            base_type::tempStart();
+        }
+
+        void setSamplerate(double samplerate) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            _samplerate = samplerate;
+            allocate();
+            base_type::tempStart();
+        }
+
+        // Latency in milliseconds
+        void setLatency(double latency) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            _latency = latency;
+            allocate();
+            base_type::tempStart();
+        }
+
+        double getLatency() { return _latency; }
+
+        // Center frequency written into the metadata of buffers that come without any
+        void setCenterFrequency(double frequency) {
+            std::lock_guard<std::mutex> lck(bufMtx);
+            _centerFrequency = frequency;
+            pendingDiscontinuity = true;
+        }
+
+        InputBufferStats getStats() {
+            std::lock_guard<std::mutex> lck(bufMtx);
+            InputBufferStats s = stats;
+            s.fill = fill;
+            s.capacity = maxFill;
+            return s;
+        }
+
+        void resetStats() {
+            std::lock_guard<std::mutex> lck(bufMtx);
+            stats = InputBufferStats();
+        }
+
+        void flush() {
+            std::lock_guard<std::mutex> lck(bufMtx);
+            readCur = (readCur + fill) % ringSize;
+            fill = 0;
+            segments.clear();
+            pendingDiscontinuity = true;
+
+            // A gap in the input is expected after a flush (source stopped or retuned)
+            lastInput = std::chrono::steady_clock::time_point();
+        }
+
+        int run() {
+            // Wait for data
+            int count = _in->read();
+            if (count < 0) { return -1; }
+
+            std::unique_lock<std::mutex> lck(bufMtx);
+            StreamMetadata meta = getMetadata(count);
+
+            if (bypass) {
+                lck.unlock();
+                memcpy(out.writeBuf, _in->readBuf, count * sizeof(T));
+                out.writeIdle = _in->readIdle;
+                out.writeMeta = meta;
+                _in->flush();
+                if (!out.swap(count)) { return -1; }
+                return count;
+            }
+
+            checkInputGap();
+
+            // If nothing is queued and the output is free, skip the ring altogether
+            if (!fill && !delivering && out.swapReady()) {
+                delivering = true;
+                lck.unlock();
+                memcpy(out.writeBuf, _in->readBuf, count * sizeof(T));
+                out.writeIdle = _in->readIdle;
+                out.writeMeta = meta;
+                _in->flush();
+                bool ok = out.swap(count);
+                lck.lock();
+                delivering = false;
+                lck.unlock();
+                cnd.notify_all();
+                return ok ? count : -1;
+            }
+
+            // Queue as much as allowed by the latency, the rest is lost
+            int space = std::min<int>(std::max<int>(maxFill, count) - fill, ringSize - fill - reserved);
+            int accepted = std::clamp<int>(space, 0, count);
+            if (accepted < count) {
+                stats.overflows++;
+                stats.droppedSamples += count - accepted;
+                stats.lastOverflow = unixTimeMs();
+                pendingDiscontinuity = true;
+            }
+            int writeCur = (readCur + fill) % ringSize;
+            int first = std::min<int>(accepted, ringSize - writeCur);
+            memcpy(&ring[writeCur], _in->readBuf, first * sizeof(T));
+            memcpy(ring, &_in->readBuf[first], (accepted - first) * sizeof(T));
+            fill += accepted;
+
+            // Keep track of the metadata of each contiguous run of samples in the ring
+            if (accepted) {
+                if (!segments.empty() && !meta.discontinuity && segments.back().meta.sampleIndex + segments.back().count == meta.sampleIndex) {
+                    segments.back().count += accepted;
+                }
+                else {
+                    segments.push_back({ accepted, meta });
+                }
+            }
+
+            lck.unlock();
+            cnd.notify_all();
+            _in->flush();
+            return count;
+        }
+
+        void worker() {
+            while (true) {
+                // Wait for data and for the output to be free
+                std::unique_lock<std::mutex> lck(bufMtx);
+                cnd.wait(lck, [this]() { return (fill > 0 && !delivering) || stopWorker; });
+                if (stopWorker) { break; }
+
+                // Reserve the oldest samples so that the producer won't overwrite them while copying.
+                // An output buffer never spans two runs so that its metadata stays exact.
+                Segment& seg = segments.front();
+                int count = std::min<int>(std::min<int>(fill, STREAM_BUFFER_SIZE), seg.count);
+                out.writeMeta = seg.meta;
+                seg.meta.sampleIndex += count;
+                seg.meta.timestamp += (int64_t)((double)count * 1e9 / seg.meta.samplerate);
+                seg.meta.discontinuity = false;
+                seg.count -= count;
+                if (!seg.count) { segments.pop_front(); }
+                int start = readCur;
+                readCur = (readCur + count) % ringSize;
+                fill -= count;
+                reserved = count;
+                delivering = true;
+                lck.unlock();
+
+                int first = std::min<int>(count, ringSize - start);
+                memcpy(out.writeBuf, &ring[start], first * sizeof(T));
+                memcpy(&out.writeBuf[first], ring, (count - first) * sizeof(T));
+
+                lck.lock();
+                reserved = 0;
+                lck.unlock();
+
+                // Swap
+                bool ok = out.swap(count);
+                lck.lock();
+                delivering = false;
+                lck.unlock();
+                cnd.notify_all();
+                if (!ok) { break; }
+            }
+        }
+
+        stream<T> out;
+
+        bool bypass = false;
+
+    private:
+        void doStart() {
+            lastInput = std::chrono::steady_clock::time_point();
+            base_type::workerThread = std::thread(&InputBuffer<T>::workerLoop, this);
+            readWorkerThread = std::thread(&InputBuffer<T>::worker, this);
+        }
+
+        void doStop() {
+            _in->stopReader();
+            out.stopWriter();
+            {
+                std::lock_guard<std::mutex> lck(bufMtx);
+                stopWorker = true;
+            }
+            cnd.notify_all();
+
+            if (base_type::workerThread.joinable()) { base_type::workerThread.join(); }
+            if (readWorkerThread.joinable()) { readWorkerThread.join(); }
+
+            _in->clearReadStop();
+            out.clearWriteStop();
+            stopWorker = false;
+            delivering = false;
+            reserved = 0;
+        }
+
+        void allocate() {
+            // The ring must at least hold one full input buffer even if the latency is shorter than that
+            maxFill = std::max<int>(round(_samplerate * _latency / 1000.0), 1);
+            int size = std::max<int>(maxFill, STREAM_BUFFER_SIZE);
+            if (size != ringSize) {
+                if (ring) { buffer::free(ring); }
+                ring = buffer::alloc<T>(size);
+                ringSize = size;
+            }
+            readCur = 0;
+            fill = 0;
+            segments.clear();
+            pendingDiscontinuity = true;
+            lastInput = std::chrono::steady_clock::time_point();
+        }
+
+        StreamMetadata getMetadata(int count) {
+            StreamMetadata meta = _in->readMeta;
+            if (!meta.valid) {
+                // Assume the last sample just arrived
+                meta.valid = true;
+                meta.sampleIndex = sampleIndex;
+                meta.timestamp = unixTimeNs() - (int64_t)((double)count * 1e9 / _samplerate);
+                meta.centerFrequency = _centerFrequency;
+                meta.samplerate = _samplerate;
+            }
+            meta.discontinuity |= pendingDiscontinuity;
+            pendingDiscontinuity = false;
+            sampleIndex += count;
+            return meta;
+        }
+
+        void checkInputGap() {
+            auto now = std::chrono::steady_clock::now();
+            if (lastInput != std::chrono::steady_clock::time_point()) {
+                double gap = std::chrono::duration<double, std::milli>(now - lastInput).count();
+                if (gap > _latency) {
+                    stats.inputGaps++;
+                    stats.lastInputGap = unixTimeMs();
+                }
+            }
+            lastInput = now;
+        }
+
+        static int64_t unixTimeNs() {
+            auto now = std::chrono::system_clock::now().time_since_epoch();
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+        }
+
+        static int64_t unixTimeMs() {
+            auto now = std::chrono::system_clock::now().time_since_epoch();
+            return std::chrono::duration_cast<std::chrono::milliseconds>(now).count();
+        }
+
+        stream<T>* _in;
+        double _samplerate;
+        double _latency;
+
+        std::thread readWorkerThread;
+        std::mutex bufMtx;
+        std::condition_variable cnd;
+
+        T* ring = NULL;
+        int ringSize = 0;
+        int maxFill = 0;
+        int readCur = 0;
+        int fill = 0;
+        int reserved = 0;
+        bool delivering = false;
+        std::chrono::steady_clock::time_point lastInput;
+        InputBufferStats stats;
+
+        struct Segment {
+            int count;
+            StreamMetadata meta;
+        };
+        std::deque<Segment> segments;
+        uint64_t sampleIndex = 0;
+        double _centerFrequency = 0.0;
+        bool pendingDiscontinuity = true;
+
+        bool stopWorker = false;
+    };
+}
\ No newline at end of file
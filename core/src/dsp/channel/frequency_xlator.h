@@ -13,6 +13,7 @@ namespace dsp::channel {
         FrequencyXlator(stream<complex_t>* in, double offset, double samplerate) { init(in, offset, samplerate); }
 
         void init(stream<complex_t>* in, double offset) {
+            _offset = offset;
             phase = lv_cmake(1.0f, 0.0f);
             phaseDelta = lv_cmake(cos(offset), sin(offset));
             base_type::init(in);
@@ -25,6 +26,7 @@ namespace dsp::channel {
         void setOffset(double offset) {
             assert(base_type::_block_init);
             std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            _offset = offset;
             phaseDelta = lv_cmake(cos(offset), sin(offset));
         }
 
@@ -51,12 +53,17 @@ namespace dsp::channel {
 
             process(count, base_type::_in->readBuf, base_type::out.writeBuf);
 
+            base_type::forwardMetadata(count);
+            if (base_type::out.writeMeta.valid) {
+                base_type::out.writeMeta.centerFrequency -= _offset * base_type::out.writeMeta.samplerate / (2.0 * DB_M_PI);
+            }
             base_type::_in->flush();
             if (!base_type::out.swap(count)) { return -1; }
             return count;
         }
 
     protected:
+        double _offset;
         lv_32fc_t phase;
         lv_32fc_t phaseDelta;
     };
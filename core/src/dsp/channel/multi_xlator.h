@@ -0,0 +1,159 @@
+#pragma once
+#include <map>
+#include <vector>
+#include "../sink.h"
+#include "../math/hz_to_rads.h"
+
+namespace dsp::channel {
+    // Translates one input stream to multiple frequency offsets at once. The input is processed in small tiles
+    // so that it's only read from memory once no matter how many channels are translated.
+    class MultiXlator : public Sink<complex_t> {
+        using base_type = Sink<complex_t>;
+    public:
+        MultiXlator() {}
+
+        MultiXlator(stream<complex_t>* in) { base_type::init(in); }
+
+        void bindStream(stream<complex_t>* stream, double offset) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+
+            // Check that the stream isn't already bound
+            if (channels.find(stream) != channels.end()) {
+                throw std::runtime_error("[MultiXlator] Tried to bind stream to that is already bound");
+            }
+
+            // Add to the list
+            base_type::tempStop();
+            base_type::registerOutput(stream);
+            {
+                std::lock_guard<std::mutex> lck2(offsetMtx);
+                Channel& ch = channels[stream];
+                ch.phase = lv_cmake(1.0f, 0.0f);
+                ch.offset = offset;
+                ch.phaseDelta = lv_cmake(cos(offset), sin(offset));
+            }
+            base_type::tempStart();
+        }
+
+        void bindStream(stream<complex_t>* stream, double offset, double samplerate) {
+            bindStream(stream, math::hzToRads(offset, samplerate));
+        }
+
+        void unbindStream(stream<complex_t>* stream) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+
+            // Check that the stream is bound
+            if (channels.find(stream) == channels.end()) {
+                throw std::runtime_error("[MultiXlator] Tried to unbind stream to that isn't bound");
+            }
+
+            // Remove from the list
+            base_type::tempStop();
+            {
+                std::lock_guard<std::mutex> lck2(offsetMtx);
+                channels.erase(stream);
+            }
+            base_type::unregisterOutput(stream);
+            base_type::tempStart();
+        }
+
+        // The phase of the channel is kept so that its output stays continuous
+        void setOffset(stream<complex_t>* stream, double offset) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::mutex> lck(offsetMtx);
+            auto it = channels.find(stream);
+            if (it == channels.end()) { return; }
+            it->second.offset = offset;
+            it->second.phaseDelta = lv_cmake(cos(offset), sin(offset));
+        }
+
+        void setOffset(stream<complex_t>* stream, double offset, double samplerate) {
+            setOffset(stream, math::hzToRads(offset, samplerate));
+        }
+
+        // Retune multiple channels at once, all of them take effect on the same input sample
+        void setOffsets(const std::vector<std::pair<stream<complex_t>*, double>>& offsets, double samplerate) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::mutex> lck(offsetMtx);
+            for (const auto& [stream, offset] : offsets) {
+                auto it = channels.find(stream);
+                if (it == channels.end()) { continue; }
+                double omega = math::hzToRads(offset, samplerate);
+                it->second.offset = omega;
+                it->second.phaseDelta = lv_cmake(cos(omega), sin(omega));
+            }
+        }
+
+        void reset() {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            {
+                std::lock_guard<std::mutex> lck2(offsetMtx);
+                for (auto& [stream, ch] : channels) {
+                    ch.phase = lv_cmake(1.0f, 0.0f);
+                }
+            }
+            base_type::tempStart();
+        }
+
+        int run() {
+            int count = base_type::_in->read();
+            if (count < 0) { return -1; }
+
+            // The channels are only accessed under the offset mutex, except for the swaps which could block it
+            bool idle = base_type::_in->readIdle;
+            {
+                std::lock_guard<std::mutex> lck(offsetMtx);
+                if (idle) {
+                    // Silence stays silence at any offset
+                    for (auto& [stream, ch] : channels) {
+                        memset(stream->writeBuf, 0, count * sizeof(complex_t));
+                    }
+                }
+                else {
+                    const complex_t* in = base_type::_in->readBuf;
+                    for (int i = 0; i < count; i += TILE_SIZE) {
+                        int tileSize = std::min<int>(TILE_SIZE, count - i);
+                        for (auto& [stream, ch] : channels) {
+                            volk_32fc_s32fc_x2_rotator_32fc((lv_32fc_t*)&stream->writeBuf[i], (lv_32fc_t*)&in[i], ch.phaseDelta, &ch.phase, tileSize);
+                        }
+                    }
+                }
+
+                StreamMetadata meta = base_type::_in->readMeta;
+                for (auto& [stream, ch] : channels) {
+                    stream->writeIdle = idle;
+                    stream->writeMeta = meta;
+                    if (meta.valid) {
+                        stream->writeMeta.centerFrequency -= ch.offset * meta.samplerate / (2.0 * DB_M_PI);
+                    }
+                }
+            }
+            base_type::_in->flush();
+
+            // Bind and unbind stop the thread before changing the channels, so the list can't change here
+            for (auto& [stream, ch] : channels) {
+                if (!stream->swap(count)) { return -1; }
+            }
+
+            return count;
+        }
+
+    protected:
+        // Number of input samples processed for all channels before moving on, chosen to stay in L1 cache
+        static const int TILE_SIZE = 2048;
+
+        struct Channel {
+            double offset;
+            lv_32fc_t phase;
+            lv_32fc_t phaseDelta;
+        };
+
+        std::map<stream<complex_t>*, Channel> channels;
+        std::mutex offsetMtx;
+
+    };
+}
\ No newline at end of file
@@ -0,0 +1,149 @@
+#pragma once
+#include <fftw3.h>
+#include <string.h>
+#include <assert.h>
+#include "../types.h"
+#include "../buffer/buffer.h"
+#include "../taps/tap.h"
+#include "../taps/windowed_sinc.h"
+#include "../taps/estimate_tap_count.h"
+#include "../fft/planner.h"
+
+namespace dsp::channel {
+    // Polyphase analysis filterbank splitting the input into evenly spaced channels. Channel c is centered on
+    // c times the spacing (samplerate / channel count), the channels past the middle being the negative frequencies.
+    // Every channel is output at OVERSAMPLING times the spacing so that a signal lying anywhere between two channel
+    // centers can be taken from the nearest one, with the passband reaching 1.5 times the spacing on each side.
+    // Each output sample costs one pass of the prototype filter over the input and a single FFT for all channels,
+    // only the channels that are asked for are copied out.
+    class PFBChannelizer {
+    public:
+        PFBChannelizer() {}
+
+        PFBChannelizer(int channels, double samplerate) { init(channels, samplerate); }
+
+        ~PFBChannelizer() { freeState(); }
+
+        // The channel count must be a multiple of OVERSAMPLING
+        void init(int channels, double samplerate) {
+            assert(channels > 0 && !(channels % OVERSAMPLING));
+            freeState();
+            _channels = channels;
+            _decimation = _channels / OVERSAMPLING;
+
+            // Passband up to 1.5 times the spacing and stopband from 2.5 times the spacing. Since the output rate is
+            // four times the spacing, nothing aliases into the passband. The tap count is rounded up to whole phases.
+            double spacing = samplerate / (double)_channels;
+            int count = taps::estimateTapCount(spacing, samplerate);
+            tapCount = ((count + _channels - 1) / _channels) * _channels;
+            tap<float> proto = taps::windowedSinc<float>(tapCount, 2.0 * spacing, samplerate, window::nuttall);
+
+            // Reversed so that the taps line up with the samples oldest first
+            rtaps = buffer::alloc<float>(tapCount);
+            for (int i = 0; i < tapCount; i++) { rtaps[i] = proto.taps[tapCount - 1 - i]; }
+            taps::free(proto);
+
+            fftIn = (complex_t*)fftwf_malloc(_channels * sizeof(complex_t));
+            fftOut = (complex_t*)fftwf_malloc(_channels * sizeof(complex_t));
+            plan = fft::planner::get(_channels, fft::FORWARD, (fftwf_complex*)fftIn, (fftwf_complex*)fftOut);
+
+            buffer::reserve(buffer, bufCapacity, tapCount - 1);
+            bufStart = &buffer[tapCount - 1];
+            reset();
+        }
+
+        void reset() {
+            if (!_channels) { return; }
+            buffer::clear(buffer, tapCount - 1);
+            offset = 0;
+            outIndex = 0;
+        }
+
+        inline int getChannelCount() { return _channels; }
+
+        inline int getDecimation() { return _decimation; }
+
+        inline int outputBufferSize(int inputSize) { return (inputSize / _decimation) + 1; }
+
+        // One output buffer per channel, NULL for the channels that aren't needed. Returns the number of samples
+        // written to each of them.
+        int process(int count, const complex_t* in, complex_t* const* out) {
+            // Copy data to work buffer
+            if (count + tapCount - 1 > bufCapacity) {
+                buffer::reserve(buffer, bufCapacity, count + tapCount - 1, tapCount - 1);
+                bufStart = &buffer[tapCount - 1];
+            }
+            memcpy(bufStart, in, count * sizeof(complex_t));
+
+            int outCount = 0;
+            for (; offset < count; offset += _decimation) {
+                // Weight the window with the prototype and fold it onto one sample per channel
+                const complex_t* win = &buffer[offset];
+                for (int i = 0; i < _channels; i++) {
+                    fftIn[i].re = win[i].re * rtaps[i];
+                    fftIn[i].im = win[i].im * rtaps[i];
+                }
+                for (int j = _channels; j < tapCount; j += _channels) {
+                    for (int i = 0; i < _channels; i++) {
+                        fftIn[i].re += win[j + i].re * rtaps[j + i];
+                        fftIn[i].im += win[j + i].im * rtaps[j + i];
+                    }
+                }
+
+                plan.execute((fftwf_complex*)fftIn, (fftwf_complex*)fftOut);
+
+                // Between two outputs the oscillator of channel c turns by c quarter turns, bringing the channels
+                // to baseband comes down to rotating them by a multiple of -90 degrees
+                for (int c = 0; c < _channels; c++) {
+                    if (!out[c]) { continue; }
+                    const complex_t& v = fftOut[c];
+                    complex_t& o = out[c][outCount];
+                    switch ((c * outIndex) & 3) {
+                        case 0: o = v; break;
+                        case 1: o = { v.im, -v.re }; break;
+                        case 2: o = { -v.re, -v.im }; break;
+                        case 3: o = { -v.im, v.re }; break;
+                    }
+                }
+                outIndex = (outIndex + 1) & 3;
+                outCount++;
+            }
+            offset -= count;
+
+            // Move unused data
+            memmove(buffer, &buffer[count], (tapCount - 1) * sizeof(complex_t));
+
+            return outCount;
+        }
+
+        static const int OVERSAMPLING = 4;
+
+    private:
+        void freeState() {
+            if (!_channels) { return; }
+            buffer::free(rtaps);
+            buffer::free(buffer);
+            fftwf_free(fftIn);
+            fftwf_free(fftOut);
+            plan.reset();
+            buffer = NULL;
+            bufCapacity = 0;
+            _channels = 0;
+        }
+
+        int _channels = 0;
+        int _decimation = 1;
+        int tapCount = 0;
+        float* rtaps = NULL;
+
+        complex_t* buffer = NULL;
+        complex_t* bufStart;
+        int bufCapacity = 0;
+        int offset = 0;
+        int outIndex = 0;
+
+        complex_t* fftIn = NULL;
+        complex_t* fftOut = NULL;
+        fft::Plan plan;
+    };
+}
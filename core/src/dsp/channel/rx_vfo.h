@@ -1,6 +1,7 @@
 #pragma once
 #include "frequency_xlator.h"
 #include "../multirate/rational_resampler.h"
+#include "../taps/cache.h"
 
 namespace dsp::channel {
     class RxVFO : public Processor<complex_t, complex_t> {
@@ -13,7 +14,6 @@ namespace dsp::channel {
         ~RxVFO() {
             if (!base_type::_block_init) { return; }
             base_type::stop();
-            taps::free(ftaps);
         }
 
         void init(stream<complex_t>* in, double inSamplerate, double outSamplerate, double bandwidth, double offset) {
@@ -22,12 +22,16 @@ namespace dsp::channel {
             _bandwidth = bandwidth;
             _offset = offset;
             filterNeeded = (_bandwidth != _outSamplerate);
-            ftaps.taps = NULL;
+            base_type::metaRateRatio = _outSamplerate / _inSamplerate;
 
             xlator.init(NULL, -_offset, _inSamplerate);
             resamp.init(NULL, _inSamplerate, _outSamplerate);
             generateTaps();
-            filter.init(NULL, ftaps);
+            filter.init(NULL, *ftaps);
+
+            // Only used for processing, the output of the xlator is kept as work buffer for the translated input
+            resamp.out.free();
+            filter.out.free();
 
             base_type::init(in);
         }
@@ -37,6 +41,7 @@ namespace dsp::channel {
             std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
             base_type::tempStop();
             _inSamplerate = inSamplerate;
+            base_type::metaRateRatio = _outSamplerate / _inSamplerate;
             xlator.setOffset(-_offset, _inSamplerate);
             resamp.setInSamplerate(_inSamplerate);
             base_type::tempStart();
@@ -49,10 +54,11 @@ namespace dsp::channel {
             _outSamplerate = outSamplerate;
             _bandwidth = bandwidth;
             filterNeeded = (_bandwidth != _outSamplerate);
+            base_type::metaRateRatio = _outSamplerate / _inSamplerate;
             resamp.setOutSamplerate(_outSamplerate);
             if (filterNeeded) {
                 generateTaps();
-                filter.setTaps(ftaps);
+                filter.setTaps(*ftaps);
             }
             base_type::tempStart();
         }
@@ -65,7 +71,7 @@ namespace dsp::channel {
             filterNeeded = (_bandwidth != _outSamplerate);
             if (filterNeeded) {
                 generateTaps();
-                filter.setTaps(ftaps);
+                filter.setTaps(*ftaps);
             }
         }
 
@@ -87,11 +93,15 @@ namespace dsp::channel {
         }
 
         inline int process(int count, const complex_t* in, complex_t* out) {
-            xlator.process(count, in, out);
+            // A zero offset means the input was already translated upstream (or is already centered)
+            if (_offset != 0.0) {
+                xlator.process(count, in, xlator.out.writeBuf);
+                in = xlator.out.writeBuf;
+            }
             if (!filterNeeded) {
-                return resamp.process(count, out, out);
+                return resamp.process(count, in, out);
             }
-            count = resamp.process(count, out, out);
+            count = resamp.process(count, in, out);
             {
                 std::lock_guard<std::mutex> lck(filterMtx);
                 filter.process(count, out, out);
@@ -99,12 +109,17 @@ namespace dsp::channel {
             return count;
         }
 
+        int outputBufferSize(int inputSize) { return resamp.outputBufferSize(inputSize); }
+
         int run() {
-            int count = base_type::_in->read();
+            int count = base_type::readInput();
             if (count < 0) { return -1; }
 
             int outCount = process(count, base_type::_in->readBuf, out.writeBuf);
 
+            base_type::forwardMetadata(count, outCount);
+            if (outCount && out.writeMeta.valid) { out.writeMeta.centerFrequency += _offset; }
+
             // Swap if some data was generated
             base_type::_in->flush();
             if (outCount) {
@@ -114,16 +129,20 @@ namespace dsp::channel {
         }
 
     protected:
+        void resizeBuffers(int inputSize) {
+            xlator.out.setBufferSize(inputSize);
+            base_type::resizeBuffers(inputSize);
+        }
+
         void generateTaps() {
-            taps::free(ftaps);
             double filterWidth = _bandwidth / 2.0;
-            ftaps = taps::lowPass(filterWidth, filterWidth * 0.1, _outSamplerate);
+            ftaps = taps::cache::lowPass(filterWidth, filterWidth * 0.1, _outSamplerate);
         }
 
         FrequencyXlator xlator;
         multirate::RationalResampler<complex_t> resamp;
         filter::FIR<complex_t, float> filter;
-        tap<float> ftaps;
+        taps::SharedTap<float> ftaps;
         bool filterNeeded;
 
         double _inSamplerate;
@@ -30,7 +30,7 @@ namespace dsp::clock_recovery {
 
             pcl.init(_muGain, _omegaGain, 0.0, 0.0, 1.0, _omega, _omega * (1.0 - omegaRelLimit), _omega * (1.0 + omegaRelLimit));
             generateInterpTaps();
-            buffer = buffer::alloc<float>(STREAM_BUFFER_SIZE + _interpTapCount);
+            buffer::reserve(buffer, bufCapacity, _interpTapCount - 1);
             bufStart = &buffer[_interpTapCount - 1];
         
             base_type::init(in);
@@ -76,9 +76,8 @@ namespace dsp::clock_recovery {
             _interpPhaseCount = interpPhaseCount;
             _interpTapCount = interpTapCount;
             dsp::multirate::freePolyphaseBank(interpBank);
-            buffer::free(buffer);
             generateInterpTaps();
-            buffer = buffer::alloc<float>(STREAM_BUFFER_SIZE + _interpTapCount);
+            buffer::reserve(buffer, bufCapacity, _interpTapCount - 1);
             bufStart = &buffer[_interpTapCount - 1];
             base_type::tempStart();
         }
@@ -94,7 +93,11 @@ namespace dsp::clock_recovery {
         }
 
         inline int process(int count, const float* in, float* out) {
-            // Copy data to work buffer
+            // Copy data to work buffer, growing it if needed
+            if (count + _interpTapCount - 1 > bufCapacity) {
+                buffer::reserve(buffer, bufCapacity, count + _interpTapCount - 1, _interpTapCount - 1);
+                bufStart = &buffer[_interpTapCount - 1];
+            }
             memcpy(bufStart, in, count * sizeof(float));
 
             // Process all samples
@@ -183,7 +186,8 @@ namespace dsp::clock_recovery {
         int _interpTapCount;
 
         int offset = 0;
-        float* buffer;
+        float* buffer = NULL;
         float* bufStart;
+        int bufCapacity = 0;
     };
 }
\ No newline at end of file
@@ -31,7 +31,7 @@ namespace dsp::clock_recovery {
 
             pcl.init(_muGain, _omegaGain, 0.0, 0.0, 1.0, _omega, _omega * (1.0 - omegaRelLimit), _omega * (1.0 + omegaRelLimit));
             generateInterpTaps();
-            buffer = buffer::alloc<T>(STREAM_BUFFER_SIZE + _interpTapCount);
+            buffer::reserve(buffer, bufCapacity, _interpTapCount - 1);
             bufStart = &buffer[_interpTapCount - 1];
         
             base_type::init(in);
@@ -77,9 +77,8 @@ namespace dsp::clock_recovery {
             _interpPhaseCount = interpPhaseCount;
             _interpTapCount = interpTapCount;
             dsp::multirate::freePolyphaseBank(interpBank);
-            buffer::free(buffer);
             generateInterpTaps();
-            buffer = buffer::alloc<T>(STREAM_BUFFER_SIZE + _interpTapCount);
+            buffer::reserve(buffer, bufCapacity, _interpTapCount - 1);
             bufStart = &buffer[_interpTapCount - 1];
             base_type::tempStart();
         }
@@ -98,7 +97,11 @@ namespace dsp::clock_recovery {
         }
 
         inline int process(int count, const T* in, T* out) {
-            // Copy data to work buffer
+            // Copy data to work buffer, growing it if needed
+            if (count + _interpTapCount - 1 > bufCapacity) {
+                buffer::reserve(buffer, bufCapacity, count + _interpTapCount - 1, _interpTapCount - 1);
+                bufStart = &buffer[_interpTapCount - 1];
+            }
             memcpy(bufStart, in, count * sizeof(T));
 
             // Process all samples
@@ -193,7 +196,8 @@ namespace dsp::clock_recovery {
         complex_t _c_0T = { 0.0f, 0.0f }, _c_1T = { 0.0f, 0.0f }, _c_2T = { 0.0f, 0.0f };
 
         int offset = 0;
-        T* buffer;
+        T* buffer = NULL;
         T* bufStart;
+        int bufCapacity = 0;
     };
 }
\ No newline at end of file
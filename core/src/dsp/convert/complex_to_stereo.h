@@ -17,6 +17,7 @@ namespace dsp::convert {
 
             memcpy(base_type::out.writeBuf, base_type::_in->readBuf, count * sizeof(complex_t));
 
+            base_type::forwardMetadata(count);
             base_type::_in->flush();
             if (!base_type::out.swap(count)) { return -1; }
             return count;
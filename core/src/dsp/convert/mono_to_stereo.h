@@ -14,12 +14,15 @@ namespace dsp::convert {
             return count;
         }
 
+        int outputBufferSize(int inputSize) { return inputSize; }
+
         int run() {
-            int count = base_type::_in->read();
+            int count = base_type::readInput();
             if (count < 0) { return -1; }
 
             process(count, base_type::_in->readBuf, base_type::out.writeBuf);
 
+            base_type::forwardMetadata(count);
             base_type::_in->flush();
             if (!base_type::out.swap(count)) { return -1; }
             return count;
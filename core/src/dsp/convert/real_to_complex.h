@@ -16,29 +16,35 @@ namespace dsp::convert {
         }
 
         void init(stream<float>* in) {
-            nullBuf = buffer::alloc<float>(STREAM_BUFFER_SIZE);
-            buffer::clear(nullBuf, STREAM_BUFFER_SIZE);
             base_type::init(in);
         }
 
         inline int process(int count, const float* in, complex_t* out) {
+            if (count > nullBufCapacity) {
+                buffer::reserve(nullBuf, nullBufCapacity, count);
+                buffer::clear(nullBuf, nullBufCapacity);
+            }
             volk_32f_x2_interleave_32fc((lv_32fc_t*)out, in, nullBuf, count);
             return count;
         }
 
+        int outputBufferSize(int inputSize) { return inputSize; }
+
         int run() {
-            int count = base_type::_in->read();
+            int count = base_type::readInput();
             if (count < 0) { return -1; }
 
             process(count, base_type::_in->readBuf, base_type::out.writeBuf);
 
+            base_type::forwardMetadata(count);
             base_type::_in->flush();
             if (!base_type::out.swap(count)) { return -1; }
             return count;
         }
 
     private:
-        float* nullBuf;
+        float* nullBuf = NULL;
+        int nullBufCapacity = 0;
 
     };
 }
\ No newline at end of file
@@ -1,7 +1,10 @@
 #pragma once
 #include "../processor.h"
+#include "../filter/iir.h"
 
 namespace dsp::correction {
+    // First order high-pass, the offset follows the input at the given rate and is subtracted from it.
+    // Runs as a block IIR section since it sits on the full rate IQ.
     template<class T>
     class DCBlocker : public Processor<T, T> {
         using base_type = Processor<T, T>;
@@ -14,12 +17,8 @@ namespace dsp::correction {
 
         void init(stream<T>* in, double rate) {
             _rate = rate;
-            if constexpr (std::is_same_v<T, float>) {
-                offset = 0.0f;
-            }
-            if constexpr (std::is_same_v<T, complex_t> || std::is_same_v<T, stereo_t>) {
-                offset = { 0.0f, 0.0f };
-            }
+            updateSection();
+            section.reset();
             base_type::init(in);
         }
 
@@ -30,7 +29,10 @@ namespace dsp::correction {
         void setRate(double rate) {
             assert(base_type::_block_init);
             std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
             _rate = rate;
+            updateSection();
+            base_type::tempStart();
         }
 
         void setRate(double rate, double samplerate)  {
@@ -41,37 +43,40 @@ namespace dsp::correction {
             assert(base_type::_block_init);
             std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
             base_type::tempStop();
-            if constexpr (std::is_same_v<T, float>) {
-                offset = 0.0f;
-            }
-            if constexpr (std::is_same_v<T, complex_t> || std::is_same_v<T, stereo_t>) {
-                offset = { 0.0f, 0.0f };
-            }
+            section.reset();
             base_type::tempStart();
         }
 
-        // TODO: Add back the const
-        int process(int count, T* in, T* out) {
-            for (int i = 0; i < count; i++) {
-                out[i] = in[i] - offset;
-                offset += out[i] * _rate;
-            }
+        int process(int count, const T* in, T* out) {
+            section.process(count, (const float*)in, (float*)out);
             return count;
         }
 
+        int outputBufferSize(int inputSize) { return inputSize; }
+
         virtual int run() {
-            int count = base_type::_in->read();
+            int count = base_type::readInput();
             if (count < 0) { return -1; }
 
             process(count, base_type::_in->readBuf, base_type::out.writeBuf);
 
+            base_type::forwardMetadata(count);
             base_type::_in->flush();
             if (!base_type::out.swap(count)) { return -1; }
             return count;
         }
 
     protected:
-        float _rate;
-        T offset;
+        static const int CHANNELS = sizeof(T) / sizeof(float);
+
+        void updateSection() {
+            // out = in - offset and offset += out * rate, that is (1 - z^-1) / (1 - (1 - rate)*z^-1)
+            const double b[2] = { 1.0, -1.0 };
+            const double a[1] = { -(1.0 - _rate) };
+            section.design(b, a);
+        }
+
+        double _rate;
+        filter::iir::FirstOrder<CHANNELS> section;
     };
 }
\ No newline at end of file
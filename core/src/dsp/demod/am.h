@@ -4,7 +4,7 @@
 #include "../correction/dc_blocker.h"
 #include "../convert/mono_to_stereo.h"
 #include "../filter/fir.h"
-#include "../taps/low_pass.h"
+#include "../taps/cache.h"
 
 namespace dsp::demod {
     template <class T>
@@ -23,7 +23,6 @@ namespace dsp::demod {
         ~AM() {
             if (!base_type::_block_init) { return; }
             base_type::stop();
-            taps::free(lpfTaps);
         }
 
         void init(stream<complex_t>* in, AGCMode agcMode, double bandwidth, double agcAttack, double agcDecay, double dcBlockRate, double samplerate) {
@@ -34,8 +33,8 @@ namespace dsp::demod {
             carrierAgc.init(NULL, 1.0, agcAttack, agcDecay, 10e6, 10.0, INFINITY);
             audioAgc.init(NULL, 1.0, agcAttack, agcDecay, 10e6, 10.0, INFINITY);
             dcBlock.init(NULL, dcBlockRate);
-            lpfTaps = taps::lowPass(bandwidth / 2.0, (bandwidth / 2.0) * 0.1, samplerate);
-            lpf.init(NULL, lpfTaps);
+            lpfTaps = taps::cache::lowPass(bandwidth / 2.0, (bandwidth / 2.0) * 0.1, samplerate);
+            lpf.init(NULL, *lpfTaps);
 
             if constexpr (std::is_same_v<T, float>) {
                 audioAgc.out.free();
@@ -61,9 +60,8 @@ namespace dsp::demod {
             if (bandwidth == _bandwidth) { return; }
             _bandwidth = bandwidth;
             std::lock_guard<std::mutex> lck2(lpfMtx);
-            taps::free(lpfTaps);
-            lpfTaps = taps::lowPass(_bandwidth / 2.0, (_bandwidth / 2.0) * 0.1, _samplerate);
-            lpf.setTaps(lpfTaps);
+            lpfTaps = taps::cache::lowPass(_bandwidth / 2.0, (_bandwidth / 2.0) * 0.1, _samplerate);
+            lpf.setTaps(*lpfTaps);
         }
 
         void setAGCAttack(double attack) {
@@ -83,7 +81,9 @@ namespace dsp::demod {
         void setDCBlockRate(double rate) {
             assert(base_type::_block_init);
             std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
             dcBlock.setRate(rate);
+            base_type::tempStart();
         }
 
         // TODO: Implement setSamplerate
@@ -132,18 +132,30 @@ namespace dsp::demod {
             return count;
         }
 
+        int outputBufferSize(int inputSize) { return inputSize; }
+
         int run() {
-            int count = base_type::_in->read();
+            int count = base_type::readInput();
             if (count < 0) { return -1; }
 
             process(count, base_type::_in->readBuf, base_type::out.writeBuf);
 
+            base_type::forwardMetadata(count);
             base_type::_in->flush();
             if (!base_type::out.swap(count)) { return -1; }
             return count;
         }
 
     protected:
+        // The outputs of the AGCs are used as work buffers
+        void resizeBuffers(int inputSize) {
+            carrierAgc.out.setBufferSize(inputSize);
+            if constexpr (std::is_same_v<T, stereo_t>) {
+                audioAgc.out.setBufferSize(inputSize);
+            }
+            base_type::resizeBuffers(inputSize);
+        }
+
         AGCMode _agcMode;
 
         double _samplerate;
@@ -152,7 +164,7 @@ namespace dsp::demod {
         loop::AGC<complex_t> carrierAgc;
         loop::AGC<float> audioAgc;
         correction::DCBlocker<float> dcBlock;
-        tap<float> lpfTaps;
+        taps::SharedTap<float> lpfTaps;
         filter::FIR<float, float> lpf;
         std::mutex lpfMtx;
 
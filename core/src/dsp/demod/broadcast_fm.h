@@ -1,35 +1,33 @@
 #pragma once
 #include "quadrature.h"
-#include "../taps/low_pass.h"
-#include "../taps/band_pass.h"
+#include "../taps/cache.h"
 #include "../filter/fir.h"
-#include "../loop/pll.h"
-#include "../convert/l_r_to_stereo.h"
-#include "../convert/real_to_complex.h"
-#include "../convert/complex_to_real.h"
-#include "../math/conjugate.h"
-#include "../math/delay.h"
-#include "../math/multiply.h"
-#include "../math/add.h"
-#include "../math/subtract.h"
+#include "../loop/phase_control_loop.h"
+#include "../math/normalize_phase.h"
+#include "../math/hz_to_rads.h"
 #include "../multirate/rational_resampler.h"
 
 namespace dsp::demod {
+    // The whole decoder runs one tile at a time so that the intermediate signals stay in L1 cache. The MPX signal
+    // is only real, so the pilot filter needs two real dot products per sample instead of a complex one, and its
+    // history doubles as the delay line aligning the MPX with the PLL. The L-R and RDS subcarriers are brought
+    // down in the same pass as the PLL using the cosine of twice and three times its phase.
     class BroadcastFM : public Processor<complex_t, stereo_t> {
         using base_type = Processor<complex_t, stereo_t>;
     public:
         BroadcastFM() {}
 
-        BroadcastFM(stream<complex_t>* in, double deviation, double samplerate, bool stereo = true, bool lowPass = true, bool rdsOut = false) { init(in, deviation, samplerate, stereo, lowPass); }
+        BroadcastFM(stream<complex_t>* in, double deviation, double samplerate, bool stereo = true, bool lowPass = true, bool rdsOut = false) { init(in, deviation, samplerate, stereo, lowPass, rdsOut); }
 
         ~BroadcastFM() {
             if (!base_type::_block_init) { return; }
             base_type::stop();
-            buffer::free(lmr);
-            buffer::free(l);
-            buffer::free(r);
-            taps::free(pilotFirTaps);
-            taps::free(audioFirTaps);
+            buffer::free(mpx);
+            buffer::free(pilotTapsRe);
+            buffer::free(pilotTapsIm);
+            buffer::free(pilot);
+            buffer::free(mono);
+            buffer::free(rds);
         }
 
         virtual void init(stream<complex_t>* in, double deviation, double samplerate, bool stereo = true, bool lowPass = true, bool rdsOut = false) {
@@ -38,27 +36,21 @@ namespace dsp::demod {
             _stereo = stereo;
             _lowPass = lowPass;
             _rdsOut = rdsOut;
-            
+
             demod.init(NULL, _deviation, _samplerate);
-            pilotFirTaps = taps::bandPass<complex_t>(18750.0, 19250.0, 3000.0, _samplerate, true);
-            pilotFir.init(NULL, pilotFirTaps);
-            rtoc.init(NULL);
-            pilotPLL.init(NULL, 25000.0 / _samplerate, 0.0, math::hzToRads(19000.0, _samplerate), math::hzToRads(18750.0, _samplerate), math::hzToRads(19250.0, _samplerate));
-            lprDelay.init(NULL, ((pilotFirTaps.size - 1) / 2) + 1);
-            lmrDelay.init(NULL, ((pilotFirTaps.size - 1) / 2) + 1);
-            audioFirTaps = taps::lowPass(15000.0, 4000.0, _samplerate);
-            alFir.init(NULL, audioFirTaps);
-            arFir.init(NULL, audioFirTaps);
+            updatePilot();
+            audioFirTaps = taps::cache::lowPass(15000.0, 4000.0, _samplerate);
+            monoFir.init(NULL, *audioFirTaps);
+            stereoFir.init(NULL, *audioFirTaps);
             rdsResamp.init(NULL, samplerate, 5000.0);
 
-            lmr = buffer::alloc<float>(STREAM_BUFFER_SIZE);
-            l = buffer::alloc<float>(STREAM_BUFFER_SIZE);
-            r = buffer::alloc<float>(STREAM_BUFFER_SIZE);
+            pilot = buffer::alloc<complex_t>(TILE_SIZE);
+            mono = buffer::alloc<float>(TILE_SIZE);
+            rds = buffer::alloc<float>(TILE_SIZE);
 
-            lprDelay.out.free();
-            lmrDelay.out.free();
-            arFir.out.free();
-            alFir.out.free();
+            demod.out.free();
+            monoFir.out.free();
+            stereoFir.out.free();
             rdsResamp.out.free();
 
             base_type::init(in);
@@ -78,19 +70,11 @@ namespace dsp::demod {
             _samplerate = samplerate;
 
             demod.setDeviation(_deviation, _samplerate);
-            taps::free(pilotFirTaps);
-            pilotFirTaps = taps::bandPass<complex_t>(18750.0, 19250.0, 3000.0, samplerate, true);
-            pilotFir.setTaps(pilotFirTaps);
-            
-            pilotPLL.setFrequencyLimits(math::hzToRads(18750.0, _samplerate), math::hzToRads(19250.0, _samplerate));
-            pilotPLL.setInitialFreq(math::hzToRads(19000.0, _samplerate));
-            lprDelay.setDelay(((pilotFirTaps.size - 1) / 2) + 1);
-            lmrDelay.setDelay(((pilotFirTaps.size - 1) / 2) + 1);
-
-            taps::free(audioFirTaps);
-            audioFirTaps = taps::lowPass(15000.0, 4000.0, _samplerate);
-            alFir.setTaps(audioFirTaps);
-            arFir.setTaps(audioFirTaps);
+            updatePilot();
+
+            audioFirTaps = taps::cache::lowPass(15000.0, 4000.0, _samplerate);
+            monoFir.setTaps(*audioFirTaps);
+            stereoFir.setTaps(*audioFirTaps);
 
             rdsResamp.setInSamplerate(samplerate);
 
@@ -130,108 +114,78 @@ namespace dsp::demod {
             std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
             base_type::tempStop();
             demod.reset();
-            pilotFir.reset();
-            pilotPLL.reset();
-            lprDelay.reset();
-            lmrDelay.reset();
-            alFir.reset();
-            arFir.reset();
+            buffer::clear(mpx, historySize);
+            pilotPCL.phase = 0.0f;
+            pilotPCL.freq = math::hzToRads(19000.0, _samplerate);
+            monoFir.reset();
+            stereoFir.reset();
+            rdsResamp.reset();
             base_type::tempStart();
         }
 
         inline int process(int count, complex_t* in, stereo_t* out, int& rdsOutCount, float* rdsout = NULL) {
-            // Demodulate
-            demod.process(count, in, demod.out.writeBuf);
-            if (_stereo) {
-                // Convert to complex
-                rtoc.process(count, demod.out.writeBuf, rtoc.out.writeBuf);
-
-                // Filter out pilot and run through PLL
-                pilotFir.process(count, rtoc.out.writeBuf, pilotFir.out.writeBuf);
-                pilotPLL.process(count, pilotFir.out.writeBuf, pilotPLL.out.writeBuf);
-
-                // Delay
-                lprDelay.process(count, demod.out.writeBuf, demod.out.writeBuf);
-                lmrDelay.process(count, rtoc.out.writeBuf, rtoc.out.writeBuf);
-                
-                // conjugate PLL output to down convert twice the L-R signal
-                math::Conjugate::process(count, pilotPLL.out.writeBuf, pilotPLL.out.writeBuf);
-                math::Multiply<dsp::complex_t>::process(count, rtoc.out.writeBuf, pilotPLL.out.writeBuf, rtoc.out.writeBuf);
-                math::Multiply<dsp::complex_t>::process(count, rtoc.out.writeBuf, pilotPLL.out.writeBuf, rtoc.out.writeBuf);
-
-                // Do RDS demod
-                if (_rdsOut) {
-                    // Since the PLL output is no longer needed after this, use it as the output
-                    math::Multiply<dsp::complex_t>::process(count, rtoc.out.writeBuf, pilotPLL.out.writeBuf, pilotPLL.out.writeBuf);
-                    convert::ComplexToReal::process(count, pilotPLL.out.writeBuf, rdsout);
-                    volk_32f_s32f_multiply_32f(rdsout, rdsout, 100.0, count);
-                    rdsOutCount = rdsResamp.process(count, rdsout, rdsout);
-                }
+            bool usePilot = _stereo || _rdsOut;
+            rdsOutCount = 0;
 
-                // Convert output back to real for further processing
-                convert::ComplexToReal::process(count, rtoc.out.writeBuf, lmr);
+            for (int i = 0; i < count; i += TILE_SIZE) {
+                int tileSize = std::min<int>(TILE_SIZE, count - i);
 
-                // Amplify by 2x
-                volk_32f_s32f_multiply_32f(lmr, lmr, 2.0f, count);
+                // Demodulate after the history of the pilot filter
+                demod.process(tileSize, &in[i], &mpx[historySize]);
 
-                // Do L = (L+R) + (L-R), R = (L+R) - (L-R)
-                math::Add<float>::process(count, demod.out.writeBuf, lmr, l);
-                math::Subtract<float>::process(count, demod.out.writeBuf, lmr, r);
+                // The L+R signal is delayed to line up with the output of the PLL
+                const float* lpr = usePilot ? &mpx[historySize - pilotDelay] : &mpx[historySize];
 
-                // Filter if needed
-                if (_lowPass) {
-                    alFir.process(count, l, l);
-                    arFir.process(count, r, r);
-                }
+                if (usePilot) {
+                    // Filter out the pilot
+                    for (int j = 0; j < tileSize; j++) {
+                        volk_32f_x2_dot_prod_32f(&pilot[j].re, &mpx[j], pilotTapsRe, pilotFirTaps->size);
+                        volk_32f_x2_dot_prod_32f(&pilot[j].im, &mpx[j], pilotTapsIm, pilotFirTaps->size);
+                    }
 
-                // Interleave into stereo
-                convert::LRToStereo::process(count, l, r, out);
-            }
-            else {
-                // Process RDS if needed. Note: find a way to not have to copy half the code from the stereo demod
-                if (_rdsOut) {
-                    // Convert to complex
-                    rtoc.process(count, demod.out.writeBuf, rtoc.out.writeBuf);
-
-                    // Filter out pilot and run through PLL
-                    pilotFir.process(count, rtoc.out.writeBuf, pilotFir.out.writeBuf);
-                    pilotPLL.process(count, pilotFir.out.writeBuf, pilotPLL.out.writeBuf);
-
-                    // Delay
-                    lprDelay.process(count, demod.out.writeBuf, demod.out.writeBuf);
-                    lmrDelay.process(count, rtoc.out.writeBuf, rtoc.out.writeBuf);
-                    
-                    // conjugate PLL output to down convert twice the L-R signal
-                    math::Conjugate::process(count, pilotPLL.out.writeBuf, pilotPLL.out.writeBuf);
-                    math::Multiply<dsp::complex_t>::process(count, rtoc.out.writeBuf, pilotPLL.out.writeBuf, rtoc.out.writeBuf);
-                    math::Multiply<dsp::complex_t>::process(count, rtoc.out.writeBuf, pilotPLL.out.writeBuf, rtoc.out.writeBuf);
-
-                    // Since the PLL output is no longer needed after this, use it as the output
-                    math::Multiply<dsp::complex_t>::process(count, rtoc.out.writeBuf, pilotPLL.out.writeBuf, pilotPLL.out.writeBuf);
-                    convert::ComplexToReal::process(count, pilotPLL.out.writeBuf, rdsout);
-                    volk_32f_s32f_multiply_32f(rdsout, rdsout, 100.0, count);
-                    rdsOutCount = rdsResamp.process(count, rdsout, rdsout);
+                    // Run the PLL and mix the subcarriers down
+                    if (_stereo && _rdsOut) { mix<true, true>(tileSize, lpr, &out[i]); }
+                    else if (_stereo) { mix<true, false>(tileSize, lpr, &out[i]); }
+                    else { mix<false, true>(tileSize, lpr, &out[i]); }
+
+                    if (_rdsOut) {
+                        rdsOutCount += rdsResamp.process(tileSize, rds, &rdsout[rdsOutCount]);
+                    }
                 }
 
-                // Filter if needed
-                if (_lowPass) {
-                    alFir.process(count, demod.out.writeBuf, demod.out.writeBuf);
+                if (_stereo) {
+                    // Filter both channels at once
+                    if (_lowPass) { stereoFir.process(tileSize, &out[i], &out[i]); }
+                }
+                else {
+                    // Filter if needed and output the raw MPX on both channels
+                    if (_lowPass) {
+                        monoFir.process(tileSize, lpr, mono);
+                        lpr = mono;
+                    }
+                    for (int j = 0; j < tileSize; j++) {
+                        out[i + j].l = lpr[j];
+                        out[i + j].r = lpr[j];
+                    }
                 }
 
-                // Interleave raw MPX to stereo
-                convert::LRToStereo::process(count, demod.out.writeBuf, demod.out.writeBuf, out);
+                // Keep the end of the MPX as history for the next tile
+                memmove(mpx, &mpx[tileSize], historySize * sizeof(float));
             }
 
             return count;
         }
 
+        int outputBufferSize(int inputSize) { return inputSize; }
+
         int run() {
-            int count = base_type::_in->read();
+            int count = base_type::readInput();
             if (count < 0) { return -1; }
 
             int rdsOutCount = 0;
             process(count, base_type::_in->readBuf, base_type::out.writeBuf, rdsOutCount, rdsOut.writeBuf);
 
+            base_type::forwardMetadata(count);
             base_type::_in->flush();
             if (!base_type::out.swap(count)) { return -1; }
             if (rdsOutCount && _rdsOut) {
@@ -243,6 +197,56 @@ namespace dsp::demod {
         stream<float> rdsOut;
 
     protected:
+        void resizeBuffers(int inputSize) {
+            base_type::resizeBuffers(inputSize);
+            rdsOut.setBufferSize(rdsResamp.outputBufferSize(inputSize));
+        }
+
+        // Number of samples demodulated before moving on to the next stage, chosen to stay in L1 cache
+        static const int TILE_SIZE = 1024;
+
+        void updatePilot() {
+            pilotFirTaps = taps::cache::bandPass<complex_t>(18750.0, 19250.0, 3000.0, _samplerate, true);
+            historySize = pilotFirTaps->size - 1;
+            pilotDelay = (historySize / 2) + 1;
+
+            // Split the taps since they're only ever applied to a real signal
+            buffer::reserve(pilotTapsRe, pilotTapsCapacity, pilotFirTaps->size);
+            buffer::reserve(pilotTapsIm, pilotTapsImCapacity, pilotFirTaps->size);
+            for (int i = 0; i < pilotFirTaps->size; i++) {
+                pilotTapsRe[i] = pilotFirTaps->taps[i].re;
+                pilotTapsIm[i] = pilotFirTaps->taps[i].im;
+            }
+            buffer::reserve(mpx, mpxCapacity, historySize + TILE_SIZE);
+            buffer::clear(mpx, historySize);
+
+            float alpha, beta;
+            loop::PhaseControlLoop<float>::criticallyDamped(25000.0 / _samplerate, alpha, beta);
+            pilotPCL.init(alpha, beta, 0.0f, -FL_M_PI, FL_M_PI, math::hzToRads(19000.0, _samplerate), math::hzToRads(18750.0, _samplerate), math::hzToRads(19250.0, _samplerate));
+        }
+
+        template <bool STEREO, bool RDS>
+        inline void mix(int count, const float* lpr, stereo_t* out) {
+            for (int i = 0; i < count; i++) {
+                // Step the PLL, its output lags the pilot by one sample
+                float c = cosf(pilotPCL.phase);
+                float s = sinf(pilotPCL.phase);
+                pilotPCL.advance(math::normalizePhase(pilot[i].phase() - pilotPCL.phase));
+
+                // L-R is on twice the pilot frequency, RDS on three times
+                float c2 = (c * c) - (s * s);
+                if constexpr (STEREO) {
+                    float lmr = 2.0f * lpr[i] * c2;
+                    out[i].l = lpr[i] + lmr;
+                    out[i].r = lpr[i] - lmr;
+                }
+                if constexpr (RDS) {
+                    float c3 = (c2 * c) - (2.0f * c * s * s);
+                    rds[i] = 100.0f * lpr[i] * c3;
+                }
+            }
+        }
+
         double _deviation;
         double _samplerate;
         bool _stereo;
@@ -250,20 +254,24 @@ namespace dsp::demod {
         bool _rdsOut;
 
         Quadrature demod;
-        tap<complex_t> pilotFirTaps;
-        filter::FIR<complex_t, complex_t> pilotFir;
-        convert::RealToComplex rtoc;
-        loop::PLL pilotPLL;
-        math::Delay<float> lprDelay;
-        math::Delay<complex_t> lmrDelay;
-        tap<float> audioFirTaps;
-        filter::FIR<float, float> arFir;
-        filter::FIR<float, float> alFir;
+        taps::SharedTap<complex_t> pilotFirTaps;
+        loop::PhaseControlLoop<float> pilotPCL;
+        taps::SharedTap<float> audioFirTaps;
+        filter::FIR<float, float> monoFir;
+        filter::FIR<stereo_t, float> stereoFir;
         multirate::RationalResampler<float> rdsResamp;
 
-        float* lmr;
-        float* l;
-        float* r;
-        
+        int historySize = 0;
+        int pilotDelay = 0;
+        float* pilotTapsRe = NULL;
+        float* pilotTapsIm = NULL;
+        int pilotTapsCapacity = 0;
+        int pilotTapsImCapacity = 0;
+        float* mpx = NULL;
+        int mpxCapacity = 0;
+        complex_t* pilot = NULL;
+        float* mono = NULL;
+        float* rds = NULL;
+
     };
-}
\ No newline at end of file
+}
@@ -2,9 +2,7 @@
 #include "../processor.h"
 #include "quadrature.h"
 #include "../filter/fir.h"
-#include "../taps/low_pass.h"
-#include "../taps/high_pass.h"
-#include "../taps/band_pass.h"
+#include "../taps/cache.h"
 #include "../convert/mono_to_stereo.h"
 
 namespace dsp::demod {
@@ -19,7 +17,6 @@ namespace dsp::demod {
         ~FM() {
             if (!base_type::_block_init) { return; }
             base_type::stop();
-            dsp::taps::free(filterTaps);
         }
 
         void init(dsp::stream<dsp::complex_t>* in, double samplerate, double bandwidth, bool lowPass, bool highPass) {
@@ -30,7 +27,7 @@ namespace dsp::demod {
 
             demod.init(NULL, bandwidth / 2.0, _samplerate);
             loadDummyTaps();
-            fir.init(NULL, filterTaps);
+            fir.init(NULL, *filterTaps);
 
             // Initialize taps
             updateFilter(lowPass, highPass);
@@ -102,17 +99,41 @@ namespace dsp::demod {
             return count;
         }
 
+        inline int skip(int count) {
+            demod.skip(count);
+            std::lock_guard<std::mutex> lck(filterMtx);
+            fir.skip(count);
+            return count;
+        }
+
+        int outputBufferSize(int inputSize) { return inputSize; }
+
         int run() {
-            int count = base_type::_in->read();
+            int count = base_type::readInput();
             if (count < 0) { return -1; }
 
-            process(count, base_type::_in->readBuf, base_type::out.writeBuf);
+            if (base_type::_in->readIdle) {
+                base_type::outputSilence(skip(count));
+            }
+            else {
+                process(count, base_type::_in->readBuf, base_type::out.writeBuf);
+            }
 
+            base_type::forwardMetadata(count);
             base_type::_in->flush();
             if (!base_type::out.swap(count)) { return -1; }
             return count;
         }
 
+    protected:
+        // The output of the demodulator is used as work buffer when outputting stereo
+        void resizeBuffers(int inputSize) {
+            if constexpr (std::is_same_v<T, stereo_t>) {
+                demod.out.setBufferSize(inputSize);
+            }
+            base_type::resizeBuffers(inputSize);
+        }
+
     private:
         void updateFilter(bool lowPass, bool highPass) {
             std::lock_guard<std::mutex> lck(filterMtx);
@@ -122,31 +143,28 @@ namespace dsp::demod {
             _highPass = highPass;
             filtering = (lowPass || highPass);
 
-            // Free filter taps
-            dsp::taps::free(filterTaps);
-
             // Generate filter depending on low and high pass settings
             if (_lowPass && _highPass) {
-                filterTaps = dsp::taps::bandPass<float>(300.0, _bandwidth / 2.0, 100.0, _samplerate);
+                filterTaps = dsp::taps::cache::bandPass<float>(300.0, _bandwidth / 2.0, 100.0, _samplerate);
             }
             else if (_highPass) {
-                filterTaps = dsp::taps::highPass(300.0, 100.0, _samplerate);
+                filterTaps = dsp::taps::cache::highPass(300.0, 100.0, _samplerate);
             }
             else if (_lowPass) {
-                filterTaps = dsp::taps::lowPass(_bandwidth / 2.0, (_bandwidth / 2.0) * 0.1, _samplerate);
+                filterTaps = dsp::taps::cache::lowPass(_bandwidth / 2.0, (_bandwidth / 2.0) * 0.1, _samplerate);
             }
             else {
                 loadDummyTaps();
             }
 
             // Set filter to use new taps
-            fir.setTaps(filterTaps);
+            fir.setTaps(*filterTaps);
             fir.reset();
         }
 
         void loadDummyTaps() {
-            float dummyTap = 1.0f;
-            filterTaps = dsp::taps::fromArray<float>(1, &dummyTap);
+            static const float dummyTap = 1.0f;
+            filterTaps = dsp::taps::cache::fromArray<float>(1, &dummyTap);
         }
 
         double _samplerate;
@@ -156,7 +174,7 @@ namespace dsp::demod {
         bool filtering;
 
         Quadrature demod;
-        tap<float> filterTaps;
+        taps::SharedTap<float> filterTaps;
         filter::FIR<float, float> fir;
         std::mutex filterMtx;
     };
@@ -91,18 +91,30 @@ namespace dsp::demod {
             return count;
         }
 
+        int outputBufferSize(int inputSize) { return inputSize; }
+
         int run() {
-            int count = base_type::_in->read();
+            int count = base_type::readInput();
             if (count < 0) { return -1; }
 
             process(count, base_type::_in->readBuf, base_type::out.writeBuf);
 
+            base_type::forwardMetadata(count);
             base_type::_in->flush();
             if (!base_type::out.swap(count)) { return -1; }
             return count;
         }
 
     protected:
+        // The outputs of the xlator and AGC are used as work buffers
+        void resizeBuffers(int inputSize) {
+            xlator.out.setBufferSize(inputSize);
+            if constexpr (std::is_same_v<T, stereo_t>) {
+                agc.out.setBufferSize(inputSize);
+            }
+            base_type::resizeBuffers(inputSize);
+        }
+
         double getTranslation() {
             if (_mode == Mode::USB) {
                 return _bandwidth / 2.0;
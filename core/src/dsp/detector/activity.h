@@ -0,0 +1,235 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <math.h>
+#include "../buffer/buffer.h"
+
+namespace dsp::detector {
+    struct ActiveSegment {
+        double lowFrequency;    // Frequency of the first bin above the threshold
+        double highFrequency;   // Frequency of the last bin above the threshold
+        double peakFrequency;   // Frequency of the strongest bin
+        double bandwidth;       // Occupied bandwidth, only counting bins above the threshold
+        float peakLevel;        // Level of the strongest bin in dB
+        float noiseLevel;       // Average noise floor under the segment in dB
+        float snr;              // Peak level above the noise floor in dB
+    };
+
+    struct ActivityReport {
+        bool valid = false;
+        double centerFrequency = 0.0;
+        double samplerate = 0.0;
+        float noiseFloor = -INFINITY;   // Average noise floor across the whole span in dB
+        std::vector<ActiveSegment> segments;
+    };
+
+    // Energy detector working on power spectra in dB, in frequency order (lowest frequency first).
+    // The noise floor of every bin is tracked with minimum statistics: the smoothed level of each bin is
+    // minimised over a sliding window made of a few sub-windows, so that it follows the floor while ignoring
+    // bursts shorter than the window. Bins above the floor by the threshold are grouped into segments.
+    // The noise floor update and the segmentation are done in a single pass over the spectrum.
+    class ActivityDetector {
+    public:
+        ActivityDetector() {}
+
+        ~ActivityDetector() { freeState(); }
+
+        // The window is the number of frames over which the noise floor minimum is taken
+        void init(int windowFrames, float threshold) {
+            _windowFrames = std::max<int>(windowFrames, SUB_WINDOW_COUNT);
+            _threshold = threshold;
+            reset();
+        }
+
+        void setWindow(int windowFrames) {
+            _windowFrames = std::max<int>(windowFrames, SUB_WINDOW_COUNT);
+            reset();
+        }
+
+        // Level above the noise floor in dB for a bin to be considered active
+        void setThreshold(float threshold) { _threshold = threshold; }
+
+        // Active bins separated by at most this many inactive bins are merged into the same segment
+        void setMergeGap(int bins) { _mergeGap = std::max<int>(bins, 0); }
+
+        // Segments narrower than this many active bins are ignored
+        void setMinWidth(int bins) { _minWidth = std::max<int>(bins, 1); }
+
+        // Forget the noise floor, to be called when the spectrum no longer matches the previous ones (retune, etc)
+        void reset() { frameCount = 0; }
+
+        // Noise floor of each bin in dB, valid after the first call to process()
+        const float* getNoiseFloor() { return floor; }
+
+        int getSize() { return size; }
+
+        void process(const float* spectrum, int count, double centerFrequency, double samplerate, ActivityReport& report) {
+            if (count != size) {
+                freeState();
+                size = count;
+                smoothed = buffer::alloc<float>(size);
+                current = buffer::alloc<float>(size);
+                history = buffer::alloc<float>(size * SUB_WINDOW_COUNT);
+                historyMin = buffer::alloc<float>(size);
+                floor = buffer::alloc<float>(size);
+                frameCount = 0;
+            }
+
+            report.valid = true;
+            report.centerFrequency = centerFrequency;
+            report.samplerate = samplerate;
+            report.segments.clear();
+
+            // Start the estimate from the first frame, nothing is active until the floor has settled
+            if (!frameCount) {
+                for (int i = 0; i < size; i++) {
+                    smoothed[i] = spectrum[i];
+                    current[i] = INFINITY;
+                    historyMin[i] = INFINITY;
+                    floor[i] = spectrum[i] + BIAS;
+                }
+                for (int i = 0; i < size * SUB_WINDOW_COUNT; i++) { history[i] = INFINITY; }
+                subFrame = 0;
+                subWindow = 0;
+                floorCap = INFINITY;
+                frameCount = 1;
+                report.noiseFloor = average(floor, size);
+                return;
+            }
+            frameCount++;
+
+            // Average the first frames evenly so that the smoothed level settles quickly, and keep the
+            // noisy levels from before it settled out of the minimum
+            float alpha = std::min<float>(SMOOTHING, 1.0f - (1.0f / (float)frameCount));
+            bool settled = (frameCount > WARMUP_FRAMES);
+
+            double binWidth = samplerate / (double)size;
+            double startFreq = centerFrequency - (samplerate / 2.0);
+            double floorSum = 0.0;
+
+            // Currently open segment
+            int segStart = -1;
+            int segLast = -1;
+            int segActive = 0;
+            int segPeak = 0;
+            double segFloorSum = 0.0;
+
+            for (int i = 0; i < size; i++) {
+                // Update the noise floor
+                smoothed[i] = (alpha * smoothed[i]) + ((1.0f - alpha) * spectrum[i]);
+                if (settled) { current[i] = std::min<float>(current[i], smoothed[i]); }
+                float min = std::min<float>(current[i], historyMin[i]);
+                floor[i] = std::min<float>((min < INFINITY) ? min : smoothed[i], floorCap) + BIAS;
+                floorSum += floor[i];
+
+                // Group active bins into segments. The smoothed level is used to keep false detections down,
+                // bursts far enough above the floor are picked up straight away without waiting for the smoothing.
+                if (smoothed[i] - floor[i] < _threshold && spectrum[i] - floor[i] < _threshold + BURST_MARGIN) {
+                    if (segStart >= 0 && i - segLast > _mergeGap) {
+                        closeSegment(report, segStart, segLast, segActive, segPeak, segFloorSum, spectrum, startFreq, binWidth);
+                        segStart = -1;
+                    }
+                    continue;
+                }
+                if (segStart < 0) {
+                    segStart = i;
+                    segActive = 0;
+                    segPeak = i;
+                    segFloorSum = 0.0;
+                }
+                segLast = i;
+                segActive++;
+                segFloorSum += floor[i];
+                if (spectrum[i] > spectrum[segPeak]) { segPeak = i; }
+            }
+            if (segStart >= 0) {
+                closeSegment(report, segStart, segLast, segActive, segPeak, segFloorSum, spectrum, startFreq, binWidth);
+            }
+            report.noiseFloor = floorSum / (double)size;
+
+            // Roll the sub-window once complete
+            if (settled && ++subFrame >= _windowFrames / SUB_WINDOW_COUNT) {
+                subFrame = 0;
+                float* slot = &history[subWindow * size];
+                memcpy(slot, current, size * sizeof(float));
+                memcpy(current, smoothed, size * sizeof(float));
+                subWindow = (subWindow + 1) % SUB_WINDOW_COUNT;
+
+                // Minimum over the completed sub-windows
+                memcpy(historyMin, history, size * sizeof(float));
+                for (int w = 1; w < SUB_WINDOW_COUNT; w++) {
+                    float* h = &history[w * size];
+                    for (int i = 0; i < size; i++) { historyMin[i] = std::min<float>(historyMin[i], h[i]); }
+                }
+
+                // Signals that stay on for longer than the window end up in the minimum. Limit how far above
+                // the median floor of the span a bin's floor can go so that strong continuous signals stay visible.
+                sorted.assign(historyMin, historyMin + size);
+                std::nth_element(sorted.begin(), sorted.begin() + (size / 2), sorted.end());
+                floorCap = sorted[size / 2] + FLOOR_SPREAD;
+            }
+        }
+
+    private:
+        void closeSegment(ActivityReport& report, int start, int last, int active, int peak, double floorSum, const float* spectrum, double startFreq, double binWidth) {
+            if (active < _minWidth) { return; }
+            ActiveSegment seg;
+            seg.lowFrequency = startFreq + ((double)start + 0.5) * binWidth;
+            seg.highFrequency = startFreq + ((double)last + 0.5) * binWidth;
+            seg.peakFrequency = startFreq + ((double)peak + 0.5) * binWidth;
+            seg.bandwidth = (double)active * binWidth;
+            seg.peakLevel = spectrum[peak];
+            seg.noiseLevel = floorSum / (double)active;
+            seg.snr = seg.peakLevel - seg.noiseLevel;
+            report.segments.push_back(seg);
+        }
+
+        static float average(const float* data, int count) {
+            double sum = 0.0;
+            for (int i = 0; i < count; i++) { sum += data[i]; }
+            return sum / (double)count;
+        }
+
+        void freeState() {
+            if (!size) { return; }
+            buffer::free(smoothed);
+            buffer::free(current);
+            buffer::free(history);
+            buffer::free(historyMin);
+            buffer::free(floor);
+            size = 0;
+        }
+
+        static const int SUB_WINDOW_COUNT = 4;
+
+        // Smoothing of the level of each bin before taking the minimum
+        static constexpr float SMOOTHING = 0.9f;
+        static const int WARMUP_FRAMES = 10;
+
+        // The minimum of the smoothed level sits below the mean noise level, compensate for it
+        static constexpr float BIAS = 3.0f;
+
+        // Maximum height of the noise floor of a bin above the median floor of the span
+        static constexpr float FLOOR_SPREAD = 10.0f;
+
+        // Margin above the threshold for a single frame to be considered active on its own
+        static constexpr float BURST_MARGIN = 12.0f;
+
+        int _windowFrames = 32;
+        float _threshold = 6.0f;
+        int _mergeGap = 1;
+        int _minWidth = 1;
+
+        int size = 0;
+        int frameCount = 0;
+        int subFrame = 0;
+        int subWindow = 0;
+        float* smoothed;
+        float* current;
+        float* history;
+        float* historyMin;
+        float* floor;
+        float floorCap;
+        std::vector<float> sorted;
+    };
+}
\ No newline at end of file
@@ -0,0 +1,245 @@
+#pragma once
+#include <fftw3.h>
+#include <map>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <deque>
+#include <string>
+#include <tuple>
+#include <condition_variable>
+
+namespace dsp::fft {
+    enum Direction {
+        FORWARD = FFTW_FORWARD,
+        BACKWARD = FFTW_BACKWARD
+    };
+
+    namespace planner {
+        // FFTW's planner isn't thread-safe, every call creating or destroying a plan must hold this lock
+        inline std::mutex& plannerMutex() {
+            static std::mutex mtx;
+            return mtx;
+        }
+
+        // Plans released while the planner was busy, they're destroyed by the next one to take the planner lock
+        inline std::mutex& retiredMutex() {
+            static std::mutex mtx;
+            return mtx;
+        }
+        inline std::vector<fftwf_plan>& retiredPlans() {
+            static std::vector<fftwf_plan> plans;
+            return plans;
+        }
+
+        // Must be called with the planner lock held
+        inline void destroyRetired() {
+            std::vector<fftwf_plan> plans;
+            {
+                std::lock_guard<std::mutex> lck(retiredMutex());
+                plans.swap(retiredPlans());
+            }
+            for (auto& plan : plans) { fftwf_destroy_plan(plan); }
+        }
+
+        struct Key {
+            int size;
+            int direction;
+            int alignment;
+            bool inPlace;
+
+            bool operator<(const Key& b) const {
+                return std::tie(size, direction, alignment, inPlace) < std::tie(b.size, b.direction, b.alignment, b.inPlace);
+            }
+        };
+
+        // Destroys the FFTW plan once the last user executing it is done. This happens on the GUI and DSP threads, so
+        // the plan is handed over to whoever holds the planner instead of waiting for it.
+        struct Handle {
+            Handle(fftwf_plan plan, bool measured) : plan(plan), measured(measured) {}
+            ~Handle() {
+                std::unique_lock<std::mutex> lck(plannerMutex(), std::try_to_lock);
+                if (!lck.owns_lock()) {
+                    std::lock_guard<std::mutex> rlck(retiredMutex());
+                    retiredPlans().push_back(plan);
+                    return;
+                }
+                destroyRetired();
+                fftwf_destroy_plan(plan);
+            }
+            const fftwf_plan plan;
+            const bool measured;
+        };
+
+        struct Entry {
+            Key key;
+            std::shared_ptr<Handle> current;
+        };
+    }
+
+    // Shared FFTW plan. Plans are cached by size, direction, alignment and placement, so every user asking for the
+    // same transform gets the same plan and executes it on its own arrays. While a measured plan is being made in the
+    // background, an estimated plan is used and then replaced as soon as the measured one is ready.
+    class Plan {
+    public:
+        Plan() {}
+
+        Plan(std::shared_ptr<planner::Entry> entry) : entry(entry) {}
+
+        // The arrays must have the same alignment as the ones the plan was requested with
+        inline void execute(fftwf_complex* in, fftwf_complex* out) {
+            std::shared_ptr<planner::Handle> handle = std::atomic_load(&entry->current);
+            fftwf_execute_dft(handle->plan, in, out);
+        }
+
+        // Keeps the current plan for a batch of executions without looking it up every time
+        inline std::shared_ptr<planner::Handle> pin() { return std::atomic_load(&entry->current); }
+
+        inline bool valid() { return (bool)entry; }
+
+        inline int size() { return entry->key.size; }
+
+        // True once the plan in use was measured instead of estimated
+        inline bool measured() { return std::atomic_load(&entry->current)->measured; }
+
+        inline void reset() { entry.reset(); }
+
+    private:
+        std::shared_ptr<planner::Entry> entry;
+    };
+
+    namespace planner {
+        class Manager {
+        public:
+            Plan get(int size, Direction direction, fftwf_complex* in, fftwf_complex* out) {
+                Key key = { size, (int)direction, fftwf_alignment_of((float*)in), in == out };
+
+                std::unique_lock<std::mutex> lck(cacheMtx);
+                auto it = entries.find(key);
+                if (it != entries.end()) {
+                    std::shared_ptr<Entry> entry = it->second.lock();
+                    if (entry) { return Plan(entry); }
+                }
+
+                // Use a measured plan straight away if the wisdom has one, otherwise estimate one and measure later
+                std::shared_ptr<Entry> entry(new Entry, [this](Entry* entry) { release(entry); });
+                entry->key = key;
+                {
+                    std::lock_guard<std::mutex> plck(plannerMutex());
+                    destroyRetired();
+                    fftwf_plan plan = fftwf_plan_dft_1d(size, in, out, direction, FFTW_MEASURE | FFTW_WISDOM_ONLY);
+                    bool measured = (plan != NULL);
+                    if (!measured) { plan = fftwf_plan_dft_1d(size, in, out, direction, FFTW_ESTIMATE); }
+                    entry->current = std::make_shared<Handle>(plan, measured);
+                }
+                entries[key] = entry;
+
+                // Only arrays with FFTW's own alignment can be reproduced by the measuring thread
+                if (!entry->current->measured && measuring && key.alignment == 0) {
+                    queue.push_back(key);
+                    if (!workerThread.joinable()) { workerThread = std::thread(&Manager::worker, this); }
+                    lck.unlock();
+                    cnd.notify_all();
+                }
+                return Plan(entry);
+            }
+
+            // Load the wisdom from a file. Measured plans are saved back to it as soon as they're made.
+            bool loadWisdom(const std::string& path) {
+                std::lock_guard<std::mutex> lck(cacheMtx);
+                wisdomPath = path;
+                std::lock_guard<std::mutex> plck(plannerMutex());
+                return fftwf_import_wisdom_from_filename(path.c_str());
+            }
+
+            void setMeasuring(bool enabled) {
+                std::lock_guard<std::mutex> lck(cacheMtx);
+                measuring = enabled;
+                if (!enabled) { queue.clear(); }
+            }
+
+        private:
+            void release(Entry* entry) {
+                {
+                    std::lock_guard<std::mutex> lck(cacheMtx);
+                    auto it = entries.find(entry->key);
+                    if (it != entries.end() && it->second.expired()) { entries.erase(it); }
+                }
+                delete entry;
+            }
+
+            void worker() {
+                std::unique_lock<std::mutex> lck(cacheMtx);
+                while (true) {
+                    cnd.wait(lck, [this]() { return !queue.empty(); });
+                    Key key = queue.front();
+                    queue.pop_front();
+
+                    // Skip plans that were released in the meantime
+                    auto it = entries.find(key);
+                    if (it == entries.end() || it->second.expired()) { continue; }
+                    std::string path = wisdomPath;
+                    lck.unlock();
+
+                    // Measuring overwrites the arrays, so do it on private scratch arrays of the same alignment. Only
+                    // the planner calls are done under the lock. The planner is a single global state in FFTW, so users
+                    // asking for a plan of another size in the meantime wait for the measurement to end. It isn't time
+                    // limited, FFTW falls back to estimating once the limit is hit and the result would be saved to
+                    // the wisdom and used as if it had been measured.
+                    std::shared_ptr<Handle> handle;
+                    fftwf_complex* in = (fftwf_complex*)fftwf_malloc(key.size * sizeof(fftwf_complex));
+                    fftwf_complex* out = key.inPlace ? in : (fftwf_complex*)fftwf_malloc(key.size * sizeof(fftwf_complex));
+                    fftwf_plan plan;
+                    {
+                        std::lock_guard<std::mutex> plck(plannerMutex());
+                        destroyRetired();
+                        plan = fftwf_plan_dft_1d(key.size, in, out, key.direction, FFTW_MEASURE);
+                    }
+                    if (out != in) { fftwf_free(out); }
+                    fftwf_free(in);
+                    if (plan) {
+                        handle = std::make_shared<Handle>(plan, true);
+                        if (!path.empty()) {
+                            std::lock_guard<std::mutex> plck(plannerMutex());
+                            fftwf_export_wisdom_to_filename(path.c_str());
+                        }
+                    }
+
+                    // Hot-swap the plan, users still executing the old one keep it alive until they're done
+                    lck.lock();
+                    it = entries.find(key);
+                    if (!handle || it == entries.end()) { continue; }
+                    std::shared_ptr<Entry> entry = it->second.lock();
+                    if (entry) { std::atomic_store(&entry->current, handle); }
+                    lck.unlock();
+                    handle.reset();
+                    entry.reset();
+                    lck.lock();
+                }
+            }
+
+            std::mutex cacheMtx;
+            std::condition_variable cnd;
+            std::map<Key, std::weak_ptr<Entry>> entries;
+            std::deque<Key> queue;
+            std::thread workerThread;
+            std::string wisdomPath;
+            bool measuring = true;
+        };
+
+        // The manager lives for the whole duration of the program, the measuring thread is never joined
+        inline Manager& manager() {
+            static Manager* mgr = new Manager;
+            return *mgr;
+        }
+
+        inline Plan get(int size, Direction direction, fftwf_complex* in, fftwf_complex* out) {
+            return manager().get(size, direction, in, out);
+        }
+
+        inline bool loadWisdom(const std::string& path) { return manager().loadWisdom(path); }
+
+        inline void setMeasuring(bool enabled) { manager().setMeasuring(enabled); }
+    }
+}
\ No newline at end of file
@@ -12,6 +12,7 @@ namespace dsp::filter {
 
         void init(stream<D>* in, tap<T>& taps, int decimation) {
             _decimation = decimation;
+            base_type::metaRateRatio = 1.0 / (double)_decimation;
             base_type::init(in, taps);
         }
 
@@ -29,6 +30,7 @@ namespace dsp::filter {
             std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
             base_type::tempStop();
             _decimation = decimation;
+            base_type::metaRateRatio = 1.0 / (double)_decimation;
             offset = 0;
             base_type::tempStart();
         }
@@ -44,6 +46,7 @@ namespace dsp::filter {
 
         inline int process(int count, const D* in, D* out) {
             // Copy data to work buffer
+            base_type::reserveBuffer(count);
             memcpy(base_type::bufStart, in, count * sizeof(D));
 
             // Do convolution
@@ -67,11 +70,37 @@ namespace dsp::filter {
             return outCount;
         }
 
+        inline int skip(int count) {
+            // Count the outputs that would have been generated without doing the convolution
+            int outCount = 0;
+            if (offset < count) {
+                outCount = ((count - offset) + _decimation - 1) / _decimation;
+                offset += outCount * _decimation;
+            }
+            offset -= count;
+
+            // Flush the delay buffer so that no stale data is used on the next active buffer
+            buffer::clear<D>(base_type::buffer, base_type::_taps.size - 1);
+
+            return outCount;
+        }
+
+        int outputBufferSize(int inputSize) { return (inputSize / _decimation) + 1; }
+
         int run() {
-            int count = base_type::_in->read();
+            int count = base_type::readInput();
             if (count < 0) { return -1; }
 
-            int outCount = process(count, base_type::_in->readBuf, base_type::out.writeBuf);
+            int outCount;
+            if (base_type::_in->readIdle) {
+                outCount = skip(count);
+                base_type::outputSilence(outCount);
+            }
+            else {
+                outCount = process(count, base_type::_in->readBuf, base_type::out.writeBuf);
+            }
+
+            base_type::forwardMetadata(count, outCount);
 
             // Swap if some data was generated
             base_type::_in->flush();
@@ -1,6 +1,6 @@
 #pragma once
 #include "../processor.h"
-
+#include "iir.h"
 
 namespace dsp::filter {
     template<class T>
@@ -9,21 +9,14 @@ namespace dsp::filter {
     public:
         Deemphasis() {}
 
-        Deemphasis(stream<T>* in, double tau, double samplerate) {}
+        Deemphasis(stream<T>* in, double tau, double samplerate) { init(in, tau, samplerate); }
 
         void init(stream<T>* in, double tau, double samplerate) {
             _tau = tau;
             _samplerate = samplerate;
 
             updateAlpha();
-
-            // Initialize state
-            if constexpr (std::is_same_v<T, float>) {
-                lastOut = 0;
-            }
-            if constexpr (std::is_same_v<T, stereo_t>) {
-                lastOut = { 0, 0 };
-            }
+            section.reset();
 
             base_type::init(in);
         }
@@ -31,72 +24,76 @@ namespace dsp::filter {
         void setTau(double tau) {
             assert(base_type::_block_init);
             std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
             _tau = tau;
             updateAlpha();
+            base_type::tempStart();
         }
 
         void setSamplerate(double samplerate) {
             assert(base_type::_block_init);
             std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
             _samplerate = samplerate;
             updateAlpha();
+            base_type::tempStart();
         }
 
         void reset() {
             assert(base_type::_block_init);
             std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
             base_type::tempStop();
-            if constexpr (std::is_same_v<T, float>) {
-                lastOut = 0;
-            }
-            if constexpr (std::is_same_v<T, stereo_t>) {
-                lastOut = { 0, 0 };
-            }
+            section.reset();
             base_type::tempStart();
         }
 
         inline int process(int count, const T* in, T* out) {
-            if constexpr (std::is_same_v<T, float>) {
-                out[0] = (alpha * in[0]) + ((1 - alpha) * lastOut);
-                for (int i = 1; i < count; i++) {
-                    out[i] = (alpha * in[i]) + ((1 - alpha) * out[i - 1]);
-                }
-                lastOut = out[count - 1];
-            }
-            if constexpr (std::is_same_v<T, stereo_t>) {
-                out[0].l = (alpha * in[0].l) + ((1 - alpha) * lastOut.l);
-                out[0].r = (alpha * in[0].r) + ((1 - alpha) * lastOut.r);
-                for (int i = 1; i < count; i++) {
-                    out[i].l = (alpha * in[i].l) + ((1 - alpha) * out[i - 1].l);
-                    out[i].r = (alpha * in[i].r) + ((1 - alpha) * out[i - 1].r);
-                }
-                lastOut.l = out[count - 1].l;
-                lastOut.r = out[count - 1].r;
-            }
+            // Both channels of stereo are filtered in the same pass
+            section.process(count, (const float*)in, (float*)out);
+            return count;
+        }
+
+        inline int skip(int count) {
+            // The output of the filter decays to zero during silence
+            section.reset();
             return count;
         }
 
         //DEFAULT_PROC_RUN();
 
+        int outputBufferSize(int inputSize) { return inputSize; }
+
         int run() {
-            int count = base_type::_in->read();
+            int count = base_type::readInput();
             if (count < 0) { return -1; }
-            process(count, base_type::_in->readBuf, base_type::out.writeBuf);
+            if (base_type::_in->readIdle) {
+                base_type::outputSilence(skip(count));
+            }
+            else {
+                process(count, base_type::_in->readBuf, base_type::out.writeBuf);
+            }
+            base_type::forwardMetadata(count);
             base_type::_in->flush();
             if (!base_type::out.swap(count)) { return -1; }
             return count;
         }
 
     private:
+        static const int CHANNELS = sizeof(T) / sizeof(float);
+
         void updateAlpha() {
-            float dt = 1.0f / _samplerate;
-            alpha = dt / (_tau + dt);
+            double dt = 1.0 / _samplerate;
+            double alpha = dt / (_tau + dt);
+
+            // y[n] = alpha*x[n] + (1 - alpha)*y[n-1]
+            const double b[2] = { alpha, 0.0 };
+            const double a[1] = { -(1.0 - alpha) };
+            section.design(b, a);
         }
 
         double _tau;
         double _samplerate;
 
-        float alpha;
-        T lastOut;
+        filter::iir::FirstOrder<CHANNELS> section;
     };
 }
\ No newline at end of file
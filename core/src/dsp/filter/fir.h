@@ -20,8 +20,8 @@ namespace dsp::filter {
         virtual void init(stream<D>* in, tap<T>& taps) {
             _taps = taps;
 
-            // Allocate and clear buffer
-            buffer = buffer::alloc<D>(STREAM_BUFFER_SIZE + 64000);
+            // Allocate and clear buffer, it grows with the size of the input buffers
+            buffer::reserve(buffer, bufCapacity, _taps.size - 1);
             bufStart = &buffer[_taps.size - 1];
             buffer::clear<D>(buffer, _taps.size - 1);
 
@@ -37,6 +37,7 @@ namespace dsp::filter {
             _taps = taps;
 
             // Update start of buffer
+            buffer::reserve(buffer, bufCapacity, _taps.size - 1, oldTC - 1);
             bufStart = &buffer[_taps.size - 1];
 
             // Move existing data to make transition seemless
@@ -61,6 +62,7 @@ namespace dsp::filter {
 
         inline int process(int count, const D* in, D* out) {
             // Copy data to work buffer
+            reserveBuffer(count);
             memcpy(bufStart, in, count * sizeof(D));
             
             // Do convolution
@@ -82,20 +84,42 @@ namespace dsp::filter {
             return count;
         }
 
+        inline int skip(int count) {
+            // Flush the delay buffer so that no stale data is used on the next active buffer
+            buffer::clear<D>(buffer, _taps.size - 1);
+            return count;
+        }
+
+        int outputBufferSize(int inputSize) { return inputSize; }
+
         virtual int run() {
-            int count = base_type::_in->read();
+            int count = base_type::readInput();
             if (count < 0) { return -1; }
 
-            process(count, base_type::_in->readBuf, base_type::out.writeBuf);
+            if (base_type::_in->readIdle) {
+                base_type::outputSilence(skip(count));
+            }
+            else {
+                process(count, base_type::_in->readBuf, base_type::out.writeBuf);
+            }
 
+            base_type::forwardMetadata(count);
             base_type::_in->flush();
             if (!base_type::out.swap(count)) { return -1; }
             return count;
         }
 
     protected:
+        // Grow the work buffer if needed to hold the history and count new samples
+        inline void reserveBuffer(int count) {
+            if (count + _taps.size - 1 <= bufCapacity) { return; }
+            buffer::reserve(buffer, bufCapacity, count + _taps.size - 1, _taps.size - 1);
+            bufStart = &buffer[_taps.size - 1];
+        }
+
         tap<T> _taps;
-        D* buffer;
+        D* buffer = NULL;
         D* bufStart;
+        int bufCapacity = 0;
     };
 }
\ No newline at end of file
@@ -0,0 +1,160 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <string.h>
+
+namespace dsp::filter::iir {
+    // Number of times the denominator is squared, outputs then only depend on outputs 2^LOOKAHEAD_STAGES samples back
+    static const int LOOKAHEAD_STAGES = 3;
+    static const int LOOKAHEAD = 1 << LOOKAHEAD_STAGES;
+
+    // Number of samples processed per pass, sized to stay in L1 cache
+    static const int TILE_SIZE = 256;
+
+    // IIR section H(z) = (b0 + b1*z^-1 + ... + bN*z^-N) / (1 + a1*z^-1 + ... + aN*z^-N) for samples made of one
+    // or more interleaved float channels (complex, stereo, etc).
+    // A plain recursion needs the previous output before computing the next one, which makes it as slow as
+    // the latency of a multiply-add per sample. Instead, the numerator and denominator are multiplied by D(-z),
+    // which leaves only even powers in the denominator, and so on LOOKAHEAD_STAGES times (scattered look-ahead).
+    // The filter becomes a few short FIR passes followed by a recursion on outputs LOOKAHEAD samples back, all of
+    // which vectorise across samples and channels. The poles added along the way are cancelled by the added zeros
+    // and lie inside the unit circle, so the section stays stable.
+    template <int ORDER, int CHANNELS = 1>
+    class Section {
+    public:
+        Section() { reset(); }
+
+        // b holds b0 to bN and a holds a1 to aN, a0 being one
+        Section(const double* b, const double* a) {
+            design(b, a);
+            reset();
+        }
+
+        // Not thread-safe against process(), the owning block must be stopped. The history is kept.
+        void design(const double* b, const double* a) {
+            for (int i = 0; i <= ORDER; i++) { taps[0][i] = b[i]; }
+
+            double den[ORDER + 1];
+            den[0] = 1.0;
+            for (int i = 0; i < ORDER; i++) { den[i + 1] = a[i]; }
+
+            for (int s = 0; s < LOOKAHEAD_STAGES; s++) {
+                // Multiply by D(-z), the coefficients of the product only remain on even powers
+                double sq[2 * ORDER + 1] = {};
+                for (int i = 0; i <= ORDER; i++) {
+                    taps[s + 1][i] = (i & 1) ? -den[i] : den[i];
+                    for (int j = 0; j <= ORDER; j++) { sq[i + j] += den[i] * ((j & 1) ? -den[j] : den[j]); }
+                }
+                for (int i = 0; i <= ORDER; i++) { den[i] = sq[2 * i]; }
+            }
+
+            for (int i = 0; i < ORDER; i++) { feedback[i] = -den[i + 1]; }
+        }
+
+        void reset() {
+            memset(hist, 0, sizeof(hist));
+            memset(outHist, 0, sizeof(outHist));
+        }
+
+        // Can be done in place
+        inline void process(int count, const float* in, float* out) {
+            for (int i = 0; i < count; i += TILE_SIZE) {
+                const int len = std::min<int>(count - i, TILE_SIZE) * CHANNELS;
+
+                // FIR passes, the numerator then each factor of the look-ahead, with taps 1, 2, 4... samples apart.
+                // They are kept separate since a pass reading values written just before stalls on store forwarding.
+                memcpy(&bufA[HIST], &in[i * CHANNELS], len * sizeof(float));
+                float* y = firPasses<0>(&bufA[HIST], &bufB[HIST], len);
+
+                // Recursive part, the closest output needed is LOOKAHEAD samples back
+                float f[ORDER];
+                for (int k = 0; k < ORDER; k++) { f[k] = feedback[k]; }
+                memcpy(&y[-HIST], outHist, HIST * sizeof(float));
+                for (int n = 0; n < len; n++) {
+                    float acc = y[n];
+                    for (int k = 0; k < ORDER; k++) { acc += f[k] * y[n - (k + 1) * LOOKAHEAD * CHANNELS]; }
+                    y[n] = acc;
+                }
+                memcpy(outHist, &y[len - HIST], HIST * sizeof(float));
+
+                memcpy(&out[i * CHANNELS], y, len * sizeof(float));
+            }
+        }
+
+    private:
+        // Runs pass S and the following ones, returns the buffer holding the result
+        template <int S>
+        inline float* firPasses(float* src, float* dst, int len) {
+            constexpr int STEP = ((S > 0) ? (1 << (S - 1)) : 1) * CHANNELS;
+            constexpr int HIST_LEN = ORDER * STEP;
+            memcpy(&src[-HIST_LEN], hist[S], HIST_LEN * sizeof(float));
+
+            float t[ORDER + 1];
+            for (int j = 0; j <= ORDER; j++) { t[j] = taps[S][j]; }
+            for (int n = 0; n < len; n++) {
+                float acc = t[0] * src[n];
+                for (int j = 1; j <= ORDER; j++) { acc += t[j] * src[n - j * STEP]; }
+                dst[n] = acc;
+            }
+
+            memcpy(hist[S], &src[len - HIST_LEN], HIST_LEN * sizeof(float));
+            if constexpr (S < LOOKAHEAD_STAGES) { return firPasses<S + 1>(dst, src, len); }
+            return dst;
+        }
+
+        // Longest history, needed by the recursion
+        static const int HIST = ORDER * LOOKAHEAD * CHANNELS;
+
+        // Stage 0 is the numerator, the others the factors of the look-ahead
+        float taps[LOOKAHEAD_STAGES + 1][ORDER + 1] = {};
+        float feedback[ORDER] = {};
+
+        // Inputs of each pass and outputs kept from one tile to the next
+        float hist[LOOKAHEAD_STAGES + 1][HIST];
+        float outHist[HIST];
+
+        // Work buffers, with room for the history in front of the tile
+        float bufA[HIST + TILE_SIZE * CHANNELS];
+        float bufB[HIST + TILE_SIZE * CHANNELS];
+    };
+
+    template <int CHANNELS = 1>
+    using FirstOrder = Section<1, CHANNELS>;
+
+    template <int CHANNELS = 1>
+    using Biquad = Section<2, CHANNELS>;
+
+    // Biquads applied one after the other
+    template <int CHANNELS>
+    class BiquadCascade {
+    public:
+        void addSection(const double* b, const double* a) {
+            sections.push_back(Biquad<CHANNELS>(b, a));
+        }
+
+        void clear() {
+            sections.clear();
+        }
+
+        void reset() {
+            for (auto& s : sections) { s.reset(); }
+        }
+
+        inline int sectionCount() { return sections.size(); }
+
+        // Can be done in place
+        inline void process(int count, const float* in, float* out) {
+            if (sections.empty()) {
+                if (in != out) { memcpy(out, in, count * CHANNELS * sizeof(float)); }
+                return;
+            }
+            sections[0].process(count, in, out);
+            for (int i = 1; i < sections.size(); i++) {
+                sections[i].process(count, out, out);
+            }
+        }
+
+    private:
+        std::vector<Biquad<CHANNELS>> sections;
+    };
+}
@@ -19,7 +19,7 @@ namespace dsp::math {
         void init(stream<T>* in, int delay) {
             _delay = delay;
 
-            buffer = buffer::alloc<T>(STREAM_BUFFER_SIZE + 64000);
+            buffer::reserve(buffer, bufCapacity, _delay);
             bufStart = &buffer[_delay];
             buffer::clear(buffer, _delay);
 
@@ -31,6 +31,7 @@ namespace dsp::math {
             std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
             base_type::tempStop();
             _delay = delay;
+            buffer::reserve(buffer, bufCapacity, _delay);
             bufStart = &buffer[_delay];
             reset();
             base_type::tempStart();
@@ -45,7 +46,11 @@ namespace dsp::math {
         }
 
         inline int process(int count, const T* in, T* out) {
-            // Copy data into delay buffer
+            // Copy data into delay buffer, growing it if needed
+            if (count + _delay > bufCapacity) {
+                buffer::reserve(buffer, bufCapacity, count + _delay, _delay);
+                bufStart = &buffer[_delay];
+            }
             memcpy(bufStart, in, count * sizeof(T));
 
             // Copy data out of the delay buffer
@@ -57,12 +62,15 @@ namespace dsp::math {
             return count;
         }
 
+        int outputBufferSize(int inputSize) { return inputSize; }
+
         virtual int run() {
-            int count = base_type::_in->read();
+            int count = base_type::readInput();
             if (count < 0) { return -1; }
 
             process(count, base_type::_in->readBuf, base_type::out.writeBuf);
 
+            base_type::forwardMetadata(count);
             base_type::_in->flush();
             if (!base_type::out.swap(count)) { return -1; }
             return count;
@@ -70,7 +78,8 @@ namespace dsp::math {
 
     private:
         int _delay;
-        T* buffer;
+        T* buffer = NULL;
         T* bufStart;
+        int bufCapacity = 0;
     };
 }
\ No newline at end of file
@@ -0,0 +1,167 @@
+#pragma once
+#include <math.h>
+#include "../processor.h"
+#include "polyphase_bank_cache.h"
+
+namespace dsp::multirate {
+    // Arbitrary ratio resampler using a polyphase bank with a fixed number of phases.
+    // The output is linearly interpolated between the two closest phases.
+    template<class T>
+    class FractionalResampler : public Processor<T, T> {
+        using base_type = Processor<T, T>;
+    public:
+        FractionalResampler() {}
+
+        FractionalResampler(stream<T>* in, double step, SharedPolyphaseBank bank) { init(in, step, bank); }
+
+        ~FractionalResampler() {
+            if (!base_type::_block_init) { return; }
+            base_type::stop();
+            buffer::free(buffer);
+        }
+
+        void init(stream<T>* in, double step, SharedPolyphaseBank bank) {
+            _step = step;
+            base_type::metaRateRatio = 1.0 / _step;
+            phases = bank;
+
+            // Allocate delay buffer, it grows with the size of the input buffers
+            buffer::reserve(buffer, bufCapacity, phases->tapsPerPhase);
+            bufStart = &buffer[phases->tapsPerPhase];
+            buffer::clear<T>(buffer, phases->tapsPerPhase);
+
+            base_type::init(in);
+        }
+
+        // Step is the number of input samples per output sample
+        void setStep(double step, SharedPolyphaseBank bank) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+
+            // Update settings
+            _step = step;
+            base_type::metaRateRatio = 1.0 / _step;
+            phases = bank;
+
+            // Reset buffer
+            buffer::reserve(buffer, bufCapacity, phases->tapsPerPhase);
+            bufStart = &buffer[phases->tapsPerPhase];
+            reset();
+
+            base_type::tempStart();
+        }
+
+        void reset() {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            buffer::clear<T>(buffer, phases->tapsPerPhase);
+            mu = 0.0;
+            offset = 0;
+            base_type::tempStart();
+        }
+
+        inline int process(int count, const T* in, T* out) {
+            int outCount = 0;
+            int phaseCount = phases->phaseCount;
+            int tapsPerPhase = phases->tapsPerPhase;
+
+            // Copy input to buffer. The interpolation reads one sample past the window of the current phase, so one
+            // more sample of history is kept and the newest input sample is held back until the next buffer.
+            if (count + tapsPerPhase > bufCapacity) {
+                buffer::reserve(buffer, bufCapacity, count + tapsPerPhase, tapsPerPhase);
+                bufStart = &buffer[tapsPerPhase];
+            }
+            memcpy(bufStart, in, count * sizeof(T));
+
+            while (offset < count) {
+                // Find the two closest phases
+                float fphase = (float)(mu * (double)phaseCount);
+                int phase = std::clamp<int>(fphase, 0, phaseCount - 1);
+                float frac = fphase - (float)phase;
+
+                // The phase after the last one is the first phase of the next input sample
+                const float* nextTaps = phases->phases[(phase + 1) % phaseCount];
+                const T* nextBuf = (phase + 1 < phaseCount) ? &buffer[offset] : &buffer[offset + 1];
+
+                // Do both convolutions and interpolate between them
+                T a, b;
+                if constexpr (std::is_same_v<T, float>) {
+                    volk_32f_x2_dot_prod_32f(&a, &buffer[offset], phases->phases[phase], tapsPerPhase);
+                    volk_32f_x2_dot_prod_32f(&b, nextBuf, nextTaps, tapsPerPhase);
+                }
+                if constexpr (std::is_same_v<T, complex_t> || std::is_same_v<T, stereo_t>) {
+                    volk_32fc_32f_dot_prod_32fc((lv_32fc_t*)&a, (lv_32fc_t*)&buffer[offset], phases->phases[phase], tapsPerPhase);
+                    volk_32fc_32f_dot_prod_32fc((lv_32fc_t*)&b, (lv_32fc_t*)nextBuf, nextTaps, tapsPerPhase);
+                }
+                out[outCount++] = a + ((b - a) * frac);
+
+                // Advance fractional position
+                mu += _step;
+                double delta = floor(mu);
+                offset += (int)delta;
+                mu -= delta;
+            }
+            offset -= count;
+
+            // Move delay
+            memmove(buffer, &buffer[count], tapsPerPhase * sizeof(T));
+
+            return outCount;
+        }
+
+        inline int skip(int count) {
+            // Advance the fractional position without doing the convolutions
+            int outCount = 0;
+            while (offset < count) {
+                outCount++;
+                mu += _step;
+                double delta = floor(mu);
+                offset += (int)delta;
+                mu -= delta;
+            }
+            offset -= count;
+
+            // Flush the delay buffer so that no stale data is used on the next active buffer
+            buffer::clear<T>(buffer, phases->tapsPerPhase);
+
+            return outCount;
+        }
+
+        int outputBufferSize(int inputSize) { return (int)ceil((double)inputSize / _step) + 2; }
+
+        int run() {
+            int count = base_type::readInput();
+            if (count < 0) { return -1; }
+
+            int outCount;
+            if (base_type::_in->readIdle) {
+                outCount = skip(count);
+                base_type::outputSilence(outCount);
+            }
+            else {
+                outCount = process(count, base_type::_in->readBuf, base_type::out.writeBuf);
+            }
+
+            base_type::forwardMetadata(count, outCount);
+
+            // Swap if some data was generated
+            base_type::_in->flush();
+            if (outCount) {
+                if (!base_type::out.swap(outCount)) { return -1; }
+            }
+            return outCount;
+        }
+
+    protected:
+        double _step;
+        SharedPolyphaseBank phases;
+        double mu = 0.0;
+        int offset = 0;
+        T* buffer = NULL;
+        T* bufStart;
+        int bufCapacity = 0;
+
+    };
+}
\ No newline at end of file
@@ -0,0 +1,36 @@
+#pragma once
+#include <memory>
+#include "polyphase_bank.h"
+#include "../taps/cache.h"
+
+namespace dsp::multirate {
+    typedef std::shared_ptr<const PolyphaseBank<float>> SharedPolyphaseBank;
+
+    inline SharedPolyphaseBank makeSharedPolyphaseBank(int phaseCount, tap<float>& taps) {
+        PolyphaseBank<float>* bank = new PolyphaseBank<float>;
+        *bank = buildPolyphaseBank<float>(phaseCount, taps);
+        return SharedPolyphaseBank(bank, [](const PolyphaseBank<float>* bank) {
+            PolyphaseBank<float>* _bank = (PolyphaseBank<float>*)bank;
+            freePolyphaseBank(*_bank);
+            delete _bank;
+        });
+    }
+
+    namespace bank_cache {
+        // Returns a low-pass interpolation bank with the given number of phases. The cutoff and transition width
+        // are relative to the input samplerate of the bank. Banks are shared by everyone requesting the same
+        // parameters and are freed once the last user releases them.
+        inline SharedPolyphaseBank lowPass(int phaseCount, double cutoff, double transWidth) {
+            static taps::cache::SharedCache<const PolyphaseBank<float>> banks;
+            taps::cache::Key key = { "lowPassBank", { (double)phaseCount, cutoff, transWidth } };
+            return banks.get(key, [=]() {
+                // Design the prototype filter at the interpolated rate and compensate for the interpolation loss
+                tap<float> lp = taps::lowPass(cutoff, transWidth, phaseCount);
+                for (int i = 0; i < lp.size; i++) { lp.taps[i] *= (float)phaseCount; }
+                SharedPolyphaseBank bank = makeSharedPolyphaseBank(phaseCount, lp);
+                taps::free(lp);
+                return bank;
+            });
+        }
+    }
+}
\ No newline at end of file
@@ -1,7 +1,7 @@
 #pragma once
 #include "../processor.h"
 #include "../taps/tap.h"
-#include "polyphase_bank.h"
+#include "polyphase_bank_cache.h"
 
 namespace dsp::multirate {
     template<class T>
@@ -12,45 +12,52 @@ namespace dsp::multirate {
 
         PolyphaseResampler(stream<T>* in, int interp, int decim, tap<float> taps) { init(in, interp, decim, taps); }
 
+        PolyphaseResampler(stream<T>* in, int interp, int decim, SharedPolyphaseBank bank) { init(in, interp, decim, bank); }
+
         ~PolyphaseResampler() {
             if (!base_type::_block_init) { return; }
             base_type::stop();
             buffer::free(buffer);
-            freePolyphaseBank(phases);
         }
 
         void init(stream<T>* in, int interp, int decim, tap<float> taps) {
+            init(in, interp, decim, makeSharedPolyphaseBank(interp, taps));
+        }
+
+        void init(stream<T>* in, int interp, int decim, SharedPolyphaseBank bank) {
+            assert(bank->phaseCount == interp);
             _interp = interp;
             _decim = decim;
-            _taps = taps;
+            base_type::metaRateRatio = (double)_interp / (double)_decim;
+            phases = bank;
 
-            // Build filter bank
-            phases = buildPolyphaseBank(_interp, _taps);
-
-            // Allocate delay buffer
-            buffer = buffer::alloc<T>(STREAM_BUFFER_SIZE + 64000);
-            bufStart = &buffer[phases.tapsPerPhase - 1];
-            buffer::clear<T>(buffer, phases.tapsPerPhase - 1);
+            // Allocate delay buffer, it grows with the size of the input buffers
+            buffer::reserve(buffer, bufCapacity, phases->tapsPerPhase - 1);
+            bufStart = &buffer[phases->tapsPerPhase - 1];
+            buffer::clear<T>(buffer, phases->tapsPerPhase - 1);
 
             base_type::init(in);
         }
 
         void setRatio(int interp, int decim, tap<float>& taps) {
+            setRatio(interp, decim, makeSharedPolyphaseBank(interp, taps));
+        }
+
+        void setRatio(int interp, int decim, SharedPolyphaseBank bank) {
             assert(base_type::_block_init);
+            assert(bank->phaseCount == interp);
             std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
             base_type::tempStop();
 
             // Update settings
             _interp = interp;
             _decim = decim;
-            _taps = taps;
-
-            // Re-generate polyphase bank
-            freePolyphaseBank(phases);
-            phases = buildPolyphaseBank(_interp, _taps);
+            base_type::metaRateRatio = (double)_interp / (double)_decim;
+            phases = bank;
 
             // Reset buffer
-            bufStart = &buffer[phases.tapsPerPhase - 1];
+            buffer::reserve(buffer, bufCapacity, phases->tapsPerPhase - 1);
+            bufStart = &buffer[phases->tapsPerPhase - 1];
             reset();
 
             base_type::tempStart();
@@ -60,7 +67,7 @@ namespace dsp::multirate {
             assert(base_type::_block_init);
             std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
             base_type::tempStop();
-            buffer::clear<T>(buffer, phases.tapsPerPhase - 1);
+            buffer::clear<T>(buffer, phases->tapsPerPhase - 1);
             phase = 0;
             offset = 0;
             base_type::tempStart();
@@ -70,15 +77,19 @@ namespace dsp::multirate {
             int outCount = 0;
 
             // Copy input to buffer
+            if (count + phases->tapsPerPhase - 1 > bufCapacity) {
+                buffer::reserve(buffer, bufCapacity, count + phases->tapsPerPhase - 1, phases->tapsPerPhase - 1);
+                bufStart = &buffer[phases->tapsPerPhase - 1];
+            }
             memcpy(bufStart, in, count * sizeof(T));
 
             while (offset < count) {
                 // Do convolution
                 if constexpr (std::is_same_v<T, float>) {
-                    volk_32f_x2_dot_prod_32f(&out[outCount++], &buffer[offset], phases.phases[phase], phases.tapsPerPhase);
+                    volk_32f_x2_dot_prod_32f(&out[outCount++], &buffer[offset], phases->phases[phase], phases->tapsPerPhase);
                 }
                 if constexpr (std::is_same_v<T, complex_t> || std::is_same_v<T, stereo_t>) {
-                    volk_32fc_32f_dot_prod_32fc((lv_32fc_t*)&out[outCount++], (lv_32fc_t*)&buffer[offset], phases.phases[phase], phases.tapsPerPhase);
+                    volk_32fc_32f_dot_prod_32fc((lv_32fc_t*)&out[outCount++], (lv_32fc_t*)&buffer[offset], phases->phases[phase], phases->tapsPerPhase);
                 }
 
                 // Increment phase
@@ -93,16 +104,44 @@ namespace dsp::multirate {
             offset -= count;
 
             // Move delay
-            memmove(buffer, &buffer[count], (phases.tapsPerPhase - 1) * sizeof(T));
+            memmove(buffer, &buffer[count], (phases->tapsPerPhase - 1) * sizeof(T));
+
+            return outCount;
+        }
+
+        inline int skip(int count) {
+            // Advance the phase without doing the convolutions
+            int outCount = 0;
+            while (offset < count) {
+                outCount++;
+                phase += _decim;
+                offset += phase / _interp;
+                phase = phase % _interp;
+            }
+            offset -= count;
+
+            // Flush the delay buffer so that no stale data is used on the next active buffer
+            buffer::clear<T>(buffer, phases->tapsPerPhase - 1);
 
             return outCount;
         }
 
+        int outputBufferSize(int inputSize) { return (int)(((int64_t)inputSize * _interp) / _decim) + 2; }
+
         int run() {
-            int count = base_type::_in->read();
+            int count = base_type::readInput();
             if (count < 0) { return -1; }
 
-            int outCount = process(count, base_type::_in->readBuf, base_type::out.writeBuf);
+            int outCount;
+            if (base_type::_in->readIdle) {
+                outCount = skip(count);
+                base_type::outputSilence(outCount);
+            }
+            else {
+                outCount = process(count, base_type::_in->readBuf, base_type::out.writeBuf);
+            }
+
+            base_type::forwardMetadata(count, outCount);
 
             // Swap if some data was generated
             base_type::_in->flush();
@@ -115,12 +154,12 @@ namespace dsp::multirate {
     protected:
         int _interp;
         int _decim;
-        tap<float> _taps;
-        PolyphaseBank<float> phases;
+        SharedPolyphaseBank phases;
         int phase = 0;
         int offset = 0;
-        T* buffer;
+        T* buffer = NULL;
         T* bufStart;
+        int bufCapacity = 0;
 
     };
 }
\ No newline at end of file
@@ -1,6 +1,6 @@
 #pragma once
 #include "../filter/decimating_fir.h"
-#include "../taps/from_array.h"
+#include "../taps/cache.h"
 #include "decim/plans.h"
 
 namespace dsp::multirate {
@@ -66,11 +66,34 @@ namespace dsp::multirate {
             return count;
         }
 
+        inline int skip(int count) {
+            if (_ratio == 1) { return count; }
+            for (int i = 0; i < stageCount; i++) {
+                count = decimFirs[i]->skip(count);
+            }
+            return count;
+        }
+
+        // The first stage writes the most to the output buffer
+        int outputBufferSize(int inputSize) {
+            if (_ratio == 1) { return inputSize; }
+            return decimFirs[0]->outputBufferSize(inputSize);
+        }
+
         int run() {
-            int count = base_type::_in->read();
+            int count = base_type::readInput();
             if (count < 0) { return -1; }
 
-            int outCount = process(count, base_type::_in->readBuf, base_type::out.writeBuf);
+            int outCount;
+            if (base_type::_in->readIdle) {
+                outCount = skip(count);
+                base_type::outputSilence(outCount);
+            }
+            else {
+                outCount = process(count, base_type::_in->readBuf, base_type::out.writeBuf);
+            }
+
+            base_type::forwardMetadata(count, outCount);
 
             // Swap if some data was generated
             base_type::_in->flush();
@@ -83,12 +106,13 @@ namespace dsp::multirate {
     protected:
         void freeFirs() {
             for (auto& fir : decimFirs) { delete fir; }
-            for (auto& taps : decimTaps) { taps::free(taps); }
             decimFirs.clear();
             decimTaps.clear();
         }
 
         void reconfigure() {
+            base_type::metaRateRatio = 1.0 / (double)_ratio;
+
             // Delete DDC FIRs and taps
             freeFirs();
 
@@ -98,8 +122,8 @@ namespace dsp::multirate {
                 decim::plan plan = decim::plans[planId];
                 stageCount = plan.stageCount;
                 for (int i = 0; i < stageCount; i++) {
-                    tap<float> taps = taps::fromArray<float>(plan.stages[i].tapcount, plan.stages[i].taps);
-                    auto fir = new filter::DecimatingFIR<T, float>(NULL, taps, plan.stages[i].decimation);
+                    taps::SharedTap<float> taps = taps::cache::fromArray<float>(plan.stages[i].tapcount, plan.stages[i].taps);
+                    auto fir = new filter::DecimatingFIR<T, float>(NULL, *taps, plan.stages[i].decimation);
                     fir->out.free();
                     decimTaps.push_back(taps);
                     decimFirs.push_back(fir);
@@ -113,7 +137,7 @@ namespace dsp::multirate {
         }
 
         std::vector<filter::DecimatingFIR<T, float>*> decimFirs;
-        std::vector<tap<float>> decimTaps;
+        std::vector<taps::SharedTap<float>> decimTaps;
         unsigned int _ratio;
         int stageCount;
     };
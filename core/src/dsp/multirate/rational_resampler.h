@@ -5,8 +5,9 @@
 #include "../filter/decimating_fir.h"
 #include "../taps/from_array.h"
 #include "polyphase_resampler.h"
+#include "fractional_resampler.h"
+#include "polyphase_bank_cache.h"
 #include "power_decimator.h"
-#include "../taps/low_pass.h"
 #include "../window/nuttall.h"
 
 namespace dsp::multirate {
@@ -18,23 +19,19 @@ namespace dsp::multirate {
 
         RationalResampler(stream<T>* in, double inSamplerate, double outSamplerate) { init(in, inSamplerate, outSamplerate); }
 
-        ~RationalResampler() {
-            if (!base_type::_block_init) { return; }
-            base_type::stop();
-            taps::free(rtaps);
-        }
-
         void init(stream<T>* in, double inSamplerate, double outSamplerate) {
             _inSamplerate = inSamplerate;
             _outSamplerate = outSamplerate;
             
             // Dummy initialization since only used for processing
-            rtaps = taps::lowPass(0.25, 0.1, 1.0);
+            SharedPolyphaseBank dummyBank = bank_cache::lowPass(1, 0.25, 0.1);
             decim.init(NULL, 2);
-            resamp.init(NULL, 1, 1, rtaps);
+            resamp.init(NULL, 1, 1, dummyBank);
+            fracResamp.init(NULL, 1.0, dummyBank);
 
             decim.out.free();
             resamp.out.free();
+            fracResamp.out.free();
 
             // Proper configuration
             reconfigure();
@@ -48,6 +45,7 @@ namespace dsp::multirate {
             base_type::tempStop();
             decim.reset();
             resamp.reset();
+            fracResamp.reset();
             base_type::tempStart();
         }
 
@@ -88,6 +86,11 @@ namespace dsp::multirate {
                     return decim.process(count, in, out);
                 case Mode::RESAMP_ONLY:
                     return resamp.process(count, in, out);
+                case Mode::BOTH_FRACTIONAL:
+                    count = decim.process(count, in, out);
+                    return fracResamp.process(count, out, out);
+                case Mode::FRACTIONAL_ONLY:
+                    return fracResamp.process(count, in, out);
                 case Mode::NONE:
                     memcpy(out, in, count * sizeof(T));
                     return count;
@@ -95,11 +98,59 @@ namespace dsp::multirate {
             return count;
         }
 
+        inline int skip(int count) {
+            switch(mode) {
+                case Mode::BOTH:
+                    return resamp.skip(decim.skip(count));
+                case Mode::DECIM_ONLY:
+                    return decim.skip(count);
+                case Mode::RESAMP_ONLY:
+                    return resamp.skip(count);
+                case Mode::BOTH_FRACTIONAL:
+                    return fracResamp.skip(decim.skip(count));
+                case Mode::FRACTIONAL_ONLY:
+                    return fracResamp.skip(count);
+                case Mode::NONE:
+                    return count;
+            }
+            return count;
+        }
+
+        int outputBufferSize(int inputSize) {
+            // When decimating first, both stages work in the output buffer
+            switch(mode) {
+                case Mode::BOTH:
+                    inputSize = decim.outputBufferSize(inputSize);
+                    return std::max<int>(inputSize, resamp.outputBufferSize(inputSize));
+                case Mode::DECIM_ONLY:
+                    return decim.outputBufferSize(inputSize);
+                case Mode::RESAMP_ONLY:
+                    return resamp.outputBufferSize(inputSize);
+                case Mode::BOTH_FRACTIONAL:
+                    inputSize = decim.outputBufferSize(inputSize);
+                    return std::max<int>(inputSize, fracResamp.outputBufferSize(inputSize));
+                case Mode::FRACTIONAL_ONLY:
+                    return fracResamp.outputBufferSize(inputSize);
+                case Mode::NONE:
+                    return inputSize;
+            }
+            return STREAM_BUFFER_SIZE;
+        }
+
         int run() {
-            int count = base_type::_in->read();
+            int count = base_type::readInput();
             if (count < 0) { return -1; }
 
-            int outCount = process(count, base_type::_in->readBuf, base_type::out.writeBuf);
+            int outCount;
+            if (base_type::_in->readIdle) {
+                outCount = skip(count);
+                base_type::outputSilence(outCount);
+            }
+            else {
+                outCount = process(count, base_type::_in->readBuf, base_type::out.writeBuf);
+            }
+
+            base_type::forwardMetadata(count, outCount);
 
             // Swap if some data was generated
             base_type::_in->flush();
@@ -114,10 +165,18 @@ namespace dsp::multirate {
             BOTH,
             DECIM_ONLY,
             RESAMP_ONLY,
+            BOTH_FRACTIONAL,
+            FRACTIONAL_ONLY,
             NONE
         };
 
+        // Above this interpolation factor, the fractional resampler is used instead of the rational one
+        static const int MAX_RATIONAL_INTERP = 128;
+        static const int FRACTIONAL_PHASE_COUNT = 128;
+
         void reconfigure() {
+            base_type::metaRateRatio = _outSamplerate / _inSamplerate;
+
             // Calculate highest power-of-two decimation for the power decimator 
             int predecPower = std::min<int>(floor(log2(_inSamplerate / _outSamplerate)), PowerDecimator<T>::getMaxRatio());
             int predecRatio = std::min<int>(1 << predecPower, PowerDecimator<T>::getMaxRatio());
@@ -136,6 +195,28 @@ namespace dsp::multirate {
             int gcd = std::gcd(IntSR, OutSR);
             int interp = OutSR / gcd;
             int decim = IntSR / gcd;
+            
+            // If the power decimator already did all the work, don't use the resampler
+            if (interp == decim) {
+                mode = useDecim ? Mode::DECIM_ONLY : Mode::NONE;
+                return;
+            }
+
+            // Filter parameters relative to the intermediate samplerate
+            double tapBandwidth = std::min<double>(_inSamplerate, _outSamplerate) / 2.0;
+            double cutoff = tapBandwidth / intSamplerate;
+            double transWidth = cutoff * 0.1;
+
+            // Awkward ratios would need a huge bank, use the fractional resampler for those
+            if (interp > MAX_RATIONAL_INTERP) {
+                SharedPolyphaseBank bank = bank_cache::lowPass(FRACTIONAL_PHASE_COUNT, cutoff, transWidth);
+                fracResamp.setStep(intSamplerate / _outSamplerate, bank);
+
+                printf("[Resamp] predec: %d, fractional: %lf, phases: %d, taps: %d\n", predecRatio, intSamplerate / _outSamplerate, FRACTIONAL_PHASE_COUNT, bank->phaseCount * bank->tapsPerPhase);
+
+                mode = useDecim ? Mode::BOTH_FRACTIONAL : Mode::FRACTIONAL_ONLY;
+                return;
+            }
 
             // Check for excessive error
             double actualOutSR = (double)IntSR * (double)interp / (double)decim;
@@ -143,30 +224,19 @@ namespace dsp::multirate {
             if (error > 0.01) {
                 fprintf(stderr, "Warning: resampling error is over 0.01%%: %lf\n", error);
             }
-            
-            // If the power decimator already did all the work, don't use the resampler
-            if (interp == decim) {
-                mode = useDecim ? Mode::DECIM_ONLY : Mode::NONE;
-                return;
-            }
 
             // Configure the polyphase resampler
-            double tapSamplerate = intSamplerate * (double)interp;
-            double tapBandwidth = std::min<double>(_inSamplerate, _outSamplerate) / 2.0;
-            double tapTransWidth = tapBandwidth * 0.1;
-            taps::free(rtaps);
-            rtaps = taps::lowPass(tapBandwidth, tapTransWidth, tapSamplerate);
-            for (int i = 0; i < rtaps.size; i++) { rtaps.taps[i] *= (float)interp; }
-            resamp.setRatio(interp, decim, rtaps);
+            SharedPolyphaseBank bank = bank_cache::lowPass(interp, cutoff, transWidth);
+            resamp.setRatio(interp, decim, bank);
 
-            printf("[Resamp] predec: %d, interp: %d, decim: %d, inacc: %lf%%, taps: %d\n", predecRatio, interp, decim, error, rtaps.size);
+            printf("[Resamp] predec: %d, interp: %d, decim: %d, inacc: %lf%%, taps: %d\n", predecRatio, interp, decim, error, bank->phaseCount * bank->tapsPerPhase);
 
             mode = useDecim ? Mode::BOTH : Mode::RESAMP_ONLY;
         }
         
         PowerDecimator<T> decim;
         PolyphaseResampler<T> resamp;
-        tap<float> rtaps;
+        FractionalResampler<T> fracResamp;
         double _inSamplerate;
         double _outSamplerate;
         Mode mode;
@@ -1,7 +1,7 @@
 #pragma once
 #include "../processor.h"
 #include "../window/nuttall.h"
-#include <fftw3.h>
+#include "../fft/planner.h"
 
 namespace dsp::noise_reduction {
     class FMIF : public Processor<complex_t, complex_t> {
@@ -43,16 +43,24 @@ namespace dsp::noise_reduction {
         }
 
         int process(int count, const complex_t* in, complex_t* out) {
-            // Write new input data to buffer buffer
+            // Write new input data to buffer buffer, growing it if needed
+            if (count + _bins - 1 > bufCapacity) {
+                buffer::reserve(buffer, bufCapacity, count + _bins - 1, _bins - 1);
+                bufferStart = &buffer[_bins - 1];
+            }
             memcpy(bufferStart, in, count * sizeof(complex_t));
             
+            // Pin the plans for the whole buffer
+            std::shared_ptr<fft::planner::Handle> forward = forwardPlan.pin();
+            std::shared_ptr<fft::planner::Handle> backward = backwardPlan.pin();
+
             // Iterate the FFT
             for (int i = 0; i < count; i++) {
                 // Apply windows
                 volk_32fc_32f_multiply_32fc((lv_32fc_t*)forwFFTIn, (lv_32fc_t*)&buffer[i], fftWin, _bins);
 
                 // Do forward FFT
-                fftwf_execute(forwardPlan);
+                fftwf_execute_dft(forward->plan, (fftwf_complex*)forwFFTIn, (fftwf_complex*)forwFFTOut);
 
                 // Process bins here
                 uint32_t idx;
@@ -63,7 +71,7 @@ namespace dsp::noise_reduction {
                 backFFTIn[idx] = forwFFTOut[idx];
 
                 // Do reverse FFT and get first element
-                fftwf_execute(backwardPlan);
+                fftwf_execute_dft(backward->plan, (fftwf_complex*)backFFTIn, (fftwf_complex*)backFFTOut);
                 out[i] = backFFTOut[_bins / 2];
 
                 // Reset the input buffer
@@ -76,11 +84,26 @@ namespace dsp::noise_reduction {
             return count;
         }
 
+        inline int skip(int count) {
+            // Flush the delay buffer so that no stale data is used on the next active buffer
+            buffer::clear(buffer, _bins - 1);
+            return count;
+        }
+
+        int outputBufferSize(int inputSize) { return inputSize; }
+
         int run() {
-            int count = base_type::_in->read();
+            int count = base_type::readInput();
             if (count < 0) { return -1; }
 
-            process(count, base_type::_in->readBuf, base_type::out.writeBuf);
+            if (base_type::_in->readIdle) {
+                base_type::outputSilence(skip(count));
+            }
+            else {
+                process(count, base_type::_in->readBuf, base_type::out.writeBuf);
+            }
+
+            base_type::forwardMetadata(count);
 
             // Swap if some data was generated
             base_type::_in->flush();
@@ -96,8 +119,8 @@ namespace dsp::noise_reduction {
             backFFTIn = (complex_t*)fftwf_malloc(_bins * sizeof(complex_t));
             backFFTOut = (complex_t*)fftwf_malloc(_bins * sizeof(complex_t));
 
-            // Allocate and clear delay buffer
-            buffer = buffer::alloc<complex_t>(STREAM_BUFFER_SIZE + 64000);
+            // Allocate and clear delay buffer, it grows with the size of the input buffers
+            buffer::reserve(buffer, bufCapacity, _bins - 1);
             bufferStart = &buffer[_bins - 1];
             buffer::clear(buffer, _bins - 1);
 
@@ -112,13 +135,13 @@ namespace dsp::noise_reduction {
             for (int i = 0; i < _bins; i++) { fftWin[i] = window::nuttall(i, _bins - 1); }
 
             // Plan FFTs
-            forwardPlan = fftwf_plan_dft_1d(_bins, (fftwf_complex*)forwFFTIn, (fftwf_complex*)forwFFTOut, FFTW_FORWARD, FFTW_ESTIMATE);
-            backwardPlan = fftwf_plan_dft_1d(_bins, (fftwf_complex*)backFFTIn, (fftwf_complex*)backFFTOut, FFTW_BACKWARD, FFTW_ESTIMATE);
+            forwardPlan = fft::planner::get(_bins, fft::FORWARD, (fftwf_complex*)forwFFTIn, (fftwf_complex*)forwFFTOut);
+            backwardPlan = fft::planner::get(_bins, fft::BACKWARD, (fftwf_complex*)backFFTIn, (fftwf_complex*)backFFTOut);
         }
 
         void destroyBuffers() {
-            fftwf_destroy_plan(forwardPlan);
-            fftwf_destroy_plan(backwardPlan);
+            forwardPlan.reset();
+            backwardPlan.reset();
             fftwf_free(forwFFTIn);
             fftwf_free(forwFFTOut);
             fftwf_free(backFFTIn);
@@ -126,6 +149,8 @@ namespace dsp::noise_reduction {
             buffer::free(buffer);
             buffer::free(ampBuf);
             buffer::free(fftWin);
+            buffer = NULL;
+            bufCapacity = 0;
         }
 
         complex_t* forwFFTIn;
@@ -133,11 +158,12 @@ namespace dsp::noise_reduction {
         complex_t* backFFTIn;
         complex_t* backFFTOut;
 
-        fftwf_plan forwardPlan;
-        fftwf_plan backwardPlan;
+        fft::Plan forwardPlan;
+        fft::Plan backwardPlan;
 
-        complex_t* buffer;
+        complex_t* buffer = NULL;
         complex_t* bufferStart;
+        int bufCapacity = 0;
 
         float* fftWin;
 
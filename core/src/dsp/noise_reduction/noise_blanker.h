@@ -9,10 +9,17 @@ namespace dsp::noise_reduction {
 
         NoiseBlanker(stream<complex_t>* in, double rate, double level) { init(in, rate, level); }
 
+        ~NoiseBlanker() {
+            if (!base_type::_block_init) { return; }
+            base_type::stop();
+            buffer::free(ampBuf);
+        }
+
         void init(stream<complex_t>* in, double rate, double level) {
             _rate = rate;
             _invRate = 1.0f - _rate;
             _level = level;
+
             base_type::init(in);
         }
 
@@ -35,33 +42,40 @@ namespace dsp::noise_reduction {
             amp = 1.0f;
         }
 
-        inline int process(int count, complex_t* in, complex_t* out) {
-            for (int i = 0; i < count; i++) {
-                // Get signal amplitude
-                float inAmp = in[i].amplitude();
+        inline int process(int count, const complex_t* in, complex_t* out) {
+            // Compute the envelope of the whole block at once
+            buffer::reserve(ampBuf, ampBufCapacity, count);
+            volk_32fc_magnitude_32f(ampBuf, (lv_32fc_t*)in, count);
 
-                // Update average amplitude
+            // Update the average amplitude and turn the envelope into a gain in place.
+            // Comparing against the scaled average avoids a division for samples that aren't blanked
+            for (int i = 0; i < count; i++) {
+                float inAmp = ampBuf[i];
                 float gain = 1.0f;
                 if (inAmp != 0.0f) {
                     amp = (amp * _invRate) + (inAmp * _rate);
-                    float excess = inAmp / amp;
-                    if (excess > _level) {
-                        gain = 1.0f / excess;
+                    if (inAmp > _level * amp) {
+                        gain = amp / inAmp;
                     }
                 }
-                
-                // Scale output by gain
-                out[i] = in[i] * gain;
+                ampBuf[i] = gain;
             }
+
+            // Scale output by gain
+            volk_32fc_32f_multiply_32fc((lv_32fc_t*)out, (lv_32fc_t*)in, ampBuf, count);
+
             return count;
         }
 
+        int outputBufferSize(int inputSize) { return inputSize; }
+
         int run() {
-            int count = base_type::_in->read();
+            int count = base_type::readInput();
             if (count < 0) { return -1; }
 
             process(count, base_type::_in->readBuf, base_type::out.writeBuf);
 
+            base_type::forwardMetadata(count);
             base_type::_in->flush();
             if (!base_type::out.swap(count)) { return -1; }
             return count;
@@ -74,5 +88,8 @@ namespace dsp::noise_reduction {
 
         float amp = 1.0;
 
+        float* ampBuf = NULL;
+        int ampBufCapacity = 0;
+
     };
 }
\ No newline at end of file
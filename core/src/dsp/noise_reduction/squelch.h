@@ -1,14 +1,14 @@
 #pragma once
 #include "../processor.h"
+#include <atomic>
 
-// TODO: Rewrite better!!!!!
 namespace dsp::noise_reduction {
     class Squelch : public Processor<complex_t, complex_t> {
         using base_type = Processor<complex_t, complex_t>;
     public:
         Squelch() {}
 
-        Squelch(stream<complex_t>* in, double level) {}
+        Squelch(stream<complex_t>* in, double level) { init(in, level); }
 
         ~Squelch() {
             if (!base_type::_block_init) { return; }
@@ -18,8 +18,7 @@ namespace dsp::noise_reduction {
 
         void init(stream<complex_t>* in, double level) {
             _level = level;
-
-            normBuffer = buffer::alloc<float>(STREAM_BUFFER_SIZE);
+            updateThreshold();
 
             base_type::init(in);
         }
@@ -28,15 +27,24 @@ namespace dsp::noise_reduction {
             assert(base_type::_block_init);
             std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
             _level = level;
+            updateThreshold();
+        }
+
+        bool isOpen() {
+            return _open;
         }
 
         inline int process(int count, const complex_t* in, complex_t* out) {
+            // Sum the amplitude of the whole block
             float sum;
+            buffer::reserve(normBuffer, normBufferCapacity, count);
             volk_32fc_magnitude_32f(normBuffer, (lv_32fc_t*)in, count);
             volk_32f_accumulator_s32f(&sum, normBuffer, count);
-            sum /= (float)count;
 
-            if (10.0f * log10f(sum) >= _level) {
+            // Compare in the linear domain so that no log or division is needed per block
+            bool open = (sum >= _threshold * (float)count);
+            _open = open;
+            if (open) {
                 memcpy(out, in, count * sizeof(complex_t));
             }
             else {
@@ -48,18 +56,30 @@ namespace dsp::noise_reduction {
 
         //DEFAULT_PROC_RUN();
 
+        int outputBufferSize(int inputSize) { return inputSize; }
+
         int run() {
-            int count = base_type::_in->read();
+            int count = base_type::readInput();
             if (count < 0) { return -1; }
             process(count, base_type::_in->readBuf, base_type::out.writeBuf);
+            base_type::out.writeIdle = !_open.load();
+            base_type::forwardMetadata(count);
             base_type::_in->flush();
             if (!base_type::out.swap(count)) { return -1; }
             return count;
         }
 
     private:
-        float* normBuffer;
+        void updateThreshold() {
+            _threshold = powf(10.0f, _level / 10.0f);
+        }
+
+        float* normBuffer = NULL;
+        int normBufferCapacity = 0;
         float _level = -50.0f;
+        float _threshold;
+        // Written by the DSP thread, read by the GUI
+        std::atomic<bool> _open { false };
                 
     };
 }
\ No newline at end of file
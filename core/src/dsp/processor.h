@@ -1,4 +1,5 @@
 #pragma once
+#include <math.h>
 #include "block.h"
 
 // These macros define a run() function using a specic expression for processing
@@ -13,6 +14,7 @@
         \
         exp;\
         \
+        base_type::forwardMetadata(count);\
         base_type::_in->flush();\
         if (!base_type::out.swap(count)) { return -1; }\
         return count;\
@@ -27,6 +29,7 @@
         \
         int outCount = exp;\
         \
+        base_type::forwardMetadata(count, outCount);\
         base_type::_in->flush();\
         if (outCount) {\
             if (!base_type::out.swap(outCount)) { return -1; }\
@@ -66,9 +69,86 @@ namespace dsp {
 
         virtual int run() = 0;
 
+        // Largest buffer the block can output for input buffers of up to inputSize samples. Blocks that don't
+        // know keep the default size. Blocks overriding it must read their input with readInput() so that larger
+        // input buffers are noticed before being processed.
+        virtual int outputBufferSize(int inputSize) { return STREAM_BUFFER_SIZE; }
+
         stream<O> out;
 
     protected:
-        stream<I>* _in;
+        // Sizes the output, and any work buffer kept by the block, for input buffers of up to inputSize samples.
+        // Only called while the block isn't processing.
+        virtual void resizeBuffers(int inputSize) {
+            out.setBufferSize(outputBufferSize(inputSize));
+        }
+
+        // Reads the input, first making sure the buffers of the block are large enough for it
+        inline int readInput() {
+            int count = _in->read();
+            if (count >= 0 && _in->getReadBufferSize() != negotiatedSize) {
+                negotiatedSize = _in->getReadBufferSize();
+                resizeBuffers(negotiatedSize);
+            }
+            return count;
+        }
+
+        virtual void doStart() {
+            // Size the buffers for what the input announces, readInput() catches up if it changes later on.
+            // Done on every start since the parameters of the block may have changed while it was stopped.
+            if (_in) {
+                negotiatedSize = _in->getBufferSize();
+                resizeBuffers(negotiatedSize);
+            }
+            block::doStart();
+        }
+
+        // Output a buffer of silence flagged as idle instead of running the processing kernel
+        inline void outputSilence(int count) {
+            memset(out.writeBuf, 0, count * sizeof(O));
+            out.writeIdle = true;
+        }
+
+        // Copy the metadata of the input buffer to the output buffer. Must be called for every input buffer,
+        // even if it didn't produce any output, so that the sample index of the output stays exact.
+        inline void forwardMetadata(int inCount, int outCount) {
+            const StreamMetadata& im = _in->readMeta;
+            if (!im.valid) {
+                out.writeMeta.valid = false;
+                metaSynced = false;
+                return;
+            }
+
+            // Restart counting output samples from the input index if samples went missing
+            if (!metaSynced || im.discontinuity || im.sampleIndex != metaNextInIndex) {
+                metaOutIndex = (uint64_t)llround((double)im.sampleIndex * metaRateRatio);
+                metaDiscontinuity |= (metaSynced || im.discontinuity);
+                metaSynced = true;
+            }
+            metaNextInIndex = im.sampleIndex + inCount;
+            if (!outCount) { return; }
+
+            StreamMetadata& om = out.writeMeta;
+            om = im;
+            om.sampleIndex = metaOutIndex;
+            om.samplerate = im.samplerate * metaRateRatio;
+            om.discontinuity = metaDiscontinuity;
+            metaDiscontinuity = false;
+            metaOutIndex += outCount;
+        }
+
+        inline void forwardMetadata(int count) { forwardMetadata(count, count); }
+
+        stream<I>* _in = NULL;
+
+        // Output samplerate over input samplerate, set by blocks that change the samplerate
+        double metaRateRatio = 1.0;
+
+    private:
+        int negotiatedSize = -1;
+        bool metaSynced = false;
+        bool metaDiscontinuity = false;
+        uint64_t metaNextInIndex = 0;
+        uint64_t metaOutIndex = 0;
     };
 }
@@ -49,6 +49,8 @@ namespace dsp::routing {
 
             for (const auto& stream : streams) {
                 memcpy(stream->writeBuf, base_type::_in->readBuf, count * sizeof(T));
+                stream->writeIdle = base_type::_in->readIdle;
+                stream->writeMeta = base_type::_in->readMeta;
                 if (!stream->swap(count)) {
                     base_type::_in->flush();
                     return -1;
@@ -0,0 +1,236 @@
+#pragma once
+#include <string>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <volk/volk.h>
+#include "../buffer/buffer.h"
+
+namespace dsp::spectrum {
+    enum ProductType {
+        PRODUCT_LIVE,           // Spectrum of each frame, untouched
+        PRODUCT_AVERAGE,        // Average of the last frames
+        PRODUCT_MAX_HOLD,       // Highest level of each bin, decaying over time
+        PRODUCT_MIN_HOLD,       // Lowest level of each bin, rising over time
+        PRODUCT_PERSISTENCE,    // Fraction of recent frames that hit each level of each bin
+        _PRODUCT_COUNT
+    };
+
+    enum AveragingMode {
+        AVERAGING_EXPONENTIAL,
+        AVERAGING_MOVING
+    };
+
+    // Names used to refer to products in configs and protocols
+    inline const char* productName(ProductType type) {
+        switch (type) {
+        case PRODUCT_LIVE:          return "live";
+        case PRODUCT_AVERAGE:       return "average";
+        case PRODUCT_MAX_HOLD:      return "max_hold";
+        case PRODUCT_MIN_HOLD:      return "min_hold";
+        case PRODUCT_PERSISTENCE:   return "persistence";
+        default:                    return "unknown";
+        }
+    }
+
+    inline bool productFromName(const std::string& name, ProductType& type) {
+        for (int i = 0; i < _PRODUCT_COUNT; i++) {
+            if (name == productName((ProductType)i)) {
+                type = (ProductType)i;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    struct ProductParams {
+        ProductType type = PRODUCT_LIVE;
+
+        // Averaging
+        AveragingMode averaging = AVERAGING_EXPONENTIAL;
+        bool linear = false;        // Average the power instead of the level in dB
+        float factor = 0.5f;        // Exponential averaging, weight given to the previous average between 0 and 1
+        int length = 8;             // Moving average, number of frames
+
+        // Hold, in dB per frame
+        float decay = 0.0f;
+
+        // Persistence, levels between minLevel and maxLevel are split into a number of rows. The fade is the
+        // fraction of the density lost every frame.
+        int levels = 64;
+        float minLevel = -150.0f;
+        float maxLevel = 0.0f;
+        float fade = 0.05f;
+
+        bool operator==(const ProductParams& b) const {
+            if (type != b.type) { return false; }
+            switch (type) {
+            case PRODUCT_AVERAGE:
+                return averaging == b.averaging && linear == b.linear && (averaging == AVERAGING_EXPONENTIAL ? factor == b.factor : length == b.length);
+            case PRODUCT_MAX_HOLD:
+            case PRODUCT_MIN_HOLD:
+                return decay == b.decay;
+            case PRODUCT_PERSISTENCE:
+                return levels == b.levels && minLevel == b.minLevel && maxLevel == b.maxLevel && fade == b.fade;
+            default:
+                return true;
+            }
+        }
+        bool operator!=(const ProductParams& b) const { return !(*this == b); }
+    };
+
+    // Converts a power spectrum normalised to full scale into dB
+    inline void powerToDB(const float* in, float* out, int count) {
+        volk_32f_log2_32f(out, in, count);
+        volk_32f_s32f_multiply_32f(out, out, 10.0f * log10f(2.0f), count);
+    }
+
+    // Post-processing of a spectrum at full FFT resolution. Every frame is given both in dB and, for products
+    // averaging in the linear domain, as a power spectrum normalised to full scale.
+    // The output of persistence is made of `levels` rows of `size` bins, the highest level first.
+    class Product {
+    public:
+        Product() {}
+
+        ~Product() { freeState(); }
+
+        void init(const ProductParams& params, int size) {
+            freeState();
+            _params = params;
+            _params.length = std::max<int>(_params.length, 1);
+            _params.levels = std::max<int>(_params.levels, 2);
+            _size = size;
+
+            if (_params.type == PRODUCT_PERSISTENCE) {
+                out = buffer::alloc<float>(_size * _params.levels);
+            }
+            else if (_params.type != PRODUCT_LIVE) {
+                out = buffer::alloc<float>(_size);
+            }
+            if (_params.type == PRODUCT_AVERAGE) {
+                acc = buffer::alloc<float>(_size);
+                if (_params.averaging == AVERAGING_MOVING) { ring = buffer::alloc<float>(_size * _params.length); }
+            }
+            reset();
+        }
+
+        // Forget the previous frames, to be called when the spectrum no longer matches them (retune, etc)
+        void reset() {
+            frames = 0;
+            ringPos = 0;
+            if (_params.type == PRODUCT_PERSISTENCE) { buffer::clear(out, _size * _params.levels); }
+        }
+
+        bool needsPower() { return _params.type == PRODUCT_AVERAGE && _params.linear; }
+
+        void process(const float* level, const float* power) {
+            switch (_params.type) {
+            case PRODUCT_LIVE:
+                live = level;
+                break;
+            case PRODUCT_AVERAGE:
+                average(_params.linear ? power : level);
+                break;
+            case PRODUCT_MAX_HOLD:
+            case PRODUCT_MIN_HOLD:
+                hold(level);
+                break;
+            case PRODUCT_PERSISTENCE:
+                accumulate(level);
+                break;
+            default:
+                break;
+            }
+            frames++;
+        }
+
+        // Valid until the next call to process()
+        const float* data() { return (_params.type == PRODUCT_LIVE) ? live : out; }
+
+        int size() { return _size; }
+
+        const ProductParams& params() { return _params; }
+
+    private:
+        void average(const float* in) {
+            float* avg = acc;
+            if (_params.averaging == AVERAGING_EXPONENTIAL) {
+                if (frames) {
+                    volk_32f_s32f_multiply_32f(avg, avg, _params.factor, _size);
+                    volk_32f_s32f_multiply_32f(out, in, 1.0f - _params.factor, _size);
+                    volk_32f_x2_add_32f(avg, avg, out, _size);
+                }
+                else {
+                    memcpy(avg, in, _size * sizeof(float));
+                }
+            }
+            else {
+                // Keep a running sum of the last frames. It's rebuilt from the stored frames every time the ring
+                // wraps around so that rounding errors can't accumulate.
+                float* slot = &ring[ringPos * _size];
+                if (frames >= _params.length) { volk_32f_x2_subtract_32f(acc, acc, slot, _size); }
+                else if (!frames) { buffer::clear(acc, _size); }
+                memcpy(slot, in, _size * sizeof(float));
+                volk_32f_x2_add_32f(acc, acc, slot, _size);
+                if (++ringPos >= _params.length) {
+                    ringPos = 0;
+                    memcpy(acc, ring, _size * sizeof(float));
+                    for (int i = 1; i < _params.length; i++) { volk_32f_x2_add_32f(acc, acc, &ring[i * _size], _size); }
+                }
+                int count = std::min<int>(frames + 1, _params.length);
+                volk_32f_s32f_multiply_32f(out, acc, 1.0f / (float)count, _size);
+                avg = out;
+            }
+
+            // Back to dB if the averaging was done on the power
+            if (_params.linear) { powerToDB(avg, out, _size); }
+            else if (avg != out) { memcpy(out, avg, _size * sizeof(float)); }
+        }
+
+        void hold(const float* in) {
+            if (!frames) {
+                memcpy(out, in, _size * sizeof(float));
+                return;
+            }
+            if (_params.type == PRODUCT_MAX_HOLD) {
+                if (_params.decay != 0.0f) { volk_32f_s32f_add_32f(out, out, -_params.decay, _size); }
+                volk_32f_x2_max_32f(out, out, in, _size);
+            }
+            else {
+                if (_params.decay != 0.0f) { volk_32f_s32f_add_32f(out, out, _params.decay, _size); }
+                volk_32f_x2_min_32f(out, out, in, _size);
+            }
+        }
+
+        void accumulate(const float* in) {
+            // Fade the previous frames and add the new one, the density of each cell converges to the
+            // fraction of frames that hit it
+            int levels = _params.levels;
+            float keep = 1.0f - _params.fade;
+            volk_32f_s32f_multiply_32f(out, out, keep, _size * levels);
+            float scale = (float)(levels - 1) / (_params.maxLevel - _params.minLevel);
+            for (int i = 0; i < _size; i++) {
+                int row = (levels - 1) - (int)roundf((std::clamp<float>(in[i], _params.minLevel, _params.maxLevel) - _params.minLevel) * scale);
+                out[(row * _size) + i] += _params.fade;
+            }
+        }
+
+        void freeState() {
+            if (out) { buffer::free(out); }
+            if (acc) { buffer::free(acc); }
+            if (ring) { buffer::free(ring); }
+            out = NULL;
+            acc = NULL;
+            ring = NULL;
+        }
+
+        ProductParams _params;
+        int _size = 0;
+        int frames = 0;
+        int ringPos = 0;
+        const float* live = NULL;
+        float* out = NULL;
+        float* acc = NULL;
+        float* ring = NULL;
+    };
+}
\ No newline at end of file
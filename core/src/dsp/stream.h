@@ -1,14 +1,27 @@
 #pragma once
 #include <string.h>
+#include <stdint.h>
 #include <mutex>
+#include <utility>
 #include <condition_variable>
 #include <volk/volk.h>
 #include "buffer/buffer.h"
 
-// 1MSample buffer
+// Default size of stream buffers, 1MSample. Writers that know the largest buffer they'll output give it with
+// setBufferSize(), see Processor::outputBufferSize().
 #define STREAM_BUFFER_SIZE 1000000
 
 namespace dsp {
+    // Describes the first sample of a buffer. Writers that don't know about it leave valid unset.
+    struct StreamMetadata {
+        bool valid = false;
+        bool discontinuity = false;     // Samples were lost or the stream was reconfigured before this buffer
+        uint64_t sampleIndex = 0;       // Index of the first sample since the start of the stream
+        int64_t timestamp = 0;          // Time of the first sample in nanoseconds since the unix epoch
+        double centerFrequency = 0.0;   // Frequency in Hz that ended up at DC
+        double samplerate = 0.0;
+    };
+
     class untyped_stream {
     public:
         virtual bool swap(int size) { return false; }
@@ -24,21 +37,31 @@ namespace dsp {
     class stream : public untyped_stream {
     public:
         stream() {
+            // The read buffer is only needed once something is swapped, streams used as scratch space never need it
             writeBuf = buffer::alloc<T>(STREAM_BUFFER_SIZE);
-            readBuf = buffer::alloc<T>(STREAM_BUFFER_SIZE);
+            writeSize = STREAM_BUFFER_SIZE;
         }
 
         virtual ~stream() {
             free();
         }
 
+        // Must only be called by the writer while it isn't writing. The write buffer is reallocated right away, the
+        // read buffer on the next swap, once the reader is done with it.
         virtual void setBufferSize(int samples) {
-            buffer::free(writeBuf);
-            buffer::free(readBuf);
-            writeBuf = buffer::alloc<T>(samples);
-            readBuf = buffer::alloc<T>(samples);
+            if (samples == bufferSize && writeSize == samples) { return; }
+            bufferSize = samples;
+            if (writeBuf) { buffer::free(writeBuf); }
+            writeBuf = buffer::alloc<T>(bufferSize);
+            writeSize = bufferSize;
         }
 
+        // Largest number of samples the writer will put in a buffer
+        inline int getBufferSize() { return bufferSize; }
+
+        // Size of the buffer currently being read, only meaningful between read() and flush()
+        inline int getReadBufferSize() { return readSize; }
+
         virtual inline bool swap(int size) {
             {
                 // Wait to either swap or stop
@@ -48,11 +71,23 @@ namespace dsp {
                 // If writer was stopped, abandon operation
                 if (writerStop) { return false; }
 
+                // The reader is done with its buffer, resize it if the buffer size changed since it was allocated
+                if (readSize != bufferSize) {
+                    if (readBuf) { buffer::free(readBuf); }
+                    readBuf = buffer::alloc<T>(bufferSize);
+                    readSize = bufferSize;
+                }
+
                 // Swap buffers
                 dataSize = size;
                 T* temp = writeBuf;
                 writeBuf = readBuf;
                 readBuf = temp;
+                std::swap(writeSize, readSize);
+                readIdle = writeIdle;
+                writeIdle = false;
+                readMeta = writeMeta;
+                writeMeta.discontinuity = false;
                 canSwap = false;
             }
 
@@ -66,6 +101,12 @@ namespace dsp {
             return true;
         }
 
+        // Returns true if the reader is done with the previous buffer, meaning swap() won't block
+        virtual inline bool swapReady() {
+            std::lock_guard<std::mutex> lck(swapMtx);
+            return canSwap;
+        }
+
         virtual inline int read() {
             // Wait for data to be ready or to be stopped
             std::unique_lock<std::mutex> lck(rdyMtx);
@@ -119,10 +160,21 @@ namespace dsp {
             if (readBuf) { buffer::free(readBuf); }
             writeBuf = NULL;
             readBuf = NULL;
+            writeSize = 0;
+            readSize = 0;
         }
 
-        T* writeBuf;
-        T* readBuf;
+        T* writeBuf = NULL;
+        T* readBuf = NULL;
+
+        // Set by the writer before a swap to signal that the buffer only contains silence (all zeros).
+        // Blocks that understand it can skip their processing, the others will simply process zeros.
+        bool writeIdle = false;
+        bool readIdle = false;
+
+        // Metadata of the buffers, swapped along with them
+        StreamMetadata writeMeta;
+        StreamMetadata readMeta;
 
     private:
         std::mutex swapMtx;
@@ -137,5 +189,9 @@ namespace dsp {
         bool writerStop = false;
 
         int dataSize = 0;
+
+        int bufferSize = STREAM_BUFFER_SIZE;
+        int writeSize = 0;
+        int readSize = 0;
     };
 }
\ No newline at end of file
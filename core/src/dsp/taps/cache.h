@@ -0,0 +1,141 @@
+#pragma once
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <future>
+#include <stdint.h>
+#include "tap.h"
+#include "low_pass.h"
+#include "high_pass.h"
+#include "band_pass.h"
+#include "from_array.h"
+
+namespace dsp::taps {
+    // Taps handed out by the cache are shared between blocks and must never be modified
+    template<class T>
+    using SharedTap = std::shared_ptr<tap<T>>;
+
+    namespace cache {
+        struct Key {
+            std::string design;
+            std::vector<double> params;
+
+            bool operator==(const Key& b) const {
+                return design == b.design && params == b.params;
+            }
+        };
+
+        struct KeyHash {
+            size_t operator()(const Key& key) const {
+                size_t hash = std::hash<std::string>()(key.design);
+                for (const auto& p : key.params) {
+                    hash ^= std::hash<double>()(p) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+                }
+                return hash;
+            }
+        };
+
+        // Keeps a weak reference to every object created so that identical designs are shared and freed when their
+        // last user releases them. Designs are made outside of the lock, users asking for one that is being made
+        // wait for it instead of making it again.
+        template<class V>
+        class SharedCache {
+        public:
+            template<typename Func>
+            std::shared_ptr<V> get(const Key& key, Func create) {
+                std::unique_lock<std::mutex> lck(mtx);
+
+                // Reuse the object if it's still alive or wait for it if it's being created
+                auto it = entries.find(key);
+                if (it != entries.end()) {
+                    std::shared_ptr<V> obj = it->second.obj.lock();
+                    if (obj) { return obj; }
+                    if (it->second.pending.valid()) {
+                        std::shared_future<std::shared_ptr<V>> pending = it->second.pending;
+                        lck.unlock();
+                        return pending.get();
+                    }
+                }
+
+                // Forget about objects that nobody uses anymore
+                for (auto eit = entries.begin(); eit != entries.end();) {
+                    bool unused = !eit->second.pending.valid() && eit->second.obj.expired();
+                    eit = unused ? entries.erase(eit) : std::next(eit);
+                }
+
+                // Create it only now that it's actually needed, without holding up the other lookups
+                std::promise<std::shared_ptr<V>> promise;
+                entries[key].pending = promise.get_future().share();
+                lck.unlock();
+                std::shared_ptr<V> obj;
+                try {
+                    obj = create();
+                }
+                catch (...) {
+                    lck.lock();
+                    entries.erase(key);
+                    lck.unlock();
+                    promise.set_exception(std::current_exception());
+                    throw;
+                }
+
+                lck.lock();
+                Entry& entry = entries[key];
+                entry.obj = obj;
+                entry.pending = std::shared_future<std::shared_ptr<V>>();
+                lck.unlock();
+                promise.set_value(obj);
+                return obj;
+            }
+
+        private:
+            struct Entry {
+                std::weak_ptr<V> obj;
+                std::shared_future<std::shared_ptr<V>> pending;
+            };
+
+            std::mutex mtx;
+            std::unordered_map<Key, Entry, KeyHash> entries;
+        };
+
+        template<class T>
+        inline SharedCache<tap<T>>& instance() {
+            static SharedCache<tap<T>> _instance;
+            return _instance;
+        }
+
+        template<class T>
+        inline SharedTap<T> makeShared(const tap<T>& designed) {
+            return SharedTap<T>(new tap<T>(designed), [](tap<T>* t) {
+                taps::free(*t);
+                delete t;
+            });
+        }
+
+        inline SharedTap<float> lowPass(double cutoff, double transWidth, double sampleRate, bool oddTapCount = false) {
+            Key key = { "lowPass", { cutoff, transWidth, sampleRate, (double)oddTapCount } };
+            return instance<float>().get(key, [=]() { return makeShared(taps::lowPass(cutoff, transWidth, sampleRate, oddTapCount)); });
+        }
+
+        inline SharedTap<float> highPass(double cutoff, double transWidth, double sampleRate, bool oddTapCount = false) {
+            Key key = { "highPass", { cutoff, transWidth, sampleRate, (double)oddTapCount } };
+            return instance<float>().get(key, [=]() { return makeShared(taps::highPass(cutoff, transWidth, sampleRate, oddTapCount)); });
+        }
+
+        template<class T>
+        inline SharedTap<T> bandPass(double bandStart, double bandStop, double transWidth, double sampleRate, bool oddTapCount = false) {
+            Key key = { "bandPass", { bandStart, bandStop, transWidth, sampleRate, (double)oddTapCount } };
+            return instance<T>().get(key, [=]() { return makeShared(taps::bandPass<T>(bandStart, bandStop, transWidth, sampleRate, oddTapCount)); });
+        }
+
+        // The array is identified by its address, only use this with arrays that live for the whole process
+        template<class T>
+        inline SharedTap<T> fromArray(int count, const T* arr) {
+            Key key = { "fromArray@" + std::to_string((uintptr_t)arr), { (double)count } };
+            return instance<T>().get(key, [=]() { return makeShared(taps::fromArray<T>(count, arr)); });
+        }
+    }
+}
\ No newline at end of file
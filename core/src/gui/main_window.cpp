@@ -84,10 +84,6 @@ void MainWindow::init() {
     gui::waterfall.setBandwidth(8000000);
     gui::waterfall.setViewBandwidth(8000000);
 
-    fft_in = (fftwf_complex*)fftwf_malloc(sizeof(fftwf_complex) * fftSize);
-    fft_out = (fftwf_complex*)fftwf_malloc(sizeof(fftwf_complex) * fftSize);
-    fftwPlan = fftwf_plan_dft_1d(fftSize, fft_in, fft_out, FFTW_FORWARD, FFTW_ESTIMATE);
-
     sigpath::iqFrontEnd.init(&dummyStream, 8000000, true, 1, false, 1024, 20.0, IQFrontEnd::FFTWindow::NUTTALL, acquireFFTBuffer, releaseFFTBuffer, this);
     sigpath::iqFrontEnd.start();
 
@@ -133,14 +129,12 @@ void MainWindow::init() {
     }
 
     // Create module instances
+    std::vector<ModuleManager::InstanceDesc_t> instList;
     for (auto const& [name, _module] : modList) {
-        std::string mod = _module["module"];
-        bool enabled = _module["enabled"];
-        flog::info("Initializing {0} ({1})", name, mod);
-        LoadingScreen::show("Initializing " + name + " (" + mod + ")");
-        core::moduleManager.createInstance(name, mod);
-        if (!enabled) { core::moduleManager.disableInstance(name); }
+        instList.push_back({ name, _module["module"], _module["enabled"] });
     }
+    LoadingScreen::show("Initializing modules");
+    core::moduleManager.createInstances(instList);
 
     // Load color maps
     LoadingScreen::show("Loading color maps");
@@ -225,6 +219,7 @@ void MainWindow::init() {
     initComplete = true;
 
     core::moduleManager.doPostInitAll();
+    if (core::args["startup-profile"].b()) { core::moduleManager.printStartupProfile(); }
 }
 
 float* MainWindow::acquireFFTBuffer(void* ctx) {
@@ -485,7 +480,7 @@ void MainWindow::draw() {
             // Update enabled and disabled modules
             for (auto [_name, inst] : core::moduleManager.instances) {
                 if (!core::configManager.conf["moduleInstances"].contains(_name)) { continue; }
-                core::configManager.conf["moduleInstances"][_name]["enabled"] = inst.instance->isEnabled();
+                core::configManager.conf["moduleInstances"][_name]["enabled"] = core::moduleManager.instanceEnabled(_name);
             }
 
             core::configManager.release(true);
@@ -505,10 +500,6 @@ void MainWindow::draw() {
             ImGui::Checkbox("Show demo window", &demoWindow);
             ImGui::Text("ImGui version: %s", ImGui::GetVersion());
 
-            // ImGui::Checkbox("Bypass buffering", &sigpath::iqFrontEnd.inputBuffer.bypass);
-
-            // ImGui::Text("Buffering: %d", (sigpath::iqFrontEnd.inputBuffer.writeCur - sigpath::iqFrontEnd.inputBuffer.readCur + 32) % 32);
-
             if (ImGui::Button("Test Bug")) {
                 flog::error("Will this make the software crash?");
             }
@@ -1,6 +1,5 @@
 #pragma once
 #include <imgui/imgui.h>
-#include <fftw3.h>
 #include <dsp/types.h>
 #include <dsp/stream.h>
 #include <signal_path/vfo_manager.h>
@@ -39,8 +38,6 @@ private:
     // FFT Variables
     int fftSize = 8192 * 8;
     std::mutex fft_mtx;
-    fftwf_complex *fft_in, *fft_out;
-    fftwf_plan fftwPlan;
 
     // GUI Variables
     bool firstMenuRender = true;
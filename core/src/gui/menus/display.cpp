@@ -7,8 +7,11 @@
 #include <gui/main_window.h>
 #include <signal_path/signal_path.h>
 #include <gui/style.h>
+#include <backend.h>
 #include <utils/optionlist.h>
+#include <dsp/fft/planner.h>
 #include <algorithm>
+#include <thread>
 
 namespace displaymenu {
     bool showWaterfall;
@@ -19,6 +22,7 @@ namespace displaymenu {
     std::string colorMapAuthor = "";
     int selectedWindow = 0;
     int fftRate = 20;
+    int maxFps = 60;
     int uiScaleId = 0;
     bool restartRequired = false;
     bool fftHold = false;
@@ -26,6 +30,8 @@ namespace displaymenu {
     bool fftSmoothing = false;
     int fftSmoothingSpeed = 100;
     bool snrSmoothing = false;
+    bool fftMeasuredPlanning = true;
+    int fftThreads = 2;
     int snrSmoothingSpeed = 20;
 
     OptionList<float, float> uiScales;
@@ -62,12 +68,53 @@ namespace displaymenu {
         IQFrontEnd::FFTWindow::NUTTALL
     };
 
+    SpectrumEngine::Consumer* fftTrace = NULL;
+    SpectrumEngine::Consumer* fftHoldTrace = NULL;
+
+    void fftTraceHandler(const float* spectrum, int size, double centerFrequency, double samplerate, void* ctx) {
+        gui::waterfall.pushFFTTrace(spectrum, size);
+    }
+
+    void fftHoldHandler(const float* spectrum, int size, double centerFrequency, double samplerate, void* ctx) {
+        gui::waterfall.pushFFTHold(spectrum, size);
+    }
+
+    // Enable, disable or reconfigure a product of the main spectrum
+    void updateProduct(SpectrumEngine::Consumer*& consumer, bool enabled, const dsp::spectrum::ProductParams& product, SpectrumEngine::Handler handler) {
+        if (enabled && !consumer) {
+            consumer = sigpath::iqFrontEnd.addMainSpectrumConsumer(product, handler, NULL);
+        }
+        else if (!enabled && consumer) {
+            sigpath::iqFrontEnd.removeMainSpectrumConsumer(consumer);
+            consumer = NULL;
+        }
+        else if (consumer) {
+            sigpath::iqFrontEnd.setMainSpectrumConsumerProduct(consumer, product);
+        }
+    }
+
+    // Hold and smoothing are computed by the DSP on the full resolution spectrum, the speeds are given per second
     void updateFFTSpeeds() {
-        gui::waterfall.setFFTHoldSpeed((float)fftHoldSpeed / ((float)fftRate * 10.0f));
-        gui::waterfall.setFFTSmoothingSpeed(std::min<float>((float)fftSmoothingSpeed / (float)(fftRate * 10.0f), 1.0f));
+        dsp::spectrum::ProductParams hold;
+        hold.type = dsp::spectrum::PRODUCT_MAX_HOLD;
+        hold.decay = (float)fftHoldSpeed / ((float)fftRate * 10.0f);
+        updateProduct(fftHoldTrace, fftHold, hold, fftHoldHandler);
+
+        dsp::spectrum::ProductParams smoothing;
+        smoothing.type = dsp::spectrum::PRODUCT_AVERAGE;
+        smoothing.averaging = dsp::spectrum::AVERAGING_EXPONENTIAL;
+        smoothing.factor = 1.0f - std::min<float>((float)fftSmoothingSpeed / (float)(fftRate * 10.0f), 1.0f);
+        updateProduct(fftTrace, fftSmoothing, smoothing, fftTraceHandler);
+
         gui::waterfall.setSNRSmoothingSpeed(std::min<float>((float)snrSmoothingSpeed / (float)(fftRate * 10.0f), 1.0f));
     }
 
+    // Every thread gets its own set of buffers for the largest FFTs, so more than a couple is opt-in.
+    // At most one per core minus the one left to the rest of the DSP.
+    int fftThreadCount() {
+        return std::clamp<int>(fftThreads, 1, std::max<int>((int)std::thread::hardware_concurrency() - 1, 1));
+    }
+
     void init() {
         showWaterfall = core::configManager.conf["showWaterfall"];
         showWaterfall ? gui::waterfall.showWaterfall() : gui::waterfall.hideWaterfall();
@@ -103,6 +150,9 @@ namespace displaymenu {
         fftRate = core::configManager.conf["fftRate"];
         sigpath::iqFrontEnd.setFFTRate(fftRate);
 
+        maxFps = core::configManager.conf["maxFps"];
+        backend::setMaxFPS(maxFps);
+
         selectedWindow = std::clamp<int>((int)core::configManager.conf["fftWindow"], 0, (sizeof(fftWindowList) / sizeof(IQFrontEnd::FFTWindow)) - 1);
         sigpath::iqFrontEnd.setFFTWindow(fftWindowList[selectedWindow]);
 
@@ -119,6 +169,10 @@ namespace displaymenu {
         gui::waterfall.setSNRSmoothing(snrSmoothing);
         updateFFTSpeeds();
 
+        fftMeasuredPlanning = core::configManager.conf["fftMeasuredPlanning"];
+        fftThreads = core::configManager.conf["fftThreads"];
+        sigpath::iqFrontEnd.setFFTThreads(fftThreadCount());
+
         // Define and load UI scales
         uiScales.define(1.0f, "100%", 1.0f);
         uiScales.define(2.0f, "200%", 2.0f);
@@ -153,6 +207,7 @@ namespace displaymenu {
 
         if (ImGui::Checkbox("FFT Hold##_sdrpp", &fftHold)) {
             gui::waterfall.setFFTHold(fftHold);
+            updateFFTSpeeds();
             core::configManager.acquire();
             core::configManager.conf["fftHold"] = fftHold;
             core::configManager.release(true);
@@ -168,6 +223,7 @@ namespace displaymenu {
 
         if (ImGui::Checkbox("FFT Smoothing##_sdrpp", &fftSmoothing)) {
             gui::waterfall.setFFTSmoothing(fftSmoothing);
+            updateFFTSpeeds();
             core::configManager.acquire();
             core::configManager.conf["fftSmoothing"] = fftSmoothing;
             core::configManager.release(true);
@@ -218,6 +274,16 @@ namespace displaymenu {
             core::configManager.release(true);
         }
 
+        ImGui::LeftLabel("Max UI Framerate");
+        ImGui::SetNextItemWidth(menuWidth - ImGui::GetCursorPosX());
+        if (ImGui::InputInt("##sdrpp_max_fps", &maxFps, 1, 10)) {
+            maxFps = std::max<int>(0, maxFps);
+            backend::setMaxFPS(maxFps);
+            core::configManager.acquire();
+            core::configManager.conf["maxFps"] = maxFps;
+            core::configManager.release(true);
+        }
+
         ImGui::LeftLabel("FFT Size");
         ImGui::SetNextItemWidth(menuWidth - ImGui::GetCursorPosX());
         if (ImGui::Combo("##sdrpp_fft_size", &fftSizeId, FFTSizesStr)) {
@@ -236,6 +302,23 @@ namespace displaymenu {
             core::configManager.release(true);
         }
 
+        if (ImGui::Checkbox("Measure FFT plans##_sdrpp", &fftMeasuredPlanning)) {
+            dsp::fft::planner::setMeasuring(fftMeasuredPlanning);
+            core::configManager.acquire();
+            core::configManager.conf["fftMeasuredPlanning"] = fftMeasuredPlanning;
+            core::configManager.release(true);
+        }
+
+        ImGui::LeftLabel("FFT Threads");
+        ImGui::SetNextItemWidth(menuWidth - ImGui::GetCursorPosX());
+        if (ImGui::InputInt("##sdrpp_fft_threads", &fftThreads, 1, 1)) {
+            fftThreads = fftThreadCount();
+            sigpath::iqFrontEnd.setFFTThreads(fftThreads);
+            core::configManager.acquire();
+            core::configManager.conf["fftThreads"] = fftThreads;
+            core::configManager.release(true);
+        }
+
         if (colorMapNames.size() > 0) {
             ImGui::LeftLabel("Color Map");
             ImGui::SetNextItemWidth(menuWidth - ImGui::GetCursorPosX());
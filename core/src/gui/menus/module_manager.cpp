@@ -39,13 +39,15 @@ namespace module_manager_menu {
         ImVec2 btnSize = ImVec2(lheight, lheight - 1);
         ImVec2 textOff = ImVec2(3.0f * style::uiScale, -5.0f * style::uiScale);
 
-        if (ImGui::BeginTable("Module Manager Table", 3, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY, ImVec2(0, 200))) {
+        if (ImGui::BeginTable("Module Manager Table", 4, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY, ImVec2(0, 200))) {
             ImGui::TableSetupColumn("Name");
             ImGui::TableSetupColumn("Type");
+            ImGui::TableSetupColumn("On", ImGuiTableColumnFlags_WidthFixed);
             ImGui::TableSetupColumn("", ImGuiTableColumnFlags_WidthFixed, cellWidth);
-            ImGui::TableSetupScrollFreeze(3, 1);
+            ImGui::TableSetupScrollFreeze(4, 1);
             ImGui::TableHeadersRow();
 
+            std::string toggled = "";
             for (auto& [name, inst] : core::moduleManager.instances) {
                 ImGui::TableNextRow();
 
@@ -55,7 +57,14 @@ namespace module_manager_menu {
                 ImGui::TableSetColumnIndex(1);
                 ImGui::TextUnformatted(inst.module.info->name);
 
+                // Deferred instances are only created once enabled from here
                 ImGui::TableSetColumnIndex(2);
+                bool enabled = core::moduleManager.instanceEnabled(name);
+                if (ImGui::Checkbox(("##module_mgr_enabled_" + name).c_str(), &enabled)) {
+                    toggled = name;
+                }
+
+                ImGui::TableSetColumnIndex(3);
                 ImVec2 cpos = ImGui::GetCursorPos();
                 ImGui::SetCursorPos(ImVec2(cpos.x - hdiff, cpos.y + 1));
                 if (ImGui::Button(("##module_mgr_" + name).c_str(), btnSize)) {
@@ -66,6 +75,17 @@ namespace module_manager_menu {
                 ImGui::TextUnformatted("_");
             }
             ImGui::EndTable();
+
+            // Applied after the loop since enabling a deferred instance modifies the instance list
+            if (!toggled.empty()) {
+                if (core::moduleManager.instanceEnabled(toggled)) {
+                    core::moduleManager.disableInstance(toggled);
+                }
+                else {
+                    core::moduleManager.enableInstance(toggled);
+                }
+                modified = true;
+            }
         }
 
         if (ImGui::GenericDialog("module_mgr_confirm_", confirmOpened, GENERIC_DIALOG_BUTTONS_YES_NO, []() {
@@ -117,7 +137,7 @@ namespace module_manager_menu {
             json instances;
             for (auto [_name, inst] : core::moduleManager.instances) {
                 instances[_name]["module"] = inst.module.info->name;
-                instances[_name]["enabled"] = inst.instance->isEnabled();
+                instances[_name]["enabled"] = core::moduleManager.instanceEnabled(_name);
             }
             core::configManager.conf["moduleInstances"] = instances;
             core::configManager.release(true);
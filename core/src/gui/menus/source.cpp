@@ -14,6 +14,7 @@ namespace sourcemenu {
     int decimationPower = 0;
     bool iqCorrection = false;
     bool invertIQ = false;
+    double bufferLatency = 250.0;
 
     EventHandler<std::string> sourceRegisteredHandler;
     EventHandler<std::string> sourceUnregisterHandler;
@@ -145,8 +146,10 @@ namespace sourcemenu {
         decimationPower = core::configManager.conf["decimationPower"];
         iqCorrection = core::configManager.conf["iqCorrection"];
         invertIQ = core::configManager.conf["invertIQ"];
+        bufferLatency = core::configManager.conf["bufferLatency"];
         sigpath::iqFrontEnd.setDCBlocking(iqCorrection);
         sigpath::iqFrontEnd.setInvertIQ(invertIQ);
+        sigpath::iqFrontEnd.setBufferLatency(bufferLatency);
         updateOffset();
 
         refreshSources();
@@ -229,6 +232,34 @@ namespace sourcemenu {
             core::configManager.conf["decimationPower"] = decimationPower;
             core::configManager.release(true);
         }
+
+        ImGui::LeftLabel("Buffer (ms)");
+        ImGui::SetNextItemWidth(itemWidth - ImGui::GetCursorPosX());
+        if (ImGui::InputDouble("##source_buffer_latency", &bufferLatency, 10.0, 100.0, "%.0f")) {
+            bufferLatency = std::clamp<double>(bufferLatency, 10.0, 5000.0);
+            sigpath::iqFrontEnd.setBufferLatency(bufferLatency);
+            core::configManager.acquire();
+            core::configManager.conf["bufferLatency"] = bufferLatency;
+            core::configManager.release(true);
+        }
         if (running) { style::endDisabled(); }
+
+        // Input buffer health
+        dsp::buffer::InputBufferStats stats = sigpath::iqFrontEnd.getInputBufferStats();
+        ImGui::Text("Buffer usage: %d%%", stats.capacity ? (int)((100ll * stats.fill) / stats.capacity) : 0);
+        if (stats.overflows) {
+            int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+            ImGui::TextColored(ImVec4(1.0f, 0.0f, 0.0f, 1.0f), "Overflows: %llu (%llu samples lost)", (unsigned long long)stats.overflows, (unsigned long long)stats.droppedSamples);
+            ImGui::Text("Last overflow: %llds ago", (long long)((now - stats.lastOverflow) / 1000));
+        }
+        else {
+            ImGui::TextUnformatted("Overflows: 0");
+        }
+        ImGui::Text("Input stalls: %llu", (unsigned long long)stats.inputGaps);
+        if (stats.overflows || stats.inputGaps) {
+            if (ImGui::Button("Reset##source_buffer_stats_reset", ImVec2(itemWidth - ImGui::GetCursorPosX(), 0))) {
+                sigpath::iqFrontEnd.resetInputBufferStats();
+            }
+        }
     }
 }
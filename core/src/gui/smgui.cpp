@@ -2,6 +2,7 @@
 #include "style.h"
 #include <gui/widgets/stepped_slider.h>
 #include <gui/gui.h>
+#include <unordered_map>
 
 namespace SmGui {
     std::map<FormatString, const char*> fmtStr = {
@@ -454,6 +455,291 @@ namespace SmGui {
         return true;
     }
 
+    // Compact encoding
+    //
+    // A list is made of a table of all its distinct strings followed by the elements. Each element starts with a tag
+    // byte holding its type and, for steps and bools, a flag (forceSync or the value). Steps are followed by the step,
+    // integers by a zigzag varint, floats by their 4 bytes and strings by their index in the table. A diff gives the
+    // element count of the whole list followed by the table and the changed elements, each preceded by its index.
+    #define COMPACT_TYPE_MASK   0x07
+    #define COMPACT_FLAG        0x08
+
+    class CompactWriter {
+    public:
+        CompactWriter(void* data, int len) : buf((uint8_t*)data), len(len) {}
+
+        void byte(uint8_t b) {
+            if (pos < len) { buf[pos] = b; }
+            pos++;
+        }
+
+        void varint(uint32_t v) {
+            while (v >= 0x80) {
+                byte((v & 0x7F) | 0x80);
+                v >>= 7;
+            }
+            byte(v);
+        }
+
+        void raw(const void* data, int count) {
+            if (pos + count <= len) { memcpy(&buf[pos], data, count); }
+            pos += count;
+        }
+
+        // Number of bytes written or -1 if they didn't fit
+        int result() { return (pos <= len) ? pos : -1; }
+
+    private:
+        uint8_t* buf;
+        int len;
+        int pos = 0;
+    };
+
+    class CompactReader {
+    public:
+        CompactReader(void* data, int len) : buf((uint8_t*)data), len(len) {}
+
+        bool byte(uint8_t& b) {
+            if (pos >= len) { return false; }
+            b = buf[pos++];
+            return true;
+        }
+
+        bool varint(uint32_t& v) {
+            v = 0;
+            for (int shift = 0; shift < 35; shift += 7) {
+                uint8_t b;
+                if (!byte(b)) { return false; }
+                v |= (uint32_t)(b & 0x7F) << shift;
+                if (!(b & 0x80)) { return true; }
+            }
+            return false;
+        }
+
+        bool raw(void* data, int count) {
+            if (pos + count > len) { return false; }
+            memcpy(data, &buf[pos], count);
+            pos += count;
+            return true;
+        }
+
+        int position() { return pos; }
+
+    private:
+        uint8_t* buf;
+        int len;
+        int pos = 0;
+    };
+
+    static bool sameItem(const DrawListElem& a, const DrawListElem& b) {
+        if (a.type != b.type) { return false; }
+        switch (a.type) {
+        case DRAW_LIST_ELEM_TYPE_DRAW_STEP: return a.step == b.step && a.forceSync == b.forceSync;
+        case DRAW_LIST_ELEM_TYPE_BOOL:      return a.b == b.b;
+        case DRAW_LIST_ELEM_TYPE_INT:       return a.i == b.i;
+        case DRAW_LIST_ELEM_TYPE_FLOAT:     return a.f == b.f;
+        case DRAW_LIST_ELEM_TYPE_STRING:    return a.str == b.str;
+        default:                            return false;
+        }
+    }
+
+    // Writes the string table and the given elements, preceded by their index if requested
+    static void writeCompactItems(CompactWriter& w, std::vector<DrawListElem>& elements, const std::vector<int>& ids, bool withIndex) {
+        // Give each distinct string an index
+        std::unordered_map<std::string, uint32_t> strIds;
+        std::vector<const std::string*> strings;
+        for (int id : ids) {
+            DrawListElem& elem = elements[id];
+            if (elem.type != DRAW_LIST_ELEM_TYPE_STRING || strIds.find(elem.str) != strIds.end()) { continue; }
+            strIds[elem.str] = strings.size();
+            strings.push_back(&elem.str);
+        }
+
+        // Write string table
+        w.varint(strings.size());
+        for (auto str : strings) {
+            w.varint(str->size());
+            w.raw(str->c_str(), str->size());
+        }
+
+        // Write elements
+        w.varint(ids.size());
+        for (int id : ids) {
+            DrawListElem& elem = elements[id];
+            if (withIndex) { w.varint(id); }
+            if (elem.type == DRAW_LIST_ELEM_TYPE_DRAW_STEP) {
+                w.byte(elem.type | (elem.forceSync ? COMPACT_FLAG : 0));
+                w.byte(elem.step);
+            }
+            else if (elem.type == DRAW_LIST_ELEM_TYPE_BOOL) {
+                w.byte(elem.type | (elem.b ? COMPACT_FLAG : 0));
+            }
+            else if (elem.type == DRAW_LIST_ELEM_TYPE_INT) {
+                w.byte(elem.type);
+                w.varint(((uint32_t)elem.i << 1) ^ (uint32_t)(elem.i >> 31));
+            }
+            else if (elem.type == DRAW_LIST_ELEM_TYPE_FLOAT) {
+                w.byte(elem.type);
+                w.raw(&elem.f, sizeof(float));
+            }
+            else if (elem.type == DRAW_LIST_ELEM_TYPE_STRING) {
+                w.byte(elem.type);
+                w.varint(strIds[elem.str]);
+            }
+        }
+    }
+
+    // Reads the string table and the elements, along with their index if requested
+    static bool readCompactItems(CompactReader& r, std::vector<DrawListElem>& elements, std::vector<uint32_t>* ids) {
+        // Read string table
+        uint32_t strCount;
+        if (!r.varint(strCount)) { return false; }
+        std::vector<std::string> strings;
+        for (uint32_t i = 0; i < strCount; i++) {
+            uint32_t slen;
+            if (!r.varint(slen) || slen > 0xFFFF) { return false; }
+            std::string str(slen, '\0');
+            if (!r.raw(str.data(), slen)) { return false; }
+            strings.push_back(std::move(str));
+        }
+
+        // Read elements
+        uint32_t count;
+        if (!r.varint(count)) { return false; }
+        for (uint32_t i = 0; i < count; i++) {
+            if (ids) {
+                uint32_t id;
+                if (!r.varint(id)) { return false; }
+                ids->push_back(id);
+            }
+
+            DrawListElem elem;
+            uint8_t tag;
+            if (!r.byte(tag)) { return false; }
+            elem.type = (DrawListElemType)(tag & COMPACT_TYPE_MASK);
+            if (elem.type == DRAW_LIST_ELEM_TYPE_DRAW_STEP) {
+                uint8_t step;
+                if (!r.byte(step)) { return false; }
+                elem.step = (DrawStep)step;
+                elem.forceSync = tag & COMPACT_FLAG;
+            }
+            else if (elem.type == DRAW_LIST_ELEM_TYPE_BOOL) {
+                elem.b = tag & COMPACT_FLAG;
+            }
+            else if (elem.type == DRAW_LIST_ELEM_TYPE_INT) {
+                uint32_t v;
+                if (!r.varint(v)) { return false; }
+                elem.i = (int)((v >> 1) ^ (~(v & 1) + 1));
+            }
+            else if (elem.type == DRAW_LIST_ELEM_TYPE_FLOAT) {
+                if (!r.raw(&elem.f, sizeof(float))) { return false; }
+            }
+            else if (elem.type == DRAW_LIST_ELEM_TYPE_STRING) {
+                uint32_t strId;
+                if (!r.varint(strId) || strId >= strings.size()) { return false; }
+                elem.str = strings[strId];
+            }
+            else {
+                return false;
+            }
+            elements.push_back(std::move(elem));
+        }
+
+        return true;
+    }
+
+    bool DrawList::isCompact(void* data, int len) {
+        uint8_t* buf = (uint8_t*)data;
+        return len >= 1 && (buf[0] == DRAW_LIST_ENCODING_FULL || buf[0] == DRAW_LIST_ENCODING_DIFF);
+    }
+
+    int DrawList::storeCompact(void* data, int len) {
+        CompactWriter w(data, len);
+        std::vector<int> ids(elements.size());
+        for (int i = 0; i < ids.size(); i++) { ids[i] = i; }
+        w.byte(DRAW_LIST_ENCODING_FULL);
+        writeCompactItems(w, elements, ids, false);
+        return w.result();
+    }
+
+    int DrawList::storeDiff(DrawList& previous, void* data, int len) {
+        if (!sameLayout(previous)) { return storeCompact(data, len); }
+
+        // Only keep the elements that changed
+        std::vector<int> ids;
+        int count = elements.size();
+        for (int i = 0; i < count; i++) {
+            if (!sameItem(elements[i], previous.elements[i])) { ids.push_back(i); }
+        }
+
+        CompactWriter w(data, len);
+        w.byte(DRAW_LIST_ENCODING_DIFF);
+        w.varint(count);
+        writeCompactItems(w, elements, ids, true);
+        return w.result();
+    }
+
+    int DrawList::loadCompact(void* data, int len) {
+        CompactReader r(data, len);
+        uint8_t encoding;
+        if (!r.byte(encoding)) { return -1; }
+
+        if (encoding == DRAW_LIST_ENCODING_FULL) {
+            DrawList dl;
+            if (!readCompactItems(r, dl.elements, NULL)) { return -1; }
+            if (!dl.validate()) {
+                flog::error("Drawlist validation failed");
+                return -1;
+            }
+            elements = std::move(dl.elements);
+        }
+        else if (encoding == DRAW_LIST_ENCODING_DIFF) {
+            // The diff must have been made against a list with the same layout
+            uint32_t count;
+            if (!r.varint(count) || count != elements.size()) { return -1; }
+            std::vector<DrawListElem> changes;
+            std::vector<uint32_t> ids;
+            if (!readCompactItems(r, changes, &ids)) { return -1; }
+            for (int i = 0; i < changes.size(); i++) {
+                if (ids[i] >= count) { return -1; }
+                DrawListElem& elem = elements[ids[i]];
+                if (changes[i].type != elem.type) { return -1; }
+                if (elem.type == DRAW_LIST_ELEM_TYPE_DRAW_STEP && changes[i].step != elem.step) { return -1; }
+            }
+
+            // Everything checks out, apply the changes
+            for (int i = 0; i < changes.size(); i++) {
+                elements[ids[i]] = std::move(changes[i]);
+            }
+        }
+        else {
+            return -1;
+        }
+
+        return r.position();
+    }
+
+    bool DrawList::sameLayout(DrawList& b) {
+        int count = elements.size();
+        if (count != b.elements.size()) { return false; }
+        for (int i = 0; i < count; i++) {
+            DrawListElem& ea = elements[i];
+            DrawListElem& eb = b.elements[i];
+            if (ea.type != eb.type) { return false; }
+            if (ea.type == DRAW_LIST_ELEM_TYPE_DRAW_STEP && ea.step != eb.step) { return false; }
+        }
+        return true;
+    }
+
+    bool DrawList::sameAs(DrawList& b) {
+        int count = elements.size();
+        if (count != b.elements.size()) { return false; }
+        for (int i = 0; i < count; i++) {
+            if (!sameItem(elements[i], b.elements[i])) { return false; }
+        }
+        return true;
+    }
+
     // Signaling functions
     void ForceSync() {
         forceSyncForNext = true;
@@ -48,6 +48,16 @@ namespace SmGui {
         DRAW_LIST_ELEM_TYPE_STRING,
     };
 
+    // First byte of a draw list in the compact encoding. A list in the original encoding starts with the type of its
+    // first element, so both can be told apart.
+    enum DrawListEncoding {
+        DRAW_LIST_ENCODING_FULL = 0xC0,
+        DRAW_LIST_ENCODING_DIFF = 0xC1
+    };
+
+    // Version of the compact encoding, given by clients when asking for the UI
+    #define SMGUI_COMPACT_VERSION   1
+
     struct DrawListElem {
         DrawListElemType type;
         DrawStep step;
@@ -96,6 +106,16 @@ namespace SmGui {
         bool checkTypes(int firstId, int n, ...);
         bool validate();
 
+        // Compact encoding, strings are sent once through a table and integers as varints
+        static bool isCompact(void* data, int len);
+        int storeCompact(void* data, int len);
+        // Only the elements that differ from `previous`, or the whole list if the layout changed
+        int storeDiff(DrawList& previous, void* data, int len);
+        // Loads a whole list or applies a diff to the current one. A diff that doesn't match the layout is rejected.
+        int loadCompact(void* data, int len);
+        bool sameLayout(DrawList& b);
+        bool sameAs(DrawList& b);
+
         std::vector<DrawListElem> elements;
     };
 
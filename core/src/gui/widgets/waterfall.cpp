@@ -3,10 +3,10 @@
 #include <imgui_internal.h>
 #include <imutils.h>
 #include <algorithm>
-#include <volk/volk.h>
 #include <utils/flog.h>
 #include <gui/gui.h>
 #include <gui/style.h>
+#include <backend.h>
 
 float DEFAULT_COLOR_MAP[][3] = {
     { 0x00, 0x00, 0x20 },
@@ -689,7 +689,6 @@ namespace ImGui {
 
     void WaterFall::onResize() {
         std::lock_guard<std::recursive_mutex> lck(latestFFTMtx);
-        std::lock_guard<std::mutex> lck2(smoothingBufMtx);
         // return if widget is too small
         if (widgetSize.x < 100 || widgetSize.y < 100) {
             return;
@@ -741,15 +740,6 @@ namespace ImGui {
         }
         latestFFTHold = new float[dataWidth];
 
-        // Reallocate smoothing buffer
-        if (fftSmoothing) {
-            if (smoothingBuf) { delete[] smoothingBuf; }
-            smoothingBuf = new float[dataWidth];
-            for (int i = 0; i < dataWidth; i++) {
-                smoothingBuf[i] = -1000.0f; 
-            }
-        }
-
         if (waterfallVisible) {
             delete[] waterfallFb;
             waterfallFb = new uint32_t[dataWidth * waterfallHeight];
@@ -861,6 +851,13 @@ namespace ImGui {
 
     void WaterFall::pushFFT() {
         if (rawFFTs == NULL) { return; }
+
+        // Nothing will be shown, only keep the raw lines so that the waterfall can be rebuilt when restored
+        if (minimized) {
+            buf_mtx.unlock();
+            return;
+        }
+
         std::lock_guard<std::recursive_mutex> lck(latestFFTMtx);
         double offsetRatio = viewOffset / (wholeBandwidth / 2.0);
         int drawDataSize = (viewBandwidth / wholeBandwidth) * rawFFTSize;
@@ -883,13 +880,9 @@ namespace ImGui {
             fftLines = 1;
         }
 
-        // Apply smoothing if enabled
-        if (fftSmoothing && latestFFT != NULL && smoothingBuf != NULL && fftLines != 0) {
-            std::lock_guard<std::mutex> lck2(smoothingBufMtx);
-            volk_32f_s32f_multiply_32f(latestFFT, latestFFT, fftSmoothingAlpha, dataWidth);
-            volk_32f_s32f_multiply_32f(smoothingBuf, smoothingBuf, fftSmoothingBeta, dataWidth);
-            volk_32f_x2_add_32f(smoothingBuf, latestFFT, smoothingBuf, dataWidth);
-            memcpy(latestFFT, smoothingBuf, dataWidth * sizeof(float));
+        // Show the smoothed trace instead of the last spectrum if enabled, the waterfall keeps the raw one
+        if (fftSmoothing && rawFFTTrace != NULL && fftLines != 0) {
+            doZoom(drawDataStart, drawDataSize, dataWidth, rawFFTTrace, latestFFT);
         }
 
         if (selectedVFO != "" && vfos.size() > 0) {
@@ -905,13 +898,25 @@ namespace ImGui {
         }
 
         // If FFT hold is enabled, update it
-        if (fftHold && latestFFT != NULL && latestFFTHold != NULL && fftLines != 0) {
-            for (int i = 1; i < dataWidth; i++) {
-                latestFFTHold[i] = std::max<float>(latestFFT[i], latestFFTHold[i] - fftHoldSpeed);
-            }
+        if (fftHold && rawFFTHold != NULL && latestFFTHold != NULL && fftLines != 0) {
+            doZoom(drawDataStart, drawDataSize, dataWidth, rawFFTHold, latestFFTHold);
         }
 
         buf_mtx.unlock();
+
+        // Wake up the render loop to show the new line
+        backend::requestFrame();
+    }
+
+    void WaterFall::setMinimized(bool minimized) {
+        std::lock_guard<std::recursive_mutex> lck(buf_mtx);
+        if (minimized == this->minimized) { return; }
+        this->minimized = minimized;
+
+        // Lines kept while minimized were never drawn
+        if (!minimized) {
+            updateWaterfallFb();
+        }
     }
 
     void WaterFall::updatePallette(float colors[][3], int colorCount) {
@@ -1116,6 +1121,18 @@ namespace ImGui {
         }
         fftLines = 0;
         memset(rawFFTs, 0, rawFFTSize * waterfallHeight * sizeof(float));
+
+        // The traces from the previous size are useless
+        std::lock_guard<std::recursive_mutex> lck2(latestFFTMtx);
+        if (rawFFTTrace) { delete[] rawFFTTrace; }
+        if (rawFFTHold) { delete[] rawFFTHold; }
+        rawFFTTrace = new float[rawFFTSize];
+        rawFFTHold = new float[rawFFTSize];
+        for (int i = 0; i < rawFFTSize; i++) {
+            rawFFTTrace[i] = -1000.0f;
+            rawFFTHold[i] = -1000.0f;
+        }
+
         updateWaterfallFb();
     }
 
@@ -1124,46 +1141,41 @@ namespace ImGui {
     }
 
     void WaterFall::setFFTHold(bool hold) {
+        std::lock_guard<std::recursive_mutex> lck(latestFFTMtx);
         fftHold = hold;
         if (fftHold && latestFFTHold) {
             for (int i = 0; i < dataWidth; i++) {
                 latestFFTHold[i] = -1000.0;
             }
         }
+        if (fftHold && rawFFTHold) {
+            for (int i = 0; i < rawFFTSize; i++) {
+                rawFFTHold[i] = -1000.0;
+            }
+        }
     }
 
-    void WaterFall::setFFTHoldSpeed(float speed) {
-        fftHoldSpeed = speed;
+    void WaterFall::pushFFTHold(const float* data, int size) {
+        std::lock_guard<std::recursive_mutex> lck(latestFFTMtx);
+        if (!rawFFTHold || size != rawFFTSize) { return; }
+        memcpy(rawFFTHold, data, size * sizeof(float));
     }
 
     void WaterFall::setFFTSmoothing(bool enabled) {
-        std::lock_guard<std::mutex> lck(smoothingBufMtx);
+        std::lock_guard<std::recursive_mutex> lck(buf_mtx);
+        std::lock_guard<std::recursive_mutex> lck2(latestFFTMtx);
         fftSmoothing = enabled;
 
-        // Free buffer if not null
-        if (smoothingBuf) {delete[] smoothingBuf; }
-
-        // If disabled, stop here
-        if (!enabled) {
-            smoothingBuf = NULL;
-            return;
-        }
-
-        // Allocate and copy existing FFT into it
-        smoothingBuf = new float[dataWidth];
-        if (latestFFT) {
-            std::lock_guard<std::recursive_mutex> lck2(latestFFTMtx);
-            memcpy(smoothingBuf, latestFFT, dataWidth * sizeof(float));
-        }
-        else {
-            memset(smoothingBuf, 0, dataWidth * sizeof(float));
+        // Start from the current spectrum until the first smoothed one comes in
+        if (fftSmoothing && rawFFTTrace && rawFFTs) {
+            memcpy(rawFFTTrace, waterfallVisible ? &rawFFTs[currentFFTLine * rawFFTSize] : rawFFTs, rawFFTSize * sizeof(float));
         }
     }
 
-    void WaterFall::setFFTSmoothingSpeed(float speed) {
-        std::lock_guard<std::mutex> lck(smoothingBufMtx);
-        fftSmoothingAlpha = speed;
-        fftSmoothingBeta = 1.0f - speed;
+    void WaterFall::pushFFTTrace(const float* data, int size) {
+        std::lock_guard<std::recursive_mutex> lck(latestFFTMtx);
+        if (!rawFFTTrace || size != rawFFTSize) { return; }
+        memcpy(rawFFTTrace, data, size * sizeof(float));
     }
 
     void WaterFall::setSNRSmoothing(bool enabled) {
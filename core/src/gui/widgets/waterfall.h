@@ -166,15 +166,19 @@ namespace ImGui {
 
         void setBandPlanPos(int pos);
 
+        // The hold and smoothed traces are computed by the DSP at full resolution and pushed along with the spectrum
         void setFFTHold(bool hold);
-        void setFFTHoldSpeed(float speed);
+        void pushFFTHold(const float* data, int size);
 
         void setFFTSmoothing(bool enabled);
-        void setFFTSmoothingSpeed(float speed);
+        void pushFFTTrace(const float* data, int size);
 
         void setSNRSmoothing(bool enabled);
         void setSNRSmoothingSpeed(float speed);
 
+        // Skips all drawing work on new FFT lines while the window can't be seen
+        void setMinimized(bool minimized);
+
         float* acquireLatestFFT(int& width);
         void releaseLatestFFT();
 
@@ -276,7 +280,6 @@ namespace ImGui {
         std::recursive_mutex buf_mtx;
         std::recursive_mutex latestFFTMtx;
         std::mutex texMtx;
-        std::mutex smoothingBufMtx;
 
         float vRange;
 
@@ -313,7 +316,8 @@ namespace ImGui {
         float* rawFFTs = NULL;
         float* latestFFT = NULL;
         float* latestFFTHold = NULL;
-        float* smoothingBuf = NULL;
+        float* rawFFTTrace = NULL;
+        float* rawFFTHold = NULL;
         int currentFFTLine = 0;
         int fftLines = 0;
 
@@ -331,13 +335,10 @@ namespace ImGui {
         int bandPlanPos = BANDPLAN_POS_BOTTOM;
 
         bool fftHold = false;
-        float fftHoldSpeed = 0.3f;
-
         bool fftSmoothing = false;
-        float fftSmoothingAlpha = 0.5;
-        float fftSmoothingBeta = 0.5;
 
         bool snrSmoothing = false;
+        bool minimized = false;
         float snrSmoothingAlpha = 0.5;
         float snrSmoothingBeta = 0.5;
 
@@ -1,9 +1,17 @@
 #include <module.h>
 #include <filesystem>
+#include <thread>
+#include <chrono>
+#include <algorithm>
 #include <utils/flog.h>
 
+static double msSince(std::chrono::high_resolution_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
 ModuleManager::Module_t ModuleManager::loadModule(std::string path) {
     Module_t mod;
+    auto start = std::chrono::high_resolution_clock::now();
 
     // On android, the path has to be relative, don't make it absolute
 #ifndef __ANDROID__
@@ -30,6 +38,7 @@ ModuleManager::Module_t ModuleManager::loadModule(std::string path) {
     mod.createInstance = (Instance * (*)(std::string)) GetProcAddress(mod.handle, "_CREATE_INSTANCE_");
     mod.deleteInstance = (void (*)(Instance*))GetProcAddress(mod.handle, "_DELETE_INSTANCE_");
     mod.end = (void (*)())GetProcAddress(mod.handle, "_END_");
+    const int* flags = (const int*)GetProcAddress(mod.handle, "_FLAGS_");
 #else
     mod.handle = dlopen(path.c_str(), RTLD_LAZY | RTLD_LOCAL);
     if (mod.handle == NULL) {
@@ -42,7 +51,9 @@ ModuleManager::Module_t ModuleManager::loadModule(std::string path) {
     mod.createInstance = (Instance * (*)(std::string)) dlsym(mod.handle, "_CREATE_INSTANCE_");
     mod.deleteInstance = (void (*)(Instance*))dlsym(mod.handle, "_DELETE_INSTANCE_");
     mod.end = (void (*)())dlsym(mod.handle, "_END_");
+    const int* flags = (const int*)dlsym(mod.handle, "_FLAGS_");
 #endif
+    mod.flags = flags ? *flags : 0;
     if (mod.info == NULL) {
         flog::error("{0} is missing _INFO_ symbol", path);
         mod.handle = NULL;
@@ -80,38 +91,120 @@ ModuleManager::Module_t ModuleManager::loadModule(std::string path) {
     }
     mod.init();
     modules[mod.info->name] = mod;
+    loadTimes[mod.info->name] = msSince(start);
     return mod;
 }
 
-int ModuleManager::createInstance(std::string name, std::string module) {
+bool ModuleManager::checkNewInstance(std::string name, std::string module) {
     if (modules.find(module) == modules.end()) {
         flog::error("Module '{0}' doesn't exist", module);
-        return -1;
+        return false;
     }
     if (instances.find(name) != instances.end()) {
         flog::error("A module instance with the name '{0}' already exists", name);
-        return -1;
+        return false;
     }
     int maxCount = modules[module].info->maxInstances;
     if (countModuleInstances(module) >= maxCount && maxCount > 0) {
         flog::error("Maximum number of instances reached for '{0}'", module);
-        return -1;
+        return false;
     }
+    return true;
+}
+
+int ModuleManager::createInstance(std::string name, std::string module) {
+    if (!checkNewInstance(name, module)) { return -1; }
     Instance_t inst;
     inst.module = modules[module];
+    auto start = std::chrono::high_resolution_clock::now();
     inst.instance = inst.module.createInstance(name);
+    createTimes[name] = msSince(start);
     instances[name] = inst;
     onInstanceCreated.emit(name);
     return 0;
 }
 
+void ModuleManager::createInstances(const std::vector<InstanceDesc_t>& list) {
+    // Register all source instances, only the enabled ones are created now
+    std::vector<std::string> toCreate;
+    for (const auto& desc : list) {
+        if (modules.find(desc.module) == modules.end()) { continue; }
+        if (!(modules[desc.module].flags & MODULE_FLAG_SOURCE)) { continue; }
+        if (!checkNewInstance(desc.name, desc.module)) { continue; }
+        Instance_t inst;
+        inst.module = modules[desc.module];
+        inst.instance = NULL;
+        instances[desc.name] = inst;
+        if (desc.enabled) {
+            flog::info("Initializing {0} ({1})", desc.name, desc.module);
+            toCreate.push_back(desc.name);
+            createTimes[desc.name] = 0.0;
+        }
+        else {
+            flog::info("Deferring {0} ({1}) until it's enabled", desc.name, desc.module);
+        }
+    }
+
+    // Create the instances of audited modules in parallel. The maps aren't modified while the threads run,
+    // each only writes to its own entries. The others are created in order on this thread meanwhile since
+    // their device libraries aren't known to be safe to initialize from several threads at once.
+    auto start = std::chrono::high_resolution_clock::now();
+    auto create = [this](std::string name, Instance_t* inst, double* time) {
+        auto start = std::chrono::high_resolution_clock::now();
+        inst->instance = inst->module.createInstance(name);
+        *time = msSince(start);
+    };
+#ifdef __ANDROID__
+    // Device access goes through the JVM which is only attached to the main thread
+    for (const auto& name : toCreate) { create(name, &instances[name], &createTimes[name]); }
+#else
+    std::vector<std::thread> threads;
+    for (const auto& name : toCreate) {
+        if (!(instances[name].module.flags & MODULE_FLAG_PARALLEL_INIT)) { continue; }
+        threads.push_back(std::thread(create, name, &instances[name], &createTimes[name]));
+    }
+    for (const auto& name : toCreate) {
+        if (instances[name].module.flags & MODULE_FLAG_PARALLEL_INIT) { continue; }
+        create(name, &instances[name], &createTimes[name]);
+    }
+    for (auto& t : threads) { t.join(); }
+#endif
+    parallelCreateTime = msSince(start);
+    for (const auto& name : toCreate) { onInstanceCreated.emit(name); }
+
+    // Then the other instances, in order
+    for (const auto& desc : list) {
+        if (modules.find(desc.module) != modules.end() && (modules[desc.module].flags & MODULE_FLAG_SOURCE)) { continue; }
+        flog::info("Initializing {0} ({1})", desc.name, desc.module);
+        if (createInstance(desc.name, desc.module)) { continue; }
+        if (!desc.enabled) { disableInstance(desc.name); }
+    }
+}
+
+void ModuleManager::createDeferred(std::string name) {
+    Instance_t& inst = instances[name];
+    flog::info("Initializing {0} ({1})", name, inst.module.info->name);
+    auto start = std::chrono::high_resolution_clock::now();
+    inst.instance = inst.module.createInstance(name);
+    createTimes[name] = msSince(start);
+    onInstanceCreated.emit(name);
+
+    // Catch up with the post-init the other instances already went through
+    if (postInitDone) { inst.instance->postInit(); }
+}
+
 int ModuleManager::deleteInstance(std::string name) {
     if (instances.find(name) == instances.end()) {
         flog::error("Tried to remove non-existent instance '{0}'", name);
         return -1;
     }
-    onInstanceDelete.emit(name);
     Instance_t inst = instances[name];
+    if (!inst.instance) {
+        // Never created
+        instances.erase(name);
+        return 0;
+    }
+    onInstanceDelete.emit(name);
     inst.module.deleteInstance(inst.instance);
     instances.erase(name);
     onInstanceDeleted.emit(name);
@@ -128,6 +221,7 @@ int ModuleManager::enableInstance(std::string name) {
         flog::error("Cannot enable '{0}', instance doesn't exist", name);
         return -1;
     }
+    if (!instances[name].instance) { createDeferred(name); }
     instances[name].instance->enable();
     return 0;
 }
@@ -137,6 +231,7 @@ int ModuleManager::disableInstance(std::string name) {
         flog::error("Cannot disable '{0}', instance doesn't exist", name);
         return -1;
     }
+    if (!instances[name].instance) { return 0; }
     instances[name].instance->disable();
     return 0;
 }
@@ -146,6 +241,7 @@ bool ModuleManager::instanceEnabled(std::string name) {
         flog::error("Cannot check if '{0}' is enabled, instance doesn't exist", name);
         return false;
     }
+    if (!instances[name].instance) { return false; }
     return instances[name].instance->isEnabled();
 }
 
@@ -154,6 +250,7 @@ void ModuleManager::postInit(std::string name) {
         flog::error("Cannot post-init '{0}', instance doesn't exist", name);
         return;
     }
+    if (!instances[name].instance) { return; }
     instances[name].instance->postInit();
 }
 
@@ -180,7 +277,55 @@ int ModuleManager::countModuleInstances(std::string module) {
 
 void ModuleManager::doPostInitAll() {
     for (auto& [name, inst] : instances) {
+        if (!inst.instance) { continue; }
         flog::info("Running post-init for {0}", name);
+        auto start = std::chrono::high_resolution_clock::now();
         inst.instance->postInit();
+        postInitTimes[name] = msSince(start);
     }
+    postInitDone = true;
+}
+
+void ModuleManager::printStartupProfile() {
+    char buf[256];
+    flog::info("Startup profile:");
+
+    // Modules, slowest first
+    std::vector<std::pair<double, std::string>> mods;
+    double totalLoad = 0.0;
+    for (auto const& [name, time] : loadTimes) {
+        mods.push_back({ time, name });
+        totalLoad += time;
+    }
+    std::sort(mods.rbegin(), mods.rend());
+    for (auto const& [time, name] : mods) {
+        sprintf(buf, "%8.1f ms", time);
+        flog::info("  Load {0} {1}", buf, name);
+    }
+
+    // Instances, slowest first
+    std::vector<std::pair<double, std::string>> insts;
+    double totalCreate = 0.0;
+    double totalPostInit = 0.0;
+    for (auto const& [name, inst] : instances) {
+        if (!inst.instance) {
+            flog::info("  Deferred    {0}", name);
+            continue;
+        }
+        double create = createTimes[name];
+        double postInit = postInitTimes[name];
+        insts.push_back({ create + postInit, name });
+        totalCreate += create;
+        totalPostInit += postInit;
+    }
+    std::sort(insts.rbegin(), insts.rend());
+    for (auto const& [time, name] : insts) {
+        sprintf(buf, "%8.1f ms (create %.1f ms, post-init %.1f ms)", time, createTimes[name], postInitTimes[name]);
+        flog::info("  Instance {0} {1}", buf, name);
+    }
+
+    sprintf(buf, "loading %.1f ms, creating %.1f ms, post-init %.1f ms", totalLoad, totalCreate, totalPostInit);
+    flog::info("  Total: {0}", buf);
+    sprintf(buf, "%.1f ms", parallelCreateTime);
+    flog::info("  Source instances created in {0}", buf);
 }
@@ -1,6 +1,7 @@
 #pragma once
 #include <string>
 #include <map>
+#include <vector>
 #include <json.hpp>
 #include <utils/event.h>
 
@@ -30,6 +31,16 @@
 
 class ModuleManager {
 public:
+    enum ModuleFlags {
+        // Instances only register a source. Disabled ones are only created once enabled.
+        MODULE_FLAG_SOURCE = (1 << 0),
+
+        // The constructor has been checked to only touch its own state, its config and the source manager,
+        // so enabled source instances are created concurrently with the other source instances at startup.
+        // Don't set it on modules whose constructor calls into a device or audio library.
+        MODULE_FLAG_PARALLEL_INIT = (1 << 1)
+    };
+
     struct ModuleInfo_t {
         const char* name;
         const char* description;
@@ -55,6 +66,7 @@ public:
         void* handle;
 #endif
         ModuleManager::ModuleInfo_t* info;
+        int flags;
         void (*init)();
         ModuleManager::Instance* (*createInstance)(std::string name);
         void (*deleteInstance)(ModuleManager::Instance* instance);
@@ -73,12 +85,22 @@ public:
 
     struct Instance_t {
         ModuleManager::Module_t module;
-        ModuleManager::Instance* instance;
+        ModuleManager::Instance* instance; // NULL until a deferred instance is enabled
+    };
+
+    struct InstanceDesc_t {
+        std::string name;
+        std::string module;
+        bool enabled;
     };
 
     ModuleManager::Module_t loadModule(std::string path);
 
     int createInstance(std::string name, std::string module);
+
+    // Create the instances listed in the config. Source instances come first and are created in parallel,
+    // the others then follow in order.
+    void createInstances(const std::vector<InstanceDesc_t>& list);
     int deleteInstance(std::string name);
     int deleteInstance(ModuleManager::Instance* instance);
 
@@ -92,12 +114,30 @@ public:
 
     void doPostInitAll();
 
+    // Time spent loading each module and creating and post-initializing each instance
+    void printStartupProfile();
+
     Event<std::string> onInstanceCreated;
     Event<std::string> onInstanceDelete;
     Event<std::string> onInstanceDeleted;
 
     std::map<std::string, ModuleManager::Module_t> modules;
     std::map<std::string, ModuleManager::Instance_t> instances;
+
+private:
+    bool checkNewInstance(std::string name, std::string module);
+    void createDeferred(std::string name);
+
+    bool postInitDone = false;
+
+    // Milliseconds spent in each step, for the startup profile
+    std::map<std::string, double> loadTimes;
+    std::map<std::string, double> createTimes;
+    std::map<std::string, double> postInitTimes;
+    double parallelCreateTime = 0.0;
 };
 
-#define SDRPP_MOD_INFO MOD_EXPORT const ModuleManager::ModuleInfo_t _INFO_
\ No newline at end of file
+#define SDRPP_MOD_INFO MOD_EXPORT const ModuleManager::ModuleInfo_t _INFO_
+
+// Optional, exported separately from the module info so that its layout stays the same for existing modules
+#define SDRPP_MOD_FLAGS MOD_EXPORT const int _FLAGS_
\ No newline at end of file
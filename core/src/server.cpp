@@ -4,22 +4,26 @@
 #include <version.h>
 #include <config.h>
 #include <filesystem>
+#include <mutex>
 #include <dsp/types.h>
 #include <signal_path/signal_path.h>
 #include <gui/smgui.h>
 #include <utils/optionlist.h>
 #include "dsp/compression/sample_stream_compressor.h"
 #include "dsp/sink/handler_sink.h"
+#include "dsp/buffer/input_buffer.h"
 #include <zstd.h>
 
 namespace server {
     dsp::stream<dsp::complex_t> dummyInput;
+    dsp::buffer::InputBuffer<dsp::complex_t> inBuf;
     dsp::compression::SampleStreamCompressor comp;
     dsp::sink::Handler<uint8_t> hnd;
     net::Conn client;
     uint8_t* rbuf = NULL;
     uint8_t* sbuf = NULL;
     uint8_t* bbuf = NULL;
+    uint8_t* ubuf = NULL;
 
     PacketHeader* r_pkt_hdr = NULL;
     uint8_t* r_pkt_data = NULL;
@@ -34,8 +38,20 @@ namespace server {
     PacketHeader* bb_pkt_hdr = NULL;
     uint8_t* bb_pkt_data = NULL;
 
+    PacketHeader* u_pkt_hdr = NULL;
+    CommandHeader* u_cmd_hdr = NULL;
+    uint8_t* u_cmd_data = NULL;
+
     SmGui::DrawListElem dummyElem;
 
+    // UI state of the client. Clients using the compact encoding are sent diffs against the last list they got,
+    // including unprompted ones when the state of the source changes. The lock is held by every command and by the
+    // periodic push from the main thread, so that the source code never runs on both at once, and when the client
+    // is replaced.
+    std::mutex uiMtx;
+    bool compactUI = false;
+    SmGui::DrawList lastUI;
+
     ZSTD_CCtx* cctx;
 
     net::Listener listener;
@@ -50,11 +66,17 @@ namespace server {
         flog::info("=====| SERVER MODE |=====");
 
         // Init DSP
-        comp.init(&dummyInput, dsp::compression::PCM_TYPE_I8);
+        core::configManager.acquire();
+        double bufferLatency = core::configManager.conf["bufferLatency"];
+        core::configManager.release();
+        inBuf.init(&dummyInput, sampleRate, bufferLatency);
+        comp.init(&inBuf.out, dsp::compression::PCM_TYPE_I8);
         hnd.init(&comp.out, _testServerHandler, NULL);
         rbuf = new uint8_t[SERVER_MAX_PACKET_SIZE];
         sbuf = new uint8_t[SERVER_MAX_PACKET_SIZE];
         bbuf = new uint8_t[SERVER_MAX_PACKET_SIZE];
+        ubuf = new uint8_t[SERVER_MAX_PACKET_SIZE];
+        inBuf.start();
         comp.start();
         hnd.start();
 
@@ -72,6 +94,10 @@ namespace server {
         bb_pkt_hdr = (PacketHeader*)bbuf;
         bb_pkt_data = &bbuf[sizeof(PacketHeader)];
 
+        u_pkt_hdr = (PacketHeader*)ubuf;
+        u_cmd_hdr = (CommandHeader*)&ubuf[sizeof(PacketHeader)];
+        u_cmd_data = &ubuf[sizeof(PacketHeader) + sizeof(CommandHeader)];
+
         // Initialize compressor
         cctx = ZSTD_createCCtx();
 
@@ -125,17 +151,17 @@ namespace server {
         }
 
         // Create module instances
+        std::vector<ModuleManager::InstanceDesc_t> instList;
         for (auto const& [name, _module] : modList) {
             std::string mod = _module["module"];
-            bool enabled = _module["enabled"];
             if (core::moduleManager.modules.find(mod) == core::moduleManager.modules.end()) { continue; }
-            flog::info("Initializing {0} ({1})", name, mod);
-            core::moduleManager.createInstance(name, mod);
-            if (!enabled) { core::moduleManager.disableInstance(name); }
+            instList.push_back({ name, mod, _module["enabled"] });
         }
+        core::moduleManager.createInstances(instList);
 
         // Do post-init
         core::moduleManager.doPostInitAll();
+        if (core::args["startup-profile"].b()) { core::moduleManager.printStartupProfile(); }
 
         // Generate source list
         auto list = sigpath::sourceManager.getSourceNames();
@@ -155,14 +181,19 @@ namespace server {
         listener->acceptAsync(_clientHandler, NULL);
 
         flog::info("Ready, listening on {0}:{1}", host, port);
-        while(1) { std::this_thread::sleep_for(std::chrono::milliseconds(100)); }
+        while(1) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            pushUIChanges();
+        }
 
         return 0;
     }
 
     void _clientHandler(net::Conn conn, void* ctx) {
         // Reject if someone else is already connected
+        std::unique_lock<std::mutex> lck(uiMtx);
         if (client && client->isOpen()) {
+            lck.unlock();
             flog::info("REJECTED Connection from {0}:{1}, another client is already connected.", "TODO", "TODO");
             
             // Issue a disconnect command to the client
@@ -186,15 +217,20 @@ namespace server {
 
         flog::info("Connection from {0}:{1}", "TODO", "TODO");
         client = std::move(conn);
-        client->readAsync(sizeof(PacketHeader), rbuf, _packetHandler, NULL);
 
         // Perform settings reset
         sigpath::sourceManager.stop();
         comp.setPCMType(dsp::compression::PCM_TYPE_I16);
         compression = false;
+        compactUI = false;
+        lastUI.elements.clear();
 
         sendSampleRate(sampleRate);
 
+        // Only start receiving commands once the reset is done
+        client->readAsync(sizeof(PacketHeader), rbuf, _packetHandler, NULL);
+        lck.unlock();
+
         // TODO: Wait otherwise someone else could connect
 
         listener->acceptAsync(_clientHandler, NULL);
@@ -243,11 +279,14 @@ namespace server {
     }
 
     void setInput(dsp::stream<dsp::complex_t>* stream) {
-        comp.setInput(stream);
+        inBuf.setInput(stream);
     }
 
     void commandHandler(Command cmd, uint8_t* data, int len) {
+        std::lock_guard<std::mutex> lck(uiMtx);
         if (cmd == COMMAND_GET_UI) {
+            // Clients supporting the compact encoding give its version, older ones send nothing
+            compactUI = (len >= 1 && data[0] >= SMGUI_COMPACT_VERSION);
             sendUI(COMMAND_GET_UI, "", dummyElem);
         }
         else if (cmd == COMMAND_UI_ACTION && len >= 3) {
@@ -277,6 +316,9 @@ namespace server {
             }
             else {
                 renderUI(NULL, diffId.str, diffValue);
+
+                // Let the client know right away if the action changed other widgets
+                _pushUIChanges();
             }
         }
         else if (cmd == COMMAND_START) {
@@ -298,6 +340,18 @@ namespace server {
         else if (cmd == COMMAND_SET_COMPRESSION && len == 1) {
             compression = *(uint8_t*)data;
         }
+        else if (cmd == COMMAND_GET_INPUT_STATS) {
+            dsp::buffer::InputBufferStats stats = inBuf.getStats();
+            InputStats* istats = (InputStats*)s_cmd_data;
+            istats->overflows = stats.overflows;
+            istats->droppedSamples = stats.droppedSamples;
+            istats->inputGaps = stats.inputGaps;
+            istats->lastOverflow = stats.lastOverflow;
+            istats->lastInputGap = stats.lastInputGap;
+            istats->fill = stats.fill;
+            istats->capacity = stats.capacity;
+            sendCommandAck(COMMAND_GET_INPUT_STATS, sizeof(InputStats));
+        }
         else {
             flog::error("Invalid Command: {0} (len = {1})", (int)cmd, len);
             sendError(ERROR_INVALID_COMMAND);
@@ -344,14 +398,55 @@ namespace server {
         SmGui::DrawList dl;
         renderUI(&dl, diffId, diffValue);
 
-        // Create response
-        int size = dl.getSize();
-        dl.store(s_cmd_data, size);
+        // Create response, a diff is enough if the client already has a list
+        int size;
+        int maxSize = SERVER_MAX_PACKET_SIZE - sizeof(PacketHeader) - sizeof(CommandHeader);
+        if (!compactUI) {
+            size = dl.getSize();
+            dl.store(s_cmd_data, size);
+        }
+        else if (originCmd == COMMAND_GET_UI) {
+            size = dl.storeCompact(s_cmd_data, maxSize);
+        }
+        else {
+            size = dl.storeDiff(lastUI, s_cmd_data, maxSize);
+        }
+        if (size < 0) {
+            flog::error("UI doesn't fit in a packet");
+            return;
+        }
+        lastUI = std::move(dl);
 
         // Send to network
         sendCommandAck(originCmd, size);
     }
 
+    void pushUIChanges() {
+        std::lock_guard<std::mutex> lck(uiMtx);
+        _pushUIChanges();
+    }
+
+    void _pushUIChanges() {
+        if (!compactUI || !client || !client->isOpen()) { return; }
+
+        // Render the UI and only send it if something changed since the client last got it
+        SmGui::DrawList dl;
+        renderUI(&dl, "", dummyElem);
+        if (dl.sameAs(lastUI)) { return; }
+        int size = dl.storeDiff(lastUI, u_cmd_data, SERVER_MAX_PACKET_SIZE - sizeof(PacketHeader) - sizeof(CommandHeader));
+        if (size < 0) {
+            flog::error("UI doesn't fit in a packet");
+            return;
+        }
+        lastUI = std::move(dl);
+
+        // Sent from its own buffer since commands may be answered at the same time
+        u_cmd_hdr->cmd = COMMAND_UI_UPDATE;
+        u_pkt_hdr->type = PACKET_TYPE_COMMAND;
+        u_pkt_hdr->size = sizeof(PacketHeader) + sizeof(CommandHeader) + size;
+        client->write(u_pkt_hdr->size, ubuf);
+    }
+
     void sendError(Error err) {
         PacketHeader* hdr = (PacketHeader*)sbuf;
         s_pkt_data[0] = err;
@@ -365,6 +460,7 @@ namespace server {
 
     void setInputSampleRate(double samplerate) {
         sampleRate = samplerate;
+        inBuf.setSamplerate(sampleRate);
         if (!client || !client->isOpen()) { return; }
         sendSampleRate(sampleRate);
     }
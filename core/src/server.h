@@ -17,6 +17,8 @@ namespace server {
     void commandHandler(Command cmd, uint8_t* data, int len);
     void renderUI(SmGui::DrawList* dl, std::string diffId, SmGui::DrawListElem diffValue);
     void sendUI(Command originCmd, std::string diffId, SmGui::DrawListElem diffValue);
+    void pushUIChanges();
+    void _pushUIChanges();
     void sendError(Error err);
     void sendSampleRate(double sampleRate);
     void setInputSampleRate(double samplerate);
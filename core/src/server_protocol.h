@@ -27,10 +27,12 @@ namespace server {
         COMMAND_GET_SAMPLERATE,
         COMMAND_SET_SAMPLE_TYPE,
         COMMAND_SET_COMPRESSION,
+        COMMAND_GET_INPUT_STATS,
 
         // Server to client
         COMMAND_SET_SAMPLERATE = 0x80,
-        COMMAND_DISCONNECT
+        COMMAND_DISCONNECT,
+        COMMAND_UI_UPDATE
     };
 
     enum Error {
@@ -49,5 +51,16 @@ namespace server {
     struct CommandHeader {
         uint32_t cmd;
     };
+
+    // Health of the server's input buffer, see dsp::buffer::InputBufferStats
+    struct InputStats {
+        uint64_t overflows;
+        uint64_t droppedSamples;
+        uint64_t inputGaps;
+        int64_t lastOverflow;
+        int64_t lastInputGap;
+        int32_t fill;
+        int32_t capacity;
+    };
 #pragma pack(pop)
 }
\ No newline at end of file
@@ -1,6 +1,4 @@
 #include "iq_frontend.h"
-#include "../dsp/window/blackman.h"
-#include "../dsp/window/nuttall.h"
 #include <utils/flog.h>
 #include <gui/gui.h>
 #include <core.h>
@@ -8,10 +6,6 @@
 IQFrontEnd::~IQFrontEnd() {
     if (!_init) { return; }
     stop();
-    dsp::buffer::free(fftWindowBuf);
-    fftwf_destroy_plan(fftwPlan);
-    fftwf_free(fftInBuf);
-    fftwf_free(fftOutBuf);
 }
 
 void IQFrontEnd::init(dsp::stream<dsp::complex_t>* in, double sampleRate, bool buffering, int decimRatio, bool dcBlocking, int fftSize, double fftRate, FFTWindow fftWindow, float* (*acquireFFTBuffer)(void* ctx), void (*releaseFFTBuffer)(void* ctx), void* fftCtx) {
@@ -26,7 +20,7 @@ void IQFrontEnd::init(dsp::stream<dsp::complex_t>* in, double sampleRate, bool b
 
     effectiveSr = _sampleRate / _decimRatio;
 
-    inBuf.init(in);
+    inBuf.init(in, _sampleRate, DEFAULT_BUFFER_LATENCY);
     inBuf.bypass = !buffering;
 
     decim.init(NULL, _decimRatio);
@@ -40,32 +34,17 @@ void IQFrontEnd::init(dsp::stream<dsp::complex_t>* in, double sampleRate, bool b
 
     split.init(preproc.out);
 
-    // TODO: Do something to avoid basically repeating this code twice
-    int skip;
-    genReshapeParams(effectiveSr, _fftSize, _fftRate, skip, _nzFFTSize);
-    reshape.init(&fftIn, fftSize, skip);
-    fftSink.init(&reshape.out, handler, this);
+    // The main spectrum is the one displayed by the waterfall
+    spectrum.init(&fftIn, effectiveSr);
+    mainSpectrum = spectrum.addConsumer(mainSpectrumParams(), handler, this);
 
-    fftWindowBuf = dsp::buffer::alloc<float>(_nzFFTSize);
-    if (_fftWindow == FFTWindow::RECTANGULAR) {
-        for (int i = 0; i < _nzFFTSize; i++) { fftWindowBuf[i] = 0; }
-    }
-    else if (_fftWindow == FFTWindow::BLACKMAN) {
-        for (int i = 0; i < _nzFFTSize; i++) { fftWindowBuf[i] = dsp::window::blackman(i, _nzFFTSize); }
-    }
-    else if (_fftWindow == FFTWindow::NUTTALL) {
-        for (int i = 0; i < _nzFFTSize; i++) { fftWindowBuf[i] = dsp::window::nuttall(i, _nzFFTSize); }
-    }
-
-    fftInBuf = (fftwf_complex*)fftwf_malloc(_fftSize * sizeof(fftwf_complex));
-    fftOutBuf = (fftwf_complex*)fftwf_malloc(_fftSize * sizeof(fftwf_complex));
-    fftwPlan = fftwf_plan_dft_1d(_fftSize, fftInBuf, fftOutBuf, FFTW_FORWARD, FFTW_ESTIMATE);
-
-    // Clear the rest of the FFT input buffer
-    dsp::buffer::clear(fftInBuf, _fftSize - _nzFFTSize, _nzFFTSize);
+    activity.init(std::max<int>(round(ACTIVITY_WINDOW * _fftRate), 1), DEFAULT_ACTIVITY_THRESHOLD);
 
     split.bindStream(&fftIn);
 
+    // All VFOs are translated in a single pass over the IQ
+    vfoXlator.init(&vfoXlatorIn);
+
     _init = true;
 }
 
@@ -74,6 +53,9 @@ void IQFrontEnd::setInput(dsp::stream<dsp::complex_t>* in) {
 }
 
 void IQFrontEnd::setSampleRate(double sampleRate) {
+    // Resize the input buffer to keep the same latency
+    inBuf.setSamplerate(sampleRate);
+
     // Temp stop the necessary blocks
     dcBlock.tempStop();
     for (auto& [name, vfo] : vfos) {
@@ -84,9 +66,12 @@ void IQFrontEnd::setSampleRate(double sampleRate) {
     _sampleRate = sampleRate;
     effectiveSr = _sampleRate / _decimRatio;
     dcBlock.setRate(genDCBlockRate(effectiveSr));
+    std::vector<std::pair<dsp::stream<dsp::complex_t>*, double>> offsets;
     for (auto& [name, vfo] : vfos) {
         vfo->setInSamplerate(effectiveSr);
+        offsets.push_back({ vfoStreams[name], -vfoOffsets[name] });
     }
+    vfoXlator.setOffsets(offsets, effectiveSr);
 
     // Reconfigure the FFT
     updateFFTPath();
@@ -102,6 +87,18 @@ void IQFrontEnd::setBuffering(bool enabled) {
     inBuf.bypass = !enabled;
 }
 
+void IQFrontEnd::setBufferLatency(double latency) {
+    inBuf.setLatency(latency);
+}
+
+void IQFrontEnd::setCenterFrequency(double frequency) {
+    inBuf.setCenterFrequency(frequency);
+
+    // The noise floor of the previous tuning is meaningless now
+    std::lock_guard<std::mutex> lck(activityMtx);
+    activity.reset();
+}
+
 void IQFrontEnd::setDecimation(int ratio) {
     // Temp stop the decimator
     decim.tempStop();
@@ -146,12 +143,17 @@ dsp::channel::RxVFO* IQFrontEnd::addVFO(std::string name, double sampleRate, dou
 
     // Create VFO and its input stream
     dsp::stream<dsp::complex_t>* vfoIn = new dsp::stream<dsp::complex_t>;
-    dsp::channel::RxVFO* vfo = new dsp::channel::RxVFO(vfoIn, effectiveSr, sampleRate, bandwidth, offset);
+    dsp::channel::RxVFO* vfo = new dsp::channel::RxVFO(vfoIn, effectiveSr, sampleRate, bandwidth, 0);
 
     // Register them
+    bool first = vfos.empty();
     vfoStreams[name] = vfoIn;
     vfos[name] = vfo;
-    bindIQStream(vfoIn);
+    vfoOffsets[name] = offset;
+    vfoXlator.bindStream(vfoIn, -offset, effectiveSr);
+
+    // Only feed the translator while at least one VFO exists
+    if (first) { bindIQStream(&vfoXlatorIn); }
 
     // Start VFO
     vfo->start();
@@ -173,15 +175,28 @@ void IQFrontEnd::removeVFO(std::string name) {
     // Stop the VFO
     vfo->stop();
 
-    unbindIQStream(vfoIn);
+    vfoXlator.unbindStream(vfoIn);
     vfoStreams.erase(name);
     vfos.erase(name);
+    vfoOffsets.erase(name);
+    if (vfos.empty()) { unbindIQStream(&vfoXlatorIn); }
 
     // Delete the VFO and its input stream
     delete vfo;
     delete vfoIn;
 }
 
+void IQFrontEnd::setVFOOffset(std::string name, double offset) {
+    // Make sure that a VFO with that name exists
+    if (vfos.find(name) == vfos.end()) {
+        flog::error("[IQFrontEnd] Tried to set the offset of a VFO that doesn't exist.");
+        return;
+    }
+
+    vfoOffsets[name] = offset;
+    vfoXlator.setOffset(vfoStreams[name], -offset, effectiveSr);
+}
+
 void IQFrontEnd::setFFTSize(int size) {
     _fftSize = size;
     updateFFTPath(true);
@@ -197,6 +212,62 @@ void IQFrontEnd::setFFTWindow(FFTWindow fftWindow) {
     updateFFTPath();
 }
 
+void IQFrontEnd::setFFTThreads(int count) {
+    spectrum.setThreadCount(count);
+}
+
+SpectrumEngine::Consumer* IQFrontEnd::addSpectrumConsumer(const SpectrumEngine::Params& params, SpectrumEngine::Handler handler, void* ctx) {
+    return spectrum.addConsumer(params, handler, ctx);
+}
+
+void IQFrontEnd::removeSpectrumConsumer(SpectrumEngine::Consumer* consumer) {
+    spectrum.removeConsumer(consumer);
+}
+
+void IQFrontEnd::setSpectrumConsumerParams(SpectrumEngine::Consumer* consumer, const SpectrumEngine::Params& params) {
+    spectrum.setParams(consumer, params);
+}
+
+SpectrumEngine::Consumer* IQFrontEnd::addMainSpectrumConsumer(const dsp::spectrum::ProductParams& product, SpectrumEngine::Handler handler, void* ctx) {
+    SpectrumEngine::Consumer* consumer = spectrum.addConsumer(mainSpectrumParams(product), handler, ctx);
+    mainProducts[consumer] = product;
+    return consumer;
+}
+
+void IQFrontEnd::removeMainSpectrumConsumer(SpectrumEngine::Consumer* consumer) {
+    mainProducts.erase(consumer);
+    spectrum.removeConsumer(consumer);
+}
+
+void IQFrontEnd::setMainSpectrumConsumerProduct(SpectrumEngine::Consumer* consumer, const dsp::spectrum::ProductParams& product) {
+    mainProducts[consumer] = product;
+    spectrum.setParams(consumer, mainSpectrumParams(product));
+}
+
+void IQFrontEnd::enableActivityDetection() {
+    std::lock_guard<std::mutex> lck(activityMtx);
+    if (!activityUsers++) { activity.reset(); }
+}
+
+void IQFrontEnd::disableActivityDetection() {
+    std::lock_guard<std::mutex> lck(activityMtx);
+    if (!activityUsers) {
+        flog::error("Tried to disable activity detection more times than it was enabled");
+        return;
+    }
+    if (!--activityUsers) { activityReport = dsp::detector::ActivityReport(); }
+}
+
+void IQFrontEnd::setActivityThreshold(float threshold) {
+    std::lock_guard<std::mutex> lck(activityMtx);
+    activity.setThreshold(threshold);
+}
+
+dsp::detector::ActivityReport IQFrontEnd::getActivity() {
+    std::lock_guard<std::mutex> lck(activityMtx);
+    return activityReport;
+}
+
 void IQFrontEnd::flushInputBuffer() {
     inBuf.flush();
 }
@@ -211,14 +282,14 @@ void IQFrontEnd::start() {
     // Start IQ splitter
     split.start();
 
-    // Start all VFOs
+    // Start the VFO translator and all VFOs
+    vfoXlator.start();
     for (auto& [name, vfo] : vfos) {
         vfo->start();
     }
 
     // Start FFT chain
-    reshape.start();
-    fftSink.start();
+    spectrum.start();
 }
 
 void IQFrontEnd::stop() {
@@ -231,79 +302,48 @@ void IQFrontEnd::stop() {
     // Stop IQ splitter
     split.stop();
 
-    // Stop all VFOs
+    // Stop the VFO translator and all VFOs
+    vfoXlator.stop();
     for (auto& [name, vfo] : vfos) {
         vfo->stop();
     }
 
     // Stop FFT chain
-    reshape.stop();
-    fftSink.stop();
+    spectrum.stop();
 }
 
 double IQFrontEnd::getEffectiveSamplerate() {
     return effectiveSr;
 }
 
-void IQFrontEnd::handler(dsp::complex_t* data, int count, void* ctx) {
+void IQFrontEnd::handler(const float* spectrum, int size, double centerFrequency, double samplerate, void* ctx) {
     IQFrontEnd* _this = (IQFrontEnd*)ctx;
 
-    // Apply window
-    volk_32fc_32f_multiply_32fc((lv_32fc_t*)_this->fftInBuf, (lv_32fc_t*)data, _this->fftWindowBuf, _this->_nzFFTSize);
-
-    // Execute FFT
-    fftwf_execute(_this->fftwPlan);
-
-    // Aquire buffer
+    // Aquire buffer, spectra still in flight from before a size change are dropped
     float* fftBuf = _this->_acquireFFTBuffer(_this->_fftCtx);
-
-    // Convert the complex output of the FFT to dB amplitude
-    if (fftBuf) {
-        volk_32fc_s32f_power_spectrum_32f(fftBuf, (lv_32fc_t*)_this->fftOutBuf, _this->_fftSize, _this->_fftSize);
-    }
+    if (fftBuf && size == _this->_fftSize) { memcpy(fftBuf, spectrum, size * sizeof(float)); }
 
     // Release buffer
     _this->_releaseFFTBuffer(_this->_fftCtx);
+
+    // Run the activity detection on the same spectrum the GUI gets. The handlers are called with the lock held so
+    // that the report can't be cleared while they read it and so that disabling the detection waits for them.
+    std::lock_guard<std::mutex> lck(_this->activityMtx);
+    if (!_this->activityUsers) { return; }
+    _this->activity.process(spectrum, size, centerFrequency, samplerate, _this->activityReport);
+    _this->onActivity.emit(_this->activityReport);
 }
 
 void IQFrontEnd::updateFFTPath(bool updateWaterfall) {
-    // Temp stop branch
-    reshape.tempStop();
-    fftSink.tempStop();
-
-    // Update reshaper settings
-    int skip;
-    genReshapeParams(effectiveSr, _fftSize, _fftRate, skip, _nzFFTSize);
-    reshape.setKeep(_nzFFTSize);
-    reshape.setSkip(skip);
-
-    // Update window
-    dsp::buffer::free(fftWindowBuf);
-    fftWindowBuf = dsp::buffer::alloc<float>(_nzFFTSize);
-    if (_fftWindow == FFTWindow::RECTANGULAR) {
-        for (int i = 0; i < _nzFFTSize; i++) { fftWindowBuf[i] = 1.0f * ((i % 2) ? -1.0f : 1.0f); }
-    }
-    else if (_fftWindow == FFTWindow::BLACKMAN) {
-        for (int i = 0; i < _nzFFTSize; i++) { fftWindowBuf[i] = dsp::window::blackman(i, _nzFFTSize) * ((i % 2) ? -1.0f : 1.0f); }
-    }
-    else if (_fftWindow == FFTWindow::NUTTALL) {
-        for (int i = 0; i < _nzFFTSize; i++) { fftWindowBuf[i] = dsp::window::nuttall(i, _nzFFTSize) * ((i % 2) ? -1.0f : 1.0f); }
-    }
-
-    // Update FFT plan
-    fftwf_free(fftInBuf);
-    fftwf_free(fftOutBuf);
-    fftInBuf = (fftwf_complex*)fftwf_malloc(_fftSize * sizeof(fftwf_complex));
-    fftOutBuf = (fftwf_complex*)fftwf_malloc(_fftSize * sizeof(fftwf_complex));
-    fftwPlan = fftwf_plan_dft_1d(_fftSize, fftInBuf, fftOutBuf, FFTW_FORWARD, FFTW_ESTIMATE);
-
-    // Clear the rest of the FFT input buffer
-    dsp::buffer::clear(fftInBuf, _fftSize - _nzFFTSize, _nzFFTSize);
-
     // Update waterfall (TODO: This is annoying, it makes this module non testable and will constantly clear the waterfall for any reason)
     if (updateWaterfall) { gui::waterfall.setRawFFTSize(_fftSize); }
 
-    // Restart branch
-    reshape.tempStart();
-    fftSink.tempStart();
+    // Update the main spectrum, the engine only rebuilds what changed
+    spectrum.setSamplerate(effectiveSr);
+    spectrum.setParams(mainSpectrum, mainSpectrumParams());
+    for (auto& [consumer, product] : mainProducts) { spectrum.setParams(consumer, mainSpectrumParams(product)); }
+
+    // Restart the activity detection since the bins and frame rate may have changed
+    std::lock_guard<std::mutex> lck(activityMtx);
+    activity.setWindow(std::max<int>(round(ACTIVITY_WINDOW * _fftRate), 1));
 }
\ No newline at end of file
@@ -1,24 +1,21 @@
 #pragma once
-#include "../dsp/buffer/frame_buffer.h"
-#include "../dsp/buffer/reshaper.h"
+#include "../dsp/buffer/input_buffer.h"
 #include "../dsp/multirate/power_decimator.h"
 #include "../dsp/correction/dc_blocker.h"
 #include "../dsp/chain.h"
 #include "../dsp/routing/splitter.h"
 #include "../dsp/channel/rx_vfo.h"
-#include "../dsp/sink/handler_sink.h"
+#include "../dsp/channel/multi_xlator.h"
 #include "../dsp/math/conjugate.h"
-#include <fftw3.h>
+#include "../dsp/detector/activity.h"
+#include "spectrum_engine.h"
+#include <utils/event.h>
 
 class IQFrontEnd {
 public:
     ~IQFrontEnd();
 
-    enum FFTWindow {
-        RECTANGULAR,
-        BLACKMAN,
-        NUTTALL
-    };
+    typedef SpectrumEngine::Window FFTWindow;
 
     void init(dsp::stream<dsp::complex_t>* in, double sampleRate, bool buffering, int decimRatio, bool dcBlocking, int fftSize, double fftRate, FFTWindow fftWindow, float* (*acquireFFTBuffer)(void* ctx), void (*releaseFFTBuffer)(void* ctx), void* fftCtx);
 
@@ -27,6 +24,11 @@ public:
     inline double getSampleRate() { return _sampleRate / _decimRatio; }
 
     void setBuffering(bool enabled);
+    void setBufferLatency(double latency);
+    void setCenterFrequency(double frequency);
+    inline double getBufferLatency() { return inBuf.getLatency(); }
+    inline dsp::buffer::InputBufferStats getInputBufferStats() { return inBuf.getStats(); }
+    inline void resetInputBufferStats() { inBuf.resetStats(); }
     void setDecimation(int ratio);
     void setInvertIQ(bool enabled);
     void setDCBlocking(bool enabled);
@@ -36,11 +38,32 @@ public:
 
     dsp::channel::RxVFO* addVFO(std::string name, double sampleRate, double bandwidth, double offset);
     void removeVFO(std::string name);
+    void setVFOOffset(std::string name, double offset);
 
     void setFFTSize(int size);
+    inline int getFFTSize() { return _fftSize; }
     void setFFTRate(double rate);
     void setFFTWindow(FFTWindow fftWindow);
 
+    // Number of threads used to compute large spectra, one computes them on the DSP thread
+    void setFFTThreads(int count);
+
+    // Additional spectra computed alongside the main one, see SpectrumEngine
+    SpectrumEngine::Consumer* addSpectrumConsumer(const SpectrumEngine::Params& params, SpectrumEngine::Handler handler, void* ctx);
+    void removeSpectrumConsumer(SpectrumEngine::Consumer* consumer);
+    void setSpectrumConsumerParams(SpectrumEngine::Consumer* consumer, const SpectrumEngine::Params& params);
+
+    // Products of the main spectrum. They share its FFT and follow its size, rate and window.
+    SpectrumEngine::Consumer* addMainSpectrumConsumer(const dsp::spectrum::ProductParams& product, SpectrumEngine::Handler handler, void* ctx);
+    void removeMainSpectrumConsumer(SpectrumEngine::Consumer* consumer);
+    void setMainSpectrumConsumerProduct(SpectrumEngine::Consumer* consumer, const dsp::spectrum::ProductParams& product);
+
+    // Activity detection runs on the main spectrum as long as at least one user has enabled it
+    void enableActivityDetection();
+    void disableActivityDetection();
+    void setActivityThreshold(float threshold);
+    dsp::detector::ActivityReport getActivity();
+
     void flushInputBuffer();
 
     void start();
@@ -48,22 +71,35 @@ public:
 
     double getEffectiveSamplerate();
 
+    // Called from the DSP thread for every spectrum while activity detection is enabled. The activity lock is held
+    // during the call, handlers must not call the activity detection methods above.
+    Event<const dsp::detector::ActivityReport&> onActivity;
+
 protected:
-    static void handler(dsp::complex_t* data, int count, void* ctx);
+    static void handler(const float* spectrum, int size, double centerFrequency, double samplerate, void* ctx);
     void updateFFTPath(bool updateWaterfall = false);
 
-    static inline double genDCBlockRate(double sampleRate) {
-        return 50.0 / sampleRate;
+    static constexpr double DEFAULT_BUFFER_LATENCY = 250.0;
+
+    // Duration over which the minimum of the noise floor is tracked
+    static constexpr double ACTIVITY_WINDOW = 5.0;
+    static constexpr float DEFAULT_ACTIVITY_THRESHOLD = 6.0f;
+
+    inline SpectrumEngine::Params mainSpectrumParams(const dsp::spectrum::ProductParams& product = dsp::spectrum::ProductParams()) {
+        SpectrumEngine::Params params;
+        params.size = _fftSize;
+        params.rate = _fftRate;
+        params.window = _fftWindow;
+        params.product = product;
+        return params;
     }
 
-    static inline void genReshapeParams(double sampleRate, int size, double rate, int& skip, int& nzSampCount) {
-        int fftInterval = round(sampleRate / rate);
-        nzSampCount = std::min<int>(fftInterval, size);
-        skip = fftInterval - nzSampCount;
+    static inline double genDCBlockRate(double sampleRate) {
+        return 50.0 / sampleRate;
     }
 
     // Input buffer
-    dsp::buffer::SampleFrameBuffer<dsp::complex_t> inBuf;
+    dsp::buffer::InputBuffer<dsp::complex_t> inBuf;
 
     // Pre-processing chain
     dsp::multirate::PowerDecimator<dsp::complex_t> decim;
@@ -76,12 +112,16 @@ protected:
 
     // FFT
     dsp::stream<dsp::complex_t> fftIn;
-    dsp::buffer::Reshaper<dsp::complex_t> reshape;
-    dsp::sink::Handler<dsp::complex_t> fftSink;
+    SpectrumEngine spectrum;
+    SpectrumEngine::Consumer* mainSpectrum;
+    std::map<SpectrumEngine::Consumer*, dsp::spectrum::ProductParams> mainProducts;
 
     // VFOs
+    dsp::stream<dsp::complex_t> vfoXlatorIn;
+    dsp::channel::MultiXlator vfoXlator;
     std::map<std::string, dsp::stream<dsp::complex_t>*> vfoStreams;
     std::map<std::string, dsp::channel::RxVFO*> vfos;
+    std::map<std::string, double> vfoOffsets;
 
     // Parameters
     double _sampleRate;
@@ -93,12 +133,11 @@ protected:
     void (*_releaseFFTBuffer)(void* ctx);
     void* _fftCtx;
 
-    // Processing data
-    int _nzFFTSize;
-    float* fftWindowBuf;
-    fftwf_complex *fftInBuf, *fftOutBuf;
-    fftwf_plan fftwPlan;
-    float* fftDbOut;
+    // Activity detection
+    dsp::detector::ActivityDetector activity;
+    dsp::detector::ActivityReport activityReport;
+    std::mutex activityMtx;
+    int activityUsers = 0;
 
     double effectiveSr;
 
@@ -8,11 +8,14 @@ SourceManager::SourceManager() {
 }
 
 void SourceManager::registerSource(std::string name, SourceHandler* handler) {
-    if (sources.find(name) != sources.end()) {
-        flog::error("Tried to register new source with existing name: {0}", name);
-        return;
+    {
+        std::lock_guard<std::mutex> lck(sourcesMtx);
+        if (sources.find(name) != sources.end()) {
+            flog::error("Tried to register new source with existing name: {0}", name);
+            return;
+        }
+        sources[name] = handler;
     }
-    sources[name] = handler;
     onSourceRegistered.emit(name);
 }
 
@@ -29,11 +32,15 @@ void SourceManager::unregisterSource(std::string name) {
         sigpath::iqFrontEnd.setInput(&nullSource);
         selectedHandler = NULL;
     }
-    sources.erase(name);
+    {
+        std::lock_guard<std::mutex> lck(sourcesMtx);
+        sources.erase(name);
+    }
     onSourceUnregistered.emit(name);
 }
 
 std::vector<std::string> SourceManager::getSourceNames() {
+    std::lock_guard<std::mutex> lck(sourcesMtx);
     std::vector<std::string> names;
     for (auto const& [name, src] : sources) { names.push_back(name); }
     return names;
@@ -86,6 +93,7 @@ void SourceManager::tune(double freq) {
     }
     // TODO: No need to always retune the hardware in panadpter mode
     selectedHandler->tuneHandler(((tuneMode == TuningMode::NORMAL) ? freq : ifFreq) + tuneOffset, selectedHandler->ctx);
+    if (!core::args["server"].b()) { sigpath::iqFrontEnd.setCenterFrequency(freq); }
     onRetune.emit(freq);
     currentFreq = freq;
 }
@@ -2,6 +2,7 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <mutex>
 #include <dsp/stream.h>
 #include <dsp/types.h>
 #include <utils/event.h>
@@ -45,6 +46,8 @@ public:
     Event<double> onRetune;
 
 private:
+    // Sources can register from several threads while instances are created in parallel
+    std::mutex sourcesMtx;
     std::map<std::string, SourceHandler*> sources;
     std::string selectedName;
     SourceHandler* selectedHandler = NULL;
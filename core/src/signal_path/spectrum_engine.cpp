@@ -0,0 +1,459 @@
+#include "spectrum_engine.h"
+#include "../dsp/window/blackman.h"
+#include "../dsp/window/nuttall.h"
+#include <algorithm>
+#include <utils/flog.h>
+
+SpectrumEngine::~SpectrumEngine() {
+    if (!base_type::_block_init) {
+        stopWorkers();
+        return;
+    }
+    base_type::stop();
+    for (auto& group : groups) { drain(group); }
+    stopWorkers();
+    for (auto& group : groups) {
+        for (auto& stage : group->stages) {
+            for (auto& consumer : stage->consumers) { delete consumer; }
+            delete stage;
+        }
+        destroyGroup(group);
+    }
+    groups.clear();
+    if (history) { dsp::buffer::free(history); }
+}
+
+void SpectrumEngine::init(dsp::stream<dsp::complex_t>* in, double samplerate) {
+    _samplerate = samplerate;
+    base_type::init(in);
+}
+
+void SpectrumEngine::setSamplerate(double samplerate) {
+    std::lock_guard<std::mutex> lck(groupMtx);
+    if (samplerate == _samplerate) { return; }
+    _samplerate = samplerate;
+    for (auto& group : groups) { configureGroup(group); }
+    updateHistory();
+}
+
+void SpectrumEngine::setThreadCount(int count) {
+    std::lock_guard<std::mutex> lck(groupMtx);
+    count = std::max<int>(count, 1);
+    if (count == threadCount) { return; }
+
+    // Restart the pool with the new number of workers and redistribute the groups
+    for (auto& group : groups) { drain(group); }
+    stopWorkers();
+    threadCount = count;
+    if (threadCount > 1) { startWorkers(threadCount); }
+    for (auto& group : groups) { configureGroup(group); }
+}
+
+SpectrumEngine::Consumer* SpectrumEngine::addConsumer(const Params& params, Handler handler, void* ctx) {
+    std::lock_guard<std::mutex> lck(groupMtx);
+    Consumer* consumer = new Consumer;
+    consumer->handler = handler;
+    consumer->ctx = ctx;
+    attach(consumer, params);
+    updateHistory();
+    return consumer;
+}
+
+void SpectrumEngine::removeConsumer(Consumer* consumer) {
+    std::lock_guard<std::mutex> lck(groupMtx);
+    detach(consumer);
+    updateHistory();
+    delete consumer;
+}
+
+void SpectrumEngine::setParams(Consumer* consumer, const Params& params) {
+    std::lock_guard<std::mutex> lck(groupMtx);
+
+    // Nothing to do if the parameters don't change
+    Group* group;
+    Stage* stage;
+    if (find(consumer, group, stage) && group->params.sameFFT(params) && stage->product.params() == params.product) { return; }
+
+    detach(consumer);
+    attach(consumer, params);
+    updateHistory();
+}
+
+int SpectrumEngine::run() {
+    int count = base_type::_in->read();
+    if (count < 0) { return -1; }
+
+    {
+        std::lock_guard<std::mutex> lck(groupMtx);
+        const dsp::StreamMetadata& meta = base_type::_in->readMeta;
+        const dsp::complex_t* data = base_type::_in->readBuf;
+        double centerFrequency = meta.valid ? meta.centerFrequency : 0.0;
+
+        // Follow the samplerate of the stream when it's known
+        if (meta.valid && meta.samplerate > 0.0 && meta.samplerate != _samplerate) {
+            _samplerate = meta.samplerate;
+            for (auto& group : groups) { configureGroup(group); }
+            updateHistory();
+        }
+
+        // Never build a spectrum from samples on both sides of a discontinuity
+        if (meta.valid && meta.discontinuity) {
+            historyFill = 0;
+            for (auto& group : groups) {
+                for (auto& stage : group->stages) { stage->product.reset(); }
+            }
+        }
+
+        // Take the frames of each group ending in this buffer
+        for (auto& group : groups) {
+            int end = group->remaining;
+            for (; end <= count; end += group->interval) {
+                int start = end - group->frameSize;
+                if (start >= 0) {
+                    takeFrame(group, &data[start], group->frameSize, NULL, 0, centerFrequency);
+                }
+                else if (-start <= historyFill) {
+                    takeFrame(group, &history[historyFill + start], -start, data, end, centerFrequency);
+                }
+            }
+            group->remaining = end - count;
+
+            // Hand over the spectra the workers are done with
+            if (group->parallel) { deliverDone(group); }
+        }
+
+        // Keep the tail for frames straddling the next buffer
+        if (historySize) {
+            if (count >= historySize) {
+                memcpy(history, &data[count - historySize], historySize * sizeof(dsp::complex_t));
+                historyFill = historySize;
+            }
+            else {
+                int keep = std::min<int>(historyFill, historySize - count);
+                memmove(history, &history[historyFill - keep], keep * sizeof(dsp::complex_t));
+                memcpy(&history[keep], data, count * sizeof(dsp::complex_t));
+                historyFill = keep + count;
+            }
+        }
+    }
+
+    base_type::_in->flush();
+    return count;
+}
+
+SpectrumEngine::Group* SpectrumEngine::createGroup(const Params& params) {
+    Group* group = new Group;
+    group->params = params;
+    group->window = NULL;
+    configureGroup(group);
+    return group;
+}
+
+void SpectrumEngine::destroyGroup(Group* group) {
+    freeGroup(group);
+    delete group;
+}
+
+void SpectrumEngine::freeGroup(Group* group) {
+    if (!group->window) { return; }
+    drain(group);
+    group->plan.reset();
+    for (auto& frame : group->frames) {
+        fftwf_free(frame.fft);
+        dsp::buffer::free(frame.spectrum);
+        if (frame.power) { dsp::buffer::free(frame.power); }
+    }
+    group->frames.clear();
+    dsp::buffer::free(group->window);
+    group->window = NULL;
+}
+
+void SpectrumEngine::configureGroup(Group* group) {
+    const Params& p = group->params;
+
+    // Free the previous configuration
+    freeGroup(group);
+
+    // When the rate is too high to fit a full FFT between two spectra, only use the samples available and zero-pad
+    group->interval = std::max<int>(round(_samplerate / p.rate), 1);
+    group->frameSize = std::min<int>(group->interval, p.size);
+    group->remaining = group->interval;
+    for (auto& stage : group->stages) { stage->product.reset(); }
+
+    // Generate the window, flipping every other sample to get the spectrum in frequency order
+    group->window = dsp::buffer::alloc<float>(group->frameSize);
+    for (int i = 0; i < group->frameSize; i++) {
+        float w = 1.0f;
+        if (p.window == BLACKMAN) { w = dsp::window::blackman(i, group->frameSize); }
+        else if (p.window == NUTTALL) { w = dsp::window::nuttall(i, group->frameSize); }
+        group->window[i] = w * ((i % 2) ? -1.0f : 1.0f);
+    }
+
+    // Large FFTs get one frame per worker plus one to fill while they're all busy
+    group->parallel = (threadCount > 1 && p.size >= PARALLEL_MIN_SIZE);
+    group->frames.resize(group->parallel ? threadCount + 1 : 1);
+    group->nextSeq = 0;
+    group->deliverSeq = 0;
+    bool power = needsPower(group);
+    for (auto& frame : group->frames) {
+        frame.fft = (fftwf_complex*)fftwf_malloc(p.size * sizeof(fftwf_complex));
+        frame.spectrum = dsp::buffer::alloc<float>(p.size);
+        frame.power = power ? dsp::buffer::alloc<float>(p.size) : NULL;
+        frame.state = FRAME_FREE;
+    }
+
+    // All frames have the same alignment and can share the plan
+    group->plan = dsp::fft::planner::get(p.size, dsp::fft::FORWARD, group->frames[0].fft, group->frames[0].fft);
+}
+
+bool SpectrumEngine::find(Consumer* consumer, Group*& group, Stage*& stage) {
+    for (auto& g : groups) {
+        for (auto& st : g->stages) {
+            if (std::find(st->consumers.begin(), st->consumers.end(), consumer) == st->consumers.end()) { continue; }
+            group = g;
+            stage = st;
+            return true;
+        }
+    }
+    return false;
+}
+
+void SpectrumEngine::detach(Consumer* consumer) {
+    Group* group;
+    Stage* stage;
+    if (!find(consumer, group, stage)) {
+        flog::error("[SpectrumEngine] Tried to detach a consumer that isn't registered");
+        return;
+    }
+    stage->consumers.erase(std::find(stage->consumers.begin(), stage->consumers.end(), consumer));
+
+    // Free the product, then the group, once nobody uses them
+    if (!stage->consumers.empty()) { return; }
+    group->stages.erase(std::find(group->stages.begin(), group->stages.end(), stage));
+    delete stage;
+    if (!group->stages.empty()) {
+        updatePower(group);
+        return;
+    }
+    destroyGroup(group);
+    groups.erase(std::find(groups.begin(), groups.end(), group));
+}
+
+void SpectrumEngine::attach(Consumer* consumer, const Params& params) {
+    // Share the FFT with any other consumer with the same FFT parameters
+    Group* group = NULL;
+    for (auto& g : groups) {
+        if (g->params.sameFFT(params)) {
+            group = g;
+            break;
+        }
+    }
+    if (!group) {
+        group = createGroup(params);
+        groups.push_back(group);
+    }
+
+    // Same thing for the product
+    for (auto& stage : group->stages) {
+        if (stage->product.params() == params.product) {
+            stage->consumers.push_back(consumer);
+            return;
+        }
+    }
+    Stage* stage = new Stage;
+    stage->product.init(params.product, params.size);
+    stage->consumers.push_back(consumer);
+    group->stages.push_back(stage);
+    updatePower(group);
+}
+
+void SpectrumEngine::updateHistory() {
+    // Frames can't be longer than one FFT, so only keep that much at most
+    int size = 0;
+    for (auto& group : groups) { size = std::max<int>(size, group->frameSize); }
+    if (size == historySize) { return; }
+    if (history) { dsp::buffer::free(history); }
+    history = size ? dsp::buffer::alloc<dsp::complex_t>(size) : NULL;
+    historySize = size;
+    historyFill = 0;
+}
+
+void SpectrumEngine::takeFrame(Group* group, const dsp::complex_t* first, int firstCount, const dsp::complex_t* second, int secondCount, double centerFrequency) {
+    // Small FFTs are done right away, windowing while copying out of the input buffer
+    if (!group->parallel) {
+        Frame* frame = &group->frames[0];
+        volk_32fc_32f_multiply_32fc((lv_32fc_t*)frame->fft, (lv_32fc_t*)first, group->window, firstCount);
+        if (secondCount) {
+            volk_32fc_32f_multiply_32fc((lv_32fc_t*)&frame->fft[firstCount], (lv_32fc_t*)second, &group->window[firstCount], secondCount);
+        }
+        frame->needsPower = needsPower(group);
+        transform(group, frame);
+        frame->centerFrequency = centerFrequency;
+        deliver(group, frame);
+        return;
+    }
+
+    // Find a free frame, if all workers are still busy the spectrum is dropped rather than stalling the stream
+    Frame* frame = NULL;
+    {
+        std::lock_guard<std::mutex> lck(poolMtx);
+        for (auto& f : group->frames) {
+            if (f.state == FRAME_FREE) {
+                frame = &f;
+                break;
+            }
+        }
+    }
+    if (!frame) { return; }
+
+    // Copy the samples and queue the frame, the worker does the windowing
+    memcpy(frame->fft, first, firstCount * sizeof(dsp::complex_t));
+    if (secondCount) { memcpy(&frame->fft[firstCount], second, secondCount * sizeof(dsp::complex_t)); }
+    frame->centerFrequency = centerFrequency;
+    frame->needsPower = needsPower(group);
+    frame->seq = group->nextSeq++;
+    {
+        std::lock_guard<std::mutex> lck(poolMtx);
+        frame->state = FRAME_QUEUED;
+        jobs.push_back({ group, frame });
+    }
+    jobCnd.notify_one();
+}
+
+void SpectrumEngine::compute(Group* group, Frame* frame) {
+    volk_32fc_32f_multiply_32fc((lv_32fc_t*)frame->fft, (lv_32fc_t*)frame->fft, group->window, group->frameSize);
+    transform(group, frame);
+}
+
+void SpectrumEngine::transform(Group* group, Frame* frame) {
+    // The previous transform overwrote the zero-padding
+    int size = group->params.size;
+    if (group->frameSize < size) { dsp::buffer::clear(frame->fft, size - group->frameSize, group->frameSize); }
+    group->plan.execute(frame->fft, frame->fft);
+
+    // Keep the linear power around if a product averages it, the level in dB is derived from it
+    if (frame->needsPower) {
+        volk_32fc_magnitude_squared_32f(frame->power, (lv_32fc_t*)frame->fft, size);
+        volk_32f_s32f_multiply_32f(frame->power, frame->power, 1.0f / ((float)size * (float)size), size);
+        dsp::spectrum::powerToDB(frame->power, frame->spectrum, size);
+    }
+    else {
+        volk_32fc_s32f_power_spectrum_32f(frame->spectrum, (lv_32fc_t*)frame->fft, size, size);
+    }
+}
+
+bool SpectrumEngine::needsPower(Group* group) {
+    for (auto& stage : group->stages) {
+        if (stage->product.needsPower()) { return true; }
+    }
+    return false;
+}
+
+void SpectrumEngine::updatePower(Group* group) {
+    // Only touch the frames if the products changed their mind, they have to be drained first
+    bool power = needsPower(group);
+    if ((group->frames[0].power != NULL) == power) { return; }
+    drain(group);
+    for (auto& frame : group->frames) {
+        if (power) {
+            frame.power = dsp::buffer::alloc<float>(group->params.size);
+        }
+        else {
+            dsp::buffer::free(frame.power);
+            frame.power = NULL;
+        }
+    }
+}
+
+void SpectrumEngine::deliver(Group* group, Frame* frame) {
+    // Update every product and hand it to its consumers
+    for (auto& stage : group->stages) {
+        // A product needing the power that was added after the frame was taken has to wait for the next one
+        if (stage->product.needsPower() && !frame->needsPower) { continue; }
+        stage->product.process(frame->spectrum, frame->power);
+        for (auto& consumer : stage->consumers) {
+            consumer->handler(stage->product.data(), group->params.size, frame->centerFrequency, _samplerate, consumer->ctx);
+        }
+    }
+}
+
+void SpectrumEngine::deliverDone(Group* group) {
+    while (true) {
+        // Spectra are delivered in the order the frames were taken
+        Frame* frame = NULL;
+        {
+            std::lock_guard<std::mutex> lck(poolMtx);
+            for (auto& f : group->frames) {
+                if (f.state == FRAME_DONE && f.seq == group->deliverSeq) {
+                    frame = &f;
+                    break;
+                }
+            }
+        }
+        if (!frame) { return; }
+
+        deliver(group, frame);
+        group->deliverSeq++;
+        std::lock_guard<std::mutex> lck(poolMtx);
+        frame->state = FRAME_FREE;
+    }
+}
+
+void SpectrumEngine::drain(Group* group) {
+    std::unique_lock<std::mutex> lck(poolMtx);
+
+    // Cancel the frames that haven't been started yet
+    for (auto it = jobs.begin(); it != jobs.end();) {
+        if (it->group == group) {
+            it = jobs.erase(it);
+            continue;
+        }
+        it++;
+    }
+
+    // Wait for the ones being computed and discard everything
+    doneCnd.wait(lck, [group]() {
+        for (auto& f : group->frames) {
+            if (f.state == FRAME_BUSY) { return false; }
+        }
+        return true;
+    });
+    for (auto& f : group->frames) { f.state = FRAME_FREE; }
+    group->deliverSeq = group->nextSeq;
+}
+
+void SpectrumEngine::startWorkers(int count) {
+    stopPool = false;
+    for (int i = 0; i < count; i++) { workers.push_back(std::thread(&SpectrumEngine::worker, this)); }
+}
+
+void SpectrumEngine::stopWorkers() {
+    {
+        std::lock_guard<std::mutex> lck(poolMtx);
+        stopPool = true;
+    }
+    jobCnd.notify_all();
+    for (auto& w : workers) {
+        if (w.joinable()) { w.join(); }
+    }
+    workers.clear();
+}
+
+void SpectrumEngine::worker() {
+    std::unique_lock<std::mutex> lck(poolMtx);
+    while (true) {
+        jobCnd.wait(lck, [this]() { return stopPool || !jobs.empty(); });
+        if (stopPool) { return; }
+        Job job = jobs.front();
+        jobs.pop_front();
+        job.frame->state = FRAME_BUSY;
+        lck.unlock();
+
+        // The group can't be reconfigured while one of its frames is busy
+        compute(job.group, job.frame);
+
+        lck.lock();
+        job.frame->state = FRAME_DONE;
+        doneCnd.notify_all();
+    }
+}
\ No newline at end of file
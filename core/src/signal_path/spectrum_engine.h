@@ -0,0 +1,155 @@
+#pragma once
+#include "../dsp/sink.h"
+#include "../dsp/fft/planner.h"
+#include "../dsp/spectrum/product.h"
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+// Computes power spectra of the IQ for any number of consumers. Every consumer picks its own FFT size, rate,
+// window and product (averaging, hold, etc, see dsp::spectrum::Product). Consumers asking for the same FFT are
+// grouped and share it, the products are computed once per group at full resolution and shared in the same way.
+// Frames are windowed straight out of the input buffer, only the tail needed by frames straddling two buffers is kept.
+// Large FFTs can be spread over a pool of worker threads, each one computing whole frames, so that consecutive
+// frames are processed in parallel. Spectra are still delivered in order from the DSP thread.
+class SpectrumEngine : public dsp::Sink<dsp::complex_t> {
+    using base_type = dsp::Sink<dsp::complex_t>;
+public:
+    enum Window {
+        RECTANGULAR,
+        BLACKMAN,
+        NUTTALL
+    };
+
+    struct Params {
+        int size;                                   // FFT size
+        double rate;                                // Number of spectra per second
+        Window window;
+        dsp::spectrum::ProductParams product;
+
+        bool sameFFT(const Params& b) const {
+            return size == b.size && rate == b.rate && window == b.window;
+        }
+
+        bool operator==(const Params& b) const {
+            return sameFFT(b) && product == b.product;
+        }
+    };
+
+    // Spectra are given in dB, in frequency order (lowest frequency first). The handler is called from the DSP thread
+    // and must not add, remove or reconfigure consumers. The size is the FFT size, even for products holding more
+    // than one value per bin.
+    typedef void (*Handler)(const float* spectrum, int size, double centerFrequency, double samplerate, void* ctx);
+
+    struct Consumer {
+        Handler handler;
+        void* ctx;
+    };
+
+    SpectrumEngine() {}
+
+    ~SpectrumEngine();
+
+    void init(dsp::stream<dsp::complex_t>* in, double samplerate);
+
+    // Only needed for streams without metadata, the samplerate of the metadata is followed otherwise
+    void setSamplerate(double samplerate);
+
+    // Number of threads used for large FFTs, one or less computes everything on the DSP thread. Every thread
+    // costs a set of buffers for each large FFT.
+    void setThreadCount(int count);
+
+    Consumer* addConsumer(const Params& params, Handler handler, void* ctx);
+    void removeConsumer(Consumer* consumer);
+    void setParams(Consumer* consumer, const Params& params);
+
+    int run();
+
+    // FFTs at least this large are computed by the worker threads
+    static const int PARALLEL_MIN_SIZE = 131072;
+
+private:
+    enum FrameState {
+        FRAME_FREE,
+        FRAME_QUEUED,
+        FRAME_BUSY,
+        FRAME_DONE
+    };
+
+    struct Frame {
+        fftwf_complex* fft;     // Windowed samples, transformed in place
+        float* spectrum;
+        float* power;           // Linear power, only allocated and computed while a product needs it
+        bool needsPower;
+        FrameState state;
+        uint64_t seq;
+        double centerFrequency;
+    };
+
+    struct Stage {
+        dsp::spectrum::Product product;
+        std::vector<Consumer*> consumers;
+    };
+
+    struct Group {
+        Params params;          // Only the FFT part is relevant
+        int interval;           // Number of samples between two spectra
+        int frameSize;          // Number of samples used for each spectrum, the rest of the FFT is zero-padded
+        int remaining;          // Number of samples before the next spectrum
+        float* window;
+        dsp::fft::Plan plan;
+        std::vector<Stage*> stages;
+
+        // A single frame computed in place, or one per worker plus one being filled when parallel
+        bool parallel;
+        std::vector<Frame> frames;
+        uint64_t nextSeq;
+        uint64_t deliverSeq;
+    };
+
+    struct Job {
+        Group* group;
+        Frame* frame;
+    };
+
+    Group* createGroup(const Params& params);
+    void destroyGroup(Group* group);
+    void freeGroup(Group* group);
+    void configureGroup(Group* group);
+    bool find(Consumer* consumer, Group*& group, Stage*& stage);
+    void detach(Consumer* consumer);
+    void attach(Consumer* consumer, const Params& params);
+    void updateHistory();
+    void takeFrame(Group* group, const dsp::complex_t* first, int firstCount, const dsp::complex_t* second, int secondCount, double centerFrequency);
+    void compute(Group* group, Frame* frame);
+    void transform(Group* group, Frame* frame);
+    bool needsPower(Group* group);
+    void updatePower(Group* group);
+    void deliver(Group* group, Frame* frame);
+    void deliverDone(Group* group);
+    void drain(Group* group);
+    void startWorkers(int count);
+    void stopWorkers();
+    void worker();
+
+    double _samplerate;
+
+    std::mutex groupMtx;
+    std::vector<Group*> groups;
+
+    // The most recent samples, enough for the largest frame of all groups
+    dsp::complex_t* history = NULL;
+    int historySize = 0;
+    int historyFill = 0;
+
+    // Worker pool for large FFTs
+    int threadCount = 0;
+    std::vector<std::thread> workers;
+    std::mutex poolMtx;
+    std::condition_variable jobCnd;
+    std::condition_variable doneCnd;
+    std::deque<Job> jobs;
+    bool stopPool = false;
+};
\ No newline at end of file
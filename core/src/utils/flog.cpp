@@ -1,8 +1,15 @@
 #include "flog.h"
 #include <mutex>
 #include <chrono>
+#include <atomic>
+#include <thread>
+#include <condition_variable>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <inttypes.h>
+#include <signal.h>
+#include <exception>
 
 #ifdef _WIN32
 #include <Windows.h>
@@ -16,8 +23,13 @@
 #endif
 
 
-#define FORMAT_BUF_SIZE 16
-#define ESCAPE_CHAR     '\\'
+#define FORMAT_BUF_SIZE         16
+#define ESCAPE_CHAR             '\\'
+#define RATE_LIMIT_SLOT_COUNT   256
+#define RATE_LIMIT_MAX_PROBE    8
+#define CRASH_FLUSH_TIMEOUT_MS  1000
+#define LOG_FILE_MAGIC          "FLOG"
+#define LOG_FILE_VERSION        1
 
 namespace flog {
     std::mutex outMtx;
@@ -56,7 +68,331 @@ namespace flog {
     };
 #endif
 
+    struct Record {
+        Type type;
+        int64_t time; // Nanoseconds since the epoch
+        std::string msg;
+    };
+
+    // Only called from one thread at a time, localtime isn't threadsafe
+    void printRecord(const Record& rec) {
+        // Get output stream depending on type
+        FILE* outStream = (rec.type == TYPE_ERROR) ? stderr : stdout;
+
+        // Get time
+        time_t nowt = rec.time / 1000000000;
+        int ms = (rec.time / 1000000) % 1000;
+        auto nowc = std::localtime(&nowt);
+
+#if defined(_WIN32)
+        // Get output handle and return if invalid
+        int wOutStream = (rec.type == TYPE_ERROR) ? STD_ERROR_HANDLE  : STD_OUTPUT_HANDLE;
+        HANDLE conHndl = GetStdHandle(wOutStream);
+        if (!conHndl || conHndl == INVALID_HANDLE_VALUE) { return; }
+
+        // Print beginning of log line
+        SetConsoleTextAttribute(conHndl, COLOR_WHITE);
+        fprintf(outStream, "[%02d/%02d/%02d %02d:%02d:%02d.%03d] [", nowc->tm_mday, nowc->tm_mon + 1, nowc->tm_year + 1900, nowc->tm_hour, nowc->tm_min, nowc->tm_sec, ms);
+
+        // Switch color to the log color, print log type and 
+        SetConsoleTextAttribute(conHndl, TYPE_COLORS[rec.type]);
+        fputs(TYPE_STR[rec.type], outStream);
+        
+
+        // Switch back to default color and print rest of log string
+        SetConsoleTextAttribute(conHndl, COLOR_WHITE);
+        fprintf(outStream, "] %s\n", rec.msg.c_str());
+#elif defined(__ANDROID__)
+        // Print format string
+        __android_log_print(TYPE_PRIORITIES[rec.type], FLOG_ANDROID_TAG, COLOR_WHITE "[%02d/%02d/%02d %02d:%02d:%02d.%03d] [%s%s" COLOR_WHITE "] %s\n",
+                nowc->tm_mday, nowc->tm_mon + 1, nowc->tm_year + 1900, nowc->tm_hour, nowc->tm_min, nowc->tm_sec, ms, TYPE_COLORS[rec.type], TYPE_STR[rec.type], rec.msg.c_str());
+#else
+        // Print format string
+        fprintf(outStream, COLOR_WHITE "[%02d/%02d/%02d %02d:%02d:%02d.%03d] [%s%s" COLOR_WHITE "] %s\n",
+                nowc->tm_mday, nowc->tm_mon + 1, nowc->tm_year + 1900, nowc->tm_hour, nowc->tm_min, nowc->tm_sec, ms, TYPE_COLORS[rec.type], TYPE_STR[rec.type], rec.msg.c_str());
+#endif
+    }
+
+    // Bounded multiple producer single consumer queue, each slot holds a sequence number telling whether it's
+    // free for the producer reserving that position or ready for the consumer
+    class Backend {
+    public:
+        Backend() {
+            static_assert((QUEUE_SIZE & (QUEUE_SIZE - 1)) == 0, "QUEUE_SIZE must be a power of two");
+            for (int i = 0; i < QUEUE_SIZE; i++) { slots[i].seq.store(i, std::memory_order_relaxed); }
+            workerThread = std::thread(&Backend::worker, this);
+        }
+
+        // Never blocks, the message is dropped if the queue is full
+        void push(Record&& rec) {
+            uint64_t pos = tail.load(std::memory_order_relaxed);
+            Slot* slot;
+            while (true) {
+                slot = &slots[pos & (QUEUE_SIZE - 1)];
+                int64_t diff = (int64_t)slot->seq.load(std::memory_order_acquire) - (int64_t)pos;
+                if (!diff) {
+                    if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) { break; }
+                }
+                else if (diff < 0) {
+                    dropped.fetch_add(1, std::memory_order_relaxed);
+                    return;
+                }
+                else {
+                    pos = tail.load(std::memory_order_relaxed);
+                }
+            }
+            slot->rec = std::move(rec);
+            slot->seq.store(pos + 1, std::memory_order_release);
+
+            // Only wake up the worker if it's waiting
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (sleeping.load()) { workerCnd.notify_one(); }
+        }
+
+        void flush() {
+            uint64_t target = tail.load();
+            std::unique_lock<std::mutex> lck(workerMtx);
+            workerCnd.notify_one();
+            flushCnd.wait(lck, [=]() { return written >= target || !running; });
+        }
+
+        // Waits for the worker to write everything queued so far without taking any lock, since the crashing thread
+        // may be holding one. The worker wakes up on its own at least every 100ms.
+        void drain(int timeoutMs) {
+            if (std::this_thread::get_id() == workerThread.get_id()) { return; }
+            uint64_t target = tail.load();
+            for (int i = 0; i < timeoutMs && running && written < target; i++) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+
+        // Writes everything left and stops the worker, messages are then written by the callers
+        void stop() {
+            {
+                std::lock_guard<std::mutex> lck(workerMtx);
+                stopWorker = true;
+            }
+            workerCnd.notify_one();
+            if (workerThread.joinable()) { workerThread.join(); }
+
+            // Messages pushed while the worker was exiting
+            Record rec;
+            while (pop(rec)) { write(rec); }
+        }
+
+        bool setLogFile(const std::string& path) {
+            std::lock_guard<std::mutex> lck(outMtx);
+            if (file) {
+                fclose(file);
+                file = NULL;
+            }
+            if (path.empty()) { return true; }
+
+            file = fopen(path.c_str(), "wb");
+            if (!file) { return false; }
+            uint32_t version = LOG_FILE_VERSION;
+            fwrite(LOG_FILE_MAGIC, 1, 4, file);
+            fwrite(&version, sizeof(version), 1, file);
+            return true;
+        }
+
+        // Used by the worker, by the callers for errors and by the callers once the worker has stopped
+        void write(const Record& rec, bool sync = false) {
+            std::lock_guard<std::mutex> lck(outMtx);
+            printRecord(rec);
+            if (file) {
+                uint8_t type = rec.type;
+                uint32_t len = rec.msg.size();
+                fwrite(&rec.time, sizeof(rec.time), 1, file);
+                fwrite(&type, sizeof(type), 1, file);
+                fwrite(&len, sizeof(len), 1, file);
+                fwrite(rec.msg.data(), 1, len, file);
+            }
+            if (sync) {
+                fflush(stdout);
+                fflush(stderr);
+                if (file) { fflush(file); }
+            }
+        }
+
+        std::atomic<bool> running { true };
+
+    private:
+        bool pop(Record& rec) {
+            Slot* slot = &slots[head & (QUEUE_SIZE - 1)];
+            if (slot->seq.load(std::memory_order_acquire) != head + 1) { return false; }
+            rec = std::move(slot->rec);
+            slot->seq.store(head + QUEUE_SIZE, std::memory_order_release);
+            head++;
+            return true;
+        }
+
+        bool empty() {
+            return slots[head & (QUEUE_SIZE - 1)].seq.load(std::memory_order_acquire) != head + 1;
+        }
+
+        void worker() {
+            Record rec;
+            while (true) {
+                while (pop(rec)) { write(rec); }
+
+                // Report dropped messages
+                uint64_t count = dropped.exchange(0);
+                if (count) {
+                    int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+                    Record drop = { TYPE_WARNING, now, std::to_string(count) + " log messages dropped, the queue was full" };
+                    write(drop);
+                }
+                {
+                    std::lock_guard<std::mutex> lck(outMtx);
+                    fflush(stdout);
+                    if (file) { fflush(file); }
+                }
+
+                std::unique_lock<std::mutex> lck(workerMtx);
+                written = head;
+                flushCnd.notify_all();
+                if (stopWorker && empty()) { break; }
+
+                // The timeout only matters if a wakeup is missed between setting the flag and waiting
+                sleeping = true;
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (empty() && !stopWorker) { workerCnd.wait_for(lck, std::chrono::milliseconds(100)); }
+                sleeping = false;
+            }
+            running = false;
+            flushCnd.notify_all();
+        }
+
+        struct Slot {
+            std::atomic<uint64_t> seq;
+            Record rec;
+        };
+        Slot slots[QUEUE_SIZE];
+        std::atomic<uint64_t> tail { 0 };
+        uint64_t head = 0;
+        std::atomic<uint64_t> dropped { 0 };
+
+        std::thread workerThread;
+        std::mutex workerMtx;
+        std::condition_variable workerCnd;
+        std::condition_variable flushCnd;
+        std::atomic<bool> sleeping { false };
+        bool stopWorker = false;
+        std::atomic<uint64_t> written { 0 };
+
+        FILE* file = NULL;
+    };
+
+    void shutdown();
+    void installCrashHandlers();
+
+    // Created on first use and never destroyed so that logging from static destructors stays safe,
+    // it's stopped at exit and messages are then written synchronously
+    Backend* getBackend() {
+        static Backend* backend = []() {
+            Backend* b = new Backend();
+            std::atexit(shutdown);
+            installCrashHandlers();
+            return b;
+        }();
+        return backend;
+    }
+
+    void shutdown() {
+        getBackend()->stop();
+    }
+
+    // The messages leading to a crash are the ones that matter most, so give the worker a chance to write them.
+    // Only signals that still have their default action are hooked, the default action then runs as usual.
+    const int CRASH_SIGNALS[] = {
+        SIGSEGV,
+        SIGILL,
+        SIGFPE,
+        SIGABRT,
+        SIGTERM,
+        SIGINT
+    };
+    std::terminate_handler prevTerminateHandler = NULL;
+
+    void crashSignalHandler(int sig) {
+        getBackend()->drain(CRASH_FLUSH_TIMEOUT_MS);
+        signal(sig, SIG_DFL);
+        raise(sig);
+    }
+
+    void terminateHandler() {
+        getBackend()->drain(CRASH_FLUSH_TIMEOUT_MS);
+        if (prevTerminateHandler) { prevTerminateHandler(); }
+        std::abort();
+    }
+
+    void installCrashHandlers() {
+        for (int sig : CRASH_SIGNALS) {
+            auto prev = signal(sig, crashSignalHandler);
+            if (prev != SIG_DFL) { signal(sig, prev); }
+        }
+        prevTerminateHandler = std::set_terminate(terminateHandler);
+    }
+
+    // Token bucket per call site, the format string pointer identifying the call site. A call site hashing to a
+    // slot taken by another one uses the next free slot. Once all of them are taken, it shares the bucket of the
+    // slot it hashes to instead of resetting it.
+    struct RateLimit {
+        std::atomic_flag busy = ATOMIC_FLAG_INIT;
+        const char* site = NULL;
+        double tokens = 0.0;
+        int64_t lastRefill = 0;
+        int suppressed = 0;
+    };
+    RateLimit rateLimits[RATE_LIMIT_SLOT_COUNT];
+
+    RateLimit& lockRateLimit(const char* site, int64_t now) {
+        uint32_t hash = ((uintptr_t)site >> 3) * 2654435761u;
+        for (int i = 0; i < RATE_LIMIT_MAX_PROBE; i++) {
+            RateLimit& rl = rateLimits[(hash + i) % RATE_LIMIT_SLOT_COUNT];
+
+            // Only held for a few instructions
+            while (rl.busy.test_and_set(std::memory_order_acquire));
+            if (rl.site == site) { return rl; }
+            if (!rl.site) {
+                rl.site = site;
+                rl.tokens = RATE_LIMIT_BURST;
+                rl.lastRefill = now;
+                rl.suppressed = 0;
+                return rl;
+            }
+            rl.busy.clear(std::memory_order_release);
+        }
+
+        RateLimit& rl = rateLimits[hash % RATE_LIMIT_SLOT_COUNT];
+        while (rl.busy.test_and_set(std::memory_order_acquire));
+        return rl;
+    }
+
+    bool rateLimit(const char* site, int64_t now, int& suppressed) {
+        RateLimit& rl = lockRateLimit(site, now);
+        rl.tokens = std::min<double>(RATE_LIMIT_BURST, rl.tokens + (double)(now - rl.lastRefill) * RATE_LIMIT_PER_SECOND / 1e9);
+        rl.lastRefill = now;
+        bool pass = (rl.tokens >= 1.0);
+        if (pass) {
+            rl.tokens -= 1.0;
+            suppressed = rl.suppressed;
+            rl.suppressed = 0;
+        }
+        else {
+            rl.suppressed++;
+        }
+        rl.busy.clear(std::memory_order_release);
+        return pass;
+    }
+
     void __log__(Type type, const char* fmt, const std::vector<std::string>& args) {
+        // Drop the message before formatting it if its call site is too verbose
+        int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        int suppressed = 0;
+        if (!rateLimit(fmt, now, suppressed)) { return; }
+
         // Reserve a buffer for the final output
         int argCount = args.size();
         int fmtLen = strlen(fmt) + 1;
@@ -64,9 +400,6 @@ namespace flog {
         for (const auto& a : args) { totSize += a.size(); }
         std::string out;
         out.reserve(totSize);
-        
-        // Get output stream depending on type
-        FILE* outStream = (type == TYPE_ERROR) ? stderr : stdout;
 
         // Parse format string
         bool escaped = false;
@@ -141,42 +474,62 @@ namespace flog {
             }
         }
 
-        // Get time
-        auto now = std::chrono::system_clock::now();
-        auto nowt = std::chrono::system_clock::to_time_t(now);
-        auto nowc = std::localtime(&nowt); // TODO: This is not threadsafe
+        // The null terminator of the format string was copied as well
+        if (!out.empty() && !out.back()) { out.pop_back(); }
+        if (suppressed) {
+            out += " (" + std::to_string(suppressed) + " similar messages suppressed)";
+        }
+
+        Record rec = { type, now, std::move(out) };
+        Backend* backend = getBackend();
+        if (!backend->running) {
+            backend->write(rec);
+        }
+        else if (type == TYPE_ERROR) {
+            // Errors are on the screen and in the file before returning, after everything logged before them
+            backend->flush();
+            backend->write(rec, true);
+        }
+        else {
+            backend->push(std::move(rec));
+        }
+    }
 
-        // Write to output
-        {
+    void flush() {
+        getBackend()->flush();
+    }
+
+    bool setLogFile(const std::string& path) {
+        return getBackend()->setLogFile(path);
+    }
+
+    bool readLogFile(const std::string& path) {
+        FILE* file = fopen(path.c_str(), "rb");
+        if (!file) { return false; }
+
+        char magic[4];
+        uint32_t version;
+        if (fread(magic, 1, 4, file) != 4 || memcmp(magic, LOG_FILE_MAGIC, 4) || fread(&version, sizeof(version), 1, file) != 1 || version != LOG_FILE_VERSION) {
+            fclose(file);
+            return false;
+        }
+
+        Record rec;
+        while (true) {
+            uint8_t type;
+            uint32_t len;
+            if (fread(&rec.time, sizeof(rec.time), 1, file) != 1) { break; }
+            if (fread(&type, sizeof(type), 1, file) != 1 || fread(&len, sizeof(len), 1, file) != 1) { break; }
+            if (type >= _TYPE_COUNT) { break; }
+            rec.type = (Type)type;
+            rec.msg.resize(len);
+            if (fread(rec.msg.data(), 1, len, file) != len) { break; }
             std::lock_guard<std::mutex> lck(outMtx);
-#if defined(_WIN32)
-            // Get output handle and return if invalid
-            int wOutStream = (type == TYPE_ERROR) ? STD_ERROR_HANDLE  : STD_OUTPUT_HANDLE;
-            HANDLE conHndl = GetStdHandle(wOutStream);
-            if (!conHndl || conHndl == INVALID_HANDLE_VALUE) { return; }
-
-            // Print beginning of log line
-            SetConsoleTextAttribute(conHndl, COLOR_WHITE);
-            fprintf(outStream, "[%02d/%02d/%02d %02d:%02d:%02d.%03d] [", nowc->tm_mday, nowc->tm_mon + 1, nowc->tm_year + 1900, nowc->tm_hour, nowc->tm_min, nowc->tm_sec, 0);
-
-            // Switch color to the log color, print log type and 
-            SetConsoleTextAttribute(conHndl, TYPE_COLORS[type]);
-            fputs(TYPE_STR[type], outStream);
-            
-
-            // Switch back to default color and print rest of log string
-            SetConsoleTextAttribute(conHndl, COLOR_WHITE);
-            fprintf(outStream, "] %s\n", out.c_str());
-#elif defined(__ANDROID__)
-            // Print format string
-            __android_log_print(TYPE_PRIORITIES[type], FLOG_ANDROID_TAG, COLOR_WHITE "[%02d/%02d/%02d %02d:%02d:%02d.%03d] [%s%s" COLOR_WHITE "] %s\n",
-                    nowc->tm_mday, nowc->tm_mon + 1, nowc->tm_year + 1900, nowc->tm_hour, nowc->tm_min, nowc->tm_sec, 0, TYPE_COLORS[type], TYPE_STR[type], out.c_str());
-#else
-            // Print format string
-            fprintf(outStream, COLOR_WHITE "[%02d/%02d/%02d %02d:%02d:%02d.%03d] [%s%s" COLOR_WHITE "] %s\n",
-                    nowc->tm_mday, nowc->tm_mon + 1, nowc->tm_year + 1900, nowc->tm_hour, nowc->tm_min, nowc->tm_sec, 0, TYPE_COLORS[type], TYPE_STR[type], out.c_str());
-#endif
+            printRecord(rec);
         }
+
+        fclose(file);
+        return true;
     }
 
     std::string __toString__(bool value) {
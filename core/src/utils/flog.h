@@ -15,6 +15,24 @@ namespace flog {
     // IO functions
     void __log__(Type type, const char* fmt, const std::vector<std::string>& args);
 
+    // Messages are formatted on the calling thread then handed to a background thread through a lock-free queue,
+    // so that a slow terminal never stalls the caller. Messages that don't fit in the queue are dropped and counted.
+    static const int QUEUE_SIZE = 1024;
+
+    // Messages logged from the same call site beyond this burst are only let through at the given rate,
+    // the number of suppressed ones is appended to the next message let through
+    static const int RATE_LIMIT_BURST = 100;
+    static const int RATE_LIMIT_PER_SECOND = 10;
+
+    // Wait until all messages logged so far have been written
+    void flush();
+
+    // Also write the log to a binary file, readable with readLogFile(). An empty path closes it.
+    bool setLogFile(const std::string& path);
+
+    // Print a binary log file to stdout, returns false if it could not be read
+    bool readLogFile(const std::string& path);
+
     // Conversion functions
     std::string __toString__(bool value);
     std::string __toString__(char value);
@@ -0,0 +1,438 @@
+#include "spectrogram.h"
+#include <algorithm>
+#include <string.h>
+#include <math.h>
+#include <utils/flog.h>
+
+namespace spectrogram {
+    const char FILE_MAGIC[8]        = { 'S', 'D', 'R', 'P', 'P', 'S', 'P', 'G' };
+    const char CHUNK_MAGIC[4]       = { 'S', 'P', 'G', 'C' };
+    const char INDEX_MAGIC[4]       = { 'S', 'P', 'G', 'I' };
+    const uint16_t FILE_VERSION     = 1;
+    const int OVERVIEW_SIZE         = 1024;
+    const int COMPRESSION_LEVEL     = 3;
+
+    Writer::Writer(int bitDepth, float minLevel, float maxLevel, int framesPerChunk) {
+        setBitDepth(bitDepth);
+        setRange(minLevel, maxLevel);
+        setFramesPerChunk(framesPerChunk);
+    }
+
+    Writer::~Writer() {
+        close();
+        if (cctx) { ZSTD_freeCCtx(cctx); }
+    }
+
+    bool Writer::open(std::string path, int binCount) {
+        std::lock_guard<std::recursive_mutex> lck(mtx);
+        // Close previous file
+        if (file.is_open()) { close(); }
+
+        // Fill header
+        memcpy(hdr.magic, FILE_MAGIC, sizeof(hdr.magic));
+        hdr.version = FILE_VERSION;
+        hdr.bitDepth = _bitDepth;
+        hdr.binCount = binCount;
+        hdr.overviewSize = std::min<int>(binCount, OVERVIEW_SIZE);
+        hdr.minLevel = _minLevel;
+        hdr.maxLevel = _maxLevel;
+
+        // Reset work values
+        index.clear();
+        frames.clear();
+        times.clear();
+        previous.resize(binCount);
+        peak.resize(binCount);
+        chunk.frameCount = 0;
+        framesWritten = 0;
+        if (!cctx) { cctx = ZSTD_createCCtx(); }
+
+        // Open file
+        file.open(path, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) { return false; }
+        file.write((char*)&hdr, sizeof(FileHeader));
+        bytesWritten = sizeof(FileHeader);
+
+        // Start the worker
+        stopWorker = false;
+        workerThread = std::thread(&Writer::worker, this);
+        return true;
+    }
+
+    bool Writer::isOpen() {
+        std::lock_guard<std::recursive_mutex> lck(mtx);
+        return file.is_open();
+    }
+
+    void Writer::close() {
+        std::lock_guard<std::recursive_mutex> lck(mtx);
+        if (!file.is_open()) { return; }
+
+        // Hand over the last chunk and wait for all of them to be written
+        flushChunk();
+        {
+            std::lock_guard<std::mutex> qlck(queueMtx);
+            stopWorker = true;
+        }
+        queueCnd.notify_all();
+        if (workerThread.joinable()) { workerThread.join(); }
+
+        // Write the index
+        Footer footer;
+        footer.indexOffset = bytesWritten;
+        footer.entryCount = index.size();
+        memcpy(footer.magic, INDEX_MAGIC, sizeof(footer.magic));
+        file.write((char*)index.data(), index.size() * sizeof(IndexEntry));
+        file.write((char*)&footer, sizeof(Footer));
+        bytesWritten += (index.size() * sizeof(IndexEntry)) + sizeof(Footer);
+
+        file.close();
+    }
+
+    void Writer::setBitDepth(int bitDepth) {
+        std::lock_guard<std::recursive_mutex> lck(mtx);
+        if (file.is_open()) { return; }
+        _bitDepth = (bitDepth > 8) ? 16 : 8;
+    }
+
+    void Writer::setRange(float minLevel, float maxLevel) {
+        std::lock_guard<std::recursive_mutex> lck(mtx);
+        if (file.is_open() || maxLevel <= minLevel) { return; }
+        _minLevel = minLevel;
+        _maxLevel = maxLevel;
+    }
+
+    void Writer::setFramesPerChunk(int framesPerChunk) {
+        std::lock_guard<std::recursive_mutex> lck(mtx);
+        _framesPerChunk = std::max<int>(framesPerChunk, 1);
+    }
+
+    void Writer::write(const float* spectrum, int count, double centerFrequency, double samplerate, int64_t time) {
+        std::lock_guard<std::recursive_mutex> lck(mtx);
+        if (!file.is_open() || count != (int)hdr.binCount) { return; }
+
+        // A chunk only ever covers a single tuning
+        if (chunk.frameCount && (centerFrequency != chunk.centerFrequency || samplerate != chunk.samplerate || (int)chunk.frameCount >= _framesPerChunk)) {
+            flushChunk();
+        }
+        if (!chunk.frameCount) {
+            chunk.startTime = time;
+            chunk.centerFrequency = centerFrequency;
+            chunk.samplerate = samplerate;
+            std::fill(peak.begin(), peak.end(), 0);
+            frames.reserve((size_t)_framesPerChunk * count * (_bitDepth / 8));
+            times.reserve(_framesPerChunk);
+        }
+
+        // Quantise and store the difference from the previous frame, wrapping around so that it's lossless
+        int maxCode = (1 << _bitDepth) - 1;
+        float scale = (float)maxCode / (_maxLevel - _minLevel);
+        bool first = !chunk.frameCount;
+        int bytes = _bitDepth / 8;
+        size_t pos = frames.size();
+        frames.resize(pos + (count * bytes));
+        uint8_t* out = &frames[pos];
+        for (int i = 0; i < count; i++) {
+            float v = (spectrum[i] - _minLevel) * scale;
+            if (!(v > 0.0f)) { v = 0.0f; }
+            else if (v > (float)maxCode) { v = (float)maxCode; }
+            uint16_t code = (uint16_t)lrintf(v);
+            uint16_t delta = first ? code : (uint16_t)((code - previous[i]) & maxCode);
+            previous[i] = code;
+            peak[i] = std::max<uint16_t>(peak[i], code);
+            if (bytes == 1) { out[i] = delta; }
+            else { memcpy(&out[i * 2], &delta, 2); }
+        }
+
+        times.push_back(time - chunk.startTime);
+        chunk.endTime = time;
+        chunk.frameCount++;
+        framesWritten++;
+    }
+
+    void Writer::flushChunk() {
+        if (!chunk.frameCount) { return; }
+        int bytes = _bitDepth / 8;
+
+        // Overview made of the highest level of each group of bins over the whole chunk
+        PendingChunk pc;
+        pc.overview.resize(hdr.overviewSize * bytes);
+        for (int i = 0; i < (int)hdr.overviewSize; i++) {
+            int start = ((int64_t)i * hdr.binCount) / hdr.overviewSize;
+            int end = ((int64_t)(i + 1) * hdr.binCount) / hdr.overviewSize;
+            uint16_t max = *std::max_element(&peak[start], &peak[end]);
+            if (bytes == 1) { pc.overview[i] = max; }
+            else { memcpy(&pc.overview[i * 2], &max, 2); }
+        }
+
+        // Hand the chunk over to the worker
+        memcpy(chunk.magic, CHUNK_MAGIC, sizeof(chunk.magic));
+        pc.header = chunk;
+        pc.times = std::move(times);
+        pc.frames = std::move(frames);
+        {
+            std::lock_guard<std::mutex> lck(queueMtx);
+            if ((int)queue.size() < MAX_PENDING_CHUNKS) {
+                queue.push_back(std::move(pc));
+            }
+            else {
+                flog::error("Spectrogram writer can't keep up, {0} frames lost", chunk.frameCount);
+            }
+        }
+        queueCnd.notify_all();
+
+        chunk.frameCount = 0;
+        frames.clear();
+        times.clear();
+    }
+
+    void Writer::writeChunk(PendingChunk& pc) {
+        // Compress the frame times followed by the frames
+        payload.resize(pc.times.size() * sizeof(int64_t) + pc.frames.size());
+        memcpy(payload.data(), pc.times.data(), pc.times.size() * sizeof(int64_t));
+        memcpy(&payload[pc.times.size() * sizeof(int64_t)], pc.frames.data(), pc.frames.size());
+        compressed.resize(ZSTD_compressBound(payload.size()));
+        size_t size = ZSTD_compressCCtx(cctx, compressed.data(), compressed.size(), payload.data(), payload.size(), COMPRESSION_LEVEL);
+        if (ZSTD_isError(size)) {
+            flog::error("Failed to compress spectrogram chunk, {0} frames lost", pc.header.frameCount);
+            return;
+        }
+        pc.header.compressedSize = size;
+
+        IndexEntry entry;
+        entry.offset = bytesWritten;
+        entry.frameCount = pc.header.frameCount;
+        entry.startTime = pc.header.startTime;
+        entry.endTime = pc.header.endTime;
+        entry.centerFrequency = pc.header.centerFrequency;
+        entry.samplerate = pc.header.samplerate;
+        index.push_back(entry);
+
+        file.write((char*)&pc.header, sizeof(ChunkHeader));
+        file.write((char*)pc.overview.data(), pc.overview.size());
+        file.write((char*)compressed.data(), size);
+        file.flush();
+        bytesWritten += sizeof(ChunkHeader) + pc.overview.size() + size;
+    }
+
+    void Writer::worker() {
+        std::unique_lock<std::mutex> lck(queueMtx);
+        while (true) {
+            // Wait for a chunk, the remaining ones are written before exiting
+            queueCnd.wait(lck, [this]() { return !queue.empty() || stopWorker; });
+            if (queue.empty()) { break; }
+            PendingChunk pc = std::move(queue.front());
+            queue.pop_front();
+
+            lck.unlock();
+            writeChunk(pc);
+            lck.lock();
+        }
+    }
+
+    Reader::~Reader() {
+        close();
+        if (dctx) { ZSTD_freeDCtx(dctx); }
+    }
+
+    bool Reader::open(std::string path) {
+        close();
+        file.open(path, std::ios::in | std::ios::binary);
+        if (!file.is_open()) { return false; }
+        file.seekg(0, std::ios::end);
+        fileSize = file.tellg();
+        file.seekg(0);
+
+        // Check header
+        if (fileSize < sizeof(FileHeader) || !file.read((char*)&hdr, sizeof(FileHeader)) ||
+            memcmp(hdr.magic, FILE_MAGIC, sizeof(hdr.magic)) || hdr.version != FILE_VERSION ||
+            (hdr.bitDepth != 8 && hdr.bitDepth != 16) || !hdr.binCount || !hdr.overviewSize || hdr.maxLevel <= hdr.minLevel) {
+            close();
+            return false;
+        }
+        if (!dctx) { dctx = ZSTD_createDCtx(); }
+
+        // Recordings that weren't closed properly have no index
+        if (!readIndex() && !rebuildIndex()) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    bool Reader::isOpen() {
+        return file.is_open();
+    }
+
+    void Reader::close() {
+        if (file.is_open()) { file.close(); }
+        file.clear();
+        index.clear();
+        cachedId = -1;
+    }
+
+    int Reader::findChunk(int64_t time) {
+        auto it = std::upper_bound(index.begin(), index.end(), time, [](int64_t t, const IndexEntry& e) { return t < e.startTime; });
+        return (int)(it - index.begin()) - 1;
+    }
+
+    bool Reader::readOverview(int id, float* levels) {
+        if (id < 0 || id >= (int)index.size()) { return false; }
+        int bytes = hdr.bitDepth / 8;
+        raw.resize(hdr.overviewSize * bytes);
+        file.clear();
+        file.seekg(index[id].offset + sizeof(ChunkHeader));
+        if (!file.read((char*)raw.data(), raw.size())) { return false; }
+        for (int i = 0; i < (int)hdr.overviewSize; i++) {
+            uint16_t code = raw[i];
+            if (bytes == 2) { memcpy(&code, &raw[i * 2], 2); }
+            levels[i] = decode(code);
+        }
+        return true;
+    }
+
+    bool Reader::readChunk(int id, std::vector<float>& levels, std::vector<int64_t>& times) {
+        if (id < 0 || id >= (int)index.size()) { return false; }
+        const IndexEntry& entry = index[id];
+        int bytes = hdr.bitDepth / 8;
+
+        // Read and decompress
+        ChunkHeader ch;
+        if (!readChunkHeader(entry.offset, ch)) { return false; }
+        compressed.resize(ch.compressedSize);
+        file.seekg(entry.offset + sizeof(ChunkHeader) + (hdr.overviewSize * bytes));
+        if (!file.read((char*)compressed.data(), compressed.size())) { return false; }
+        size_t timesSize = ch.frameCount * sizeof(int64_t);
+        raw.resize(timesSize + ((size_t)ch.frameCount * hdr.binCount * bytes));
+        size_t size = ZSTD_decompressDCtx(dctx, raw.data(), raw.size(), compressed.data(), compressed.size());
+        if (ZSTD_isError(size) || size != raw.size()) { return false; }
+
+        // Undo the delta coding
+        times.resize(ch.frameCount);
+        memcpy(times.data(), raw.data(), timesSize);
+        for (auto& t : times) { t += ch.startTime; }
+        levels.resize((size_t)ch.frameCount * hdr.binCount);
+        std::vector<uint16_t> codes(hdr.binCount, 0);
+        int mask = (1 << hdr.bitDepth) - 1;
+        const uint8_t* in = &raw[timesSize];
+        for (uint32_t f = 0; f < ch.frameCount; f++) {
+            float* line = &levels[(size_t)f * hdr.binCount];
+            for (uint32_t i = 0; i < hdr.binCount; i++) {
+                uint16_t delta = *in;
+                if (bytes == 2) { memcpy(&delta, in, 2); }
+                in += bytes;
+                codes[i] = (codes[i] + delta) & mask;
+                line[i] = decode(codes[i]);
+            }
+        }
+        return true;
+    }
+
+    void Reader::render(int64_t startTime, int64_t endTime, double startFreq, double endFreq, int width, int height, float* out) {
+        std::fill(out, out + ((size_t)width * height), -INFINITY);
+        if (endTime <= startTime || endFreq <= startFreq || width <= 0 || height <= 0) { return; }
+        double rowTime = (double)(endTime - startTime) / (double)height;
+        std::vector<float> overview(hdr.overviewSize);
+
+        for (int id = std::max<int>(findChunk(startTime), 0); id < (int)index.size(); id++) {
+            const IndexEntry& entry = index[id];
+            if (entry.startTime > endTime) { break; }
+            if (entry.endTime < startTime) { continue; }
+
+            // Chunks spanning no more than a row are drawn from their overview
+            if ((double)(entry.endTime - entry.startTime) <= rowTime) {
+                if (!readOverview(id, overview.data())) { continue; }
+                int first = std::clamp<int>((std::max<int64_t>(entry.startTime, startTime) - startTime) / rowTime, 0, height - 1);
+                int last = std::clamp<int>((std::min<int64_t>(entry.endTime, endTime) - startTime) / rowTime, 0, height - 1);
+                for (int r = first; r <= last; r++) { drawLine(overview.data(), hdr.overviewSize, entry, startFreq, endFreq, width, &out[r * width]); }
+                continue;
+            }
+
+            // Otherwise decode it
+            if (cachedId != id) {
+                cachedId = -1;
+                if (!readChunk(id, cachedLevels, cachedTimes)) { continue; }
+                cachedId = id;
+            }
+            for (int f = 0; f < (int)cachedTimes.size(); f++) {
+                int64_t t = cachedTimes[f];
+                if (t < startTime || t > endTime) { continue; }
+                int r = std::clamp<int>((t - startTime) / rowTime, 0, height - 1);
+                drawLine(&cachedLevels[(size_t)f * hdr.binCount], hdr.binCount, entry, startFreq, endFreq, width, &out[r * width]);
+            }
+        }
+    }
+
+    bool Reader::readIndex() {
+        if (fileSize < sizeof(FileHeader) + sizeof(Footer)) { return false; }
+        Footer footer;
+        file.clear();
+        file.seekg(fileSize - sizeof(Footer));
+        if (!file.read((char*)&footer, sizeof(Footer)) || memcmp(footer.magic, INDEX_MAGIC, sizeof(footer.magic))) { return false; }
+        if (footer.indexOffset + ((uint64_t)footer.entryCount * sizeof(IndexEntry)) + sizeof(Footer) != fileSize) { return false; }
+        index.resize(footer.entryCount);
+        file.seekg(footer.indexOffset);
+        if (!file.read((char*)index.data(), index.size() * sizeof(IndexEntry))) {
+            index.clear();
+            return false;
+        }
+        return true;
+    }
+
+    bool Reader::rebuildIndex() {
+        // Walk the chunks until the end of the file or the first incomplete one
+        uint64_t offset = sizeof(FileHeader);
+        uint64_t overviewBytes = hdr.overviewSize * (hdr.bitDepth / 8);
+        ChunkHeader ch;
+        while (readChunkHeader(offset, ch)) {
+            uint64_t size = sizeof(ChunkHeader) + overviewBytes + ch.compressedSize;
+            if (offset + size > fileSize) { break; }
+            IndexEntry entry;
+            entry.offset = offset;
+            entry.frameCount = ch.frameCount;
+            entry.startTime = ch.startTime;
+            entry.endTime = ch.endTime;
+            entry.centerFrequency = ch.centerFrequency;
+            entry.samplerate = ch.samplerate;
+            index.push_back(entry);
+            offset += size;
+        }
+        flog::warn("Spectrogram recording has no index, recovered {0} chunks", index.size());
+        return true;
+    }
+
+    bool Reader::readChunkHeader(uint64_t offset, ChunkHeader& ch) {
+        if (offset + sizeof(ChunkHeader) > fileSize) { return false; }
+        file.clear();
+        file.seekg(offset);
+        if (!file.read((char*)&ch, sizeof(ChunkHeader))) { return false; }
+        return !memcmp(ch.magic, CHUNK_MAGIC, sizeof(ch.magic));
+    }
+
+    void Reader::drawLine(const float* levels, int count, const IndexEntry& entry, double startFreq, double endFreq, int width, float* row) {
+        double lineStart = entry.centerFrequency - (entry.samplerate / 2.0);
+        double binWidth = entry.samplerate / (double)count;
+        double colWidth = (endFreq - startFreq) / (double)width;
+
+        // Take the highest bin of each column when zoomed out, or the bin under each column when zoomed in
+        if (binWidth < colWidth) {
+            for (int i = 0; i < count; i++) {
+                double col = ((lineStart + ((double)i + 0.5) * binWidth) - startFreq) / colWidth;
+                if (col < 0.0 || col >= (double)width) { continue; }
+                float& cell = row[(int)col];
+                cell = std::max<float>(cell, levels[i]);
+            }
+        }
+        else {
+            for (int c = 0; c < width; c++) {
+                double bin = ((startFreq + ((double)c + 0.5) * colWidth) - lineStart) / binWidth;
+                if (bin < 0.0 || bin >= (double)count) { continue; }
+                row[c] = std::max<float>(row[c], levels[(int)bin]);
+            }
+        }
+    }
+
+    float Reader::decode(uint16_t code) {
+        return hdr.minLevel + ((float)code * (hdr.maxLevel - hdr.minLevel) / (float)((1 << hdr.bitDepth) - 1));
+    }
+}
\ No newline at end of file
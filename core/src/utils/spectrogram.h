@@ -0,0 +1,175 @@
+#pragma once
+#include <string>
+#include <fstream>
+#include <vector>
+#include <deque>
+#include <stdint.h>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+#include <zstd.h>
+
+// Compact spectrogram file format. Spectra are quantised to 8 or 16 bits, each frame is stored as the difference
+// from the previous one and frames are zstd-compressed in chunks. Every chunk starts with a header giving its time
+// span and tuning, followed by an uncompressed overview line holding the maximum of each group of bins over the
+// whole chunk. An index of all chunks is written at the end of the file, or rebuilt from the chunk headers if the
+// recording wasn't closed properly. Zoomed out views are drawn from the overview lines alone, frames are only
+// decoded for the chunks that need the full detail.
+namespace spectrogram {
+    #pragma pack(push, 1)
+    struct FileHeader {
+        char magic[8];
+        uint16_t version;
+        uint16_t bitDepth;
+        uint32_t binCount;
+        uint32_t overviewSize;
+        float minLevel;             // Level in dB of the lowest code
+        float maxLevel;             // Level in dB of the highest code
+    };
+
+    struct ChunkHeader {
+        char magic[4];
+        uint32_t frameCount;
+        int64_t startTime;          // Time of the first frame in microseconds since the epoch
+        int64_t endTime;            // Time of the last frame in microseconds since the epoch
+        double centerFrequency;
+        double samplerate;
+        uint32_t compressedSize;    // Size of the compressed frames following the overview
+    };
+
+    struct IndexEntry {
+        uint64_t offset;            // Offset of the chunk header in the file
+        uint32_t frameCount;
+        int64_t startTime;
+        int64_t endTime;
+        double centerFrequency;
+        double samplerate;
+    };
+
+    struct Footer {
+        uint64_t indexOffset;
+        uint32_t entryCount;
+        char magic[4];
+    };
+    #pragma pack(pop)
+
+    class Writer {
+    public:
+        Writer(int bitDepth = 8, float minLevel = -150.0f, float maxLevel = 0.0f, int framesPerChunk = 256);
+        ~Writer();
+
+        bool open(std::string path, int binCount);
+        bool isOpen();
+        void close();
+
+        void setBitDepth(int bitDepth);
+        void setRange(float minLevel, float maxLevel);
+        void setFramesPerChunk(int framesPerChunk);
+
+        uint64_t getFramesWritten() { return framesWritten; }
+        uint64_t getBytesWritten() { return bytesWritten; }
+
+        // Spectra are given in dB, in frequency order. The time is in microseconds since the epoch.
+        // Frames of the wrong size are dropped. Only the quantisation is done by the caller, finished chunks are
+        // compressed and written to the file by a worker thread.
+        void write(const float* spectrum, int count, double centerFrequency, double samplerate, int64_t time);
+
+        // Chunks waiting to be written beyond which new ones are dropped, in case the disk can't keep up
+        static const int MAX_PENDING_CHUNKS = 64;
+
+    private:
+        struct PendingChunk {
+            ChunkHeader header;
+            std::vector<uint8_t> overview;
+            std::vector<int64_t> times;
+            std::vector<uint8_t> frames;
+        };
+
+        void flushChunk();
+        void writeChunk(PendingChunk& pc);
+        void worker();
+
+        std::recursive_mutex mtx;
+        std::ofstream file;
+        FileHeader hdr;
+        std::vector<IndexEntry> index;
+
+        int _bitDepth;
+        float _minLevel;
+        float _maxLevel;
+        int _framesPerChunk;
+
+        // Current chunk
+        ChunkHeader chunk;
+        std::vector<uint8_t> frames;        // Delta-coded frames
+        std::vector<int64_t> times;         // Time of each frame relative to the start of the chunk
+        std::vector<uint16_t> previous;     // Codes of the previous frame
+        std::vector<uint16_t> peak;         // Highest code of each bin over the chunk
+
+        // Chunks waiting to be written. The file, the index and the compression are only used by the worker while
+        // the file is open.
+        std::thread workerThread;
+        std::mutex queueMtx;
+        std::condition_variable queueCnd;
+        std::deque<PendingChunk> queue;
+        bool stopWorker = false;
+        std::vector<uint8_t> payload;
+        std::vector<uint8_t> compressed;
+        ZSTD_CCtx* cctx = NULL;
+
+        std::atomic<uint64_t> framesWritten { 0 };
+        std::atomic<uint64_t> bytesWritten { 0 };
+    };
+
+    class Reader {
+    public:
+        Reader() {}
+        ~Reader();
+
+        bool open(std::string path);
+        bool isOpen();
+        void close();
+
+        int getBitDepth() { return hdr.bitDepth; }
+        int getBinCount() { return hdr.binCount; }
+        int getOverviewSize() { return hdr.overviewSize; }
+        float getMinLevel() { return hdr.minLevel; }
+        float getMaxLevel() { return hdr.maxLevel; }
+        const std::vector<IndexEntry>& getIndex() { return index; }
+
+        // Index of the last chunk starting at or before the given time, -1 if there is none
+        int findChunk(int64_t time);
+
+        // Overview of a chunk, getOverviewSize() levels in dB
+        bool readOverview(int id, float* levels);
+
+        // All frames of a chunk, frameCount lines of getBinCount() levels in dB
+        bool readChunk(int id, std::vector<float>& levels, std::vector<int64_t>& times);
+
+        // Draw the highest level of each cell of a grid covering the given time and frequency span, the first row
+        // being the start time. Chunks are only decoded when a row is shorter than the chunk, otherwise the
+        // overview is used. Cells without data are set to -INFINITY.
+        void render(int64_t startTime, int64_t endTime, double startFreq, double endFreq, int width, int height, float* out);
+
+    private:
+        bool readIndex();
+        bool rebuildIndex();
+        bool readChunkHeader(uint64_t offset, ChunkHeader& ch);
+        void drawLine(const float* levels, int count, const IndexEntry& entry, double startFreq, double endFreq, int width, float* row);
+        float decode(uint16_t code);
+
+        std::ifstream file;
+        uint64_t fileSize = 0;
+        FileHeader hdr;
+        std::vector<IndexEntry> index;
+
+        // Last decoded chunk, consecutive rows usually fall in the same one
+        int cachedId = -1;
+        std::vector<float> cachedLevels;
+        std::vector<int64_t> cachedTimes;
+        std::vector<uint8_t> compressed;
+        std::vector<uint8_t> raw;
+        ZSTD_DCtx* dctx = NULL;
+    };
+}
\ No newline at end of file
@@ -0,0 +1,441 @@
+#include <imgui.h>
+#include <config.h>
+#include <core.h>
+#include <gui/style.h>
+#include <gui/gui.h>
+#include <gui/widgets/folder_select.h>
+#include <signal_path/signal_path.h>
+#include <module.h>
+#include <utils/optionlist.h>
+#include <utils/flog.h>
+#include <dsp/detector/activity.h>
+#include "monitor_engine.h"
+#include <fstream>
+#include <filesystem>
+#include <map>
+#include <set>
+#include <chrono>
+#include <thread>
+
+#define CONCAT(a, b) ((std::string(a) + b).c_str())
+
+SDRPP_MOD_INFO{
+    /* Name:            */ "fm_band_monitor",
+    /* Description:     */ "Decodes the RDS of every FM broadcast station in the captured span",
+    /* Author:          */ "SDR++ contributors",
+    /* Version:         */ 0, 1, 0,
+    /* Max instances    */ -1
+};
+
+ConfigManager config;
+
+std::string genFileName(std::string prefix, std::string suffix) {
+    time_t now = time(0);
+    tm* ltm = localtime(&now);
+    char buf[1024];
+    sprintf(buf, "%s_%02d-%02d-%02d_%02d-%02d-%02d%s", prefix.c_str(), ltm->tm_hour, ltm->tm_min, ltm->tm_sec, ltm->tm_mday, ltm->tm_mon + 1, ltm->tm_year + 1900, suffix.c_str());
+    return buf;
+}
+
+class FMBandMonitorModule : public ModuleManager::Instance {
+public:
+    FMBandMonitorModule(std::string name) : folderSelect("%ROOT%/recordings") {
+        this->name = name;
+
+        // Define the station rasters
+        rasters.define(50000, "50 KHz", 50000.0);
+        rasters.define(100000, "100 KHz", 100000.0);
+        rasters.define(200000, "200 KHz", 200000.0);
+
+        // Load config
+        threadCount = std::max<int>((int)std::thread::hardware_concurrency() - 1, 1);
+        config.acquire();
+        if (!config.conf.contains(name)) {
+            config.conf[name] = json({});
+        }
+        if (config.conf[name].contains("logPath")) {
+            folderSelect.setPath(config.conf[name]["logPath"]);
+        }
+        if (config.conf[name].contains("logging")) {
+            logging = config.conf[name]["logging"];
+        }
+        if (config.conf[name].contains("threshold")) {
+            threshold = config.conf[name]["threshold"];
+        }
+        if (config.conf[name].contains("raster")) {
+            int raster = config.conf[name]["raster"];
+            if (rasters.keyExists(raster)) { rasterId = rasters.keyId(raster); }
+        }
+        if (config.conf[name].contains("minFreq")) {
+            minFreq = config.conf[name]["minFreq"];
+        }
+        if (config.conf[name].contains("maxFreq")) {
+            maxFreq = config.conf[name]["maxFreq"];
+        }
+        if (config.conf[name].contains("threads")) {
+            threadCount = config.conf[name]["threads"];
+        }
+        config.release();
+        updateLogSettings();
+
+        detector.init(DETECTOR_WINDOW, threshold);
+        engine.init(&iqStream, stationHandler, this);
+        engine.setThreadCount(threadCount);
+
+        start();
+
+        gui::menu.registerEntry(name, menuHandler, this, this);
+    }
+
+    ~FMBandMonitorModule() {
+        gui::menu.removeEntry(name);
+        stop();
+        std::lock_guard<std::mutex> lck(logMtx);
+        if (logFile.is_open()) { logFile.close(); }
+    }
+
+    void postInit() {}
+
+    void enable() {
+        start();
+        enabled = true;
+    }
+
+    void disable() {
+        stop();
+        enabled = false;
+    }
+
+    bool isEnabled() {
+        return enabled;
+    }
+
+private:
+    void start() {
+        if (running) { return; }
+        {
+            std::lock_guard<std::mutex> lck(detMtx);
+            detector.reset();
+            carriers.clear();
+            decoded.clear();
+            lastCenterFrequency = 0.0;
+            lastSamplerate = 0.0;
+        }
+        engine.setStations({});
+        engine.start();
+        sigpath::iqFrontEnd.bindIQStream(&iqStream);
+
+        // Stations are found on an averaged spectrum of the whole capture
+        SpectrumEngine::Params params;
+        params.size = SPECTRUM_SIZE;
+        params.rate = SPECTRUM_RATE;
+        params.window = SpectrumEngine::NUTTALL;
+        params.product.type = dsp::spectrum::PRODUCT_AVERAGE;
+        params.product.averaging = dsp::spectrum::AVERAGING_EXPONENTIAL;
+        params.product.factor = 0.8f;
+        spectrumConsumer = sigpath::iqFrontEnd.addSpectrumConsumer(params, spectrumHandler, this);
+
+        running = true;
+    }
+
+    void stop() {
+        if (!running) { return; }
+        sigpath::iqFrontEnd.removeSpectrumConsumer(spectrumConsumer);
+        sigpath::iqFrontEnd.unbindIQStream(&iqStream);
+        engine.stop();
+        running = false;
+    }
+
+    // The handler runs on the DSP thread, so it gets its own copy of the log settings
+    void updateLogSettings() {
+        std::string dir = folderSelect.pathIsValid() ? folderSelect.expandString(folderSelect.path) : "";
+        std::lock_guard<std::mutex> lck(logMtx);
+        logActive = logging;
+
+        // The log is reopened in the new folder on the next station
+        if (logFile.is_open() && (!logActive || dir != logDir)) { logFile.close(); }
+        logDir = dir;
+    }
+
+    static void menuHandler(void* ctx) {
+        FMBandMonitorModule* _this = (FMBandMonitorModule*)ctx;
+        float menuWidth = ImGui::GetContentRegionAvail().x;
+
+        if (!_this->enabled) { style::beginDisabled(); }
+
+        if (_this->folderSelect.render("##fm_band_monitor_log" + _this->name)) {
+            _this->updateLogSettings();
+            if (_this->folderSelect.pathIsValid()) {
+                config.acquire();
+                config.conf[_this->name]["logPath"] = _this->folderSelect.path;
+                config.release(true);
+            }
+        }
+
+        // Reflect the handler giving up on a log it couldn't open
+        bool logFailed;
+        {
+            std::lock_guard<std::mutex> lck(_this->logMtx);
+            logFailed = (_this->logging && !_this->logActive);
+        }
+        if (logFailed) {
+            _this->logging = false;
+            config.acquire();
+            config.conf[_this->name]["logging"] = false;
+            config.release(true);
+        }
+
+        if (ImGui::Checkbox(CONCAT("Log to file##_fm_band_monitor_log_", _this->name), &_this->logging)) {
+            _this->updateLogSettings();
+            config.acquire();
+            config.conf[_this->name]["logging"] = _this->logging;
+            config.release(true);
+        }
+
+        ImGui::LeftLabel("Threshold (dB)");
+        ImGui::SetNextItemWidth(menuWidth - ImGui::GetCursorPosX());
+        if (ImGui::SliderFloat(CONCAT("##_fm_band_monitor_thr_", _this->name), &_this->threshold, 3.0f, 40.0f, "%.1f")) {
+            {
+                std::lock_guard<std::mutex> lck(_this->detMtx);
+                _this->detector.setThreshold(_this->threshold);
+            }
+            config.acquire();
+            config.conf[_this->name]["threshold"] = _this->threshold;
+            config.release(true);
+        }
+
+        ImGui::LeftLabel("Raster");
+        ImGui::SetNextItemWidth(menuWidth - ImGui::GetCursorPosX());
+        if (ImGui::Combo(CONCAT("##_fm_band_monitor_raster_", _this->name), &_this->rasterId, _this->rasters.txt)) {
+            _this->clearCarriers();
+            config.acquire();
+            config.conf[_this->name]["raster"] = _this->rasters.key(_this->rasterId);
+            config.release(true);
+        }
+
+        ImGui::LeftLabel("Start");
+        ImGui::SetNextItemWidth(menuWidth - ImGui::GetCursorPosX());
+        if (ImGui::InputDouble(CONCAT("##_fm_band_monitor_start_", _this->name), &_this->minFreq, 100.0, 100000.0, "%0.0f")) {
+            _this->minFreq = round(_this->minFreq);
+            _this->clearCarriers();
+            config.acquire();
+            config.conf[_this->name]["minFreq"] = _this->minFreq;
+            config.release(true);
+        }
+
+        ImGui::LeftLabel("Stop");
+        ImGui::SetNextItemWidth(menuWidth - ImGui::GetCursorPosX());
+        if (ImGui::InputDouble(CONCAT("##_fm_band_monitor_stop_", _this->name), &_this->maxFreq, 100.0, 100000.0, "%0.0f")) {
+            _this->maxFreq = round(_this->maxFreq);
+            _this->clearCarriers();
+            config.acquire();
+            config.conf[_this->name]["maxFreq"] = _this->maxFreq;
+            config.release(true);
+        }
+
+        ImGui::LeftLabel("Threads");
+        ImGui::SetNextItemWidth(menuWidth - ImGui::GetCursorPosX());
+        if (ImGui::InputInt(CONCAT("##_fm_band_monitor_threads_", _this->name), &_this->threadCount, 1, 1)) {
+            _this->threadCount = std::clamp<int>(_this->threadCount, 1, 64);
+            _this->engine.setThreadCount(_this->threadCount);
+            config.acquire();
+            config.conf[_this->name]["threads"] = _this->threadCount;
+            config.release(true);
+        }
+
+        // Stations currently decoded
+        std::vector<StationInfo> stations = _this->engine.getStations();
+        if (ImGui::BeginTable(CONCAT("fm_band_monitor_stations_", _this->name), 4, ImGuiTableFlags_RowBg | ImGuiTableFlags_Borders | ImGuiTableFlags_ScrollY, ImVec2(0, 300.0f * style::uiScale))) {
+            ImGui::TableSetupColumn("Frequency");
+            ImGui::TableSetupColumn("PI");
+            ImGui::TableSetupColumn("PS");
+            ImGui::TableSetupColumn("Radio Text");
+            ImGui::TableSetupScrollFreeze(0, 1);
+            ImGui::TableHeadersRow();
+            for (const auto& st : stations) {
+                if (!st.active) { continue; }
+                ImGui::TableNextRow();
+                ImGui::TableSetColumnIndex(0);
+                ImGui::Text("%.1lf", st.frequency / 1e6);
+                ImGui::TableSetColumnIndex(1);
+                if (st.piValid) { ImGui::Text("%04X", st.pi); }
+                ImGui::TableSetColumnIndex(2);
+                ImGui::TextUnformatted(st.ps.c_str());
+                ImGui::TableSetColumnIndex(3);
+                ImGui::TextUnformatted(st.rt.c_str());
+            }
+            ImGui::EndTable();
+        }
+
+        if (!_this->enabled) { style::endDisabled(); }
+    }
+
+    void clearCarriers() {
+        std::lock_guard<std::mutex> lck(detMtx);
+        carriers.clear();
+        decoded.clear();
+        engine.setStations({});
+    }
+
+    static void spectrumHandler(const float* spectrum, int size, double centerFrequency, double samplerate, void* ctx) {
+        FMBandMonitorModule* _this = (FMBandMonitorModule*)ctx;
+        std::lock_guard<std::mutex> lck(_this->detMtx);
+
+        // The noise floor is only valid for the current tuning
+        if (centerFrequency != _this->lastCenterFrequency || samplerate != _this->lastSamplerate) {
+            _this->detector.reset();
+            _this->lastCenterFrequency = centerFrequency;
+            _this->lastSamplerate = samplerate;
+        }
+        _this->detector.process(spectrum, size, centerFrequency, samplerate, _this->report);
+        const float* floor = _this->detector.getNoiseFloor();
+
+        // Level above the noise floor of every raster frequency within the band and the capture
+        double raster = _this->rasters[_this->rasterId];
+        double low = std::max<double>(_this->minFreq, centerFrequency - (samplerate / 2.0) + MonitorEngine::STATION_HALF_WIDTH);
+        double high = std::min<double>(_this->maxFreq, centerFrequency + (samplerate / 2.0) - MonitorEngine::STATION_HALF_WIDTH);
+        double binWidth = samplerate / (double)size;
+        int halfBins = std::max<int>(round(CARRIER_HALF_WIDTH / binWidth), 1);
+        std::vector<double> freqs;
+        std::vector<float> levels;
+        for (double f = _this->minFreq + (ceil((low - _this->minFreq) / raster) * raster); f <= high; f += raster) {
+            int center = round((f - centerFrequency) / binWidth) + (size / 2);
+            int first = std::max<int>(center - halfBins, 0);
+            int last = std::min<int>(center + halfBins, size - 1);
+            float sum = 0.0f;
+            for (int i = first; i <= last; i++) { sum += spectrum[i] - floor[i]; }
+            freqs.push_back(f);
+            levels.push_back(sum / (float)(last - first + 1));
+        }
+
+        // A carrier is a raster frequency above the threshold that is also stronger than its neighbours,
+        // a strong station spilling onto the adjacent raster frequencies is only counted once
+        auto now = std::chrono::steady_clock::now();
+        for (int i = 0; i < freqs.size(); i++) {
+            if (levels[i] < _this->threshold) { continue; }
+            if (i > 0 && levels[i - 1] >= levels[i]) { continue; }
+            if (i < freqs.size() - 1 && levels[i + 1] > levels[i]) { continue; }
+            _this->carriers[freqs[i]] = now;
+        }
+
+        // Stations are held for a while so that a fading station keeps its decoder state
+        for (auto it = _this->carriers.begin(); it != _this->carriers.end();) {
+            if (std::chrono::duration<double>(now - it->second).count() > HOLD_TIME) {
+                it = _this->carriers.erase(it);
+                continue;
+            }
+            it++;
+        }
+        std::set<double> current;
+        for (auto& [freq, lastSeen] : _this->carriers) { current.insert(freq); }
+        if (current == _this->decoded) { return; }
+
+        _this->decoded = current;
+        _this->engine.setStations(std::vector<double>(current.begin(), current.end()));
+    }
+
+    static void stationHandler(const StationInfo& info, void* ctx) {
+        FMBandMonitorModule* _this = (FMBandMonitorModule*)ctx;
+        flog::info("FM band monitor: {0} MHz PI={1} PS='{2}'", info.frequency / 1e6, info.pi, info.ps);
+
+        std::lock_guard<std::mutex> lck(_this->logMtx);
+        if (!_this->logActive) { return; }
+
+        // Open the log on the first station of the session
+        if (!_this->logFile.is_open()) {
+            if (_this->logDir.empty()) { return; }
+            std::string path = _this->logDir + "/" + genFileName("fm_band", ".txt");
+            _this->logFile.open(path, std::ios::out | std::ios::app);
+            if (!_this->logFile.is_open()) {
+                flog::error("Could not open FM band monitor log: {0}", path);
+                _this->logActive = false;
+                return;
+            }
+        }
+
+        // Tab separated: local time, frequency, PI, PS and radio text
+        time_t now = time(0);
+        tm* ltm = localtime(&now);
+        char timeStr[64];
+        strftime(timeStr, sizeof(timeStr), "%Y-%m-%d %H:%M:%S", ltm);
+        char freqStr[32];
+        sprintf(freqStr, "%.2lf", info.frequency / 1e6);
+        char piStr[8];
+        sprintf(piStr, "%04X", info.pi);
+        _this->logFile << timeStr << '\t' << freqStr << '\t' << piStr << '\t' << info.ps << '\t' << info.rt << std::endl;
+    }
+
+    // Spectrum used to find the stations
+    static const int SPECTRUM_SIZE = 8192;
+    static constexpr double SPECTRUM_RATE = 10.0;
+
+    // Number of spectra over which the noise floor is tracked
+    static const int DETECTOR_WINDOW = 100;
+
+    // Half the bandwidth around a raster frequency over which the level of a carrier is averaged
+    static constexpr double CARRIER_HALF_WIDTH = 25000.0;
+
+    // Time in seconds a station keeps being decoded after its carrier was last seen
+    static constexpr double HOLD_TIME = 10.0;
+
+    std::string name;
+    bool enabled = true;
+    bool running = false;
+
+    FolderSelect folderSelect;
+    OptionList<int, double> rasters;
+    int rasterId = 1;
+    float threshold = 10.0f;
+    double minFreq = 87.5e6;
+    double maxFreq = 108e6;
+    int threadCount;
+
+    // Carrier detection
+    std::mutex detMtx;
+    dsp::detector::ActivityDetector detector;
+    dsp::detector::ActivityReport report;
+    double lastCenterFrequency = 0.0;
+    double lastSamplerate = 0.0;
+    std::map<double, std::chrono::steady_clock::time_point> carriers;
+    std::set<double> decoded;
+
+    // Decoding
+    dsp::stream<dsp::complex_t> iqStream;
+    MonitorEngine engine;
+    SpectrumEngine::Consumer* spectrumConsumer = NULL;
+
+    // Log, the settings being copied from the GUI under the lock for the handler
+    bool logging = false;
+    std::mutex logMtx;
+    bool logActive = false;
+    std::string logDir;
+    std::ofstream logFile;
+};
+
+MOD_EXPORT void _INIT_() {
+    // Create default recording directory
+    std::string root = (std::string)core::args["root"];
+    if (!std::filesystem::exists(root + "/recordings")) {
+        flog::warn("Recordings directory does not exist, creating it");
+        if (!std::filesystem::create_directory(root + "/recordings")) {
+            flog::error("Could not create recordings directory");
+        }
+    }
+    json def = json({});
+    config.setPath(root + "/fm_band_monitor_config.json");
+    config.load(def);
+    config.enableAutoSave();
+}
+
+MOD_EXPORT ModuleManager::Instance* _CREATE_INSTANCE_(std::string name) {
+    return new FMBandMonitorModule(name);
+}
+
+MOD_EXPORT void _DELETE_INSTANCE_(void* instance) {
+    delete (FMBandMonitorModule*)instance;
+}
+
+MOD_EXPORT void _END_() {
+    config.disableAutoSave();
+    config.save();
+}
@@ -0,0 +1,235 @@
+#include "monitor_engine.h"
+#include <utils/flog.h>
+#include <math.h>
+#include <algorithm>
+
+MonitorEngine::~MonitorEngine() {
+    if (base_type::_block_init) { base_type::stop(); }
+    stopWorkers();
+    for (auto& [freq, station] : stations) { delete station; }
+    stations.clear();
+    for (auto& buf : channelBufs) {
+        if (buf) { dsp::buffer::free(buf); }
+    }
+}
+
+void MonitorEngine::init(dsp::stream<dsp::complex_t>* in, Handler handler, void* ctx) {
+    _handler = handler;
+    _ctx = ctx;
+    base_type::init(in);
+}
+
+void MonitorEngine::setThreadCount(int count) {
+    assert(base_type::_block_init);
+    std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+    count = std::max<int>(count, 1);
+    if (count == threadCount) { return; }
+
+    // The DSP thread decodes stations too, so one less worker is needed
+    base_type::tempStop();
+    stopWorkers();
+    threadCount = count;
+    if (threadCount > 1) { startWorkers(threadCount - 1); }
+    base_type::tempStart();
+}
+
+void MonitorEngine::setStations(const std::vector<double>& frequencies) {
+    std::lock_guard<std::mutex> lck(stationMtx);
+    requested = frequencies;
+    stationsChanged = true;
+}
+
+std::vector<StationInfo> MonitorEngine::getStations() {
+    std::lock_guard<std::mutex> lck(stationMtx);
+    return infos;
+}
+
+int MonitorEngine::run() {
+    int count = base_type::_in->read();
+    if (count < 0) { return -1; }
+
+    // Without metadata there's no telling which frequency each channel is on
+    const dsp::StreamMetadata& meta = base_type::_in->readMeta;
+    if (!meta.valid || meta.samplerate <= 0.0) {
+        base_type::_in->flush();
+        return count;
+    }
+
+    // Follow the samplerate and the tuning of the capture
+    if (meta.samplerate != samplerate) { configure(meta.samplerate); }
+    if (meta.centerFrequency != centerFrequency || meta.discontinuity) {
+        centerFrequency = meta.centerFrequency;
+        pfb.reset();
+        for (auto& [freq, station] : stations) { tuneStation(station); }
+        updateActive();
+    }
+    applyStations();
+
+    // Channelize, only the channels stations are taken from are copied out
+    int bound = pfb.outputBufferSize(count);
+    for (auto& station : active) {
+        int ch = station->getChannel();
+        dsp::buffer::reserve(channelBufs[ch], channelCapacities[ch], bound);
+        channelOut[ch] = channelBufs[ch];
+    }
+    int outCount = pfb.process(count, base_type::_in->readBuf, channelOut.data());
+    base_type::_in->flush();
+
+    processStations(outCount);
+
+    // Report the stations whose data settled on something new
+    std::vector<StationInfo> newInfos;
+    newInfos.reserve(stations.size());
+    for (auto& [freq, station] : stations) {
+        StationInfo info;
+        if (station->active && station->poll(info)) { _handler(info, _ctx); }
+        else if (!station->active) { station->getInfo(info); }
+        info.active = station->active;
+        newInfos.push_back(info);
+    }
+    {
+        std::lock_guard<std::mutex> lck(stationMtx);
+        infos = std::move(newInfos);
+    }
+
+    return count;
+}
+
+void MonitorEngine::configure(double samplerate) {
+    this->samplerate = samplerate;
+
+    // Channels at least MIN_CHANNEL_SPACING apart, in a multiple of the oversampling of the filterbank
+    const int os = dsp::channel::PFBChannelizer::OVERSAMPLING;
+    int channels = std::max<int>(floor(samplerate / (MIN_CHANNEL_SPACING * os)), 1) * os;
+    channelSpacing = samplerate / (double)channels;
+    pfb.init(channels, samplerate);
+    flog::info("FM band monitor: {0} channels spaced by {1} Hz", channels, channelSpacing);
+
+    for (auto& buf : channelBufs) {
+        if (buf) { dsp::buffer::free(buf); }
+    }
+    channelBufs.assign(channels, NULL);
+    channelCapacities.assign(channels, 0);
+    channelOut.assign(channels, NULL);
+
+    // The stations run at the rate of the channels, start them over
+    for (auto& [freq, station] : stations) { delete station; }
+    stations.clear();
+    active.clear();
+    std::lock_guard<std::mutex> lck(stationMtx);
+    stationsChanged = true;
+}
+
+void MonitorEngine::applyStations() {
+    std::vector<double> freqs;
+    {
+        std::lock_guard<std::mutex> lck(stationMtx);
+        if (!stationsChanged) { return; }
+        freqs = requested;
+        stationsChanged = false;
+    }
+
+    // Remove the stations no longer wanted
+    for (auto it = stations.begin(); it != stations.end();) {
+        if (std::find(freqs.begin(), freqs.end(), it->first) != freqs.end()) {
+            it++;
+            continue;
+        }
+        delete it->second;
+        it = stations.erase(it);
+    }
+
+    // Add the new ones
+    for (double freq : freqs) {
+        if (stations.find(freq) != stations.end()) { continue; }
+        Station* station = new Station(freq, channelSpacing * dsp::channel::PFBChannelizer::OVERSAMPLING);
+        tuneStation(station);
+        stations[freq] = station;
+    }
+
+    updateActive();
+}
+
+void MonitorEngine::tuneStation(Station* station) {
+    // Ignore stations not entirely within the capture
+    double offset = station->getFrequency() - centerFrequency;
+    station->active = (fabs(offset) + STATION_HALF_WIDTH <= samplerate / 2.0);
+    if (!station->active) { return; }
+
+    // Take the station from the nearest channel
+    int channels = pfb.getChannelCount();
+    int nearest = round(offset / channelSpacing);
+    station->tune(((nearest % channels) + channels) % channels, offset - ((double)nearest * channelSpacing));
+}
+
+void MonitorEngine::updateActive() {
+    active.clear();
+    std::fill(channelOut.begin(), channelOut.end(), (dsp::complex_t*)NULL);
+    for (auto& [freq, station] : stations) {
+        if (station->active) { active.push_back(station); }
+    }
+}
+
+void MonitorEngine::processStations(int count) {
+    for (auto& station : active) {
+        station->input = channelBufs[station->getChannel()];
+        station->inputCount = count;
+    }
+
+    if (workers.empty()) {
+        for (auto& station : active) { station->process(station->inputCount, station->input); }
+        return;
+    }
+
+    // Hand the stations over to the workers and decode some of them in the meantime
+    {
+        std::lock_guard<std::mutex> lck(poolMtx);
+        jobs = active;
+        nextJob = 0;
+        pendingJobs = jobs.size();
+    }
+    jobCnd.notify_all();
+    runJobs();
+
+    std::unique_lock<std::mutex> lck(poolMtx);
+    doneCnd.wait(lck, [this]() { return !pendingJobs; });
+}
+
+void MonitorEngine::runJobs() {
+    std::unique_lock<std::mutex> lck(poolMtx);
+    while (nextJob < (int)jobs.size()) {
+        Station* station = jobs[nextJob++];
+        lck.unlock();
+        station->process(station->inputCount, station->input);
+        lck.lock();
+        if (!--pendingJobs) { doneCnd.notify_all(); }
+    }
+}
+
+void MonitorEngine::startWorkers(int count) {
+    stopPool = false;
+    for (int i = 0; i < count; i++) { workers.push_back(std::thread(&MonitorEngine::worker, this)); }
+}
+
+void MonitorEngine::stopWorkers() {
+    {
+        std::lock_guard<std::mutex> lck(poolMtx);
+        stopPool = true;
+    }
+    jobCnd.notify_all();
+    for (auto& w : workers) {
+        if (w.joinable()) { w.join(); }
+    }
+    workers.clear();
+}
+
+void MonitorEngine::worker() {
+    std::unique_lock<std::mutex> lck(poolMtx);
+    while (true) {
+        jobCnd.wait(lck, [this]() { return stopPool || nextJob < (int)jobs.size(); });
+        if (stopPool) { return; }
+        lck.unlock();
+        runJobs();
+        lck.lock();
+    }
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include <dsp/sink.h>
+#include <dsp/channel/pfb_channelizer.h>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include "station.h"
+
+// Demodulates every station of a wideband capture from a single pass over the IQ. The capture is split once by a
+// polyphase filterbank, each station then only runs at the rate of its channel: fine tuning, resampling to the WFM
+// rate, channel filter, WFM demodulation and RDS decoding. Stations are processed by a pool of worker threads,
+// the DSP thread helping out and only moving on to the next buffer once all of them are done.
+class MonitorEngine : public dsp::Sink<dsp::complex_t> {
+    using base_type = dsp::Sink<dsp::complex_t>;
+public:
+    // Called from the DSP thread when the decoded data of a station changes and has settled
+    typedef void (*Handler)(const StationInfo& info, void* ctx);
+
+    MonitorEngine() {}
+
+    ~MonitorEngine();
+
+    void init(dsp::stream<dsp::complex_t>* in, Handler handler, void* ctx);
+
+    // Number of threads decoding the stations, one or less decodes them all on the DSP thread
+    void setThreadCount(int count);
+
+    // Absolute frequencies of the stations to decode, applied from the next buffer on. Stations that are already
+    // decoded keep their state.
+    void setStations(const std::vector<double>& frequencies);
+
+    std::vector<StationInfo> getStations();
+
+    int run();
+
+    // Lowest spacing between the channels of the filterbank, so that a station fits in a channel with room to spare
+    static constexpr double MIN_CHANNEL_SPACING = 100000.0;
+
+    // Stations closer than this to the edge of the capture are ignored
+    static constexpr double STATION_HALF_WIDTH = 100000.0;
+
+private:
+    void configure(double samplerate);
+    void applyStations();
+    void tuneStation(Station* station);
+    void updateActive();
+    void processStations(int count);
+    void runJobs();
+    void startWorkers(int count);
+    void stopWorkers();
+    void worker();
+
+    Handler _handler;
+    void* _ctx;
+
+    // Filterbank
+    dsp::channel::PFBChannelizer pfb;
+    double samplerate = 0.0;
+    double centerFrequency = 0.0;
+    double channelSpacing = 0.0;
+    std::vector<dsp::complex_t*> channelBufs;
+    std::vector<int> channelCapacities;
+    std::vector<dsp::complex_t*> channelOut;
+
+    // Stations, only touched from the DSP thread and the workers it hands them to
+    std::map<double, Station*> stations;
+    std::vector<Station*> active;
+
+    // Requested stations and decoded data, shared with the other threads
+    std::mutex stationMtx;
+    std::vector<double> requested;
+    bool stationsChanged = false;
+    std::vector<StationInfo> infos;
+
+    // Worker pool
+    int threadCount = 0;
+    std::vector<std::thread> workers;
+    std::mutex poolMtx;
+    std::condition_variable jobCnd;
+    std::condition_variable doneCnd;
+    std::vector<Station*> jobs;
+    int nextJob = 0;
+    int pendingJobs = 0;
+    bool stopPool = false;
+};
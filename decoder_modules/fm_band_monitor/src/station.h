@@ -0,0 +1,187 @@
+#pragma once
+#include <dsp/multirate/rational_resampler.h>
+#include <dsp/filter/fir.h>
+#include <dsp/taps/cache.h>
+#include <dsp/demod/broadcast_fm.h>
+#include <dsp/clock_recovery/fd.h>
+#include <dsp/math/hz_to_rads.h>
+#include <rds.h>
+#include <chrono>
+#include <string>
+
+struct StationInfo {
+    double frequency;
+    bool active;            // False while the station is outside of the captured span
+    bool piValid;
+    uint16_t pi;
+    bool psValid;
+    std::string ps;
+    bool rtValid;
+    std::string rt;
+};
+
+// Demodulation and RDS decoding of a single station, from the output of the filterbank channel nearest to it.
+// The blocks are only used for their processing functions, the station owns all the buffers in between.
+class Station {
+public:
+    Station(double frequency, double channelSamplerate) {
+        _frequency = frequency;
+        _channelSamplerate = channelSamplerate;
+
+        resamp.init(NULL, _channelSamplerate, WFM_SAMPLERATE);
+        ftaps = dsp::taps::cache::lowPass(FILTER_CUTOFF, FILTER_TRANSITION, WFM_SAMPLERATE);
+        filter.init(NULL, *ftaps);
+        demod.init(NULL, WFM_DEVIATION, WFM_SAMPLERATE, false, false, true);
+        recov.init(NULL, RDS_SAMPLERATE / RDS_BAUDRATE, OMEGA_GAIN, MU_GAIN, 0.01);
+
+        resamp.out.free();
+        filter.out.free();
+        demod.out.free();
+        demod.rdsOut.free();
+        recov.out.free();
+
+        lastChange = std::chrono::steady_clock::now();
+    }
+
+    ~Station() {
+        dsp::buffer::free(iq);
+        dsp::buffer::free(wfm);
+        dsp::buffer::free(audio);
+        dsp::buffer::free(rds);
+        dsp::buffer::free(symbols);
+    }
+
+    double getFrequency() { return _frequency; }
+
+    // Select the filterbank channel to take the station from along with the remaining offset to correct
+    void tune(int channel, double offset) {
+        _channel = channel;
+        _offset = offset;
+        double omega = -dsp::math::hzToRads(_offset, _channelSamplerate);
+        phaseDelta = lv_cmake(cosf(omega), sinf(omega));
+        phase = lv_cmake(1.0f, 0.0f);
+        reset();
+    }
+
+    int getChannel() { return _channel; }
+
+    // Forget the DSP state after a discontinuity, the RDS data is kept
+    void reset() {
+        resamp.reset();
+        filter.reset();
+        demod.reset();
+        recov.reset();
+    }
+
+    void process(int count, const dsp::complex_t* in) {
+        reserve(count);
+
+        // Correct the offset from the channel center
+        volk_32fc_s32fc_x2_rotator_32fc((lv_32fc_t*)iq, (const lv_32fc_t*)in, phaseDelta, &phase, count);
+
+        // Bring it to the WFM samplerate and isolate it from its neighbours
+        count = resamp.process(count, iq, wfm);
+        filter.process(count, wfm, wfm);
+
+        // Demodulate, only the RDS output is of interest
+        int rdsCount = 0;
+        demod.process(count, wfm, audio, rdsCount, rds);
+
+        // Recover the symbols and decode them, soft decisions help with the weaker stations
+        int symCount = recov.process(rdsCount, rds, symbols);
+        decoder.processSoft(symbols, symCount);
+    }
+
+    void getInfo(StationInfo& info) {
+        info.frequency = _frequency;
+        info.piValid = decoder.programRefNumberValid();
+        info.pi = info.piValid ? (decoder.getCountryCode() << 12) | (decoder.getProgramCoverage() << 8) | decoder.getProgramRefNumber() : 0;
+        info.psValid = decoder.PSNameValid();
+        info.ps = info.psValid ? decoder.getPSName() : "";
+        info.rtValid = decoder.radioTextValid();
+        info.rt = info.rtValid ? decoder.getRadioText() : "";
+    }
+
+    // True once the decoded data has changed and then stayed the same for long enough to be worth reporting.
+    // PS and RT are sent a few characters at a time, this keeps half updated strings out of the log.
+    bool poll(StationInfo& info) {
+        getInfo(info);
+        auto now = std::chrono::steady_clock::now();
+        if (!sameData(info, pending)) {
+            pending = info;
+            lastChange = now;
+            return false;
+        }
+        if (!info.piValid || sameData(info, reported)) { return false; }
+        if (std::chrono::duration<double>(now - lastChange).count() < STABLE_TIME) { return false; }
+        reported = info;
+        return true;
+    }
+
+    bool active = false;
+
+    // Set before handing the station to a worker
+    const dsp::complex_t* input = NULL;
+    int inputCount = 0;
+
+    static constexpr double WFM_SAMPLERATE = 250000.0;
+
+private:
+    static bool sameData(const StationInfo& a, const StationInfo& b) {
+        return a.piValid == b.piValid && a.pi == b.pi && a.psValid == b.psValid && a.ps == b.ps && a.rtValid == b.rtValid && a.rt == b.rt;
+    }
+
+    void reserve(int count) {
+        if (count <= inputCapacity) { return; }
+        dsp::buffer::free(iq);
+        dsp::buffer::free(wfm);
+        dsp::buffer::free(audio);
+        dsp::buffer::free(rds);
+        dsp::buffer::free(symbols);
+
+        // Everything after the resampler is at most as many samples as its output
+        inputCapacity = count;
+        int wfmCount = resamp.outputBufferSize(count) + 16;
+        iq = dsp::buffer::alloc<dsp::complex_t>(count);
+        wfm = dsp::buffer::alloc<dsp::complex_t>(wfmCount);
+        audio = dsp::buffer::alloc<dsp::stereo_t>(wfmCount);
+        rds = dsp::buffer::alloc<float>(wfmCount);
+        symbols = dsp::buffer::alloc<float>(wfmCount);
+    }
+
+    static constexpr double WFM_DEVIATION = 75000.0;
+    static constexpr double FILTER_CUTOFF = 90000.0;
+    static constexpr double FILTER_TRANSITION = 20000.0;
+    static constexpr double RDS_SAMPLERATE = 5000.0;
+    static constexpr double RDS_BAUDRATE = 2375.0;
+    static constexpr float OMEGA_GAIN = (0.01 * 0.01) / 4.0;
+    static constexpr float MU_GAIN = 0.01;
+
+    // Time in seconds the decoded data has to stay the same before being reported
+    static constexpr double STABLE_TIME = 2.0;
+
+    double _frequency;
+    double _channelSamplerate;
+    int _channel = 0;
+    double _offset = 0.0;
+    lv_32fc_t phase = lv_cmake(1.0f, 0.0f);
+    lv_32fc_t phaseDelta = lv_cmake(1.0f, 0.0f);
+
+    dsp::multirate::RationalResampler<dsp::complex_t> resamp;
+    dsp::taps::SharedTap<float> ftaps;
+    dsp::filter::FIR<dsp::complex_t, float> filter;
+    dsp::demod::BroadcastFM demod;
+    dsp::clock_recovery::FD recov;
+    rds::RDSDecoder decoder;
+
+    int inputCapacity = 0;
+    dsp::complex_t* iq = NULL;
+    dsp::complex_t* wfm = NULL;
+    dsp::stereo_t* audio = NULL;
+    float* rds = NULL;
+    float* symbols = NULL;
+
+    StationInfo pending = {};
+    StationInfo reported = {};
+    std::chrono::steady_clock::time_point lastChange;
+};
@@ -0,0 +1,368 @@
+#pragma once
+#include <dsp/multirate/rational_resampler.h>
+#include <dsp/filter/fir.h>
+#include <dsp/taps/cache.h>
+#include <dsp/demod/gfsk.h>
+#include <dsp/math/hz_to_rads.h>
+#include <m17dsp.h>
+#include "monitor_engine.h"
+
+// Reception of a single M17 channel, from the output of the filterbank channel nearest to it. The blocks are only
+// used for their processing functions and everything runs on the thread calling process(): demodulation, slicing,
+// sync detection, frame decoding and, only for the channel being listened to, codec2.
+class M17Channel {
+public:
+    M17Channel(double frequency, double channelSamplerate) {
+        _frequency = frequency;
+        _channelSamplerate = channelSamplerate;
+
+        resamp.init(NULL, _channelSamplerate, SAMPLERATE);
+        ftaps = dsp::taps::cache::lowPass(FILTER_CUTOFF, FILTER_TRANSITION, SAMPLERATE);
+        filter.init(NULL, *ftaps);
+        demod.init(NULL, M17_BAUDRATE, SAMPLERATE, M17_DEVIATION, 31, M17_RRC_ALPHA, 1e-6f, 0.01f, 0.01f);
+
+        resamp.out.free();
+        filter.out.free();
+        demod.out.free();
+
+        conv = correct_convolutional_create(2, 5, correct_conv_m17_polynomial);
+
+        lsfSync = packSync(M17_LSF_SYNC);
+        streamSync = packSync(M17_STF_SYNC);
+        packetSync = packSync(M17_PKF_SYNC);
+
+        txLsf.valid = false;
+        lastLsf.valid = false;
+    }
+
+    ~M17Channel() {
+        correct_convolutional_destroy(conv);
+        if (codec3200) { codec2_destroy(codec3200); }
+        if (codec1600) { codec2_destroy(codec1600); }
+        dsp::buffer::free(iq);
+        dsp::buffer::free(baseband);
+        dsp::buffer::free(symbols);
+        dsp::buffer::free(dibits);
+        dsp::buffer::free(audio);
+    }
+
+    double getFrequency() { return _frequency; }
+
+    // Select the filterbank channel to take the signal from along with the remaining offset to correct
+    void tune(int channel, double offset) {
+        _channel = channel;
+        double omega = -dsp::math::hzToRads(offset, _channelSamplerate);
+        phaseDelta = lv_cmake(cosf(omega), sinf(omega));
+        phase = lv_cmake(1.0f, 0.0f);
+        reset();
+    }
+
+    int getChannel() { return _channel; }
+
+    // Forget the DSP state after a discontinuity, the last link setup is kept for display
+    void reset() {
+        resamp.reset();
+        filter.reset();
+        demod.reset();
+        syncReg = 0;
+        frameType = FRAME_NONE;
+        lichNewFrame = false;
+        endTransmission();
+    }
+
+    // Audio is only decoded when asked for, the returned count of 8KHz stereo samples is then available from getAudio()
+    int process(int count, const dsp::complex_t* in, bool decodeAudio) {
+        reserve(count);
+
+        // Correct the offset from the channel center then bring it to the demodulator samplerate
+        volk_32fc_s32fc_x2_rotator_32fc((lv_32fc_t*)iq, (const lv_32fc_t*)in, phaseDelta, &phase, count);
+        count = resamp.process(count, iq, baseband);
+        filter.process(count, baseband, baseband);
+        int symCount = demod.process(count, baseband, symbols);
+
+        // Slice all symbols at once, without branches so that the loop gets vectorised
+        for (int i = 0; i < symCount; i++) {
+            dibits[i] = ((uint8_t)(symbols[i] < 0.0f) << 1) | (uint8_t)(fabsf(symbols[i]) > M17_4FSK_HIGH_CUT);
+        }
+
+        audioCount = 0;
+        for (int i = 0; i < symCount; i++) { pushDibit(dibits[i], decodeAudio); }
+
+        // A stream ends with its last frame or when frames stop coming in
+        if (receiving && symbolCounter - lastStreamSymbol > STREAM_TIMEOUT_SYMBOLS) { endTransmission(); }
+
+        return audioCount;
+    }
+
+    const dsp::stereo_t* getAudio() { return audio; }
+
+    bool isReceiving() { return receiving; }
+
+    // Only true once the link setup says the stream is voice, before that nothing could be decoded anyway
+    bool isReceivingVoice() { return receiving && txLsf.valid && (txLsf.dataType == M17_DATATYPE_VOICE || txLsf.dataType == M17_DATATYPE_DATA_VOICE); }
+
+    void getInfo(M17ChannelInfo& info) {
+        info.frequency = _frequency;
+        info.receiving = receiving;
+        info.lsf = lastLsf;
+        info.lastHeard = lastHeard;
+    }
+
+    // True once per transmission, when its link setup was first decoded
+    bool poll(M17ChannelInfo& info) {
+        getInfo(info);
+        if (!newLsf) { return false; }
+        newLsf = false;
+        return true;
+    }
+
+    bool active = false;
+
+    static constexpr double SAMPLERATE = 14400.0;
+
+private:
+    enum FrameType {
+        FRAME_NONE,
+        FRAME_LSF,
+        FRAME_STREAM,
+        FRAME_PACKET
+    };
+
+    static uint16_t packSync(const uint8_t* bits) {
+        uint16_t sync = 0;
+        for (int i = 0; i < M17_SYNC_SIZE; i++) { sync = (sync << 1) | bits[i]; }
+        return sync;
+    }
+
+    inline void pushDibit(uint8_t dibit, bool decodeAudio) {
+        symbolCounter++;
+
+        // The last eight symbols, a sync word is symbol aligned so a single compare per symbol is enough
+        syncReg = (syncReg << 2) | dibit;
+
+        if (frameType != FRAME_NONE) {
+            frameBits[frameLen++] = dibit >> 1;
+            frameBits[frameLen++] = dibit & 1;
+            if (frameLen >= M17_CUT_FRAME_SIZE) {
+                decodeFrame(decodeAudio);
+                frameType = FRAME_NONE;
+            }
+            return;
+        }
+
+        if (syncReg == lsfSync) { frameType = FRAME_LSF; }
+        else if (syncReg == streamSync) { frameType = FRAME_STREAM; }
+        else if (syncReg == packetSync) { frameType = FRAME_PACKET; }
+        frameLen = 0;
+    }
+
+    void decodeFrame(bool decodeAudio) {
+        // Descramble and deinterleave the whole frame
+        for (int i = 0; i < M17_CUT_FRAME_SIZE; i++) { frame[M17_INTERLEAVER[i]] = frameBits[i] ^ M17_SCRAMBLER[i]; }
+
+        if (frameType == FRAME_LSF) {
+            decodeLSF(frame);
+            return;
+        }
+
+        // Stream and packet frames both start with a chunk of the link setup
+        decodeLICH(frame);
+        if (frameType == FRAME_STREAM) { decodeStream(&frame[M17_LICH_SIZE], decodeAudio); }
+    }
+
+    void decodeLSF(const uint8_t* bits) {
+        // Depuncture the data
+        int inOffset = 0;
+        for (int i = 0; i < M17_ENCODED_LSF_SIZE; i++) {
+            depunctured[i] = M17_PUNCTURING_P1[i % 61] ? bits[inOffset++] : 0;
+        }
+
+        // Pack into bytes and run through convolutional decoder
+        memset(packed, 0, sizeof(packed));
+        for (int i = 0; i < M17_ENCODED_LSF_SIZE; i++) { packed[i / 8] |= depunctured[i] << (7 - (i % 8)); }
+        uint8_t lsf[M17_LSF_SIZE / 8];
+        correct_convolutional_decode(conv, packed, M17_ENCODED_LSF_SIZE, lsf);
+
+        M17LSF decLsf = M17DecodeLSF(lsf);
+        if (decLsf.valid) { onLSF(decLsf); }
+    }
+
+    void decodeLICH(const uint8_t* bits) {
+        // Decode the 4 Golay(24, 12) blocks
+        uint8_t chunk[6] = {};
+        for (int b = 0; b < 4; b++) {
+            uint32_t encodedBlock = 0;
+            uint32_t decodedBlock = 0;
+            for (int i = 0; i < 24; i++) { encodedBlock |= bits[(b * 24) + i] << (23 - i); }
+            if (!mobilinkd::Golay24::decode(encodedBlock, decodedBlock)) { return; }
+            for (int i = 0; i < 12; i++) {
+                int id = (b * 12) + i;
+                chunk[id / 8] |= ((decodedBlock >> (23 - i)) & 1) << (7 - (id % 8));
+            }
+        }
+
+        // Chunks are numbered, the link setup is only complete when all six came in order
+        int partId = chunk[5] >> 5;
+        if (partId == 0) {
+            lichNewFrame = true;
+            lichLastId = 0;
+            memcpy(lichLsf, chunk, 5);
+            return;
+        }
+        if (!lichNewFrame || partId != lichLastId + 1 || partId > 5) {
+            lichNewFrame = false;
+            return;
+        }
+        lichLastId = partId;
+        memcpy(&lichLsf[partId * 5], chunk, 5);
+        if (partId < 5) { return; }
+
+        lichNewFrame = false;
+        M17LSF decLsf = M17DecodeLSF(lichLsf);
+        if (decLsf.valid) { onLSF(decLsf); }
+    }
+
+    void decodeStream(const uint8_t* bits, bool decodeAudio) {
+        // Depuncture the data
+        int inOffset = 0;
+        for (int i = 0; i < M17_ENCODED_PAYLOAD_SIZE; i++) {
+            depunctured[i] = M17_PUNCTURING_P2[i % 12] ? bits[inOffset++] : 0;
+        }
+
+        // Pack into bytes and run through convolutional decoder
+        memset(packed, 0, sizeof(packed));
+        for (int i = 0; i < M17_ENCODED_PAYLOAD_SIZE; i++) { packed[i / 8] |= depunctured[i] << (7 - (i % 8)); }
+        uint8_t payload[M17_PAYLOAD_SIZE / 8];
+        correct_convolutional_decode(conv, packed, M17_ENCODED_PAYLOAD_SIZE, payload);
+
+        // Only start receiving on consecutive frame numbers, a false sync gives a random one
+        uint16_t fn = ((uint16_t)payload[0] << 8) | payload[1];
+        bool consecutive = ((((int)(fn & M17_MAX_FN) - (int)(lastFn & M17_MAX_FN) + M17_END_FN) % M17_END_FN) == 1);
+        lastFn = fn;
+        if (consecutive) {
+            receiving = true;
+            lastStreamSymbol = symbolCounter;
+        }
+        if (!receiving) { return; }
+
+        if (decodeAudio && isReceivingVoice()) { decodeVoice(&payload[2]); }
+
+        if (fn & M17_END_FN) { endTransmission(); }
+    }
+
+    void decodeVoice(const uint8_t* data) {
+        // Voice only streams carry two 3200bps codec2 frames, voice and data streams a single 1600bps one
+        if (txLsf.dataType == M17_DATATYPE_VOICE) {
+            if (!codec3200) { codec3200 = codec2_create(CODEC2_MODE_3200); }
+            int samps = codec2_samples_per_frame(codec3200);
+            codec2_decode(codec3200, int16Audio, data);
+            codec2_decode(codec3200, &int16Audio[samps], &data[8]);
+            writeAudio(samps * 2);
+        }
+        else {
+            if (!codec1600) { codec1600 = codec2_create(CODEC2_MODE_1600); }
+            codec2_decode(codec1600, int16Audio, data);
+            writeAudio(codec2_samples_per_frame(codec1600));
+        }
+    }
+
+    void writeAudio(int count) {
+        volk_16i_s32f_convert_32f(floatAudio, int16Audio, 32768.0f, count);
+        volk_32f_x2_interleave_32fc((lv_32fc_t*)&audio[audioCount], floatAudio, floatAudio, count);
+        audioCount += count;
+    }
+
+    void onLSF(const M17LSF& lsf) {
+        lastLsf = lsf;
+        lastHeard = std::chrono::system_clock::now();
+
+        // Repeated many times during a transmission, only report it once unless it changes
+        if (txLsf.valid && txLsf.rawSrc == lsf.rawSrc && txLsf.rawDst == lsf.rawDst && txLsf.rawType == lsf.rawType) { return; }
+        txLsf = lsf;
+        newLsf = true;
+    }
+
+    void endTransmission() {
+        receiving = false;
+        txLsf.valid = false;
+    }
+
+    void reserve(int count) {
+        int bound = resamp.outputBufferSize(count) + 16;
+        dsp::buffer::reserve(iq, iqCapacity, count);
+        dsp::buffer::reserve(baseband, basebandCapacity, bound);
+        dsp::buffer::reserve(symbols, symbolsCapacity, bound);
+        dsp::buffer::reserve(dibits, dibitsCapacity, bound);
+
+        // At most one stream frame completes every 184 symbols, each with up to 40ms of audio
+        dsp::buffer::reserve(audio, audioCapacity, ((bound / (M17_CUT_FRAME_SIZE / 2)) + 1) * MAX_FRAME_AUDIO);
+    }
+
+    static constexpr double FILTER_CUTOFF = 4800.0;
+    static constexpr double FILTER_TRANSITION = 1600.0;
+
+    // Time without a stream frame after which a transmission is over
+    static const int64_t STREAM_TIMEOUT_SYMBOLS = (M17_STREAM_TIMEOUT * (int64_t)M17_BAUDRATE) / 1000;
+
+    // Audio samples in a stream frame, 40ms at 8KHz
+    static const int MAX_FRAME_AUDIO = 320;
+
+    double _frequency;
+    double _channelSamplerate;
+    int _channel = 0;
+    lv_32fc_t phase = lv_cmake(1.0f, 0.0f);
+    lv_32fc_t phaseDelta = lv_cmake(1.0f, 0.0f);
+
+    // Demodulation
+    dsp::multirate::RationalResampler<dsp::complex_t> resamp;
+    dsp::taps::SharedTap<float> ftaps;
+    dsp::filter::FIR<dsp::complex_t, float> filter;
+    dsp::demod::GFSK demod;
+
+    // Framing
+    uint16_t lsfSync;
+    uint16_t streamSync;
+    uint16_t packetSync;
+    uint16_t syncReg = 0;
+    int64_t symbolCounter = 0;
+    FrameType frameType = FRAME_NONE;
+    int frameLen = 0;
+    uint8_t frameBits[M17_CUT_FRAME_SIZE];
+    uint8_t frame[M17_CUT_FRAME_SIZE];
+
+    // Forward error correction
+    correct_convolutional* conv;
+    uint8_t depunctured[M17_ENCODED_LSF_SIZE];
+    uint8_t packed[M17_ENCODED_LSF_SIZE / 8 + 1];
+    bool lichNewFrame = false;
+    int lichLastId = 0;
+    uint8_t lichLsf[M17_LSF_SIZE / 8];
+
+    // Transmission state
+    bool receiving = false;
+    uint16_t lastFn = 0;
+    int64_t lastStreamSymbol = 0;
+    M17LSF txLsf;
+    M17LSF lastLsf;
+    bool newLsf = false;
+    std::chrono::system_clock::time_point lastHeard;
+
+    // Voice, the codecs are only created once a channel is listened to
+    CODEC2* codec3200 = NULL;
+    CODEC2* codec1600 = NULL;
+    int16_t int16Audio[MAX_FRAME_AUDIO];
+    float floatAudio[MAX_FRAME_AUDIO];
+    int audioCount = 0;
+
+    // Work buffers
+    int iqCapacity = 0;
+    int basebandCapacity = 0;
+    int symbolsCapacity = 0;
+    int dibitsCapacity = 0;
+    int audioCapacity = 0;
+    dsp::complex_t* iq = NULL;
+    dsp::complex_t* baseband = NULL;
+    float* symbols = NULL;
+    uint8_t* dibits = NULL;
+    dsp::stereo_t* audio = NULL;
+};
@@ -0,0 +1,343 @@
+#include <imgui.h>
+#include <config.h>
+#include <core.h>
+#include <gui/style.h>
+#include <gui/gui.h>
+#include <gui/widgets/folder_select.h>
+#include <signal_path/signal_path.h>
+#include <module.h>
+#include <utils/flog.h>
+#include <dsp/multirate/rational_resampler.h>
+#include "monitor_engine.h"
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+#include <chrono>
+
+#define CONCAT(a, b) ((std::string(a) + b).c_str())
+
+SDRPP_MOD_INFO{
+    /* Name:            */ "m17_band_monitor",
+    /* Description:     */ "Receives every M17 channel of a band plan at once",
+    /* Author:          */ "SDR++ contributors",
+    /* Version:         */ 0, 1, 0,
+    /* Max instances    */ -1
+};
+
+ConfigManager config;
+
+std::string genFileName(std::string prefix, std::string suffix) {
+    time_t now = time(0);
+    tm* ltm = localtime(&now);
+    char buf[1024];
+    sprintf(buf, "%s_%02d-%02d-%02d_%02d-%02d-%02d%s", prefix.c_str(), ltm->tm_hour, ltm->tm_min, ltm->tm_sec, ltm->tm_mday, ltm->tm_mon + 1, ltm->tm_year + 1900, suffix.c_str());
+    return buf;
+}
+
+class M17BandMonitorModule : public ModuleManager::Instance {
+public:
+    M17BandMonitorModule(std::string name) : folderSelect("%ROOT%/recordings") {
+        this->name = name;
+
+        // Load config
+        config.acquire();
+        if (!config.conf.contains(name)) {
+            config.conf[name] = json({});
+        }
+        if (config.conf[name].contains("logPath")) {
+            folderSelect.setPath(config.conf[name]["logPath"]);
+        }
+        if (config.conf[name].contains("logging")) {
+            logging = config.conf[name]["logging"];
+        }
+        if (config.conf[name].contains("channels")) {
+            for (auto& freq : config.conf[name]["channels"]) { channels.push_back(freq); }
+        }
+        if (config.conf[name].contains("listened")) {
+            listened = config.conf[name]["listened"];
+        }
+        config.release();
+        std::sort(channels.begin(), channels.end());
+        updateLogSettings();
+
+        engine.init(&iqStream, channelHandler, this);
+        engine.setChannels(channels);
+        engine.setListened(listened);
+        resamp.init(&engine.out, M17MonitorEngine::AUDIO_SAMPLERATE, audioSampRate);
+
+        // Setup audio stream
+        srChangeHandler.ctx = this;
+        srChangeHandler.handler = sampleRateChangeHandler;
+        stream.init(&resamp.out, &srChangeHandler, audioSampRate);
+        sigpath::sinkManager.registerStream(name, &stream);
+        stream.start();
+
+        start();
+
+        gui::menu.registerEntry(name, menuHandler, this, this);
+    }
+
+    ~M17BandMonitorModule() {
+        gui::menu.removeEntry(name);
+        stream.stop();
+        stop();
+        sigpath::sinkManager.unregisterStream(name);
+        std::lock_guard<std::mutex> lck(logMtx);
+        if (logFile.is_open()) { logFile.close(); }
+    }
+
+    void postInit() {}
+
+    void enable() {
+        start();
+        enabled = true;
+    }
+
+    void disable() {
+        stop();
+        enabled = false;
+    }
+
+    bool isEnabled() {
+        return enabled;
+    }
+
+private:
+    void start() {
+        if (running) { return; }
+        engine.start();
+        resamp.start();
+        sigpath::iqFrontEnd.bindIQStream(&iqStream);
+        running = true;
+    }
+
+    void stop() {
+        if (!running) { return; }
+        sigpath::iqFrontEnd.unbindIQStream(&iqStream);
+        engine.stop();
+        resamp.stop();
+        running = false;
+    }
+
+    void saveChannels() {
+        engine.setChannels(channels);
+        config.acquire();
+        config.conf[name]["channels"] = channels;
+        config.release(true);
+    }
+
+    // The handler runs on the DSP thread, so it gets its own copy of the log settings
+    void updateLogSettings() {
+        std::string dir = folderSelect.pathIsValid() ? folderSelect.expandString(folderSelect.path) : "";
+        std::lock_guard<std::mutex> lck(logMtx);
+        logActive = logging;
+
+        // The log is reopened in the new folder on the next transmission
+        if (logFile.is_open() && (!logActive || dir != logDir)) { logFile.close(); }
+        logDir = dir;
+    }
+
+    void setListened(double frequency) {
+        listened = frequency;
+        engine.setListened(listened);
+        config.acquire();
+        config.conf[name]["listened"] = listened;
+        config.release(true);
+    }
+
+    static void menuHandler(void* ctx) {
+        M17BandMonitorModule* _this = (M17BandMonitorModule*)ctx;
+        float menuWidth = ImGui::GetContentRegionAvail().x;
+
+        if (!_this->enabled) { style::beginDisabled(); }
+
+        if (_this->folderSelect.render("##m17_band_monitor_log" + _this->name)) {
+            _this->updateLogSettings();
+            if (_this->folderSelect.pathIsValid()) {
+                config.acquire();
+                config.conf[_this->name]["logPath"] = _this->folderSelect.path;
+                config.release(true);
+            }
+        }
+
+        // Reflect the handler giving up on a log it couldn't open
+        bool logFailed;
+        {
+            std::lock_guard<std::mutex> lck(_this->logMtx);
+            logFailed = (_this->logging && !_this->logActive);
+        }
+        if (logFailed) {
+            _this->logging = false;
+            config.acquire();
+            config.conf[_this->name]["logging"] = false;
+            config.release(true);
+        }
+
+        if (ImGui::Checkbox(CONCAT("Log to file##_m17_band_monitor_log_", _this->name), &_this->logging)) {
+            _this->updateLogSettings();
+            config.acquire();
+            config.conf[_this->name]["logging"] = _this->logging;
+            config.release(true);
+        }
+
+        // Band plan
+        ImGui::LeftLabel("Channel");
+        ImGui::SetNextItemWidth(menuWidth - ImGui::GetCursorPosX() - ImGui::CalcTextSize("Add").x - (ImGui::GetStyle().FramePadding.x * 2.0f) - ImGui::GetStyle().ItemSpacing.x);
+        ImGui::InputDouble(CONCAT("##_m17_band_monitor_freq_", _this->name), &_this->newFreq, 100.0, 12500.0, "%0.0f");
+        ImGui::SameLine();
+        if (ImGui::Button(CONCAT("Add##_m17_band_monitor_add_", _this->name))) {
+            double freq = round(_this->newFreq);
+            if (freq > 0.0 && std::find(_this->channels.begin(), _this->channels.end(), freq) == _this->channels.end()) {
+                _this->channels.push_back(freq);
+                std::sort(_this->channels.begin(), _this->channels.end());
+                _this->saveChannels();
+            }
+        }
+
+        if (ImGui::RadioButton(CONCAT("Follow activity##_m17_band_monitor_auto_", _this->name), _this->listened == 0.0)) {
+            _this->setListened(0.0);
+        }
+
+        // Channels, the radio buttons select the one to listen to
+        std::vector<M17ChannelInfo> infos = _this->engine.getChannels();
+        double removed = 0.0;
+        if (ImGui::BeginTable(CONCAT("m17_band_monitor_channels_", _this->name), 5, ImGuiTableFlags_RowBg | ImGuiTableFlags_Borders | ImGuiTableFlags_ScrollY, ImVec2(0, 300.0f * style::uiScale))) {
+            ImGui::TableSetupColumn("Frequency");
+            ImGui::TableSetupColumn("Source");
+            ImGui::TableSetupColumn("Destination");
+            ImGui::TableSetupColumn("Type");
+            ImGui::TableSetupColumn("");
+            ImGui::TableSetupScrollFreeze(0, 1);
+            ImGui::TableHeadersRow();
+            for (const auto& ch : infos) {
+                ImGui::TableNextRow();
+                ImGui::TableSetColumnIndex(0);
+                char freqStr[64];
+                sprintf(freqStr, "%.4lf##_m17_band_monitor_listen_%lf_", ch.frequency / 1e6, ch.frequency);
+                if (ImGui::RadioButton(CONCAT(freqStr, _this->name), _this->listened == ch.frequency)) {
+                    _this->setListened(ch.frequency);
+                }
+
+                // Highlight the channels being received
+                ImVec4 color = ch.playing ? ImVec4(0.0f, 1.0f, 0.0f, 1.0f) : (ch.receiving ? ImVec4(1.0f, 1.0f, 0.0f, 1.0f) : ImGui::GetStyleColorVec4(ImGuiCol_Text));
+                if (!ch.active) {
+                    ImGui::TableSetColumnIndex(1);
+                    ImGui::TextDisabled("Out of span");
+                }
+                else if (ch.lsf.valid) {
+                    ImGui::TableSetColumnIndex(1);
+                    ImGui::TextColored(color, "%s", ch.lsf.src.c_str());
+                    ImGui::TableSetColumnIndex(2);
+                    ImGui::TextColored(color, "%s", ch.lsf.dst.c_str());
+                    ImGui::TableSetColumnIndex(3);
+                    ImGui::TextColored(color, "%s", M17DataTypesTxt[ch.lsf.dataType]);
+                }
+                ImGui::TableSetColumnIndex(4);
+                sprintf(freqStr, "X##_m17_band_monitor_del_%lf_", ch.frequency);
+                if (ImGui::SmallButton(CONCAT(freqStr, _this->name))) { removed = ch.frequency; }
+            }
+            ImGui::EndTable();
+        }
+
+        if (removed != 0.0) {
+            _this->channels.erase(std::remove(_this->channels.begin(), _this->channels.end(), removed), _this->channels.end());
+            _this->saveChannels();
+            if (_this->listened == removed) { _this->setListened(0.0); }
+        }
+
+        if (!_this->enabled) { style::endDisabled(); }
+    }
+
+    static void sampleRateChangeHandler(float sampleRate, void* ctx) {
+        M17BandMonitorModule* _this = (M17BandMonitorModule*)ctx;
+        _this->audioSampRate = sampleRate;
+        _this->resamp.tempStop();
+        _this->resamp.setOutSamplerate(sampleRate);
+        _this->resamp.tempStart();
+    }
+
+    static void channelHandler(const M17ChannelInfo& info, void* ctx) {
+        M17BandMonitorModule* _this = (M17BandMonitorModule*)ctx;
+        const M17LSF& lsf = info.lsf;
+        flog::info("M17 band monitor: {0} MHz {1} -> {2} ({3})", info.frequency / 1e6, lsf.src, lsf.dst, M17DataTypesTxt[lsf.dataType]);
+
+        std::lock_guard<std::mutex> lck(_this->logMtx);
+        if (!_this->logActive) { return; }
+
+        // Open the log on the first transmission of the session
+        if (!_this->logFile.is_open()) {
+            if (_this->logDir.empty()) { return; }
+            std::string path = _this->logDir + "/" + genFileName("m17_band", ".txt");
+            _this->logFile.open(path, std::ios::out | std::ios::app);
+            if (!_this->logFile.is_open()) {
+                flog::error("Could not open M17 band monitor log: {0}", path);
+                _this->logActive = false;
+                return;
+            }
+        }
+
+        // Tab separated: local time, frequency, source, destination, data type, encryption and channel access number
+        time_t now = std::chrono::system_clock::to_time_t(info.lastHeard);
+        tm* ltm = localtime(&now);
+        char timeStr[64];
+        strftime(timeStr, sizeof(timeStr), "%Y-%m-%d %H:%M:%S", ltm);
+        char freqStr[32];
+        sprintf(freqStr, "%.4lf", info.frequency / 1e6);
+        _this->logFile << timeStr << '\t' << freqStr << '\t' << lsf.src << '\t' << lsf.dst << '\t' << M17DataTypesTxt[lsf.dataType] << '\t'
+                       << M17EncryptionTypesTxt[lsf.encryptionType] << '\t' << (int)lsf.channelAccessNum << std::endl;
+    }
+
+    std::string name;
+    bool enabled = true;
+    bool running = false;
+
+    FolderSelect folderSelect;
+    std::vector<double> channels;
+    double newFreq = 433475000.0;
+    double listened = 0.0;
+
+    // Decoding
+    dsp::stream<dsp::complex_t> iqStream;
+    M17MonitorEngine engine;
+
+    // Audio
+    dsp::multirate::RationalResampler<dsp::stereo_t> resamp;
+    double audioSampRate = 48000;
+    EventHandler<float> srChangeHandler;
+    SinkManager::Stream stream;
+
+    // Log, the settings being copied from the GUI under the lock for the handler
+    bool logging = false;
+    std::mutex logMtx;
+    bool logActive = false;
+    std::string logDir;
+    std::ofstream logFile;
+};
+
+MOD_EXPORT void _INIT_() {
+    // Create default recording directory
+    std::string root = (std::string)core::args["root"];
+    if (!std::filesystem::exists(root + "/recordings")) {
+        flog::warn("Recordings directory does not exist, creating it");
+        if (!std::filesystem::create_directory(root + "/recordings")) {
+            flog::error("Could not create recordings directory");
+        }
+    }
+    json def = json({});
+    config.setPath(root + "/m17_band_monitor_config.json");
+    config.load(def);
+    config.enableAutoSave();
+}
+
+MOD_EXPORT ModuleManager::Instance* _CREATE_INSTANCE_(std::string name) {
+    return new M17BandMonitorModule(name);
+}
+
+MOD_EXPORT void _DELETE_INSTANCE_(void* instance) {
+    delete (M17BandMonitorModule*)instance;
+}
+
+MOD_EXPORT void _END_() {
+    config.disableAutoSave();
+    config.save();
+}
@@ -0,0 +1,199 @@
+#include "monitor_engine.h"
+#include "channel.h"
+#include <utils/flog.h>
+#include <math.h>
+#include <algorithm>
+
+M17MonitorEngine::~M17MonitorEngine() {
+    if (base_type::_block_init) { base_type::stop(); }
+    for (auto& [freq, channel] : channels) { delete channel; }
+    channels.clear();
+    for (auto& buf : channelBufs) {
+        if (buf) { dsp::buffer::free(buf); }
+    }
+}
+
+void M17MonitorEngine::init(dsp::stream<dsp::complex_t>* in, Handler handler, void* ctx) {
+    _handler = handler;
+    _ctx = ctx;
+    base_type::init(in);
+    base_type::registerOutput(&out);
+}
+
+void M17MonitorEngine::setChannels(const std::vector<double>& frequencies) {
+    std::lock_guard<std::mutex> lck(channelMtx);
+    requested = frequencies;
+    channelsChanged = true;
+}
+
+void M17MonitorEngine::setListened(double frequency) {
+    std::lock_guard<std::mutex> lck(channelMtx);
+    listened = frequency;
+}
+
+std::vector<M17ChannelInfo> M17MonitorEngine::getChannels() {
+    std::lock_guard<std::mutex> lck(channelMtx);
+    return infos;
+}
+
+int M17MonitorEngine::run() {
+    int count = base_type::_in->read();
+    if (count < 0) { return -1; }
+
+    // Without metadata there's no telling which frequency each channel is on
+    const dsp::StreamMetadata& meta = base_type::_in->readMeta;
+    if (!meta.valid || meta.samplerate <= 0.0) {
+        base_type::_in->flush();
+        return count;
+    }
+
+    // Follow the samplerate and the tuning of the capture
+    if (meta.samplerate != samplerate) { configure(meta.samplerate); }
+    if (meta.centerFrequency != centerFrequency || meta.discontinuity) {
+        centerFrequency = meta.centerFrequency;
+        pfb.reset();
+        for (auto& [freq, channel] : channels) { tuneChannel(channel); }
+        updateActive();
+    }
+    applyChannels();
+
+    // Channelize, only the filterbank channels the M17 channels are taken from are copied out
+    int bound = pfb.outputBufferSize(count);
+    for (auto& channel : active) {
+        int ch = channel->getChannel();
+        dsp::buffer::reserve(channelBufs[ch], channelCapacities[ch], bound);
+        channelOut[ch] = channelBufs[ch];
+    }
+    int outCount = pfb.process(count, base_type::_in->readBuf, channelOut.data());
+    base_type::_in->flush();
+
+    // Decode all channels, only the one being listened to decodes its voice
+    playing = selectPlaying();
+    int audioCount = 0;
+    for (auto& channel : active) {
+        int n = channel->process(outCount, channelBufs[channel->getChannel()], channel == playing);
+        if (channel == playing) { audioCount = n; }
+    }
+
+    // Report the transmissions that just started and publish the state of all channels
+    std::vector<M17ChannelInfo> newInfos;
+    newInfos.reserve(channels.size());
+    for (auto& [freq, channel] : channels) {
+        M17ChannelInfo info;
+        if (channel->active && channel->poll(info)) { _handler(info, _ctx); }
+        else if (!channel->active) { channel->getInfo(info); }
+        info.active = channel->active;
+        info.playing = (channel == playing);
+        newInfos.push_back(info);
+    }
+    {
+        std::lock_guard<std::mutex> lck(channelMtx);
+        infos = std::move(newInfos);
+    }
+
+    if (audioCount) {
+        memcpy(out.writeBuf, playing->getAudio(), audioCount * sizeof(dsp::stereo_t));
+        if (!out.swap(audioCount)) { return -1; }
+    }
+
+    return count;
+}
+
+void M17MonitorEngine::configure(double samplerate) {
+    this->samplerate = samplerate;
+
+    // Channels at least MIN_CHANNEL_SPACING apart, in a multiple of the oversampling of the filterbank
+    const int os = dsp::channel::PFBChannelizer::OVERSAMPLING;
+    int count = std::max<int>(floor(samplerate / (MIN_CHANNEL_SPACING * os)), 1) * os;
+    channelSpacing = samplerate / (double)count;
+    pfb.init(count, samplerate);
+    flog::info("M17 band monitor: {0} filterbank channels spaced by {1} Hz", count, channelSpacing);
+
+    for (auto& buf : channelBufs) {
+        if (buf) { dsp::buffer::free(buf); }
+    }
+    channelBufs.assign(count, NULL);
+    channelCapacities.assign(count, 0);
+    channelOut.assign(count, NULL);
+
+    // The channels run at the rate of the filterbank outputs, start them over
+    for (auto& [freq, channel] : channels) { delete channel; }
+    channels.clear();
+    active.clear();
+    playing = NULL;
+    std::lock_guard<std::mutex> lck(channelMtx);
+    channelsChanged = true;
+}
+
+void M17MonitorEngine::applyChannels() {
+    std::vector<double> freqs;
+    {
+        std::lock_guard<std::mutex> lck(channelMtx);
+        if (!channelsChanged) { return; }
+        freqs = requested;
+        channelsChanged = false;
+    }
+
+    // Remove the channels no longer wanted
+    for (auto it = channels.begin(); it != channels.end();) {
+        if (std::find(freqs.begin(), freqs.end(), it->first) != freqs.end()) {
+            it++;
+            continue;
+        }
+        if (it->second == playing) { playing = NULL; }
+        delete it->second;
+        it = channels.erase(it);
+    }
+
+    // Add the new ones
+    for (double freq : freqs) {
+        if (channels.find(freq) != channels.end()) { continue; }
+        M17Channel* channel = new M17Channel(freq, channelSpacing * dsp::channel::PFBChannelizer::OVERSAMPLING);
+        tuneChannel(channel);
+        channels[freq] = channel;
+    }
+
+    updateActive();
+}
+
+void M17MonitorEngine::tuneChannel(M17Channel* channel) {
+    // Ignore channels not entirely within the capture
+    double offset = channel->getFrequency() - centerFrequency;
+    channel->active = (fabs(offset) + CHANNEL_HALF_WIDTH <= samplerate / 2.0);
+    if (!channel->active) { return; }
+
+    // Take the channel from the nearest filterbank channel
+    int count = pfb.getChannelCount();
+    int nearest = round(offset / channelSpacing);
+    channel->tune(((nearest % count) + count) % count, offset - ((double)nearest * channelSpacing));
+}
+
+void M17MonitorEngine::updateActive() {
+    active.clear();
+    std::fill(channelOut.begin(), channelOut.end(), (dsp::complex_t*)NULL);
+    for (auto& [freq, channel] : channels) {
+        if (channel->active) { active.push_back(channel); }
+    }
+    if (playing && !playing->active) { playing = NULL; }
+}
+
+M17Channel* M17MonitorEngine::selectPlaying() {
+    double freq;
+    {
+        std::lock_guard<std::mutex> lck(channelMtx);
+        freq = listened;
+    }
+
+    // A fixed channel is played even while idle so that a transmission is heard from its start
+    if (freq > 0.0) {
+        auto it = channels.find(freq);
+        return (it != channels.end() && it->second->active) ? it->second : NULL;
+    }
+
+    // Otherwise stick to a channel until its transmission is over
+    if (playing && playing->isReceivingVoice()) { return playing; }
+    for (auto& channel : active) {
+        if (channel->isReceivingVoice()) { return channel; }
+    }
+    return NULL;
+}
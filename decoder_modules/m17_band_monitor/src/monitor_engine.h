@@ -0,0 +1,89 @@
+#pragma once
+#include <dsp/sink.h>
+#include <dsp/channel/pfb_channelizer.h>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <chrono>
+#include <lsf_decode.h>
+
+struct M17ChannelInfo {
+    double frequency;
+    bool active;            // False while the channel is outside of the captured span
+    bool receiving;         // A stream is being received
+    bool playing;           // Its audio is the one being played
+    M17LSF lsf;             // Link setup of the current or last transmission, check lsf.valid
+    std::chrono::system_clock::time_point lastHeard;
+};
+
+// Defined in channel.h, which can only be included once since the Golay decoder is defined in a header
+class M17Channel;
+
+// Receives every M17 channel of a band plan from a single pass over the wideband IQ. The capture is split once by a
+// polyphase filterbank and all channels are then demodulated and decoded one after the other on the DSP thread,
+// instead of a VFO and a dozen blocks with their own threads per channel. Only the channel being listened to
+// decodes its voice, its audio being sent to the output at 8KHz.
+class M17MonitorEngine : public dsp::Sink<dsp::complex_t> {
+    using base_type = dsp::Sink<dsp::complex_t>;
+public:
+    // Called from the DSP thread when a transmission's link setup is first decoded
+    typedef void (*Handler)(const M17ChannelInfo& info, void* ctx);
+
+    M17MonitorEngine() {}
+
+    ~M17MonitorEngine();
+
+    void init(dsp::stream<dsp::complex_t>* in, Handler handler, void* ctx);
+
+    // Absolute frequencies of the channels to receive, applied from the next buffer on. Channels that are already
+    // received keep their state.
+    void setChannels(const std::vector<double>& frequencies);
+
+    // Frequency of the channel to listen to, zero to follow whichever channel starts receiving voice first
+    void setListened(double frequency);
+
+    std::vector<M17ChannelInfo> getChannels();
+
+    int run();
+
+    dsp::stream<dsp::stereo_t> out;
+
+    // Lowest spacing between the channels of the filterbank, the band plans use 12.5KHz steps
+    static constexpr double MIN_CHANNEL_SPACING = 12500.0;
+
+    // Channels closer than this to the edge of the capture are ignored
+    static constexpr double CHANNEL_HALF_WIDTH = 6250.0;
+
+    static constexpr double AUDIO_SAMPLERATE = 8000.0;
+
+private:
+    void configure(double samplerate);
+    void applyChannels();
+    void tuneChannel(M17Channel* channel);
+    void updateActive();
+    M17Channel* selectPlaying();
+
+    Handler _handler;
+    void* _ctx;
+
+    // Filterbank
+    dsp::channel::PFBChannelizer pfb;
+    double samplerate = 0.0;
+    double centerFrequency = 0.0;
+    double channelSpacing = 0.0;
+    std::vector<dsp::complex_t*> channelBufs;
+    std::vector<int> channelCapacities;
+    std::vector<dsp::complex_t*> channelOut;
+
+    // Channels, only touched from the DSP thread
+    std::map<double, M17Channel*> channels;
+    std::vector<M17Channel*> active;
+    M17Channel* playing = NULL;
+
+    // Requested channels and decoded data, shared with the other threads
+    std::mutex channelMtx;
+    std::vector<double> requested;
+    bool channelsChanged = false;
+    double listened = 0.0;
+    std::vector<M17ChannelInfo> infos;
+};
@@ -4,9 +4,7 @@
 #include <dsp/clock_recovery/mm.h>
 #include <dsp/clock_recovery/fd.h>
 #include <dsp/taps/root_raised_cosine.h>
-#include <dsp/digital/binary_slicer.h>
-#include <dsp/digital/manchester_decoder.h>
-#include <dsp/digital/differential_decoder.h>
+#include <dsp/sink/handler_sink.h>
 #include <gui/widgets/symbol_diagram.h>
 #include <fstream>
 #include <rds.h>
@@ -50,27 +48,18 @@ namespace demod {
             // Define structure
             demod.init(input, bandwidth / 2.0f, getIFSampleRate(), _stereo, _lowPass, _rds);
             recov.init(&demod.rdsOut, 5000.0 / 2375, omegaGain, muGain, 0.01);
-            slice.init(&recov.out);
-            manch.init(&slice.out);
-            diff.init(&manch.out, 2);
-            hs.init(&diff.out, rdsHandler, this);
+            hs.init(&recov.out, rdsHandler, this);
         }
 
         void start() {
             demod.start();
             recov.start();
-            slice.start();
-            manch.start();
-            diff.start();
             hs.start();
         }
 
         void stop() {
             demod.stop();
             recov.stop();
-            slice.stop();
-            manch.stop();
-            diff.stop();
             hs.stop();
         }
 
@@ -140,9 +129,9 @@ namespace demod {
         }
 
     private:
-        static void rdsHandler(uint8_t* data, int count, void* ctx) {
+        static void rdsHandler(float* data, int count, void* ctx) {
             WFM* _this = (WFM*)ctx;
-            _this->rdsDecode.process(data, count);
+            _this->rdsDecode.processSoft(data, count);
         }
 
         static void fftRedraw(ImGui::WaterFall::FFTRedrawArgs args, void* ctx) {
@@ -187,10 +176,7 @@ namespace demod {
 
         dsp::demod::BroadcastFM demod;
         dsp::clock_recovery::FD recov;
-        dsp::digital::BinarySlicer slice;
-        dsp::digital::ManchesterDecoder manch;
-        dsp::digital::DifferentialDecoder diff;
-        dsp::sink::Handler<uint8_t> hs;
+        dsp::sink::Handler<float> hs;
         EventHandler<ImGui::WaterFall::FFTRedrawArgs> fftRedrawHandler;
 
         rds::RDSDecoder rdsDecode;
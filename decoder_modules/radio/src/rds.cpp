@@ -1,219 +1,324 @@
 #include "rds.h"
 #include <string.h>
-#include <map>
+#include <math.h>
 #include <algorithm>
 
 namespace rds {
-    std::map<uint16_t, BlockType> SYNDROMES = {
-        { 0b1111011000, BLOCK_TYPE_A  },
-        { 0b1111010100, BLOCK_TYPE_B  },
-        { 0b1001011100, BLOCK_TYPE_C  },
-        { 0b1111001100, BLOCK_TYPE_CP },
-        { 0b1001011000, BLOCK_TYPE_D  }
-    };
-
-    std::map<BlockType, uint16_t> OFFSETS = {
-        { BLOCK_TYPE_A,  0b0011111100 },
-        { BLOCK_TYPE_B,  0b0110011000 },
-        { BLOCK_TYPE_C,  0b0101101000 },
-        { BLOCK_TYPE_CP, 0b1101010000 },
-        { BLOCK_TYPE_D,  0b0110110100 }
-    };
-
     //                           9876543210
     const uint16_t LFSR_POLY = 0b0110111001;
     const uint16_t IN_POLY   = 0b1100011011;
 
     const int BLOCK_LEN = 26;
-    const int DATA_LEN = 16;
     const int POLY_LEN = 10;
 
-    void RDSDecoder::process(uint8_t* symbols, int count) {
-        for (int i = 0; i < count; i++) {
-            // Shift in the bit
-            shiftReg = ((shiftReg << 1) & 0x3FFFFFF) | (symbols[i] & 1);
-
-            // Skip if we need to shift in new data
-            if (--skip > 0) { continue; }
-
-            // Calculate the syndrome and update sync status
-            uint16_t syn = calcSyndrome(shiftReg);
-            auto synIt = SYNDROMES.find(syn);
-            bool knownSyndrome = synIt != SYNDROMES.end();
-            sync = std::clamp<int>(knownSyndrome ? ++sync : --sync, 0, 4);
-            
-            // If we're still no longer in sync, try to resync
-            if (!sync) { continue; }
-
-            // Figure out which block we've got
-            BlockType type;
-            if (knownSyndrome) {
-                type = SYNDROMES[syn];
+    // Longest error burst the code is guaranteed to correct
+    const int MAX_BURST_LEN = 5;
+
+    // Number of least reliable bits tried in every combination when soft decoding
+    const int SOFT_FLIP_BITS = 3;
+
+    const uint16_t SYNDROMES[_BLOCK_TYPE_COUNT] = {
+        0b1111011000,   // BLOCK_TYPE_A
+        0b1111010100,   // BLOCK_TYPE_B
+        0b1001011100,   // BLOCK_TYPE_C
+        0b1111001100,   // BLOCK_TYPE_CP
+        0b1001011000    // BLOCK_TYPE_D
+    };
+
+    const uint16_t OFFSETS[_BLOCK_TYPE_COUNT] = {
+        0b0011111100,   // BLOCK_TYPE_A
+        0b0110011000,   // BLOCK_TYPE_B
+        0b0101101000,   // BLOCK_TYPE_C
+        0b1101010000,   // BLOCK_TYPE_CP
+        0b0110110100    // BLOCK_TYPE_D
+    };
+
+    // The syndrome is linear in the bits of the block, so it's the XOR of the syndromes of each of its bytes.
+    // Every syndrome is also mapped to the block type it identifies and to the error burst that produces it,
+    // which makes both the sync search and the error correction a handful of lookups per block.
+    struct Tables {
+        Tables() {
+            for (int i = 0; i < 4; i++) {
+                for (int j = 0; j < 256; j++) {
+                    byteSyndromes[i][j] = lfsrSyndrome((uint32_t)j << (i * 8));
+                }
             }
-            else {
-                type = (BlockType)((lastType + 1) % _BLOCK_TYPE_COUNT);
+
+            for (int i = 0; i < 1024; i++) { blockTypes[i] = -1; }
+            for (int i = 0; i < _BLOCK_TYPE_COUNT; i++) { blockTypes[SYNDROMES[i]] = i; }
+
+            // Bursts start and end with an error, anything in between may or may not be one.
+            // Shorter bursts are written last so that they win if two bursts share a syndrome.
+            memset(bursts, 0, sizeof(bursts));
+            for (int len = MAX_BURST_LEN; len >= 1; len--) {
+                int inner = std::max<int>(len - 2, 0);
+                for (int pattern = 0; pattern < (1 << inner); pattern++) {
+                    uint32_t burst = (len == 1) ? 1 : ((1u << (len - 1)) | ((uint32_t)pattern << 1) | 1);
+                    for (int pos = 0; pos + len <= BLOCK_LEN; pos++) {
+                        uint32_t err = burst << pos;
+                        bursts[syndrome(err)] = err;
+                    }
+                }
             }
+        }
 
-            // Save block while correcting errors (NOT YET)
-            blocks[type] = correctErrors(shiftReg, type, blockAvail[type]);
+        inline uint16_t syndrome(uint32_t block) const {
+            return byteSyndromes[0][block & 0xFF] ^ byteSyndromes[1][(block >> 8) & 0xFF] ^
+                   byteSyndromes[2][(block >> 16) & 0xFF] ^ byteSyndromes[3][(block >> 24) & 0x03];
+        }
 
-            // Update continous group count
-            if (type == BLOCK_TYPE_A) { contGroup = 1; }
-            else if (type == BLOCK_TYPE_B && lastType == BLOCK_TYPE_A) { contGroup++; }
-            else if ((type == BLOCK_TYPE_C || type == BLOCK_TYPE_CP) && lastType == BLOCK_TYPE_B) { contGroup++; }
-            else if (type == BLOCK_TYPE_D && (lastType == BLOCK_TYPE_C || lastType == BLOCK_TYPE_CP)) { contGroup++; }
-            else { contGroup = 0; }
+        // Reference implementation, only used to build the tables
+        static uint16_t lfsrSyndrome(uint32_t block) {
+            uint16_t syn = 0;
 
-            // If we've got an entire group, process it
-            if (contGroup >= 4) {
-                contGroup = 0;
-                decodeGroup();
+            // Calculate the syndrome using a LFSR
+            for (int i = BLOCK_LEN - 1; i >= 0; i--) {
+                // Shift the syndrome and keep the output
+                uint8_t outBit = (syn >> (POLY_LEN - 1)) & 1;
+                syn = (syn << 1) & 0b1111111111;
+
+                // Apply LFSR polynomial
+                syn ^= LFSR_POLY * outBit;
+
+                // Apply input polynomial.
+                syn ^= IN_POLY * ((block >> i) & 1);
             }
 
-            // // Remember the last block type and skip to new block
-            lastType = type;
-            skip = BLOCK_LEN;
+            return syn;
         }
+
+        uint16_t byteSyndromes[4][256];
+        int8_t blockTypes[1024];        // -1 if the syndrome isn't that of an offset word
+        uint32_t bursts[1024];          // Zero if the syndrome isn't that of a correctable burst
+    };
+
+    // Shared by all decoders
+    static const Tables tables;
+
+    void RDSDecoder::process(uint8_t* symbols, int count) {
+        for (int i = 0; i < count; i++) {
+            decodeBit(symbols[i] & 1, 1.0f, false);
+        }
+        publish();
+    }
+
+    void RDSDecoder::processSoft(const float* symbols, int count) {
+        for (int i = 0; i < count; i++) {
+            // The two halves of a bit are of opposite sign. Follow the pairing of symbols with the most
+            // energy in their difference, which is the one that lines up with the bits.
+            float diff = lastSymbol - symbols[i];
+            lastSymbol = symbols[i];
+            pairLevel[pairPhase] += (fabsf(diff) - pairLevel[pairPhase]) * 0.01f;
+            int phase = pairPhase;
+            pairPhase ^= 1;
+            if (pairLevel[phase] < pairLevel[phase ^ 1]) { continue; }
+
+            // Differential decoding, a one is a change of sign from the previous bit. The decision is
+            // only as reliable as the weakest of the two bits.
+            float rel = std::min<float>(fabsf(diff), fabsf(lastBit));
+            uint8_t bit = ((diff * lastBit) < 0.0f);
+            lastBit = diff;
+            decodeBit(bit, rel, true);
+        }
+        publish();
     }
 
-    uint16_t RDSDecoder::calcSyndrome(uint32_t block) {
-        uint16_t syn = 0;
+    void RDSDecoder::decodeBit(uint8_t bit, float reliability, bool soft) {
+        // Shift in the bit
+        shiftReg = ((shiftReg << 1) & 0x3FFFFFF) | bit;
+        reliabilities[relIndex] = reliability;
+        if (++relIndex >= BLOCK_LEN) { relIndex = 0; }
 
-        // Calculate the syndrome using a LFSR
-        for (int i = BLOCK_LEN - 1; i >= 0; i--) {
-            // Shift the syndrome and keep the output
-            uint8_t outBit = (syn >> (POLY_LEN - 1)) & 1;
-            syn = (syn << 1) & 0b1111111111;
+        // Skip if we need to shift in new data
+        if (--skip > 0) { return; }
 
-            // Apply LFSR polynomial
-            syn ^= LFSR_POLY * outBit;
+        // Calculate the syndrome and update sync status
+        int knownType = tables.blockTypes[tables.syndrome(shiftReg)];
+        bool knownSyndrome = (knownType >= 0);
+        sync = std::clamp<int>(knownSyndrome ? ++sync : --sync, 0, 4);
 
-            // Apply input polynomial.
-            syn ^= IN_POLY * ((block >> i) & 1);
+        // If we're still no longer in sync, try to resync
+        if (!sync) { return; }
+
+        // Figure out which block we've got
+        BlockType type;
+        if (knownSyndrome) {
+            type = (BlockType)knownType;
+        }
+        else {
+            type = (BlockType)((lastType + 1) % _BLOCK_TYPE_COUNT);
+        }
+
+        // Save block while correcting errors
+        uint32_t block = shiftReg;
+        blockAvail[type] = correctErrors(block, type, soft);
+        blocks[type] = block;
+
+        // Update continous group count
+        if (type == BLOCK_TYPE_A) { contGroup = 1; }
+        else if (type == BLOCK_TYPE_B && lastType == BLOCK_TYPE_A) { contGroup++; }
+        else if ((type == BLOCK_TYPE_C || type == BLOCK_TYPE_CP) && lastType == BLOCK_TYPE_B) { contGroup++; }
+        else if (type == BLOCK_TYPE_D && (lastType == BLOCK_TYPE_C || lastType == BLOCK_TYPE_CP)) { contGroup++; }
+        else { contGroup = 0; }
+
+        // If we've got an entire group, process it
+        if (contGroup >= 4) {
+            contGroup = 0;
+            decodeGroup();
         }
 
-        return syn;
+        // Remember the last block type and skip to new block
+        lastType = type;
+        skip = BLOCK_LEN;
     }
 
-    uint32_t RDSDecoder::correctErrors(uint32_t block, BlockType type, bool& recovered) {        
+    bool RDSDecoder::correctErrors(uint32_t& block, BlockType type, bool soft) {
         // Subtract the offset from block
         block ^= (uint32_t)OFFSETS[type];
-        uint32_t out = block;
-
-        // Calculate syndrome of corrected block
-        uint16_t syn = calcSyndrome(block);
-
-        // Use the syndrome register to do error correction if errors are present
-        uint8_t errorFound = 0;
-        if (syn) {
-            for (int i = DATA_LEN - 1; i >= 0; i--) {
-                // Check if the 5 leftmost bits are all zero
-                errorFound |= !(syn & 0b11111);
-
-                // Write output
-                uint8_t outBit = (syn >> (POLY_LEN - 1)) & 1;
-                out ^= (errorFound & outBit) << (i + POLY_LEN);
+        uint16_t syn = tables.syndrome(block);
+        if (!syn) { return true; }
+
+        // Flip the least reliable bits in every combination, fewest first, until the block is valid
+        if (soft) {
+            int weakest[SOFT_FLIP_BITS];
+            float weakestRel[SOFT_FLIP_BITS];
+            for (int i = 0; i < SOFT_FLIP_BITS; i++) {
+                weakest[i] = 0;
+                weakestRel[i] = INFINITY;
+            }
+            for (int i = 0; i < BLOCK_LEN; i++) {
+                // Bit i of the block was shifted in i bits ago
+                float rel = reliabilities[(relIndex + BLOCK_LEN - 1 - i) % BLOCK_LEN];
+                if (rel >= weakestRel[SOFT_FLIP_BITS - 1]) { continue; }
+                int j = SOFT_FLIP_BITS - 1;
+                for (; j > 0 && weakestRel[j - 1] > rel; j--) {
+                    weakest[j] = weakest[j - 1];
+                    weakestRel[j] = weakestRel[j - 1];
+                }
+                weakest[j] = i;
+                weakestRel[j] = rel;
+            }
 
-                // Shift syndrome
-                syn = (syn << 1) & 0b1111111111;
-                syn ^= LFSR_POLY * outBit * !errorFound;
+            for (int flips = 1; flips <= SOFT_FLIP_BITS; flips++) {
+                for (int mask = 1; mask < (1 << SOFT_FLIP_BITS); mask++) {
+                    int bits = 0;
+                    uint32_t err = 0;
+                    for (int i = 0; i < SOFT_FLIP_BITS; i++) {
+                        if (!(mask & (1 << i))) { continue; }
+                        err |= 1u << weakest[i];
+                        bits++;
+                    }
+                    if (bits != flips || tables.syndrome(err) != syn) { continue; }
+                    block ^= err;
+                    return true;
+                }
             }
         }
-        recovered = !(syn & 0b11111);
 
-        return out;
+        // Fall back on burst correction
+        uint32_t err = tables.bursts[syn];
+        if (!err) { return false; }
+        block ^= err;
+        return true;
     }
 
     void RDSDecoder::decodeGroup() {
-        std::lock_guard<std::mutex> lck(groupMtx);
         auto now = std::chrono::high_resolution_clock::now();
-        anyGroupLastUpdate = now;
+        data.anyGroupLastUpdate = now;
+        groupDecoded = true;
 
         // Make sure blocks A and B are available
         if (!blockAvail[BLOCK_TYPE_A] || !blockAvail[BLOCK_TYPE_B]) { return; }
 
         // Decode PI code
-        countryCode = (blocks[BLOCK_TYPE_A] >> 22) & 0xF;
-        programCoverage = (AreaCoverage)((blocks[BLOCK_TYPE_A] >> 18) & 0xF);
-        programRefNumber = (blocks[BLOCK_TYPE_A] >> 10) & 0xFF;
+        data.countryCode = (blocks[BLOCK_TYPE_A] >> 22) & 0xF;
+        data.programCoverage = (AreaCoverage)((blocks[BLOCK_TYPE_A] >> 18) & 0xF);
+        data.programRefNumber = (blocks[BLOCK_TYPE_A] >> 10) & 0xFF;
 
         // Decode group type and version
         uint8_t groupType = (blocks[BLOCK_TYPE_B] >> 22) & 0xF;
         GroupVersion groupVer = (GroupVersion)((blocks[BLOCK_TYPE_B] >> 21) & 1);
 
         // Decode traffic program and program type
-        trafficProgram = (blocks[BLOCK_TYPE_B] >> 20) & 1;
-        programType = (ProgramType)((blocks[BLOCK_TYPE_B] >> 15) & 0x1F);
-        
+        data.trafficProgram = (blocks[BLOCK_TYPE_B] >> 20) & 1;
+        data.programType = (ProgramType)((blocks[BLOCK_TYPE_B] >> 15) & 0x1F);
+
         if (groupType == 0) {
-            group0LastUpdate = now;
-            trafficAnnouncement = (blocks[BLOCK_TYPE_B] >> 14) & 1;
-            music = (blocks[BLOCK_TYPE_B] >> 13) & 1;
+            data.group0LastUpdate = now;
+            data.trafficAnnouncement = (blocks[BLOCK_TYPE_B] >> 14) & 1;
+            data.music = (blocks[BLOCK_TYPE_B] >> 13) & 1;
             uint8_t diBit = (blocks[BLOCK_TYPE_B] >> 12) & 1;
             uint8_t offset = ((blocks[BLOCK_TYPE_B] >> 10) & 0b11);
             uint8_t diOffset = 3 - offset;
             uint8_t psOffset = offset * 2;
 
             if (groupVer == GROUP_VER_A && blockAvail[BLOCK_TYPE_C]) {
-                alternateFrequency = (blocks[BLOCK_TYPE_C] >> 10) & 0xFFFF;
+                data.alternateFrequency = (blocks[BLOCK_TYPE_C] >> 10) & 0xFFFF;
             }
 
             // Write DI bit to the decoder identification
-            decoderIdent &= ~(1 << diOffset);
-            decoderIdent |= (diBit << diOffset);
+            data.decoderIdent &= ~(1 << diOffset);
+            data.decoderIdent |= (diBit << diOffset);
 
             // Write chars at offset the PSName
             if (blockAvail[BLOCK_TYPE_D]) {
-                programServiceName[psOffset] = (blocks[BLOCK_TYPE_D] >> 18) & 0xFF;
-                programServiceName[psOffset + 1] = (blocks[BLOCK_TYPE_D] >> 10) & 0xFF;
+                data.programServiceName[psOffset] = (blocks[BLOCK_TYPE_D] >> 18) & 0xFF;
+                data.programServiceName[psOffset + 1] = (blocks[BLOCK_TYPE_D] >> 10) & 0xFF;
             }
         }
         else if (groupType == 2) {
-            group2LastUpdate = now;
+            data.group2LastUpdate = now;
             // Get char offset and write chars in the Radiotext
             bool nAB = (blocks[BLOCK_TYPE_B] >> 14) & 1;
             uint8_t offset = (blocks[BLOCK_TYPE_B] >> 10) & 0xF;
 
             // Clear text field if the A/B flag changed
-            if (nAB != rtAB) {
-                radioText = "                                                                ";
+            if (nAB != data.rtAB) {
+                data.radioText = "                                                                ";
             }
-            rtAB = nAB;
+            data.rtAB = nAB;
 
             // Write char at offset in Radiotext
             if (groupVer == GROUP_VER_A) {
                 uint8_t rtOffset = offset * 4;
                 if (blockAvail[BLOCK_TYPE_C]) {
-                    radioText[rtOffset] = (blocks[BLOCK_TYPE_C] >> 18) & 0xFF;
-                    radioText[rtOffset + 1] = (blocks[BLOCK_TYPE_C] >> 10) & 0xFF;
+                    data.radioText[rtOffset] = (blocks[BLOCK_TYPE_C] >> 18) & 0xFF;
+                    data.radioText[rtOffset + 1] = (blocks[BLOCK_TYPE_C] >> 10) & 0xFF;
                 }
                 if (blockAvail[BLOCK_TYPE_D]) {
-                    radioText[rtOffset + 2] = (blocks[BLOCK_TYPE_D] >> 18) & 0xFF;
-                    radioText[rtOffset + 3] = (blocks[BLOCK_TYPE_D] >> 10) & 0xFF;
+                    data.radioText[rtOffset + 2] = (blocks[BLOCK_TYPE_D] >> 18) & 0xFF;
+                    data.radioText[rtOffset + 3] = (blocks[BLOCK_TYPE_D] >> 10) & 0xFF;
                 }
             }
             else {
                 uint8_t rtOffset = offset * 2;
                 if (blockAvail[BLOCK_TYPE_D]) {
-                    radioText[rtOffset] = (blocks[BLOCK_TYPE_D] >> 18) & 0xFF;
-                    radioText[rtOffset + 1] = (blocks[BLOCK_TYPE_D] >> 10) & 0xFF;
+                    data.radioText[rtOffset] = (blocks[BLOCK_TYPE_D] >> 18) & 0xFF;
+                    data.radioText[rtOffset + 1] = (blocks[BLOCK_TYPE_D] >> 10) & 0xFF;
                 }
             }
         }
     }
 
+    void RDSDecoder::publish() {
+        if (!groupDecoded) { return; }
+        groupDecoded = false;
+        std::lock_guard<std::mutex> lck(groupMtx);
+        published = data;
+    }
+
     bool RDSDecoder::anyGroupValid() {
         auto now = std::chrono::high_resolution_clock::now();
-        return (std::chrono::duration_cast<std::chrono::milliseconds>(now - anyGroupLastUpdate)).count() < 5000.0;
+        return (std::chrono::duration_cast<std::chrono::milliseconds>(now - published.anyGroupLastUpdate)).count() < 5000.0;
     }
 
     bool RDSDecoder::group0Valid() {
         auto now = std::chrono::high_resolution_clock::now();
-        return (std::chrono::duration_cast<std::chrono::milliseconds>(now - group0LastUpdate)).count() < 5000.0;
+        return (std::chrono::duration_cast<std::chrono::milliseconds>(now - published.group0LastUpdate)).count() < 5000.0;
     }
 
     bool RDSDecoder::group2Valid() {
         auto now = std::chrono::high_resolution_clock::now();
-        return (std::chrono::duration_cast<std::chrono::milliseconds>(now - group2LastUpdate)).count() < 5000.0;
+        return (std::chrono::duration_cast<std::chrono::milliseconds>(now - published.group2LastUpdate)).count() < 5000.0;
     }
 }
\ No newline at end of file
@@ -117,29 +117,58 @@ namespace rds {
 
     class RDSDecoder {
     public:
+        // Hard decoded bits, after Manchester and differential decoding
         void process(uint8_t* symbols, int count);
 
+        // Soft symbols straight out of the clock recovery, two per bit. Manchester and differential decoding are
+        // done here so that the reliability of every bit can be used to correct errors the burst decoder can't.
+        void processSoft(const float* symbols, int count);
+
         bool countryCodeValid() { std::lock_guard<std::mutex> lck(groupMtx); return anyGroupValid(); }
-        uint8_t getCountryCode() { std::lock_guard<std::mutex> lck(groupMtx); return countryCode; }
+        uint8_t getCountryCode() { std::lock_guard<std::mutex> lck(groupMtx); return published.countryCode; }
         bool programCoverageValid() { std::lock_guard<std::mutex> lck(groupMtx); return anyGroupValid(); }
-        uint8_t getProgramCoverage() { std::lock_guard<std::mutex> lck(groupMtx); return programCoverage; }
+        uint8_t getProgramCoverage() { std::lock_guard<std::mutex> lck(groupMtx); return published.programCoverage; }
         bool programRefNumberValid() { std::lock_guard<std::mutex> lck(groupMtx); return anyGroupValid(); }
-        uint8_t getProgramRefNumber() { std::lock_guard<std::mutex> lck(groupMtx); return programRefNumber; }
+        uint8_t getProgramRefNumber() { std::lock_guard<std::mutex> lck(groupMtx); return published.programRefNumber; }
         bool programTypeValid() { std::lock_guard<std::mutex> lck(groupMtx); return anyGroupValid(); }
-        ProgramType getProgramType() { std::lock_guard<std::mutex> lck(groupMtx); return programType; }
+        ProgramType getProgramType() { std::lock_guard<std::mutex> lck(groupMtx); return published.programType; }
 
         bool musicValid() { std::lock_guard<std::mutex> lck(groupMtx); return group0Valid(); }
-        bool getMusic() { std::lock_guard<std::mutex> lck(groupMtx); return music; }
+        bool getMusic() { std::lock_guard<std::mutex> lck(groupMtx); return published.music; }
         bool PSNameValid() { std::lock_guard<std::mutex> lck(groupMtx); return group0Valid(); }
-        std::string getPSName() { std::lock_guard<std::mutex> lck(groupMtx); return programServiceName; }
+        std::string getPSName() { std::lock_guard<std::mutex> lck(groupMtx); return published.programServiceName; }
 
         bool radioTextValid() { std::lock_guard<std::mutex> lck(groupMtx); return group2Valid(); }
-        std::string getRadioText() { std::lock_guard<std::mutex> lck(groupMtx); return radioText; }
+        std::string getRadioText() { std::lock_guard<std::mutex> lck(groupMtx); return published.radioText; }
 
     private:
-        static uint16_t calcSyndrome(uint32_t block);
-        static uint32_t correctErrors(uint32_t block, BlockType type, bool& recovered);
+        struct Data {
+            // All groups
+            std::chrono::time_point<std::chrono::high_resolution_clock> anyGroupLastUpdate;
+            uint8_t countryCode;
+            AreaCoverage programCoverage;
+            uint8_t programRefNumber;
+            bool trafficProgram;
+            ProgramType programType;
+
+            // Group type 0
+            std::chrono::time_point<std::chrono::high_resolution_clock> group0LastUpdate;
+            bool trafficAnnouncement;
+            bool music;
+            uint8_t decoderIdent;
+            uint16_t alternateFrequency;
+            std::string programServiceName = "        ";
+
+            // Group type 2
+            std::chrono::time_point<std::chrono::high_resolution_clock> group2LastUpdate;
+            bool rtAB = false;
+            std::string radioText = "                                                                ";
+        };
+
+        void decodeBit(uint8_t bit, float reliability, bool soft);
+        bool correctErrors(uint32_t& block, BlockType type, bool soft);
         void decodeGroup();
+        void publish();
 
         bool anyGroupValid();
         bool group0Valid();
@@ -153,28 +182,20 @@ namespace rds {
         int contGroup = 0;
         uint32_t blocks[_BLOCK_TYPE_COUNT];
         bool blockAvail[_BLOCK_TYPE_COUNT];
-
-        // All groups
+        bool groupDecoded = false;
+
+        // Soft decoding, reliability of the bits of the shift register indexed from the oldest
+        float lastSymbol = 0.0f;
+        float pairLevel[2] = { 0.0f, 0.0f };
+        int pairPhase = 0;
+        float lastBit = 0.0f;
+        float reliabilities[26] = {};
+        int relIndex = 0;
+
+        // Data being decoded and the copy last published to other threads. The lock is only
+        // taken once per call to process() instead of once per group.
+        Data data;
+        Data published;
         std::mutex groupMtx;
-        std::chrono::time_point<std::chrono::high_resolution_clock> anyGroupLastUpdate;
-        uint8_t countryCode;
-        AreaCoverage programCoverage;
-        uint8_t programRefNumber;
-        bool trafficProgram;
-        ProgramType programType;
-
-        // Group type 0
-        std::chrono::time_point<std::chrono::high_resolution_clock> group0LastUpdate;
-        bool trafficAnnouncement;
-        bool music;
-        uint8_t decoderIdent;
-        uint16_t alternateFrequency;
-        std::string programServiceName = "        ";
-
-        // Group type 2
-        std::chrono::time_point<std::chrono::high_resolution_clock> group2LastUpdate;
-        bool rtAB = false;
-        std::string radioText = "                                                                ";
-
     };
 }
\ No newline at end of file
@@ -71,6 +71,8 @@ cp $build_dir/sink_modules/network_sink/Release/network_sink.dll sdrpp_windows_x
 cp $build_dir/decoder_modules/atv_decoder/Release/atv_decoder.dll sdrpp_windows_x64/modules/
 cp $build_dir/decoder_modules/satv_decoder/Release/satv_decoder.dll sdrpp_windows_x64/modules/
 
+cp $build_dir/decoder_modules/fm_band_monitor/Release/fm_band_monitor.dll sdrpp_windows_x64/modules/
+
 cp $build_dir/decoder_modules/m17_decoder/Release/m17_decoder.dll sdrpp_windows_x64/modules/
 cp "C:/Program Files/codec2/lib/libcodec2.dll" sdrpp_windows_x64/
 
@@ -67,8 +67,11 @@ public:
         config.acquire();
         std::string selList = config.conf["selectedList"];
         bookmarkDisplayMode = config.conf["bookmarkDisplayMode"];
+        showActivity = config.conf["showActivity"];
         config.release();
 
+        if (showActivity) { sigpath::iqFrontEnd.enableActivityDetection(); }
+
         refreshLists();
         loadByName(selList);
         refreshWaterfallBookmarks();
@@ -87,6 +90,7 @@ public:
         gui::menu.removeEntry(name);
         gui::waterfall.onFFTRedraw.unbindHandler(&fftRedrawHandler);
         gui::waterfall.onInputProcess.unbindHandler(&inputHandler);
+        if (showActivity) { sigpath::iqFrontEnd.disableActivityDetection(); }
     }
 
     void postInit() {}
@@ -561,6 +565,18 @@ private:
             config.release(true);
         }
 
+        if (ImGui::Checkbox(("Highlight active bookmarks##_freq_mgr_act_" + _this->name).c_str(), &_this->showActivity)) {
+            if (_this->showActivity) {
+                sigpath::iqFrontEnd.enableActivityDetection();
+            }
+            else {
+                sigpath::iqFrontEnd.disableActivityDetection();
+            }
+            config.acquire();
+            config.conf["showActivity"] = _this->showActivity;
+            config.release(true);
+        }
+
         if (_this->selectedListName == "") { style::endDisabled(); }
 
         if (_this->createOpen) {
@@ -606,12 +622,17 @@ private:
         FrequencyManagerModule* _this = (FrequencyManagerModule*)ctx;
         if (_this->bookmarkDisplayMode == BOOKMARK_DISP_MODE_OFF) { return; }
 
+        // Get the signals currently present in the spectrum
+        dsp::detector::ActivityReport activity;
+        if (_this->showActivity) { activity = sigpath::iqFrontEnd.getActivity(); }
+
         if (_this->bookmarkDisplayMode == BOOKMARK_DISP_MODE_TOP) {
             for (auto const bm : _this->waterfallBookmarks) {
+                ImU32 color = isActive(bm.bookmark, activity) ? IM_COL32(0, 255, 0, 255) : IM_COL32(255, 255, 0, 255);
                 double centerXpos = args.min.x + std::round((bm.bookmark.frequency - args.lowFreq) * args.freqToPixelRatio);
 
                 if (bm.bookmark.frequency >= args.lowFreq && bm.bookmark.frequency <= args.highFreq) {
-                    args.window->DrawList->AddLine(ImVec2(centerXpos, args.min.y), ImVec2(centerXpos, args.max.y), IM_COL32(255, 255, 0, 255));
+                    args.window->DrawList->AddLine(ImVec2(centerXpos, args.min.y), ImVec2(centerXpos, args.max.y), color);
                 }
 
                 ImVec2 nameSize = ImGui::CalcTextSize(bm.bookmarkName.c_str());
@@ -621,7 +642,7 @@ private:
                 ImVec2 clampedRectMax = ImVec2(std::clamp<double>(rectMax.x, args.min.x, args.max.x), rectMax.y);
 
                 if (clampedRectMax.x - clampedRectMin.x > 0) {
-                    args.window->DrawList->AddRectFilled(clampedRectMin, clampedRectMax, IM_COL32(255, 255, 0, 255));
+                    args.window->DrawList->AddRectFilled(clampedRectMin, clampedRectMax, color);
                 }
                 if (rectMin.x >= args.min.x && rectMax.x <= args.max.x) {
                     args.window->DrawList->AddText(ImVec2(centerXpos - (nameSize.x / 2), args.min.y), IM_COL32(0, 0, 0, 255), bm.bookmarkName.c_str());
@@ -630,10 +651,11 @@ private:
         }
         else if (_this->bookmarkDisplayMode == BOOKMARK_DISP_MODE_BOTTOM) {
             for (auto const bm : _this->waterfallBookmarks) {
+                ImU32 color = isActive(bm.bookmark, activity) ? IM_COL32(0, 255, 0, 255) : IM_COL32(255, 255, 0, 255);
                 double centerXpos = args.min.x + std::round((bm.bookmark.frequency - args.lowFreq) * args.freqToPixelRatio);
 
                 if (bm.bookmark.frequency >= args.lowFreq && bm.bookmark.frequency <= args.highFreq) {
-                    args.window->DrawList->AddLine(ImVec2(centerXpos, args.min.y), ImVec2(centerXpos, args.max.y), IM_COL32(255, 255, 0, 255));
+                    args.window->DrawList->AddLine(ImVec2(centerXpos, args.min.y), ImVec2(centerXpos, args.max.y), color);
                 }
 
                 ImVec2 nameSize = ImGui::CalcTextSize(bm.bookmarkName.c_str());
@@ -643,7 +665,7 @@ private:
                 ImVec2 clampedRectMax = ImVec2(std::clamp<double>(rectMax.x, args.min.x, args.max.x), rectMax.y);
 
                 if (clampedRectMax.x - clampedRectMin.x > 0) {
-                    args.window->DrawList->AddRectFilled(clampedRectMin, clampedRectMax, IM_COL32(255, 255, 0, 255));
+                    args.window->DrawList->AddRectFilled(clampedRectMin, clampedRectMax, color);
                 }
                 if (rectMin.x >= args.min.x && rectMax.x <= args.max.x) {
                     args.window->DrawList->AddText(ImVec2(centerXpos - (nameSize.x / 2), args.max.y - nameSize.y), IM_COL32(0, 0, 0, 255), bm.bookmarkName.c_str());
@@ -652,6 +674,15 @@ private:
         }
     }
 
+    static bool isActive(const FrequencyBookmark& bm, const dsp::detector::ActivityReport& activity) {
+        double low = bm.frequency - (bm.bandwidth / 2.0);
+        double high = bm.frequency + (bm.bandwidth / 2.0);
+        for (const auto& seg : activity.segments) {
+            if (seg.highFrequency >= low && seg.lowFrequency <= high) { return true; }
+        }
+        return false;
+    }
+
     bool mouseAlreadyDown = false;
     bool mouseClickedInLabel = false;
     static void fftInput(ImGui::WaterFall::InputHandlerArgs args, void* ctx) {
@@ -822,12 +853,14 @@ private:
     std::vector<WaterfallBookmark> waterfallBookmarks;
 
     int bookmarkDisplayMode = 0;
+    bool showActivity = false;
 };
 
 MOD_EXPORT void _INIT_() {
     json def = json({});
     def["selectedList"] = "General";
     def["bookmarkDisplayMode"] = BOOKMARK_DISP_MODE_TOP;
+    def["showActivity"] = false;
     def["lists"]["General"]["showOnWaterfall"] = true;
     def["lists"]["General"]["bookmarks"] = json::object();
 
@@ -840,6 +873,9 @@ MOD_EXPORT void _INIT_() {
     if (!config.conf.contains("bookmarkDisplayMode")) {
         config.conf["bookmarkDisplayMode"] = BOOKMARK_DISP_MODE_TOP;
     }
+    if (!config.conf.contains("showActivity")) {
+        config.conf["showActivity"] = false;
+    }
     for (auto [listName, list] : config.conf["lists"].items()) {
         if (list.contains("bookmarks") && list.contains("showOnWaterfall") && list["showOnWaterfall"].is_boolean()) { continue; }
         json newList;
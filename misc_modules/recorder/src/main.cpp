@@ -9,6 +9,7 @@
 #include <dsp/convert/stereo_to_mono.h>
 #include <thread>
 #include <ctime>
+#include <chrono>
 #include <gui/gui.h>
 #include <filesystem>
 #include <signal_path/signal_path.h>
@@ -21,6 +22,7 @@
 #include <core.h>
 #include <utils/optionlist.h>
 #include <utils/wav.h>
+#include <utils/spectrogram.h>
 #include <radio_interface.h>
 
 #define CONCAT(a, b) ((std::string(a) + b).c_str())
@@ -51,10 +53,27 @@ public:
         sampleTypes.define(wav::SAMP_TYPE_INT16, "Int16", wav::SAMP_TYPE_INT16);
         sampleTypes.define(wav::SAMP_TYPE_INT32, "Int32", wav::SAMP_TYPE_INT32);
         sampleTypes.define(wav::SAMP_TYPE_FLOAT32, "Float32", wav::SAMP_TYPE_FLOAT32);
+        spectrumSizes.define(1024, "1024", 1024);
+        spectrumSizes.define(2048, "2048", 2048);
+        spectrumSizes.define(4096, "4096", 4096);
+        spectrumSizes.define(8192, "8192", 8192);
+        spectrumSizes.define(16384, "16384", 16384);
+        spectrumSizes.define(32768, "32768", 32768);
+        spectrumSizes.define(65536, "65536", 65536);
+        spectrumRates.define("0.1", "0.1 FPS", 0.1);
+        spectrumRates.define("1", "1 FPS", 1.0);
+        spectrumRates.define("5", "5 FPS", 5.0);
+        spectrumRates.define("10", "10 FPS", 10.0);
+        spectrumRates.define("20", "20 FPS", 20.0);
+        spectrumDepths.define(8, "8 bit", 8);
+        spectrumDepths.define(16, "16 bit", 16);
 
         // Load default config for option lists
         containerId = containers.valueId(wav::FORMAT_WAV);
         sampleTypeId = sampleTypes.valueId(wav::SAMP_TYPE_INT16);
+        spectrumSizeId = spectrumSizes.valueId(8192);
+        spectrumRateId = spectrumRates.valueId(1.0);
+        spectrumDepthId = spectrumDepths.valueId(8);
 
         // Load config
         config.acquire();
@@ -70,6 +89,15 @@ public:
         if (config.conf[name].contains("sampleType") && sampleTypes.keyExists(config.conf[name]["sampleType"])) {
             sampleTypeId = sampleTypes.keyId(config.conf[name]["sampleType"]);
         }
+        if (config.conf[name].contains("spectrumSize") && spectrumSizes.keyExists(config.conf[name]["spectrumSize"])) {
+            spectrumSizeId = spectrumSizes.keyId(config.conf[name]["spectrumSize"]);
+        }
+        if (config.conf[name].contains("spectrumRate") && spectrumRates.keyExists(config.conf[name]["spectrumRate"])) {
+            spectrumRateId = spectrumRates.keyId(config.conf[name]["spectrumRate"]);
+        }
+        if (config.conf[name].contains("spectrumDepth") && spectrumDepths.keyExists(config.conf[name]["spectrumDepth"])) {
+            spectrumDepthId = spectrumDepths.keyId(config.conf[name]["spectrumDepth"]);
+        }
         if (config.conf[name].contains("audioStream")) {
             selectedStreamName = config.conf[name]["audioStream"];
         }
@@ -100,6 +128,7 @@ public:
 
         // Init sinks
         basebandSink.init(NULL, complexHandler, this);
+        spectrum.init(NULL, sigpath::iqFrontEnd.getEffectiveSamplerate());
         stereoSink.init(&stereoStream, stereoHandler, this);
         monoSink.init(&s2m.out, monoHandler, this);
 
@@ -154,6 +183,28 @@ public:
         std::lock_guard<std::recursive_mutex> lck(recMtx);
         if (recording) { return; }
 
+        // Spectra are computed from the IQ by the recorder itself, independently of the waterfall and its FFT
+        if (recMode == RECORDER_MODE_SPECTRUM) {
+            std::string expandedPath = expandString(folderSelect.path + "/" + genFileName(nameTemplate, "spectrum", "") + ".spg");
+            spectrogramWriter.setBitDepth(spectrumDepths[spectrumDepthId]);
+            if (!spectrogramWriter.open(expandedPath, spectrumSizes[spectrumSizeId])) {
+                flog::error("Failed to open file for recording: {0}", expandedPath);
+                return;
+            }
+            SpectrumEngine::Params params;
+            params.size = spectrumSizes[spectrumSizeId];
+            params.rate = spectrumRates[spectrumRateId];
+            params.window = SpectrumEngine::NUTTALL;
+            spectrumConsumer = spectrum.addConsumer(params, spectrumHandler, this);
+            basebandStream = new dsp::stream<dsp::complex_t>();
+            spectrum.setInput(basebandStream);
+            spectrum.setSamplerate(sigpath::iqFrontEnd.getEffectiveSamplerate());
+            spectrum.start();
+            sigpath::iqFrontEnd.bindIQStream(basebandStream);
+            recording = true;
+            return;
+        }
+
         // Configure the wav writer
         if (recMode == RECORDER_MODE_AUDIO) {
             if (selectedStreamName.empty()) { return; }
@@ -204,6 +255,16 @@ public:
         std::lock_guard<std::recursive_mutex> lck(recMtx);
         if (!recording) { return; }
 
+        if (recMode == RECORDER_MODE_SPECTRUM) {
+            sigpath::iqFrontEnd.unbindIQStream(basebandStream);
+            spectrum.stop();
+            spectrum.removeConsumer(spectrumConsumer);
+            delete basebandStream;
+            spectrogramWriter.close();
+            recording = false;
+            return;
+        }
+
         // Close audio stream or baseband
         if (recMode == RECORDER_MODE_AUDIO) {
             splitter.unbindStream(&stereoStream);
@@ -233,7 +294,7 @@ private:
         // Recording mode
         if (_this->recording) { style::beginDisabled(); }
         ImGui::BeginGroup();
-        ImGui::Columns(2, CONCAT("RecorderModeColumns##_", _this->name), false);
+        ImGui::Columns(3, CONCAT("RecorderModeColumns##_", _this->name), false);
         if (ImGui::RadioButton(CONCAT("Baseband##_recorder_mode_", _this->name), _this->recMode == RECORDER_MODE_BASEBAND)) {
             _this->recMode = RECORDER_MODE_BASEBAND;
             config.acquire();
@@ -247,6 +308,13 @@ private:
             config.conf[_this->name]["mode"] = _this->recMode;
             config.release(true);
         }
+        ImGui::NextColumn();
+        if (ImGui::RadioButton(CONCAT("Spectrum##_recorder_mode_", _this->name), _this->recMode == RECORDER_MODE_SPECTRUM)) {
+            _this->recMode = RECORDER_MODE_SPECTRUM;
+            config.acquire();
+            config.conf[_this->name]["mode"] = _this->recMode;
+            config.release(true);
+        }
         ImGui::Columns(1, CONCAT("EndRecorderModeColumns##_", _this->name), false);
         ImGui::EndGroup();
         if (_this->recording) { style::endDisabled(); }
@@ -268,20 +336,49 @@ private:
             config.release(true);
         }
 
-        ImGui::LeftLabel("Container");
-        ImGui::FillWidth();
-        if (ImGui::Combo(CONCAT("##_recorder_container_", _this->name), &_this->containerId, _this->containers.txt)) {
-            config.acquire();
-            config.conf[_this->name]["container"] = _this->containers.key(_this->containerId);
-            config.release(true);
+        if (_this->recMode == RECORDER_MODE_SPECTRUM) {
+            if (_this->recording) { style::beginDisabled(); }
+            ImGui::LeftLabel("FFT Size");
+            ImGui::FillWidth();
+            if (ImGui::Combo(CONCAT("##_recorder_spec_size_", _this->name), &_this->spectrumSizeId, _this->spectrumSizes.txt)) {
+                config.acquire();
+                config.conf[_this->name]["spectrumSize"] = _this->spectrumSizes.key(_this->spectrumSizeId);
+                config.release(true);
+            }
+
+            ImGui::LeftLabel("Rate");
+            ImGui::FillWidth();
+            if (ImGui::Combo(CONCAT("##_recorder_spec_rate_", _this->name), &_this->spectrumRateId, _this->spectrumRates.txt)) {
+                config.acquire();
+                config.conf[_this->name]["spectrumRate"] = _this->spectrumRates.key(_this->spectrumRateId);
+                config.release(true);
+            }
+
+            ImGui::LeftLabel("Resolution");
+            ImGui::FillWidth();
+            if (ImGui::Combo(CONCAT("##_recorder_spec_depth_", _this->name), &_this->spectrumDepthId, _this->spectrumDepths.txt)) {
+                config.acquire();
+                config.conf[_this->name]["spectrumDepth"] = _this->spectrumDepths.key(_this->spectrumDepthId);
+                config.release(true);
+            }
+            if (_this->recording) { style::endDisabled(); }
         }
+        else {
+            ImGui::LeftLabel("Container");
+            ImGui::FillWidth();
+            if (ImGui::Combo(CONCAT("##_recorder_container_", _this->name), &_this->containerId, _this->containers.txt)) {
+                config.acquire();
+                config.conf[_this->name]["container"] = _this->containers.key(_this->containerId);
+                config.release(true);
+            }
 
-        ImGui::LeftLabel("Sample type");
-        ImGui::FillWidth();
-        if (ImGui::Combo(CONCAT("##_recorder_st_", _this->name), &_this->sampleTypeId, _this->sampleTypes.txt)) {
-            config.acquire();
-            config.conf[_this->name]["sampleType"] = _this->sampleTypes.key(_this->sampleTypeId);
-            config.release(true);
+            ImGui::LeftLabel("Sample type");
+            ImGui::FillWidth();
+            if (ImGui::Combo(CONCAT("##_recorder_st_", _this->name), &_this->sampleTypeId, _this->sampleTypes.txt)) {
+                config.acquire();
+                config.conf[_this->name]["sampleType"] = _this->sampleTypes.key(_this->sampleTypeId);
+                config.release(true);
+            }
         }
 
         // Show additional audio options
@@ -337,7 +434,13 @@ private:
             if (ImGui::Button(CONCAT("Stop##_recorder_rec_", _this->name), ImVec2(menuWidth, 0))) {
                 _this->stop();
             }
-            uint64_t seconds = _this->writer.getSamplesWritten() / _this->samplerate;
+            uint64_t seconds;
+            if (_this->recMode == RECORDER_MODE_SPECTRUM) {
+                seconds = _this->spectrogramWriter.getFramesWritten() / _this->spectrumRates[_this->spectrumRateId];
+            }
+            else {
+                seconds = _this->writer.getSamplesWritten() / _this->samplerate;
+            }
             time_t diff = seconds;
             tm* dtm = gmtime(&diff);
 
@@ -534,6 +637,12 @@ private:
         _this->writer.write(data, count);
     }
 
+    static void spectrumHandler(const float* spectrum, int size, double centerFrequency, double samplerate, void* ctx) {
+        RecorderModule* _this = (RecorderModule*)ctx;
+        int64_t now = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        _this->spectrogramWriter.write(spectrum, size, centerFrequency, samplerate, now);
+    }
+
     static void moduleInterfaceHandler(int code, void* in, void* out, void* ctx) {
         RecorderModule* _this = (RecorderModule*)ctx;
         std::lock_guard lck(_this->recMtx);
@@ -544,7 +653,7 @@ private:
         else if (code == RECORDER_IFACE_CMD_SET_MODE) {
             if (_this->recording) { return; }
             int* _in = (int*)in;
-            _this->recMode = std::clamp<int>(*_in, 0, 1);
+            _this->recMode = std::clamp<int>(*_in, 0, 2);
         }
         else if (code == RECORDER_IFACE_CMD_START) {
             if (!_this->recording) { _this->start(); }
@@ -561,11 +670,17 @@ private:
 
     OptionList<std::string, wav::Format> containers;
     OptionList<int, wav::SampleType> sampleTypes;
+    OptionList<int, int> spectrumSizes;
+    OptionList<std::string, double> spectrumRates;
+    OptionList<int, int> spectrumDepths;
     FolderSelect folderSelect;
 
     int recMode = RECORDER_MODE_AUDIO;
     int containerId;
     int sampleTypeId;
+    int spectrumSizeId;
+    int spectrumRateId;
+    int spectrumDepthId;
     bool stereo = true;
     std::string selectedStreamName = "";
     float audioVolume = 1.0f;
@@ -575,6 +690,9 @@ private:
     bool recording = false;
     bool ignoringSilence = false;
     wav::Writer writer;
+    spectrogram::Writer spectrogramWriter;
+    SpectrumEngine spectrum;
+    SpectrumEngine::Consumer* spectrumConsumer = NULL;
     std::recursive_mutex recMtx;
     dsp::stream<dsp::complex_t>* basebandStream;
     dsp::stream<dsp::stereo_t> stereoStream;
@@ -3,6 +3,10 @@
 #include <gui/gui.h>
 #include <gui/style.h>
 #include <signal_path/signal_path.h>
+#include <gui/tuner.h>
+#include <thread>
+#include <condition_variable>
+#include "scan_engine.h"
 
 SDRPP_MOD_INFO{
     /* Name:            */ "scanner",
@@ -16,6 +20,9 @@ class ScannerModule : public ModuleManager::Instance {
 public:
     ScannerModule(std::string name) {
         this->name = name;
+        engine.init(&iqStream, 1000.0, RECEIVE_FFT_RATE, SEEK_FFT_RATE, spectrumHandler, this);
+        retuneHandler.handler = onRetune;
+        retuneHandler.ctx = this;
         gui::menu.registerEntry(name, menuHandler, this, NULL);
     }
 
@@ -64,10 +71,10 @@ private:
         if (ImGui::InputDouble("##pb_ratio_scanner", &_this->passbandRatio, 1.0, 10.0, "%0.0f")) {
             _this->passbandRatio = std::clamp<double>(round(_this->passbandRatio), 1.0, 100.0);
         }
-        ImGui::LeftLabel("Tuning Time (ms)");
+        ImGui::LeftLabel("Settle Time (ms)");
         ImGui::SetNextItemWidth(menuWidth - ImGui::GetCursorPosX());
-        if (ImGui::InputInt("##tuning_time_scanner", &_this->tuningTime, 100, 1000)) {
-            _this->tuningTime = std::clamp<int>(_this->tuningTime, 100, 10000.0);
+        if (ImGui::InputInt("##tuning_time_scanner", &_this->settleTime, 10, 100)) {
+            _this->settleTime = std::clamp<int>(_this->settleTime, 0, 10000.0);
         }
         ImGui::LeftLabel("Linger Time (ms)");
         ImGui::SetNextItemWidth(menuWidth - ImGui::GetCursorPosX());
@@ -76,6 +83,8 @@ private:
         }
         if (_this->running) { ImGui::EndDisabled(); }
 
+        // The level is compared to the spectrum as shown by the FFT, whatever FFT size the scanner uses
+        _this->displayFFTSize = sigpath::iqFrontEnd.getFFTSize();
         ImGui::LeftLabel("Level");
         ImGui::SetNextItemWidth(menuWidth - ImGui::GetCursorPosX());
         ImGui::SliderFloat("##scanner_level", &_this->level, -150.0, 0.0);
@@ -88,6 +97,7 @@ private:
             _this->reverseLock = true;
             _this->receiving = false;
             _this->scanUp = false;
+            _this->engine.setSeeking(true);
         }
         ImGui::TableSetColumnIndex(1);
         if (ImGui::Button((">>##scanner_forw_" + _this->name).c_str(), ImVec2(ImGui::GetContentRegionAvail().x, 0))) {
@@ -95,6 +105,7 @@ private:
             _this->reverseLock = true;
             _this->receiving = false;
             _this->scanUp = true;
+            _this->engine.setSeeking(true);
         }
         ImGui::EndTable();
 
@@ -111,7 +122,7 @@ private:
             if (_this->receiving) {
                 ImGui::TextColored(ImVec4(0, 1, 0, 1), "Status: Receiving");
             }
-            else if (_this->tuning) {
+            else if (_this->engine.isWaitingRetune()) {
                 ImGui::TextColored(ImVec4(0, 1, 1, 1), "Status: Tuning");
             }
             else {
@@ -122,148 +133,183 @@ private:
 
     void start() {
         if (running) { return; }
+        if (gui::waterfall.selectedVFO.empty()) { return; }
         current = startFreq;
+        receiving = true;
+        lastSignalTime = std::chrono::high_resolution_clock::now();
+
+        // Resolve the passband of the narrowest thing we need to look at with a few bins
+        double vfoWidth = sigpath::vfoManager.getBandwidth(gui::waterfall.selectedVFO);
+        engine.setResolution(std::min<double>(interval, vfoWidth * passbandRatio * 0.01) / 4.0);
+        engine.setSeeking(false);
+        engine.release();
+        displayFFTSize = sigpath::iqFrontEnd.getFFTSize();
+
         running = true;
-        workerThread = std::thread(&ScannerModule::worker, this);
+        sigpath::sourceManager.onRetune.bindHandler(&retuneHandler);
+        tuneThread = std::thread(&ScannerModule::tuneWorker, this);
+        sigpath::iqFrontEnd.bindIQStream(&iqStream);
+        engine.start();
+        tuner::normalTuning(gui::waterfall.selectedVFO, current);
     }
 
     void stop() {
         if (!running) { return; }
+        sigpath::iqFrontEnd.unbindIQStream(&iqStream);
+        engine.stop();
+
+        // Let the tuning in flight finish, if any
+        {
+            std::lock_guard<std::mutex> lck(tuneMtx);
+            stopTuner = true;
+        }
+        tuneCnd.notify_all();
+        if (tuneThread.joinable()) { tuneThread.join(); }
+        stopTuner = false;
+        tunePending = false;
+
+        sigpath::sourceManager.onRetune.unbindHandler(&retuneHandler);
         running = false;
-        if (workerThread.joinable()) {
-            workerThread.join();
+    }
+
+    // Tuning goes through the source, the VFOs and the waterfall, so it's done on a thread of its own instead of
+    // the DSP thread. The engine drops the samples until the tuning is done.
+    void requestTune(double freq) {
+        engine.hold();
+        {
+            std::lock_guard<std::mutex> lck(tuneMtx);
+            tuneFreq = freq;
+            tunePending = true;
         }
+        tuneCnd.notify_all();
     }
 
-    void worker() {
-        // 10Hz scan loop
-        while (running) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(100));
-            {
-                std::lock_guard<std::mutex> lck(scanMtx);
-                auto now = std::chrono::high_resolution_clock::now();
-
-                // Enforce tuning
-                if (gui::waterfall.selectedVFO.empty()) {
-                    running = false;
-                    return;
-                }
-                tuner::normalTuning(gui::waterfall.selectedVFO, current);
-
-                // Check if we are waiting for a tune
-                if (tuning) {
-                    flog::warn("Tuning");
-                    if ((std::chrono::duration_cast<std::chrono::milliseconds>(now - lastTuneTime)).count() > tuningTime) {
-                        tuning = false;
-                    }
-                    continue;
-                }
-
-                // Get FFT data
-                int dataWidth = 0;
-                float* data = gui::waterfall.acquireLatestFFT(dataWidth);
-                if (!data) { continue; }
-
-                // Get gather waterfall data
-                double wfCenter = gui::waterfall.getViewOffset() + gui::waterfall.getCenterFrequency();
-                double wfWidth = gui::waterfall.getViewBandwidth();
-                double wfStart = wfCenter - (wfWidth / 2.0);
-                double wfEnd = wfCenter + (wfWidth / 2.0);
-
-                // Gather VFO data
-                double vfoWidth = sigpath::vfoManager.getBandwidth(gui::waterfall.selectedVFO);
-
-                if (receiving) {
-                    flog::warn("Receiving");
-                
-                    float maxLevel = getMaxLevel(data, current, vfoWidth, dataWidth, wfStart, wfWidth);
-                    if (maxLevel >= level) {
-                        lastSignalTime = now;
-                    }
-                    else if ((std::chrono::duration_cast<std::chrono::milliseconds>(now - lastSignalTime)).count() > lingerTime) {
-                        receiving = false;
-                    }
-                }
-                else {
-                    flog::warn("Seeking signal");
-                    double bottomLimit = current;
-                    double topLimit = current;
-                    
-                    // Search for a signal in scan direction
-                    if (findSignal(scanUp, bottomLimit, topLimit, wfStart, wfEnd, wfWidth, vfoWidth, data, dataWidth)) {
-                        gui::waterfall.releaseLatestFFT();
-                        continue;
-                    }
-                    
-                    // Search for signal in the inverse scan direction if direction isn't enforced
-                    if (!reverseLock) {
-                        if (findSignal(!scanUp, bottomLimit, topLimit, wfStart, wfEnd, wfWidth, vfoWidth, data, dataWidth)) {
-                            gui::waterfall.releaseLatestFFT();
-                            continue;
-                        }
-                    }
-                    else { reverseLock = false; }
-                    
-
-                    // There is no signal on the visible spectrum, tune in scan direction and retry
-                    if (scanUp) {
-                        current = topLimit + interval;
-                        if (current > stopFreq) { current = startFreq; }
-                    }
-                    else {
-                        current = bottomLimit - interval;
-                        if (current < startFreq) { current = stopFreq; }
-                    }
-
-                    // If the new current frequency is outside the visible bandwidth, wait for retune
-                    if (current - (vfoWidth/2.0) < wfStart || current + (vfoWidth/2.0) > wfEnd) {
-                        lastTuneTime = now;
-                        tuning = true;
-                    }
-                }
-
-                // Release FFT Data
-                gui::waterfall.releaseLatestFFT();
-            }
+    void tuneWorker() {
+        std::unique_lock<std::mutex> lck(tuneMtx);
+        while (true) {
+            tuneCnd.wait(lck, [this]() { return tunePending || stopTuner; });
+            if (stopTuner) { break; }
+            double freq = tuneFreq;
+            tunePending = false;
+            lck.unlock();
+
+            // A retune calls back into the engine through onRetune before the engine is released
+            tuner::normalTuning(gui::waterfall.selectedVFO, freq);
+            engine.release();
+
+            lck.lock();
         }
     }
 
-    bool findSignal(bool scanDir, double& bottomLimit, double& topLimit, double wfStart, double wfEnd, double wfWidth, double vfoWidth, float* data, int dataWidth) {
-        bool found = false;
-        double freq = current;
-        for (freq += scanDir ? interval : -interval;
-            scanDir ? (freq <= stopFreq) : (freq >= startFreq);
-            freq += scanDir ? interval : -interval) {
+    static void onRetune(double freq, void* ctx) {
+        ScannerModule* _this = (ScannerModule*)ctx;
+        _this->engine.waitForRetune(freq, (double)_this->settleTime / 1000.0);
+    }
+
+    // Called by the engine for every spectrum taken at a settled tuning
+    static void spectrumHandler(const float* spectrum, int size, double centerFreq, double samplerate, void* ctx) {
+        ScannerModule* _this = (ScannerModule*)ctx;
+        std::lock_guard<std::mutex> lck(_this->scanMtx);
+        auto now = std::chrono::high_resolution_clock::now();
+        if (gui::waterfall.selectedVFO.empty()) { return; }
+
+        // Put the spectrum in frequency order
+        _this->data.resize(size);
+        int half = size / 2;
+        memcpy(&_this->data[0], &spectrum[size - half], half * sizeof(float));
+        memcpy(&_this->data[half], spectrum, (size - half) * sizeof(float));
+
+        double spanStart = centerFreq - (samplerate / 2.0);
+        double spanEnd = centerFreq + (samplerate / 2.0);
+        double vfoWidth = sigpath::vfoManager.getBandwidth(gui::waterfall.selectedVFO);
+
+        // The level of noise and of anything wider than a bin goes down as the FFT gets larger. Bring the level
+        // set by the user, which is read off the FFT display, to the bin size of this spectrum.
+        _this->binLevel = _this->level - 10.0f * log10f((float)size / (float)_this->displayFFTSize);
+
+        if (_this->receiving) {
+            float maxLevel = _this->getMaxLevel(_this->current, vfoWidth, spanStart, samplerate);
+            if (maxLevel >= _this->binLevel) {
+                _this->lastSignalTime = now;
+            }
+            else if ((std::chrono::duration_cast<std::chrono::milliseconds>(now - _this->lastSignalTime)).count() > _this->lingerTime) {
+                _this->receiving = false;
+                _this->engine.setSeeking(true);
+            }
+            return;
+        }
+
+        // Evaluate every channel of the scan grid visible in this spectrum at once
+        _this->evaluateChannels(spanStart, spanEnd, samplerate, vfoWidth);
 
-            // Check if signal is within bounds
-            if (freq - (vfoWidth/2.0) < wfStart) { break; }
-            if (freq + (vfoWidth/2.0) > wfEnd) { break; }
+        // Search for a signal in scan direction, then in the inverse scan direction if direction isn't enforced
+        double bottomLimit = _this->current;
+        double topLimit = _this->current;
+        if (_this->findSignal(_this->scanUp, bottomLimit, topLimit)) { return; }
+        if (!_this->reverseLock) {
+            if (_this->findSignal(!_this->scanUp, bottomLimit, topLimit)) { return; }
+        }
+        else { _this->reverseLock = false; }
 
+        // There is no signal on the visible spectrum, tune in scan direction and retry.
+        // If this requires a retune, the engine will hold off until the new tuning comes through.
+        if (_this->scanUp) {
+            _this->current = topLimit + _this->interval;
+            if (_this->current > _this->stopFreq) { _this->current = _this->startFreq; }
+        }
+        else {
+            _this->current = bottomLimit - _this->interval;
+            if (_this->current < _this->startFreq) { _this->current = _this->stopFreq; }
+        }
+        _this->requestTune(_this->current);
+    }
+
+    void evaluateChannels(double spanStart, double spanEnd, double samplerate, double vfoWidth) {
+        // Range of channels relative to the current one that are within the scan limits and fully visible
+        double low = std::max<double>(startFreq, spanStart + (vfoWidth / 2.0));
+        double high = std::min<double>(stopFreq, spanEnd - (vfoWidth / 2.0));
+        minChannel = ceil((low - current) / interval);
+        maxChannel = floor((high - current) / interval);
+        channelLevels.clear();
+        if (maxChannel < minChannel) { return; }
+
+        // Peak level in the passband of each channel
+        double passband = vfoWidth * (passbandRatio * 0.01);
+        channelLevels.resize(maxChannel - minChannel + 1);
+        for (int i = minChannel; i <= maxChannel; i++) {
+            channelLevels[i - minChannel] = getMaxLevel(current + (double)i * interval, passband, spanStart, samplerate);
+        }
+    }
+
+    bool findSignal(bool scanDir, double& bottomLimit, double& topLimit) {
+        int step = scanDir ? 1 : -1;
+        for (int i = step; i >= minChannel && i <= maxChannel; i += step) {
+            double freq = current + (double)i * interval;
             if (freq < bottomLimit) { bottomLimit = freq; }
             if (freq > topLimit) { topLimit = freq; }
-            
+
             // Check signal level
-            float maxLevel = getMaxLevel(data, freq, vfoWidth * (passbandRatio * 0.01f), dataWidth, wfStart, wfWidth);
-            if (maxLevel >= level) {
-                found = true;
+            if (channelLevels[i - minChannel] >= binLevel) {
                 receiving = true;
+                lastSignalTime = std::chrono::high_resolution_clock::now();
                 current = freq;
-                break;
+                engine.setSeeking(false);
+                requestTune(current);
+                return true;
             }
         }
-        return found;
+        return false;
     }
 
-    float getMaxLevel(float* data, double freq, double width, int dataWidth, double wfStart, double wfWidth) {
+    float getMaxLevel(double freq, double width, double spanStart, double spanWidth) {
+        int dataWidth = data.size();
         double low = freq - (width/2.0);
         double high = freq + (width/2.0);
-        int lowId = std::clamp<int>((low - wfStart) * (double)dataWidth / wfWidth, 0, dataWidth - 1);
-        int highId = std::clamp<int>((high - wfStart) * (double)dataWidth / wfWidth, 0, dataWidth - 1);
-        float max = -INFINITY;
-        for (int i = lowId; i <= highId; i++) {
-            if (data[i] > max) { max = data[i]; }
-        }
-        return max;
+        int lowId = std::clamp<int>((low - spanStart) * (double)dataWidth / spanWidth, 0, dataWidth - 1);
+        int highId = std::clamp<int>((high - spanStart) * (double)dataWidth / spanWidth, 0, dataWidth - 1);
+        uint32_t maxId;
+        volk_32f_index_max_32u(&maxId, &data[lowId], highId - lowId + 1);
+        return data[lowId + maxId];
     }
 
     std::string name;
@@ -276,17 +322,38 @@ private:
     double interval = 100000.0;
     double current = 88000000.0;
     double passbandRatio = 10.0;
-    int tuningTime = 250;
+    int settleTime = 20;
     int lingerTime = 1000.0;
     float level = -50.0;
+    float binLevel = -50.0;
+    std::atomic<int> displayFFTSize { 65536 };
     bool receiving = true;
-    bool tuning = false;
     bool scanUp = true;
     bool reverseLock = false;
     std::chrono::time_point<std::chrono::high_resolution_clock> lastSignalTime;
-    std::chrono::time_point<std::chrono::high_resolution_clock> lastTuneTime;
-    std::thread workerThread;
     std::mutex scanMtx;
+
+    // Spectra are only needed at a moderate rate while listening to a signal
+    static constexpr double RECEIVE_FFT_RATE = 20.0;
+
+    // While seeking, every spectrum covers all the channels visible in it, there's no point in going much faster
+    static constexpr double SEEK_FFT_RATE = 100.0;
+
+    // Tuning requests from the DSP thread
+    std::thread tuneThread;
+    std::mutex tuneMtx;
+    std::condition_variable tuneCnd;
+    double tuneFreq = 0.0;
+    bool tunePending = false;
+    bool stopTuner = false;
+
+    dsp::stream<dsp::complex_t> iqStream;
+    ScanEngine engine;
+    EventHandler<double> retuneHandler;
+    std::vector<float> data;
+    std::vector<float> channelLevels;
+    int minChannel = 0;
+    int maxChannel = -1;
 };
 
 MOD_EXPORT void _INIT_() {
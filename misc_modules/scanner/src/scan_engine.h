@@ -0,0 +1,215 @@
+#pragma once
+#include <dsp/sink.h>
+#include <dsp/window/nuttall.h>
+#include <dsp/fft/planner.h>
+#include <mutex>
+
+// Computes power spectra directly from the IQ stream. Frames never span a retune or any other discontinuity,
+// so every spectrum handed to the handler is guaranteed to come from the current tuning.
+class ScanEngine : public dsp::Sink<dsp::complex_t> {
+    using base_type = dsp::Sink<dsp::complex_t>;
+public:
+    ScanEngine() {}
+
+    ~ScanEngine() {
+        if (!base_type::_block_init) { return; }
+        base_type::stop();
+        freeFFT();
+    }
+
+    // The handler receives the spectrum in dB in FFT order (DC first), along with the tuning it was taken at
+    void init(dsp::stream<dsp::complex_t>* in, double resolution, double rate, double seekRate, void (*handler)(const float* spectrum, int size, double centerFreq, double samplerate, void* ctx), void* ctx) {
+        _resolution = resolution;
+        _rate = rate;
+        _seekRate = seekRate;
+        _handler = handler;
+        _ctx = ctx;
+        base_type::init(in);
+    }
+
+    // Frequency resolution in Hz, the FFT size is derived from it and the samplerate of the stream
+    void setResolution(double resolution) {
+        std::lock_guard<std::mutex> lck(stateMtx);
+        _resolution = resolution;
+        samplerate = 0;
+    }
+
+    // Maximum number of spectra per second outside of seek mode
+    void setRate(double rate) {
+        std::lock_guard<std::mutex> lck(stateMtx);
+        _rate = rate;
+    }
+
+    // Maximum number of spectra per second in seek mode. The first spectrum after a retune is never delayed, this
+    // only matters while the scan range is all visible without retuning.
+    void setSeekRate(double rate) {
+        std::lock_guard<std::mutex> lck(stateMtx);
+        _seekRate = rate;
+    }
+
+    void setSeeking(bool seeking) {
+        std::lock_guard<std::mutex> lck(stateMtx);
+        _seeking = seeking;
+        if (seeking) { skipRemaining = 0; }
+    }
+
+    // Drop all samples until the stream is tuned to the given frequency, then wait for the settle time (in seconds)
+    void waitForRetune(double centerFreq, double settleTime) {
+        std::lock_guard<std::mutex> lck(stateMtx);
+        retuneFreq = centerFreq;
+        _settleTime = settleTime;
+        waitingRetune = true;
+    }
+
+    bool isWaitingRetune() {
+        std::lock_guard<std::mutex> lck(stateMtx);
+        return holding || waitingRetune || settleRemaining > 0;
+    }
+
+    // Drop all samples until release() is called. Used while a tuning request is in flight, any retune it causes
+    // must be announced through waitForRetune() before releasing.
+    void hold() {
+        std::lock_guard<std::mutex> lck(stateMtx);
+        holding = true;
+    }
+
+    void release() {
+        std::lock_guard<std::mutex> lck(stateMtx);
+        if (!holding) { return; }
+        holding = false;
+        fill = 0;
+        skipRemaining = 0;
+    }
+
+    int run() {
+        int count = base_type::_in->read();
+        if (count < 0) { return -1; }
+
+        const dsp::StreamMetadata& meta = base_type::_in->readMeta;
+        const dsp::complex_t* data = base_type::_in->readBuf;
+
+        std::unique_lock<std::mutex> lck(stateMtx);
+
+        // Wait for the first buffer belonging to the new tuning. Without metadata there is no way to tell, so assume it's this one.
+        // Sources may report the frequency they actually tuned to, anything within half the resolution is close enough.
+        if (waitingRetune && (!meta.valid || std::abs(meta.centerFrequency - retuneFreq) <= _resolution / 2.0)) {
+            waitingRetune = false;
+            settleRemaining = (int64_t)(_settleTime * (meta.valid ? meta.samplerate : samplerate));
+            fill = 0;
+            skipRemaining = 0;
+        }
+        if (waitingRetune || holding) {
+            base_type::_in->flush();
+            return count;
+        }
+
+        // Resize the FFT if needed
+        if (meta.valid && meta.samplerate != samplerate) {
+            samplerate = meta.samplerate;
+            allocFFT();
+        }
+        if (!fftSize) {
+            base_type::_in->flush();
+            return count;
+        }
+
+        // Never build a spectrum with samples from both sides of a discontinuity
+        if (meta.valid && meta.discontinuity) { fill = 0; }
+
+        int i = 0;
+        while (i < count && !waitingRetune && !holding) {
+            // Let the hardware settle after a retune
+            if (settleRemaining > 0) {
+                int n = std::min<int64_t>(settleRemaining, count - i);
+                settleRemaining -= n;
+                i += n;
+                continue;
+            }
+
+            // Limit the rate of spectra
+            if (skipRemaining > 0) {
+                int n = std::min<int64_t>(skipRemaining, count - i);
+                skipRemaining -= n;
+                i += n;
+                continue;
+            }
+
+            // Accumulate a frame
+            int n = std::min<int>(fftSize - fill, count - i);
+            memcpy(&fftInBuf[fill], &data[i], n * sizeof(dsp::complex_t));
+            fill += n;
+            i += n;
+            if (fill < fftSize) { continue; }
+            fill = 0;
+            double rate = _seeking ? _seekRate : _rate;
+            if (rate > 0) { skipRemaining = std::max<int64_t>((int64_t)(samplerate / rate) - fftSize, 0); }
+
+            // Compute the spectrum
+            volk_32fc_32f_multiply_32fc((lv_32fc_t*)fftInBuf, (lv_32fc_t*)fftInBuf, window, fftSize);
+            plan.execute((fftwf_complex*)fftInBuf, fftOutBuf);
+            volk_32fc_s32f_power_spectrum_32f(spectrum, (lv_32fc_t*)fftOutBuf, fftSize, fftSize);
+
+            // The handler is allowed to hold the engine or to retune, which will call back into waitForRetune()
+            double centerFreq = meta.centerFrequency;
+            lck.unlock();
+            _handler(spectrum, fftSize, centerFreq, samplerate, _ctx);
+            lck.lock();
+        }
+
+        base_type::_in->flush();
+        return count;
+    }
+
+private:
+    void allocFFT() {
+        freeFFT();
+
+        // Smallest power of two giving the requested resolution
+        fftSize = 256;
+        while (fftSize < MAX_FFT_SIZE && samplerate / (double)fftSize > _resolution) { fftSize <<= 1; }
+        fill = 0;
+
+        window = dsp::buffer::alloc<float>(fftSize);
+        for (int i = 0; i < fftSize; i++) { window[i] = dsp::window::nuttall(i, fftSize); }
+        spectrum = dsp::buffer::alloc<float>(fftSize);
+        fftInBuf = (dsp::complex_t*)fftwf_malloc(fftSize * sizeof(fftwf_complex));
+        fftOutBuf = (fftwf_complex*)fftwf_malloc(fftSize * sizeof(fftwf_complex));
+        plan = dsp::fft::planner::get(fftSize, dsp::fft::FORWARD, (fftwf_complex*)fftInBuf, fftOutBuf);
+    }
+
+    void freeFFT() {
+        if (!fftSize) { return; }
+        plan.reset();
+        fftwf_free(fftInBuf);
+        fftwf_free(fftOutBuf);
+        dsp::buffer::free(window);
+        dsp::buffer::free(spectrum);
+        fftSize = 0;
+    }
+
+    static const int MAX_FFT_SIZE = 1 << 16;
+
+    double _resolution;
+    double _rate;
+    double _seekRate;
+    bool _seeking = true;
+    void (*_handler)(const float* spectrum, int size, double centerFreq, double samplerate, void* ctx);
+    void* _ctx;
+
+    std::mutex stateMtx;
+    bool waitingRetune = false;
+    bool holding = false;
+    double retuneFreq = 0.0;
+    double _settleTime = 0.0;
+    int64_t settleRemaining = 0;
+    int64_t skipRemaining = 0;
+
+    double samplerate = 0.0;
+    int fftSize = 0;
+    int fill = 0;
+    float* window;
+    float* spectrum;
+    dsp::complex_t* fftInBuf;
+    fftwf_complex* fftOutBuf;
+    dsp::fft::Plan plan;
+};
\ No newline at end of file
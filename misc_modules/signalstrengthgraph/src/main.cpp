@@ -2,9 +2,10 @@
 #include <implot.h>
 #include <module.h>
 #include <gui/gui.h>
+#include <signal_path/signal_path.h>
 #include <vector>
 #include <cstring>
-#include <thread>
+#include <mutex>
 
 #define CONCAT(a, b) ((std::string(a) + b).c_str())
 
@@ -26,6 +27,7 @@ public:
     }
 
     ~signalstrengthgraph() {
+        if (running) { stop(); }
         free(buffer);
         gui::menu.removeEntry(name);
     }
@@ -57,10 +59,17 @@ private:
             }
         }
 
-        ImGui::Text("Note: values here will depend on zoom level!");
-        ImGui::SliderFloat(CONCAT("% bw from center##_signalstrengthgraph_", _this->name), &_this->bandwidthPercent, 1, 100, "%.0f");
-        ImGui::SliderInt(CONCAT("interval##_signalstrengthgraph_", _this->name), &_this->interval, 1, 300);
+        {
+            std::lock_guard<std::mutex> lck(_this->graphMtx);
+            ImGui::SliderFloat(CONCAT("% bw from center##_signalstrengthgraph_", _this->name), &_this->bandwidthPercent, 1, 100, "%.0f");
+        }
+
+        // Not under the graph lock, changing the parameters waits for the spectrum handler
+        if (ImGui::SliderInt(CONCAT("interval (ms)##_signalstrengthgraph_", _this->name), &_this->interval, MIN_INTERVAL, 1000) && _this->running) {
+            sigpath::iqFrontEnd.setSpectrumConsumerParams(_this->spectrum, _this->spectrumParams());
+        }
 
+        std::lock_guard<std::mutex> lck(_this->graphMtx);
         ImGui::Text("max: %.2fdBFS level diff: %.2fdB", _this->maxValue, _this->maxValue - _this->level);
 
         if (ImGui::Button(CONCAT("reset##_signalstrengthgraph_", _this->name))) {
@@ -68,7 +77,7 @@ private:
         }
         ImGui::Text("level: %.2fdBFS", _this->level);
         if (ImGui::Button(CONCAT("level##_signalstrengthgraph_", _this->name))) {
-            _this->level = getAveragePower(ctx);
+            _this->level = _this->lastPower;
         }
 
         if (_this->running) {
@@ -86,72 +95,84 @@ private:
     }
 
     void start() {
+        {
+            std::lock_guard<std::mutex> lck(graphMtx);
+            counter = 0;
+        }
+        spectrum = sigpath::iqFrontEnd.addSpectrumConsumer(spectrumParams(), spectrumHandler, this);
         running = true;
-        workerThread = std::thread(worker, this);
     }
 
     void stop() {
+        sigpath::iqFrontEnd.removeSpectrumConsumer(spectrum);
         running = false;
-        workerThread.join();
     }
 
-    static void worker(void* ctx) {
-        signalstrengthgraph* _this = (signalstrengthgraph*)ctx;
-
-        int counter = 0;
-
-        while (_this->running) {
-            float averagePower = getAveragePower(ctx);
-            if (counter > (_this->bufferSize - 1)) {
-                counter = 0;
-            }
-            _this->buffer[counter] = averagePower;
-            if (averagePower > _this->maxValue) {
-                _this->maxValue = averagePower;
-            }
-            counter++;
-            std::this_thread::sleep_for(std::chrono::microseconds(_this->interval));
-        }
+    // The spectrum is computed by the front end at the graph interval, independently of the waterfall zoom and frame rate.
+    // Every point of the graph is a full FFT on the DSP thread, hence the cap on the rate.
+    SpectrumEngine::Params spectrumParams() {
+        SpectrumEngine::Params params;
+        params.size = SPECTRUM_SIZE;
+        params.rate = std::min<double>(1000.0 / (double)std::max<int>(interval, 1), MAX_RATE);
+        params.window = SpectrumEngine::NUTTALL;
+        return params;
     }
 
-    static double getAveragePower(void* ctx) {
+    static void spectrumHandler(const float* spectrum, int size, double centerFrequency, double samplerate, void* ctx) {
         signalstrengthgraph* _this = (signalstrengthgraph*)ctx;
-        int fftSize;
-        float* latestFFT = gui::waterfall.acquireLatestFFT(fftSize);
+        std::lock_guard<std::mutex> lck(_this->graphMtx);
+        float averagePower = getAveragePower(spectrum, size, _this->bandwidthPercent);
+        if (_this->counter > (_this->bufferSize - 1)) {
+            _this->counter = 0;
+        }
+        _this->buffer[_this->counter] = averagePower;
+        if (averagePower > _this->maxValue) {
+            _this->maxValue = averagePower;
+        }
+        _this->lastPower = averagePower;
+        _this->counter++;
+    }
 
-        int halfCount = ((float)fftSize * (_this->bandwidthPercent / 100)) / 2;
+    static double getAveragePower(const float* spectrum, int fftSize, float bandwidthPercent) {
+        int halfCount = ((float)fftSize * (bandwidthPercent / 100)) / 2;
         int count = halfCount * 2;
 
         if (count == 0) {
-            gui::waterfall.releaseLatestFFT();
             return -160;
         }
 
         double averageFFT = 0;
         for (int i = 0; i < count; i++) {
             int index = (((fftSize / 2)) - halfCount) + i;
-            averageFFT += latestFFT[index];
+            averageFFT += spectrum[index];
         }
 
-        gui::waterfall.releaseLatestFFT();
-
         averageFFT /= count;
 
         return averageFFT;
     }
 
+    static const int SPECTRUM_SIZE = 1024;
+    static constexpr double MAX_RATE = 60.0;
+    static const int MIN_INTERVAL = 17;
+
+    // Protects the graph and the values below, written by the spectrum handler from the DSP thread
+    std::mutex graphMtx;
+
     float bandwidthPercent = 100;
-    int interval = 100;
+    int interval = 50;
 
     float maxValue = -200;
     float level = 0;
+    float lastPower = -160;
 
     float* buffer;
     size_t bufferSize = 100000;
 
     bool running = false;
 
-    std::thread workerThread;
+    SpectrumEngine::Consumer* spectrum;
+    size_t counter = 0;
 
     std::string name;
     bool enabled = true;
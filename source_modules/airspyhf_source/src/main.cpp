@@ -23,6 +23,8 @@ SDRPP_MOD_INFO{
     /* Max instances    */ 1
 };
 
+SDRPP_MOD_FLAGS = ModuleManager::MODULE_FLAG_SOURCE;
+
 ConfigManager config;
 
 const char* AGG_MODES_STR = "Off\0Low\0High\0";
@@ -24,6 +24,8 @@ SDRPP_MOD_INFO{
     /* Max instances    */ 1
 };
 
+SDRPP_MOD_FLAGS = ModuleManager::MODULE_FLAG_SOURCE;
+
 ConfigManager config;
 
 enum BladeRFType {
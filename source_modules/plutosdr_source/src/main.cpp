@@ -19,6 +19,8 @@ SDRPP_MOD_INFO{
     /* Max instances    */ 1
 };
 
+SDRPP_MOD_FLAGS = ModuleManager::MODULE_FLAG_SOURCE;
+
 const char* gainModes[] = {
     "manual", "fast_attack", "slow_attack", "hybrid"
 };
@@ -21,6 +21,8 @@ SDRPP_MOD_INFO{
     /* Max instances    */ 1
 };
 
+SDRPP_MOD_FLAGS = ModuleManager::MODULE_FLAG_SOURCE | ModuleManager::MODULE_FLAG_PARALLEL_INIT;
+
 ConfigManager config;
 
 class RFSpaceSourceModule : public ModuleManager::Instance {
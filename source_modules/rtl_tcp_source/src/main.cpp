@@ -19,6 +19,8 @@ SDRPP_MOD_INFO{
     /* Max instances    */ 1
 };
 
+SDRPP_MOD_FLAGS = ModuleManager::MODULE_FLAG_SOURCE | ModuleManager::MODULE_FLAG_PARALLEL_INIT;
+
 ConfigManager config;
 
 class RTLTCPSourceModule : public ModuleManager::Instance {
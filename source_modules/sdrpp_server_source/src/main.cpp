@@ -21,6 +21,8 @@ SDRPP_MOD_INFO{
     /* Max instances    */ 1
 };
 
+SDRPP_MOD_FLAGS = ModuleManager::MODULE_FLAG_SOURCE | ModuleManager::MODULE_FLAG_PARALLEL_INIT;
+
 ConfigManager config;
 
 class SDRPPServerSourceModule : public ModuleManager::Instance {
@@ -210,12 +212,25 @@ private:
                 _this->datarate = ((float)_this->client->bytes / (_this->frametimeCounter * 1024.0f * 1024.0f)) * 8;
                 _this->frametimeCounter = 0;
                 _this->client->bytes = 0;
+                _this->client->requestInputStats();
             }
 
             ImGui::TextUnformatted("Status:");
             ImGui::SameLine();
             ImGui::TextColored(ImVec4(0.0f, 1.0f, 0.0f, 1.0f), "Connected (%.3f Mbit/s)", _this->datarate);
 
+            // Servers that don't know about input stats reject the request and are no longer asked
+            server::InputStats stats;
+            if (_this->client->getInputStats(stats)) {
+                ImGui::Text("Server buffer: %d%%", stats.capacity ? (int)((100ll * stats.fill) / stats.capacity) : 0);
+                if (stats.overflows) {
+                    ImGui::TextColored(ImVec4(1.0f, 0.0f, 0.0f, 1.0f), "Server overflows: %llu (%llu samples lost)", (unsigned long long)stats.overflows, (unsigned long long)stats.droppedSamples);
+                }
+                else {
+                    ImGui::TextUnformatted("Server overflows: 0");
+                }
+            }
+
             ImGui::CollapsingHeader("Source [REMOTE]", ImGuiTreeNodeFlags_DefaultOpen);
 
             _this->client->showMenu();
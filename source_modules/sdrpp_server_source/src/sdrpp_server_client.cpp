@@ -54,6 +54,9 @@ namespace server {
     }
 
     void ClientClass::showMenu() {
+        // Get the whole UI again if an update couldn't be applied
+        if (uiResyncRequired.exchange(false)) { getUI(); }
+
         std::string diffId = "";
         SmGui::DrawListElem diffValue;
         bool syncRequired = false;
@@ -80,8 +83,7 @@ namespace server {
                 auto waiter = awaitCommandAck(COMMAND_UI_ACTION);
                 sendCommand(COMMAND_UI_ACTION, size);
                 if (waiter->await(PROTOCOL_TIMEOUT_MS)) {
-                    std::lock_guard lck(dlMtx);
-                    dl.load(r_cmd_data, r_pkt_hdr->size - sizeof(PacketHeader) - sizeof(CommandHeader));
+                    loadUI(r_cmd_data, r_pkt_hdr->size - sizeof(PacketHeader) - sizeof(CommandHeader));
                 }
                 else {
                     flog::error("Timeout out after asking for UI");
@@ -119,6 +121,17 @@ namespace server {
         sendCommand(COMMAND_SET_COMPRESSION, 1);
     }
 
+    void ClientClass::requestInputStats() {
+        if (!client || !client->isOpen() || inputStatsUnsupported || inputStatsPending.exchange(true)) { return; }
+        sendCommand(COMMAND_GET_INPUT_STATS, 0);
+    }
+
+    bool ClientClass::getInputStats(InputStats& stats) {
+        std::lock_guard<std::mutex> lck(statsMtx);
+        stats = inputStats;
+        return inputStatsValid;
+    }
+
     void ClientClass::start() {
         if (!client || !client->isOpen()) { return; }
         sendCommand(COMMAND_START, 0);
@@ -165,6 +178,9 @@ namespace server {
                 _this->currentSampleRate = *(double*)_this->r_cmd_data;
                 core::setInputSampleRate(_this->currentSampleRate);
             }
+            else if (_this->r_cmd_hdr->cmd == COMMAND_UI_UPDATE) {
+                _this->loadUI(_this->r_cmd_data, _this->r_pkt_hdr->size - sizeof(PacketHeader) - sizeof(CommandHeader));
+            }
             else if (_this->r_cmd_hdr->cmd == COMMAND_DISCONNECT) {
                 flog::error("Asked to disconnect by the server");
                 _this->serverBusy = true;
@@ -184,6 +200,16 @@ namespace server {
             }
         }
         else if (_this->r_pkt_hdr->type == PACKET_TYPE_COMMAND_ACK) {
+            // Input stats are requested without waiting for the answer
+            if (_this->r_cmd_hdr->cmd == COMMAND_GET_INPUT_STATS && _this->r_pkt_hdr->size == sizeof(PacketHeader) + sizeof(CommandHeader) + sizeof(InputStats)) {
+                {
+                    std::lock_guard<std::mutex> lck(_this->statsMtx);
+                    _this->inputStats = *(InputStats*)_this->r_cmd_data;
+                    _this->inputStatsValid = true;
+                }
+                _this->inputStatsPending = false;
+            }
+
             // Notify waiters
             std::vector<PacketWaiter*> toBeRemoved;
             for (auto& [waiter, cmd] : _this->commandAckWaiters) {
@@ -207,7 +233,14 @@ namespace server {
             if (outCount) { _this->decompIn.swap(outCount); };
         }
         else if (_this->r_pkt_hdr->type == PACKET_TYPE_ERROR) {
-            flog::error("SDR++ Server Error: {0}", buf[sizeof(PacketHeader)]);
+            // Servers that don't know about input stats reject the request, stop asking them
+            if (buf[sizeof(PacketHeader)] == ERROR_INVALID_COMMAND && _this->inputStatsPending.exchange(false)) {
+                flog::info("SDR++ Server doesn't support input stats");
+                _this->inputStatsUnsupported = true;
+            }
+            else {
+                flog::error("SDR++ Server Error: {0}", buf[sizeof(PacketHeader)]);
+            }
         }
         else {
             flog::error("Invalid packet type: {0}", _this->r_pkt_hdr->type);
@@ -218,11 +251,12 @@ namespace server {
     }
 
     int ClientClass::getUI() {
+        // Ask for the compact encoding, older servers ignore it and answer with the original one
         auto waiter = awaitCommandAck(COMMAND_GET_UI);
-        sendCommand(COMMAND_GET_UI, 0);
+        s_cmd_data[0] = SMGUI_COMPACT_VERSION;
+        sendCommand(COMMAND_GET_UI, 1);
         if (waiter->await(PROTOCOL_TIMEOUT_MS)) {
-            std::lock_guard lck(dlMtx);
-            dl.load(r_cmd_data, r_pkt_hdr->size - sizeof(PacketHeader) - sizeof(CommandHeader));
+            loadUI(r_cmd_data, r_pkt_hdr->size - sizeof(PacketHeader) - sizeof(CommandHeader));
         }
         else {
             if (!serverBusy) { flog::error("Timeout out after asking for UI"); };
@@ -233,6 +267,20 @@ namespace server {
         return 0;
     }
 
+    void ClientClass::loadUI(uint8_t* data, int len) {
+        std::lock_guard lck(dlMtx);
+        if (!SmGui::DrawList::isCompact(data, len)) {
+            dl.load(data, len);
+            return;
+        }
+
+        // A diff can only be applied to the list it was made against, start over if it doesn't match
+        if (dl.loadCompact(data, len) < 0) {
+            flog::warn("Could not apply UI update, asking for the whole UI");
+            uiResyncRequired = true;
+        }
+    }
+
     void ClientClass::sendPacket(PacketType type, int len) {
         s_pkt_hdr->type = type;
         s_pkt_hdr->size = sizeof(PacketHeader) + len;
@@ -88,6 +88,13 @@ namespace server {
         void setSampleType(dsp::compression::PCMType type);
         void setCompression(bool enabled);
 
+        // Asks the server for the state of its input buffer without waiting for the answer. Nothing is sent if the
+        // server doesn't support it or hasn't answered the previous request yet.
+        void requestInputStats();
+
+        // Copy of the last input stats received, false if none were
+        bool getInputStats(InputStats& stats);
+
         void start();
         void stop();
 
@@ -101,6 +108,7 @@ namespace server {
         static void tcpHandler(int count, uint8_t* buf, void* ctx);
 
         int getUI();
+        void loadUI(uint8_t* data, int len);
 
         void sendPacket(PacketType type, int len);
         void sendCommand(Command cmd, int len);
@@ -134,6 +142,14 @@ namespace server {
 
         SmGui::DrawList dl;
         std::mutex dlMtx;
+        std::atomic<bool> uiResyncRequired { false };
+
+        // Input stats, received on the network thread
+        std::mutex statsMtx;
+        InputStats inputStats = {};
+        bool inputStatsValid = false;
+        std::atomic<bool> inputStatsPending { false };
+        std::atomic<bool> inputStatsUnsupported { false };
 
         ZSTD_DCtx* dctx;
 